@@ -1,9 +1,45 @@
 #include "force_field.h"
 
+#include <cmath>
+
 #include "../utilities/constants.h"
 
+// The beads of the molecules from delete_id to delete_id + counterion are
+// left out, as in BeadsEnergy.
+double ForceField::BeadRealEnergy(Bead& bead, vector<Molecule>& mols,
+                                  int delete_id, int counterion) {
+  double energy = 0;
+  if (bead.Charge() == 0)  return energy;
+  const double * q = particles.Charges();
+  int del_begin = 0;
+  int del_end = 0;
+  if (delete_id != -1) {
+    del_begin = particles.Begin(delete_id);
+    del_end = particles.End(delete_id + counterion);
+  }
+  double pos[3];
+  for (int d = 0; d < 3; d++) {
+    pos[d] = bead.GetCrd(1, d);
+  }
+  vector<int>& nearby = ewald_cells.Neighbors(ewald_cells.CellIndex(pos));
+  for (int c = 0; c < (int)nearby.size(); c++) {
+    vector<int>& list = ewald_cells.Beads(nearby[c]);
+    for (int n = 0; n < (int)list.size(); n++) {
+      int p = list[n];
+      if ((p >= del_begin && p < del_end) || q[p] == 0)  continue;
+      int m = particles.MolOf(p);
+      energy += ewald_pot->PairEnergyReal(bead,
+                                          mols[m].bds[p - particles.Begin(m)],
+                                          npbc);
+    }
+  }
+  return energy;
+
+}
+
 double ForceField::BeadsEnergy(Bead& bead1, Bead& bead2, vector<Molecule>& mols,
-                               int current_len, int delete_id) {
+                               CBMCGrowth& growth, int current_len,
+                               int delete_id, int thread) {
   double energy   = 0;
   double pair_e   = 0;  double ewald_e  = 0;
   double pair_e1  = 0;  double pair_e2  = 0;
@@ -19,33 +55,57 @@ double ForceField::BeadsEnergy(Bead& bead1, Bead& bead2, vector<Molecule>& mols,
   /////////////////////////////////////////////////////////////////
   // 1. Pairwise interactions for the bead with other molecules. //
   /////////////////////////////////////////////////////////////////
+  vector<double>& store_e1 = store_pair_e[2*thread];
+  vector<double>& store_e2 = store_pair_e[2*thread + 1];
+  if (use_pair_pot) {
+    StorePairEnergies(bead1, store_e1);
+    if (gc_bead_charge != 0)
+      StorePairEnergies(bead2, store_e2);
+  }
   for (int i = 0; i < (int)mols.size(); i++) {
     if (delete_id == -1 || (i < delete_id || i > delete_id + counterion)) {
       for (int j = 0; j < mols[i].Size(); j++) {
         if (use_pair_pot) {
-          pair_e1 = pair_pot->PairEnergy(bead1, mols[i].bds[j], box_l, npbc);
+          pair_e1 = store_e1[particles.Begin(i) + j];
           if (gc_bead_charge != 0)
-            pair_e2 = pair_pot->PairEnergy(bead2, mols[i].bds[j], box_l, npbc);
+            pair_e2 = store_e2[particles.Begin(i) + j];
         }
         pair_e += pair_e1 + pair_e2;
 
         if (pair_e >= kVeryLargeEnergy)  break;
-
-        if (use_ewald_pot) {
-          ewald_r1 = ewald_pot->PairEnergyReal(bead1, mols[i].bds[j], npbc);
-          ewald_k1 = ewald_pot->PairEnergyRepl(bead1, mols[i].bds[j], npbc);
-          if (gc_bead_charge != 0) {
-            ewald_r2 = ewald_pot->PairEnergyReal(bead2, mols[i].bds[j], npbc);
-            ewald_k2 = ewald_pot->PairEnergyRepl(bead2, mols[i].bds[j], npbc);
-          }
-        }
-        ewald_e += (ewald_r1 + ewald_k1 + ewald_r2 + ewald_k2);
-//tot_real += ewald_r1 + ewald_r2;
-//tot_repl += ewald_k1 + ewald_k2;
       }
     }
     if (pair_e >= kVeryLargeEnergy)  break;
   }
+  // The real energies only with the beads in the cells around each bead.
+  if (use_ewald_pot && pair_e < kVeryLargeEnergy) {
+    ewald_r1 = BeadRealEnergy(bead1, mols, delete_id, counterion);
+    if (gc_bead_charge != 0)
+      ewald_r2 = BeadRealEnergy(bead2, mols, delete_id, counterion);
+    ewald_e += (ewald_r1 + ewald_r2);
+//tot_real += ewald_r1 + ewald_r2;
+  }
+  // The reciprocal energies with all beads come from the structure factor,
+  // which still holds the chain being deleted, so that its beads are taken
+  // out pair by pair.
+  if (use_ewald_pot && pair_e < kVeryLargeEnergy) {
+    ewald_k1 = ewald_pot->BeadReplEnergy(bead1, thread);
+    if (gc_bead_charge != 0)
+      ewald_k2 = ewald_pot->BeadReplEnergy(bead2, thread);
+    if (delete_id != -1) {
+      for (int i = delete_id; i <= delete_id + counterion; i++) {
+        for (int j = 0; j < mols[i].Size(); j++) {
+          ewald_k1 -= ewald_pot->PairEnergyRepl(bead1, mols[i].bds[j], npbc,
+                                                thread);
+          if (gc_bead_charge != 0)
+            ewald_k2 -= ewald_pot->PairEnergyRepl(bead2, mols[i].bds[j],
+                                                  npbc, thread);
+        }
+      }
+    }
+    ewald_e += (ewald_k1 + ewald_k2);
+//tot_repl += ewald_k1 + ewald_k2;
+  }
 
 
   ////////////////////////////////////////////////////////
@@ -55,12 +115,12 @@ double ForceField::BeadsEnergy(Bead& bead1, Bead& bead2, vector<Molecule>& mols,
     if (use_pair_pot) {
       pair_e1 = 0;
       if (i < current_len - 1)
-        pair_e1 += pair_pot->PairEnergy(bead1, cbmc_chain[i], box_l, npbc);
+        pair_e1 += pair_pot->PairEnergy(bead1, growth.chain[i], box_l, npbc);
       if (gc_bead_charge != 0) {
-        pair_e1 += pair_pot->PairEnergy(bead1, cbmc_chain[i+gc_chain_len],
+        pair_e1 += pair_pot->PairEnergy(bead1, growth.chain[i+gc_chain_len],
                                         box_l, npbc);
-        pair_e2  = pair_pot->PairEnergy(bead2, cbmc_chain[i], box_l, npbc);
-        pair_e2 += pair_pot->PairEnergy(bead2, cbmc_chain[i+gc_chain_len], 
+        pair_e2  = pair_pot->PairEnergy(bead2, growth.chain[i], box_l, npbc);
+        pair_e2 += pair_pot->PairEnergy(bead2, growth.chain[i+gc_chain_len], 
                                         box_l, npbc);
       }
     }
@@ -69,19 +129,21 @@ double ForceField::BeadsEnergy(Bead& bead1, Bead& bead2, vector<Molecule>& mols,
     if (pair_e >= kVeryLargeEnergy)  break;
 
     if (use_ewald_pot) {
-      ewald_r1 = ewald_pot->PairEnergyReal(bead1, cbmc_chain[i], npbc);
-      ewald_k1 = ewald_pot->PairEnergyRepl(bead1, cbmc_chain[i], npbc);
+      ewald_r1 = ewald_pot->PairEnergyReal(bead1, growth.chain[i], npbc);
+      ewald_k1 = ewald_pot->PairEnergyRepl(bead1, growth.chain[i], npbc,
+                                           thread);
       if (gc_bead_charge != 0) {
-        ewald_r1 += ewald_pot->PairEnergyReal(bead1, cbmc_chain[i+gc_chain_len],
-                                              npbc);
-        ewald_k1 += ewald_pot->PairEnergyRepl(bead1, cbmc_chain[i+gc_chain_len], 
+        ewald_r1 += ewald_pot->PairEnergyReal(bead1, growth.chain[i+gc_chain_len],
                                               npbc);
-        ewald_r2  = ewald_pot->PairEnergyReal(bead2, cbmc_chain[i], npbc);
-        ewald_k2  = ewald_pot->PairEnergyRepl(bead2, cbmc_chain[i], npbc);
-        ewald_r2 += ewald_pot->PairEnergyReal(bead2, cbmc_chain[i+gc_chain_len],
-                                              npbc);
-        ewald_k2 += ewald_pot->PairEnergyRepl(bead2, cbmc_chain[i+gc_chain_len],
+        ewald_k1 += ewald_pot->PairEnergyRepl(bead1, growth.chain[i+gc_chain_len], 
+                                              npbc, thread);
+        ewald_r2  = ewald_pot->PairEnergyReal(bead2, growth.chain[i], npbc);
+        ewald_k2  = ewald_pot->PairEnergyRepl(bead2, growth.chain[i], npbc,
+                                              thread);
+        ewald_r2 += ewald_pot->PairEnergyReal(bead2, growth.chain[i+gc_chain_len],
                                               npbc);
+        ewald_k2 += ewald_pot->PairEnergyRepl(bead2, growth.chain[i+gc_chain_len],
+                                              npbc, thread);
      }
     }
     ewald_e += (ewald_r1 + ewald_k1 + ewald_r2 + ewald_k2);
@@ -98,17 +160,17 @@ double ForceField::BeadsEnergy(Bead& bead1, Bead& bead2, vector<Molecule>& mols,
   if (use_ewald_pot && pair_e < kVeryLargeEnergy) {
     ewald_e += ewald_pot->SelfEnergy(bead1);
     ewald_e += 0.5*ewald_pot->PairEnergyReal(bead1, bead1, npbc);
-    ewald_e += 0.5*ewald_pot->PairEnergyRepl(bead1, bead1, npbc);
+    ewald_e += 0.5*ewald_pot->PairEnergyRepl(bead1, bead1, npbc, thread);
 
     if (gc_bead_charge != 0) {
       ewald_e += ewald_pot->SelfEnergy(bead2);
       ewald_e += ewald_pot->PairEnergyReal(bead1, bead2, npbc);
-      ewald_e += ewald_pot->PairEnergyRepl(bead1, bead2, npbc);
+      ewald_e += ewald_pot->PairEnergyRepl(bead1, bead2, npbc, thread);
       ewald_e += 0.5*ewald_pot->PairEnergyReal(bead2, bead2, npbc);
-      ewald_e += 0.5*ewald_pot->PairEnergyRepl(bead2, bead2, npbc);
+      ewald_e += 0.5*ewald_pot->PairEnergyRepl(bead2, bead2, npbc, thread);
     }
     if (ewald_pot->UseDipoleCorrection())
-      ewald_e += ewald_pot->DipoleEDiff(mols, cbmc_chain, bead1, bead2,
+      ewald_e += ewald_pot->DipoleEDiff(mols, growth.chain, bead1, bead2,
                                         current_len, gc_chain_len,
                                         gc_bead_charge,  delete_id);
 
@@ -154,22 +216,35 @@ double ForceField::BeadsEnergy(Bead& bead1, Bead& bead2, vector<Molecule>& mols,
  * Input
  * end_bead   : the previously chosen bead in the trial chain.
  * mols       : molecule array of the existing beads.
+ * growth     : the chain being grown and its trial beads and weights.
  * current_len: current length of the trial chain.
  * rand_gen   : random number generator.
  * delete_id  : used for chain deletion, the ID of the chain to be deleted.
+ * thread     : -1 to score the trials on the thread pool, otherwise the
+ *              thread that scores them all.
  */
 double ForceField::CBMCFGenTrialBeads(Bead& end_bead, vector<Molecule>& mols,
-                                      int current_len, mt19937& rand_gen,
-                                      int delete_id) {
+                                      CBMCGrowth& growth, int current_len,
+                                      RandomGenerator& rand_gen, int delete_id,
+                                      int thread) {
   double Wi = 0;
+  int ion_offset = 0;
+  if (gc_bead_charge != 0)  ion_offset = cbmc_no_of_trials;
 
+  // The trial positions are all drawn before any is scored, so the random
+  // numbers used do not depend on the threads.
+  growth.directions.resize(3*cbmc_no_of_trials);
+  rand_gen.UnitSphere(growth.directions.data(), cbmc_no_of_trials);
+  if (gc_bead_charge != 0) {
+    growth.ion_crd.resize(3*cbmc_no_of_trials);
+    rand_gen.Uniform(growth.ion_crd.data(), 3*cbmc_no_of_trials);
+  }
   for (int i = 0; i < cbmc_no_of_trials; i++) {
     /////////////////////////////////////
     // Decide indices and bond length. //
     /////////////////////////////////////
-    int c_index = i;  // Chain trial bead index.
-    int i_index = i;  // Ion trial bead index.
-    if (gc_bead_charge != 0)  i_index = i + cbmc_no_of_trials;
+    int c_index = i;                // Chain trial bead index.
+    int i_index = i + ion_offset;   // Ion trial bead index.
     double bond_len = 0;
     if (use_bond_pot) {
       bond_len = bond_pot->RandomBondLen(beta, rand_gen); 
@@ -183,28 +258,40 @@ double ForceField::CBMCFGenTrialBeads(Bead& end_bead, vector<Molecule>& mols,
     //////////////////////////////
     double bead_coord[3];
     // Chain particle.
-    randSphere(bead_coord, rand_gen);
     for (int j = 0; j < 3; j++) {
-      bead_coord[j] *= bond_len;
+      bead_coord[j] = growth.directions[3*i + j] * bond_len;
       bead_coord[j] += end_bead.GetCrd(0, j);
     }
-    cbmc_trial_beads[c_index].SetAllCrd(bead_coord);
+    growth.trial_beads[c_index].SetAllCrd(bead_coord);
     // Chain counterion.
     if (gc_bead_charge != 0) {
-      bead_coord[0] = (double)rand_gen()/rand_gen.max() * box_l[0];
-      bead_coord[1] = (double)rand_gen()/rand_gen.max() * box_l[1];
-      bead_coord[2] = (double)rand_gen()/rand_gen.max() * box_l[2];
-      cbmc_trial_beads[i_index].SetAllCrd(bead_coord);
+      for (int j = 0; j < 3; j++) {
+        bead_coord[j] = growth.ion_crd[3*i + j] * box_l[j];
+      }
+      growth.trial_beads[i_index].SetAllCrd(bead_coord);
     }
+  }
 
-    //////////////////////////////
-    // Calculating bead energy. //
-    //////////////////////////////
-    double bead_energy = BeadsEnergy(cbmc_trial_beads[c_index],
-                                     cbmc_trial_beads[i_index],
-                                     mols, current_len, delete_id);
-    cbmc_trial_weights[i] = exp(-beta * bead_energy);    
-    Wi += cbmc_trial_weights[i];
+  //////////////////////////////
+  // Calculating bead energy. //
+  //////////////////////////////
+  // Each trial writes only its own weight.
+  auto score = [&](int i, int t) {
+    double bead_energy = BeadsEnergy(growth.trial_beads[i],
+                                     growth.trial_beads[i + ion_offset],
+                                     mols, growth, current_len, delete_id, t);
+    growth.trial_weights[i] = exp(-beta * bead_energy);
+  };
+  if (thread < 0) {
+    pool.Run(cbmc_no_of_trials, score);
+  }
+  else {
+    for (int i = 0; i < cbmc_no_of_trials; i++) {
+      score(i, thread);
+    }
+  }
+  for (int i = 0; i < cbmc_no_of_trials; i++) {
+    Wi += growth.trial_weights[i];
   }
 
   return Wi;
@@ -212,7 +299,7 @@ double ForceField::CBMCFGenTrialBeads(Bead& end_bead, vector<Molecule>& mols,
 }
 
 bool ForceField::CBMCFChainInsertion(vector<Molecule>& mols,
-                                     mt19937& rand_gen) {
+                                     RandomGenerator& rand_gen) {
   bool accept = false;
   double weight = 1.0;
 
@@ -228,11 +315,12 @@ bool ForceField::CBMCFChainInsertion(vector<Molecule>& mols,
   }
   for (int i = 0; i < initial_beads; i++) {
     for (int j = 0; j < 3; j++)
-      xyz[j] = (double)rand_gen() / rand_gen.max() * box_l[j];
-    cbmc_chain[i*gc_chain_len].SetAllCrd(xyz);
+      xyz[j] = rand_gen.Uniform() * box_l[j];
+    cbmc.chain[i*gc_chain_len].SetAllCrd(xyz);
   }
-  weight *= exp(-beta * BeadsEnergy(cbmc_chain[0], cbmc_chain[i_index], mols, 0,
-                                    -1));
+  if (use_ewald_pot)  ewald_pot->PrepareBeadReplEnergy();
+  weight *= exp(-beta * BeadsEnergy(cbmc.chain[0], cbmc.chain[i_index], mols,
+                                    cbmc, 0, -1, 0));
   if (weight <= 0)  return false;
 
 
@@ -241,28 +329,29 @@ bool ForceField::CBMCFChainInsertion(vector<Molecule>& mols,
   ////////////////////
   for (int i = 1; i < gc_chain_len; i++) {
     // Generate beads calculate their energies.
-    double Wi = CBMCFGenTrialBeads(cbmc_chain[i-1], mols, i, rand_gen, -1);
+    double Wi = CBMCFGenTrialBeads(cbmc.chain[i-1], mols, cbmc, i, rand_gen,
+                                   -1, -1);
     weight *= Wi/cbmc_no_of_trials;
     if (weight <= 0)  return accept;
 
     // Choose bead(s).
-    double rand_num = (double)rand_gen() / rand_gen.max() * Wi;
+    double rand_num = rand_gen.Uniform() * Wi;
     int current_bead = 0;
-    double cumulate_weight = cbmc_trial_weights[0];
+    double cumulate_weight = cbmc.trial_weights[0];
     while (cumulate_weight < rand_num) {
       current_bead++;
-      cumulate_weight += cbmc_trial_weights[current_bead];
+      cumulate_weight += cbmc.trial_weights[current_bead];
     }
 
     // Assign coordinates.
     for (int j = 0; j < 3; j++)
-      xyz[j] = cbmc_trial_beads[current_bead].GetCrd(0, j);
-    cbmc_chain[i].SetAllCrd(xyz);
+      xyz[j] = cbmc.trial_beads[current_bead].GetCrd(0, j);
+    cbmc.chain[i].SetAllCrd(xyz);
     if (gc_bead_charge != 0) {
       current_bead += cbmc_no_of_trials;
       for (int j = 0; j < 3; j++) 
-        xyz[j] = cbmc_trial_beads[current_bead].GetCrd(0, j);
-      cbmc_chain[i + gc_chain_len].SetAllCrd(xyz);
+        xyz[j] = cbmc.trial_beads[current_bead].GetCrd(0, j);
+      cbmc.chain[i + gc_chain_len].SetAllCrd(xyz);
     }
   }
 
@@ -295,17 +384,18 @@ bool ForceField::CBMCFChainInsertion(vector<Molecule>& mols,
   double C = vol_over_lam * (1.0/(double)factorial);
 
   // Decide acceptance or rejection.
-  double rand_num = (double)rand_gen() / rand_gen.max();
+  double rand_num = rand_gen.Uniform();
 
   if (rand_num < (exp(beta*chem_pot) * weight) * C) {
     accept = true;
     // Initialize Ewald energy.
     if (use_ewald_pot)
-      ewald_pot->TrialChainEnergy(mols, cbmc_chain, gc_chain_len*2, -1, npbc);
+      ewald_pot->TrialChainEnergy(mols, cbmc.chain, gc_chain_len*2, -1, npbc,
+                                  particles, ewald_cells);
 
     mols.push_back(Molecule());
     for (int i = 0; i < gc_chain_len; i++) {
-      mols[(int)mols.size() - 1].AddBead(cbmc_chain[i]); 
+      mols[(int)mols.size() - 1].AddBead(cbmc.chain[i]); 
     }
     // Add bonds to the new chain ASSUMING LINEAR MOLECULE!
     for (int i = 0; i < mols[(int)mols.size() - 1].Size()-1; i++) {
@@ -315,7 +405,7 @@ bool ForceField::CBMCFChainInsertion(vector<Molecule>& mols,
     if (gc_bead_charge != 0) {
       for (int i = gc_chain_len; i < gc_chain_len*2; i++) {
         mols.push_back(Molecule());
-        mols[(int)mols.size() - 1].AddBead(cbmc_chain[i]);
+        mols[(int)mols.size() - 1].AddBead(cbmc.chain[i]);
       }
     }
   }
@@ -327,7 +417,7 @@ bool ForceField::CBMCFChainInsertion(vector<Molecule>& mols,
 
 }
 
-int ForceField::CBMCFChainDeletion(vector<Molecule>& mols, mt19937& rand_gen) {
+int ForceField::CBMCFChainDeletion(vector<Molecule>& mols, RandomGenerator& rand_gen) {
   UpdateMolCounts(mols);
   int spc1;
   if      (gc_chain_len   >  1)  spc1 = n_chain;
@@ -337,7 +427,7 @@ int ForceField::CBMCFChainDeletion(vector<Molecule>& mols, mt19937& rand_gen) {
   else                           spc1 = n_aion - coion;
 
   int delete_id;
-  delete_id = floor((double)rand_gen()/rand_gen.max() * spc1);
+  delete_id = floor(rand_gen.Uniform() * spc1);
   if (delete_id >= spc1)  delete_id = spc1 - 1;
   if (gc_bead_charge != 0)
     delete_id = phantom + coion + grafted + grafted_counterion +
@@ -352,22 +442,23 @@ int ForceField::CBMCFChainDeletion(vector<Molecule>& mols, mt19937& rand_gen) {
   // "Grow" first bead. //
   ////////////////////////
   double weight = 1.0;
+  if (use_ewald_pot)  ewald_pot->PrepareBeadReplEnergy();
   // Weight for the first bead in chain.
   int second_mol = delete_id;
   if (gc_bead_charge != 0)  second_mol = delete_id + 1;
   weight *= exp(-beta*BeadsEnergy(mols[delete_id].bds[0],
                                   mols[second_mol].bds[0],
-                                  mols, 0, delete_id));
+                                  mols, cbmc, 0, delete_id, 0));
   // Replace the xyz bead by the existing bead on the chain to be deleted.
   double xyz[3] = {mols[delete_id].bds[0].GetCrd(0, 0),
                    mols[delete_id].bds[0].GetCrd(0, 1),
                    mols[delete_id].bds[0].GetCrd(0, 2)};
-  cbmc_chain[0].SetAllCrd(xyz);
+  cbmc.chain[0].SetAllCrd(xyz);
   if (gc_bead_charge != 0) {
     xyz[0] = mols[second_mol].bds[0].GetCrd(0, 0);
     xyz[1] = mols[second_mol].bds[0].GetCrd(0, 1);
     xyz[2] = mols[second_mol].bds[0].GetCrd(0, 2);
-    cbmc_chain[gc_chain_len].SetAllCrd(xyz);
+    cbmc.chain[gc_chain_len].SetAllCrd(xyz);
   }
 
   ////////////////////
@@ -377,21 +468,21 @@ int ForceField::CBMCFChainDeletion(vector<Molecule>& mols, mt19937& rand_gen) {
     xyz[0] = mols[delete_id].bds[i].GetCrd(0, 0);
     xyz[1] = mols[delete_id].bds[i].GetCrd(0, 1);
     xyz[2] = mols[delete_id].bds[i].GetCrd(0, 2);
-    cbmc_chain[i].SetAllCrd(xyz);
+    cbmc.chain[i].SetAllCrd(xyz);
     if (gc_bead_charge != 0) {
       xyz[0] = mols[delete_id+i+1].bds[0].GetCrd(0, 0);
       xyz[1] = mols[delete_id+i+1].bds[0].GetCrd(0, 1);
       xyz[2] = mols[delete_id+i+1].bds[0].GetCrd(0, 2);
-      cbmc_chain[i+gc_chain_len].SetAllCrd(xyz);
+      cbmc.chain[i+gc_chain_len].SetAllCrd(xyz);
     }
 
-    CBMCFGenTrialBeads(cbmc_chain[i-1], mols, i, rand_gen, delete_id);
-    cbmc_trial_weights[0] = exp(-beta * BeadsEnergy(cbmc_chain[i],
-                            cbmc_chain[i+second_bead*gc_chain_len], mols, i,
-                            delete_id));
+    CBMCFGenTrialBeads(cbmc.chain[i-1], mols, cbmc, i, rand_gen, delete_id, -1);
+    cbmc.trial_weights[0] = exp(-beta * BeadsEnergy(cbmc.chain[i],
+                            cbmc.chain[i+second_bead*gc_chain_len], mols, cbmc,
+                            i, delete_id, 0));
     double Wi = 0;
     for (int j = 0; j < cbmc_no_of_trials; j++) {
-      Wi += cbmc_trial_weights[j];
+      Wi += cbmc.trial_weights[j];
     }
     weight *= Wi/cbmc_no_of_trials;
   }
@@ -417,7 +508,7 @@ int ForceField::CBMCFChainDeletion(vector<Molecule>& mols, mt19937& rand_gen) {
   lam_over_vol *= pow((gc_deBroglie_prefactor/pow(m1, 1.5))/vol, spc1_del);
   lam_over_vol *= pow((gc_deBroglie_prefactor/pow(m2, 1.5))/vol, spc2_del);
   double C = lam_over_vol * (double)factorial;
-  double rand_num = (double)rand_gen() / rand_gen.max();
+  double rand_num = rand_gen.Uniform();
 
   if (rand_num < C / (exp(beta*chem_pot) * weight)) {
     if (use_pair_pot) {
@@ -427,7 +518,7 @@ int ForceField::CBMCFChainDeletion(vector<Molecule>& mols, mt19937& rand_gen) {
       ewald_pot->AdjustEnergyUponMolDeletion(mols, delete_id);
     }
     if (use_bond_pot) {
-      bond_pot->AdjustEnergyUponMolDeletion(delete_id); 
+      bond_pot->AdjustEnergyUponMolDeletion(mols, delete_id); 
     }
     if (use_ext_pot) {
       ext_pot->AdjustEnergyUponMolDeletion(mols, delete_id); 
@@ -441,8 +532,69 @@ int ForceField::CBMCFChainDeletion(vector<Molecule>& mols, mt19937& rand_gen) {
 
 }
 
+// Grows one test chain, the same way CBMCFChainInsertion does, and returns its
+// Rosenbluth weight. Called from the thread pool, so it only touches the
+// growth and the scratch arrays of its own thread.
+double ForceField::WidomInsertion(vector<Molecule>& mols, CBMCGrowth& growth,
+                                  RandomGenerator& rand_gen, int thread) {
+  double weight = 1.0;
+
+  // First beads.
+  double xyz[3];
+  int i_index = 0;
+  int initial_beads = 1;
+  if (gc_bead_charge != 0) {
+    i_index = gc_chain_len;
+    initial_beads = 2;
+  }
+  for (int i = 0; i < initial_beads; i++) {
+    for (int j = 0; j < 3; j++)
+      xyz[j] = rand_gen.Uniform() * box_l[j];
+    growth.chain[i*gc_chain_len].SetAllCrd(xyz);
+  }
+  double dE = BeadsEnergy(growth.chain[0], growth.chain[i_index], mols, growth,
+                          0, -1, thread);
+
+  if (dE == kVeryLargeEnergy)
+    weight *= 0;
+  else
+    weight *= exp(-beta * dE);
+
+  // The rest.
+  for (int i = 1; i < gc_chain_len; i++) {
+    // Generate beads calculate their energies.
+    double Wi = CBMCFGenTrialBeads(growth.chain[i-1], mols, growth, i,
+                                   rand_gen, -1, thread);
+    weight *= Wi/cbmc_no_of_trials;
+    if (weight <= 0)  break;
+
+    // Choose bead(s).
+    double rand_num = rand_gen.Uniform() * Wi;
+    int current_bead = 0;
+    double cumulate_weight = growth.trial_weights[0];
+    while (cumulate_weight < rand_num) {
+      current_bead++;
+      cumulate_weight += growth.trial_weights[current_bead];
+    }
+
+    // Assign coordinates.
+    for (int j = 0; j < 3; j++)
+      xyz[j] = growth.trial_beads[current_bead].GetCrd(0, j);
+    growth.chain[i].SetAllCrd(xyz);
+    if (gc_bead_charge != 0) {
+      current_bead += cbmc_no_of_trials;
+      for (int j = 0; j < 3; j++)
+        xyz[j] = growth.trial_beads[current_bead].GetCrd(0, j);
+      growth.chain[i + gc_chain_len].SetAllCrd(xyz);
+    }
+  }
+
+  return weight;
+
+}
+
 double ForceField::CalcChemicalPotentialF(vector<Molecule>& mols,
-                                          mt19937& rand_gen) {
+                                          RandomGenerator& rand_gen) {
   double total = 0;
 
   int spc1;
@@ -471,61 +623,19 @@ double ForceField::CalcChemicalPotentialF(vector<Molecule>& mols,
   int toadd = gc_chain_len;
   if (gc_bead_charge != 0)  toadd *= 2;
 
+  // Every insertion grows its chain with its own stream of a seed drawn
+  // here, so the result does not depend on the threads.
+  unsigned long widom_seed = rand_gen();
+  widom_weights.resize(mu_tot_ins);
+  if (use_ewald_pot)  ewald_pot->PrepareBeadReplEnergy();
+  pool.Run(mu_tot_ins, [&](int c, int t) {
+    RandomGenerator gen(widom_seed, c);
+    widom_weights[c] = WidomInsertion(mols, widom_growths[t], gen, t);
+  });
   for (int c = 0; c < mu_tot_ins; c++) {
-    double weight = 1.0;
-
-    // First beads.
-    double xyz[3];
-    int i_index = 0;
-    int initial_beads = 1;
-    if (gc_bead_charge != 0) {
-      i_index = gc_chain_len;
-      initial_beads = 2;
-    }
-    for (int i = 0; i < initial_beads; i++) {
-      for (int j = 0; j < 3; j++)
-        xyz[j] = (double)rand_gen() / rand_gen.max() * box_l[j];
-      cbmc_chain[i*gc_chain_len].SetAllCrd(xyz);
-    }
-    double dE = BeadsEnergy(cbmc_chain[0], cbmc_chain[i_index], mols, 0, -1);
-
-    if (dE == kVeryLargeEnergy)
-      weight *= 0;
-    else
-      weight *= exp(-beta * dE);
-
-    // The rest.
-    for (int i = 1; i < gc_chain_len; i++) {
-      // Generate beads calculate their energies.
-      double Wi = CBMCFGenTrialBeads(cbmc_chain[i-1], mols, i, rand_gen, -1);
-      weight *= Wi/cbmc_no_of_trials;
-      if (weight <= 0)  break;
-  
-      // Choose bead(s).
-      double rand_num = (double)rand_gen() / rand_gen.max() * Wi;
-      int current_bead = 0;
-      double cumulate_weight = cbmc_trial_weights[0];
-      while (cumulate_weight < rand_num) {
-        current_bead++;
-        cumulate_weight += cbmc_trial_weights[current_bead];
-      }
-  
-      // Assign coordinates.
-      for (int j = 0; j < 3; j++)
-        xyz[j] = cbmc_trial_beads[current_bead].GetCrd(0, j);
-      cbmc_chain[i].SetAllCrd(xyz);
-      if (gc_bead_charge != 0) {
-        current_bead += cbmc_no_of_trials;
-        for (int j = 0; j < 3; j++)
-          xyz[j] = cbmc_trial_beads[current_bead].GetCrd(0, j);
-        cbmc_chain[i + gc_chain_len].SetAllCrd(xyz);
-      }
-    }
-
-    total += weight * C;
+    total += widom_weights[c] * C;
   }
 
-
   return total/(double)mu_tot_ins;
 
 }
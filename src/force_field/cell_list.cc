@@ -0,0 +1,205 @@
+#include "cell_list.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../utilities/binary_io.h"
+
+using namespace std; 
+
+CellList::CellList() {
+  npbc = 0;
+  for (int i = 0; i < 3; i++) {
+    box_l[i] = 0;
+    n_cell[i] = 1;
+    cell_l[i] = 0;
+  }
+
+}
+
+void CellList::Initialize(double box_l_in[], int npbc_in, double cutoff) {
+  npbc = npbc_in;
+  for (int i = 0; i < 3; i++) {
+    box_l[i] = box_l_in[i];
+    n_cell[i] = 1;
+    if (cutoff > 0)
+      n_cell[i] = max(1, (int)floor(box_l[i] / cutoff));
+    cell_l[i] = box_l[i] / n_cell[i];
+  }
+
+  cells.assign(n_cell[0]*n_cell[1]*n_cell[2], vector<int>());
+  neighbors.assign(cells.size(), vector<int>());
+  for (int i = 0; i < n_cell[0]; i++) {
+    for (int j = 0; j < n_cell[1]; j++) {
+      for (int k = 0; k < n_cell[2]; k++) {
+        int cell[3] = {i, j, k};
+        vector<int>& list = neighbors[(i*n_cell[1] + j)*n_cell[2] + k];
+        for (int di = -1; di <= 1; di++) {
+          for (int dj = -1; dj <= 1; dj++) {
+            for (int dk = -1; dk <= 1; dk++) {
+              int d[3] = {di, dj, dk};
+              int nb[3];
+              bool inside = true;
+              for (int l = 0; l < 3; l++) {
+                nb[l] = cell[l] + d[l];
+                if (l < npbc)
+                  nb[l] = (nb[l] + n_cell[l]) % n_cell[l];
+                else if (nb[l] < 0 || nb[l] >= n_cell[l])
+                  inside = false;
+              }
+              if (inside)
+                list.push_back((nb[0]*n_cell[1] + nb[1])*n_cell[2] + nb[2]);
+            }
+          }
+        }
+        // With fewer than 3 cells along a periodic dimension, the same cell
+        // is reached from both sides.
+        sort(list.begin(), list.end());
+        list.erase(unique(list.begin(), list.end()), list.end());
+      }
+    }
+  }
+
+}
+
+void CellList::Build(ParticleStore& particles) {
+  for (int i = 0; i < (int)cells.size(); i++) {
+    cells[i].clear();
+  }
+  bead_cell.clear();
+  AddParticles(particles, 0);
+
+}
+
+void CellList::AddParticles(ParticleStore& particles, int first) {
+  bead_cell.resize(particles.Size());
+  for (int i = first; i < particles.Size(); i++) {
+    int cell = CellIndex(particles, i, 0);
+    bead_cell[i] = cell;
+    cells[cell].push_back(i);
+  }
+
+}
+
+void CellList::RemoveParticles(int first, int end) {
+  int count = end - first;
+  int last = (int)bead_cell.size() - count;
+
+  for (int i = first; i < end; i++) {
+    vector<int>& list = cells[bead_cell[i]];
+    for (int j = 0; j < (int)list.size(); j++) {
+      if (list[j] == i) {
+        list[j] = list.back();
+        list.pop_back();
+        break;
+      }
+    }
+  }
+
+  if (first != last) {
+    for (int k = 0; k < count; k++) {
+      vector<int>& list = cells[bead_cell[last+k]];
+      for (int j = 0; j < (int)list.size(); j++) {
+        if (list[j] == last+k) {
+          list[j] = first+k;
+          break;
+        }
+      }
+      bead_cell[first+k] = bead_cell[last+k];
+    }
+  }
+  bead_cell.resize(last);
+
+}
+
+void CellList::Update(ParticleStore& particles, int mol) {
+  for (int i = particles.Begin(mol); i < particles.End(mol); i++) {
+    int old_cell = bead_cell[i];
+    int new_cell = CellIndex(particles, i, 0);
+    if (new_cell != old_cell) {
+      vector<int>& list = cells[old_cell];
+      for (int j = 0; j < (int)list.size(); j++) {
+        if (list[j] == i) {
+          list[j] = list.back();
+          list.pop_back();
+          break;
+        }
+      }
+      cells[new_cell].push_back(i);
+      bead_cell[i] = new_cell;
+    }
+  }
+
+}
+
+int CellList::CellIndex(ParticleStore& particles, int p, int flag) {
+  double pos[3];
+  for (int i = 0; i < 3; i++) {
+    pos[i] = particles.Crd(flag, i)[p];
+  }
+  return CellIndex(pos);
+
+}
+
+int CellList::CellIndex(double pos[]) {
+  int index[3];
+  for (int i = 0; i < 3; i++) {
+    double x = pos[i];
+    if (i < npbc)
+      x -= box_l[i] * floor(x / box_l[i]);
+    index[i] = (int)floor(x / cell_l[i]);
+    if (index[i] < 0)           index[i] = 0;
+    if (index[i] >= n_cell[i])  index[i] = n_cell[i] - 1;
+  }
+
+  return (index[0]*n_cell[1] + index[1])*n_cell[2] + index[2];
+
+}
+
+vector<int>& CellList::Neighbors(int cell) {
+  return neighbors[cell];
+
+}
+
+vector<int>& CellList::Beads(int cell) {
+  return cells[cell];
+
+}
+
+int CellList::Size() {
+  return (int)cells.size();
+
+}
+
+int CellList::NumCells(int dim) {
+  return n_cell[dim];
+
+}
+
+void CellList::SaveState(ostream& out) {
+  WriteBinary(out, cells);
+  WriteBinary(out, bead_cell);
+
+}
+
+void CellList::LoadState(istream& in, ParticleStore& particles) {
+  vector<vector<int> > cells_saved;
+  vector<int> bead_cell_saved;
+  ReadBinary(in, cells_saved);
+  ReadBinary(in, bead_cell_saved);
+  if (cells_saved.size() == cells.size() &&
+      (int)bead_cell_saved.size() == particles.Size()) {
+    cells.swap(cells_saved);
+    bead_cell.swap(bead_cell_saved);
+  }
+  else {
+    Build(particles);
+  }
+
+}
+
+void CellList::SwapState(CellList& other) {
+  cells.swap(other.cells);
+  bead_cell.swap(other.bead_cell);
+
+}
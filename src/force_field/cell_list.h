@@ -0,0 +1,80 @@
+#ifndef SRC_FORCE_FIELD_CELL_LIST_H_
+#define SRC_FORCE_FIELD_CELL_LIST_H_
+
+#include <iostream>
+#include <vector>
+
+#include "../molecules/particle_store.h"
+
+using namespace std; 
+
+/** Linked-cell neighbor search for short-ranged potentials. The box is divided
+    into cells that are no smaller than the cutoff, so every interaction
+    partner of a bead sits in the bead's own cell or in one of the adjacent
+    cells. The first npbc dimensions are periodic; along the others, beads
+    outside of the box are kept in the outermost cells. Beads are stored by
+    their index in the particle store, so the list follows every change of
+    the store: Build after Build, AddParticles after Append and
+    RemoveParticles after RemoveMolecules. */
+class CellList {
+ private:
+  /** The box dimensions. */
+  double box_l[3];
+  /** Number of periodic dimensions. */
+  int npbc;
+  /** Number of cells along each dimension. */
+  int n_cell[3];
+  /** The length of a cell along each dimension. */
+  double cell_l[3];
+  /** The beads in each cell. */
+  vector<vector<int> > cells;
+  /** The cells adjacent to each cell, including itself, without
+      duplicates. */
+  vector<vector<int> > neighbors;
+  /** The cell of every particle. */
+  vector<int> bead_cell;
+
+ public:
+  CellList();
+  /** Set up the cells for the box dimensions, the number of periodic
+      dimensions and the cutoff. */
+  void Initialize(double[], int, double);
+  /** Bin all particles by their current positions. */
+  void Build(ParticleStore&);
+  /** Bin the particles of the store from the given index on, after they
+      were appended to it. */
+  void AddParticles(ParticleStore&, int);
+  /** Take the particles [first, end) out of their cells and renumber the
+      last end-first particles to take their places, the way
+      ParticleStore::RemoveMolecules moves them. */
+  void RemoveParticles(int, int);
+  /** Move the beads of a molecule to the cells of their current positions.
+      Call it after the store has accepted a move. */
+  void Update(ParticleStore&, int);
+  /** The cell of a particle, for its current (0) or trial (1) position. */
+  int CellIndex(ParticleStore&, int, int);
+  /** The cell of a position, e.g. of a bead that is not in the store. */
+  int CellIndex(double[]);
+  /** The cells adjacent to a cell, including itself. */
+  vector<int>& Neighbors(int);
+  /** The particles in a cell. */
+  vector<int>& Beads(int);
+  /** Total number of cells. */
+  int Size();
+  /** Number of cells along a dimension. */
+  int NumCells(int);
+  /** Write the cell contents to a checkpoint. The order of the beads within
+      a cell sets the order in which pair energies are summed, so it is kept
+      to continue a run bit for bit. */
+  void SaveState(ostream&);
+  /** Read the cell contents back. If they do not fit the current cells, the
+      list is built from the store instead. */
+  void LoadState(istream&, ParticleStore&);
+  /** Exchange the cell contents with another list of the same cells, along
+      with the particle stores they were built from. */
+  void SwapState(CellList&);
+
+}; 
+
+#endif
+
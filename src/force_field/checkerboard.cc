@@ -0,0 +1,221 @@
+#include "force_field.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+#include "../utilities/constants.h"
+
+// The checkerboard moves split the periodic dimensions of the box into
+// domains of whole pair cells, at least two cells and so at least one cutoff
+// wide, with an even number of domains along every split dimension. Wider
+// domains reject fewer moves for leaving the domain and hold longer chains. The
+// domains whose indices have the parity of the color of a pass are active.
+// Two active domains are then always separated by an inactive domain, so a
+// bead of one active domain cannot interact with a bead of another, and the
+// molecules of different active domains can be moved at the same time. The
+// grid is shifted by a random number of cells and the color is picked at
+// random for every pass, so that every position is moved in the long run.
+
+int ForceField::InitCheckerboard(double min_width) {
+  if (!use_pair_pot || use_ewald_pot || use_gc)  return 0;
+
+  int n_colors = 1;
+  for (int d = 0; d < 3; d++) {
+    int n_cell = pair_cells.NumCells(d);
+    int min_cells = max(2, (int)ceil(min_width * n_cell / box_l[d]));
+    n_domain[d] = 1;
+    if (d < npbc)  n_domain[d] = 2*(n_cell/(2*min_cells));
+    if (n_domain[d] < 2)  n_domain[d] = 1;
+    else                  n_colors *= 2;
+    cell_domain[d].resize(n_cell);
+    for (int c = 0; c < n_cell; c++) {
+      cell_domain[d][c] = c*n_domain[d]/n_cell;
+    }
+    domain_shift[d] = 0;
+  }
+  if (n_colors == 1)  return 0;
+  cout << setw(35) << "Checkerboard domains        : " << n_domain[0] << " x "
+       << n_domain[1] << " x " << n_domain[2] << ", " << n_colors
+       << " colors" << endl;
+
+  active_slot.assign(n_domain[0]*n_domain[1]*n_domain[2], -1);
+  parallel_moves.resize(pool.Size());
+
+  return n_colors;
+
+}
+
+int ForceField::CellDomain(int cell) {
+  int n1 = pair_cells.NumCells(1);
+  int n2 = pair_cells.NumCells(2);
+  int coord[3] = {cell/(n1*n2), (cell/n2) % n1, cell % n2};
+  int domain = 0;
+  for (int d = 0; d < 3; d++) {
+    int n_cell = pair_cells.NumCells(d);
+    int c = (coord[d] - domain_shift[d] + n_cell) % n_cell;
+    domain = domain*n_domain[d] + cell_domain[d][c];
+  }
+  return domain;
+
+}
+
+int ForceField::SortIntoDomains(vector<Molecule>& mols, int first,
+                                RandomGenerator& rand_gen,
+                                vector<vector<int> >& chains,
+                                vector<vector<int> >& ions) {
+  int color = 0;
+  for (int d = 0; d < 3; d++) {
+    domain_shift[d] = 0;
+    if (n_domain[d] > 1) {
+      domain_shift[d] = rand_gen() % pair_cells.NumCells(d);
+      color = 2*color + rand_gen() % 2;
+    }
+  }
+
+  // The domains whose indices along the split dimensions have the parities
+  // of the bits of the color.
+  active_domains.clear();
+  int bits[3] = {0, 0, 0};
+  for (int d = 2; d >= 0; d--) {
+    if (n_domain[d] > 1) {
+      bits[d] = color % 2;
+      color /= 2;
+    }
+  }
+  for (int i = bits[0]; i < n_domain[0]; i += 2) {
+    for (int j = bits[1]; j < n_domain[1]; j += 2) {
+      for (int k = bits[2]; k < n_domain[2]; k += 2) {
+        active_domains.push_back((i*n_domain[1] + j)*n_domain[2] + k);
+      }
+    }
+  }
+  int n_active = (int)active_domains.size();
+  fill(active_slot.begin(), active_slot.end(), -1);
+  for (int a = 0; a < n_active; a++) {
+    active_slot[active_domains[a]] = a;
+  }
+
+  domain_pair_dE.assign(n_active, 0);
+  domain_ext_dE.assign(n_active, 0);
+  domain_bond_dE.assign(n_active, 0);
+  chains.resize(n_active);
+  ions.resize(n_active);
+  for (int a = 0; a < n_active; a++) {
+    chains[a].clear();
+    ions[a].clear();
+  }
+  for (int m = first; m < (int)mols.size(); m++) {
+    int domain = CellDomain(pair_cells.CellIndex(particles,
+                                                 particles.Begin(m), 0));
+    for (int p = particles.Begin(m)+1; p < particles.End(m); p++) {
+      if (CellDomain(pair_cells.CellIndex(particles, p, 0)) != domain) {
+        domain = -1;
+        break;
+      }
+    }
+    if (domain < 0 || active_slot[domain] < 0)  continue;
+    if (mols[m].Size() > 1)  chains[active_slot[domain]].push_back(m);
+    else                     ions[active_slot[domain]].push_back(m);
+  }
+
+  return n_active;
+
+}
+
+double ForceField::ParallelEnergyDifference(vector<Molecule>& mols,
+                                            int moved_mol, int active,
+                                            int thread) {
+  ParallelMove& move = parallel_moves[thread];
+  move.pair.dE = 0;
+  move.pair.changed.clear();
+  move.ext_e.clear();
+  move.ext_dE = 0;
+  move.bond_dE = 0;
+
+  particles.LoadTrial(mols, moved_mol);
+  int domain = active_domains[active];
+  for (int p = particles.Begin(moved_mol); p < particles.End(moved_mol); p++) {
+    if (CellDomain(pair_cells.CellIndex(particles, p, 1)) != domain) {
+      return kVeryLargeEnergy;
+    }
+  }
+
+  if (hard_pair_pot && pair_pot->Overlaps(mols, particles, moved_mol, box_l,
+                                          npbc, pair_cells)) {
+    return kVeryLargeEnergy;
+  }
+  double dE = pair_pot->EnergyDifference(mols, particles, moved_mol, box_l,
+                                         npbc, pair_cells, move.pair);
+  if (dE >= kVeryLargeEnergy) {
+    return dE;
+  }
+  // The new external energies and the trial bond energies the potentials
+  // keep are shared by all threads, so the new energies are kept in the
+  // scratch until the decision.
+  if (use_ext_pot) {
+    for (int i = 0; i < mols[moved_mol].Size(); i++) {
+      Bead& bead = mols[moved_mol].bds[i];
+      if (!bead.GetMoved())  continue;
+      double energy = ext_pot->BeadEnergy(bead, box_l);
+      if (energy >= kVeryLargeEnergy) {
+        return kVeryLargeEnergy;
+      }
+      move.ext_e.push_back(energy);
+      move.ext_dE += energy - ext_pot->GetE(bead.ID());
+    }
+    dE += move.ext_dE;
+  }
+  if (use_bond_pot && mols[moved_mol].Size() > 1) {
+    move.bond_e = bond_pot->MoleculeEnergy(mols[moved_mol], box_l, npbc);
+    move.bond_dE = move.bond_e - bond_pot->GetE(0, moved_mol);
+    dE += move.bond_dE;
+  }
+
+  return dE;
+
+}
+
+void ForceField::ParallelFinalize(vector<Molecule>& mols, int moved_mol,
+                                  bool accept, int active, int thread) {
+  ParallelMove& move = parallel_moves[thread];
+  if (accept)  particles.Accept(moved_mol);
+  else         particles.Reject(moved_mol);
+  pair_pot->FinalizeMove(move.pair, accept);
+  if (!accept)  return;
+
+  pair_cells.Update(particles, moved_mol);
+  domain_pair_dE[active] += move.pair.dE;
+  if (use_ext_pot) {
+    int n = 0;
+    for (int i = 0; i < mols[moved_mol].Size(); i++) {
+      Bead& bead = mols[moved_mol].bds[i];
+      if (!bead.GetMoved())  continue;
+      ext_pot->SetE(bead.ID(), move.ext_e[n]);
+      n++;
+    }
+    domain_ext_dE[active] += move.ext_dE;
+  }
+  if (use_bond_pot && mols[moved_mol].Size() > 1) {
+    bond_pot->SetE(0, moved_mol, move.bond_e);
+    bond_pot->SetE(1, moved_mol, move.bond_e);
+    domain_bond_dE[active] += move.bond_dE;
+  }
+
+}
+
+void ForceField::CommitParallelMoves() {
+  for (int a = 0; a < (int)active_domains.size(); a++) {
+    pair_pot->AddEnergy(domain_pair_dE[a]);
+    if (use_ext_pot)   ext_pot->AddEnergy(domain_ext_dE[a]);
+    if (use_bond_pot)  bond_pot->AddEnergy(domain_bond_dE[a]);
+  }
+
+}
+
+ThreadPool& ForceField::Pool() {
+  return pool;
+
+}
+
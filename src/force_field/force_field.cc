@@ -1,11 +1,15 @@
 #include "force_field.h" 
 
+#include <cmath>
 #include <iomanip>
 #include <sstream>
+#include <utility>
 
+#include "../utilities/binary_io.h"
 #include "../utilities/constants.h"
 #include "../utilities/misc.h"
 #include "potential_ewald_coul.h"
+#include "potential_ewald_pme.h"
 #include "potential_hard_sphere.h"
 #include "potential_hard_wall.h"
 #include "potential_spring.h"
@@ -21,7 +25,6 @@ ForceField::ForceField () {
 
 ForceField::~ForceField () {
   delete [] gc_chain_chg;
-  delete [] cbmc_trial_weights;
   
   if (!use_ext_pot) {
     delete [] vp_hs_g;
@@ -46,7 +49,7 @@ ForceField::~ForceField () {
 void ForceField::Initialize(double beta_in, int npbc_in, double box_l_in[3],
                             vector<Molecule>& mols, int phantom_in,
                             int coion_in, int grafted_in,
-                            int grafted_counterion_in) {
+                            int grafted_counterion_in, bool compute_energy) {
   // Initial setting up.
   beta = beta_in;
   npbc = npbc_in;
@@ -93,6 +96,11 @@ void ForceField::Initialize(double beta_in, int npbc_in, double box_l_in[3],
   cin >> flag >> use_gc;
   cout << setw(35) << "Use grand canonical MC?     : " << YesOrNo(use_gc)
        << endl;
+  n_threads = 1;
+  ReadOptional(cin, "s2_number_of_threads", n_threads);
+  if (n_threads < 1)  n_threads = 1;
+  cout << setw(35) << "Number of threads           : " << n_threads << endl;
+  pool.Start(n_threads);
   if (use_gc) {
     cin >> flag >> chem_pot
         >> flag >> gc_deBroglie_prefactor
@@ -101,6 +109,8 @@ void ForceField::Initialize(double beta_in, int npbc_in, double box_l_in[3],
         >> flag >> gc_bead_charge
         >> flag >> gc_bead_symbol 
         >> flag >> cbmc_no_of_trials;
+    // Register the type before the potentials build their tables.
+    BeadTypeID(gc_bead_symbol);
     cout << setw(35) << "[GC] Chemical pot (kBT)     : " << chem_pot << endl; 
     cout << setw(35) << "[GC] de Broglie wavelength^3: "
          << gc_deBroglie_prefactor << endl;
@@ -119,6 +129,8 @@ void ForceField::Initialize(double beta_in, int npbc_in, double box_l_in[3],
   string potential_name;
   int hard_pot = 0;
   int soft_pot = 0;
+  hard_pair_pot = false;
+  hard_ext_pot = false;
   // Pair potential.
   if (use_pair_pot) {
     cin >> flag >> potential_name;
@@ -128,6 +140,7 @@ void ForceField::Initialize(double beta_in, int npbc_in, double box_l_in[3],
     }
     else if (potential_name == "HardSphere") {
       hard_pot++;
+      hard_pair_pot = true;
       pair_pot = new PotentialHardSphere(potential_name);
       //CoordinateObeyRigidBond(mols);
     }
@@ -139,10 +152,23 @@ void ForceField::Initialize(double beta_in, int npbc_in, double box_l_in[3],
   }
   // Ewald potential.
   if (use_ewald_pot) {
+    // The number of charges is used when alpha is tuned automatically.
+    int n_charges = 0;
+    for (int i = 0; i < (int)mols.size(); i++) {
+      for (int j = 0; j < mols[i].Size(); j++) {
+        if (mols[i].bds[j].Charge() != 0)  n_charges++;
+      }
+    }
     cin >> flag >> potential_name;
     if (potential_name == "Coul") {
       soft_pot++;
-      ewald_pot = new PotentialEwaldCoul(potential_name, box_l); 
+      ewald_pot = new PotentialEwaldCoul(potential_name, box_l, n_charges,
+                                         n_threads); 
+    }
+    else if (potential_name == "PME") {
+      soft_pot++;
+      ewald_pot = new PotentialEwaldPME(potential_name, box_l, n_charges,
+                                        n_threads);
     }
     else {
       cout << "ForceField::ReadParameters: " << endl;
@@ -179,10 +205,12 @@ void ForceField::Initialize(double beta_in, int npbc_in, double box_l_in[3],
     }
     else if (potential_name == "HardWall") {
       hard_pot++;
+      hard_ext_pot = true;
       ext_pot = new PotentialHardWall(potential_name);
     }
     else if (potential_name == "WellWall") {
       hard_pot++;
+      hard_ext_pot = true;
       cout << "  Note: Currently, no correct pressure calculation" << endl;
       cout << "        routine exists for well wall potential." << endl;
       ext_pot = new PotentialWellWall(potential_name);
@@ -358,64 +386,152 @@ void ForceField::Initialize(double beta_in, int npbc_in, double box_l_in[3],
   }
   // Pressure init end.
 
-  InitializeEnergy(mols);
+  InitializeEnergy(mols, compute_energy);
 
 }
 
-void ForceField::InitializeEnergy(vector<Molecule>& mols) {
+void ForceField::InitializeEnergy(vector<Molecule>& mols, bool compute_energy) {
+  particles.Build(mols);
   if (use_pair_pot) {
-    pair_pot->EnergyInitialization(mols, box_l, this->npbc); 
-    cout << "  Initialized pair potential." << endl;
+    pair_cells.Initialize(box_l, this->npbc, pair_pot->Cutoff());
+    pair_cells.Build(particles);
   }
   if (use_ewald_pot) {
-    ewald_pot->EnergyInitialization(mols, this->npbc); 
-    cout << "  Initialized Ewald potential." << endl;
+    ewald_pot->InitializeRealCells(ewald_cells);
+    ewald_cells.Build(particles);
   }
-  if (use_bond_pot) {
-    bond_pot->EnergyInitialization(mols, box_l, this->npbc);
-    cout << "  Initialized bond potential." << endl;
-  }
-  if (use_ext_pot) {
-    ext_pot->EnergyInitialization(mols, box_l, this->npbc);
-    cout << "  Initialized external potential." << endl; 
+  if (compute_energy) {
+    ComputeEnergies(mols);
   }
 
   // Add beads to CG CBMC data structures. Proper IDs are not assigned at this
   // stage since the beads are not yet in the simulation.
   for (int i = 0; i < gc_chain_len; i++) {
     Bead bead(gc_bead_symbol, -1, -1, gc_chain_chg[i], 0, 0, 0);
-    cbmc_chain.push_back(bead);
+    cbmc.chain.push_back(bead);
   }
   for (int i = 0; i < cbmc_no_of_trials; i++) {
     Bead bead(gc_bead_symbol, -1, -1, gc_chain_chg[0], 0, 0, 0);
-    cbmc_trial_beads.push_back(bead);
+    cbmc.trial_beads.push_back(bead);
   }
   // Add counterions into array in case the chain is charged.
   for (int i = 0; i < gc_chain_len; i++) {
     Bead bead(gc_bead_symbol, -1, -1, -gc_chain_chg[i], 0, 0, 0);
-    cbmc_chain.push_back(bead);
+    cbmc.chain.push_back(bead);
   }
   for (int i = 0; i < cbmc_no_of_trials; i++) {
     Bead bead(gc_bead_symbol, -1, -1, -gc_chain_chg[0], 0, 0, 0);
-    cbmc_trial_beads.push_back(bead);
+    cbmc.trial_beads.push_back(bead);
   }
   // Will be initialized in other functions before use.
-  cbmc_trial_weights = new double[cbmc_no_of_trials];
+  cbmc.trial_weights.resize(cbmc_no_of_trials);
+  // Every thread grows its own Widom test chains.
+  widom_growths.assign(n_threads, cbmc);
+  store_pair_e.resize(2*n_threads);
+
+}
+
+// Same as ComputeEnergies, without its progress messages, which would repeat
+// for every replica exchange.
+void ForceField::ReplaceSystem(vector<Molecule>& mols) {
+  UpdateMolCounts(mols);
+  particles.Build(mols);
+  if (use_pair_pot) {
+    pair_cells.Build(particles);
+    pair_pot->EnergyInitialization(mols, box_l, this->npbc);
+  }
+  if (use_ewald_pot) {
+    ewald_cells.Build(particles);
+    ewald_pot->EnergyInitialization(mols, this->npbc);
+  }
+  if (use_bond_pot)  bond_pot->EnergyInitialization(mols, box_l, this->npbc);
+  if (use_ext_pot)   ext_pot->EnergyInitialization(mols, box_l, this->npbc);
+
+}
+
+void ForceField::SwapSystem(ForceField& other, vector<Molecule>& mols,
+                            vector<Molecule>& other_mols) {
+  UpdateMolCounts(mols);
+  other.UpdateMolCounts(other_mols);
+  swap(particles, other.particles);
+  if (use_pair_pot) {
+    pair_cells.SwapState(other.pair_cells);
+    pair_pot->SwapState(*other.pair_pot);
+  }
+  if (use_ewald_pot) {
+    ewald_cells.SwapState(other.ewald_cells);
+    if (SameEwaldSums(other)) {
+      ewald_pot->SwapState(*other.ewald_pot);
+    }
+    else {
+      ewald_pot->EnergyInitialization(mols, this->npbc);
+      other.ewald_pot->EnergyInitialization(other_mols, other.npbc);
+    }
+  }
+  if (use_bond_pot)  bond_pot->SwapState(*other.bond_pot);
+  if (use_ext_pot)   ext_pot->SwapState(*other.ext_pot);
+
+}
+
+bool ForceField::SameEwaldSums(ForceField& other) {
+  if (!use_ewald_pot)  return true;
+  return ewald_pot->SameSums(*other.ewald_pot);
+
+}
+
+void ForceField::ComputeEnergies(vector<Molecule>& mols) {
+  if (use_pair_pot) {
+    pair_pot->EnergyInitialization(mols, box_l, this->npbc); 
+    cout << "  Initialized pair potential." << endl;
+  }
+  if (use_ewald_pot) {
+    ewald_pot->EnergyInitialization(mols, this->npbc); 
+    cout << "  Initialized Ewald potential." << endl;
+  }
+  if (use_bond_pot) {
+    bond_pot->EnergyInitialization(mols, box_l, this->npbc);
+    cout << "  Initialized bond potential." << endl;
+  }
+  if (use_ext_pot) {
+    ext_pot->EnergyInitialization(mols, box_l, this->npbc);
+    cout << "  Initialized external potential." << endl; 
+  }
 
 }
 
 double ForceField::EnergyDifference(vector<Molecule>& mols, int moved_mol) {
   double dE = 0;
+  particles.LoadTrial(mols, moved_mol);
   // In case we use hard potentials for pair_pot and ext_pot, we can return
-  // energy early if there are collisions.
+  // energy early if there are collisions. A hard wall only needs the moved
+  // beads, so it goes first, and hard spheres are checked for an overlap
+  // before any pair energy is stored.
+  if (use_ext_pot && hard_ext_pot) {
+    Timing::Clock::time_point start = timing.Start();
+    dE += ext_pot->EnergyDifference(mols, moved_mol, box_l, npbc);
+    timing.Stop(kTimeExt, start);
+    if (dE >= kVeryLargeEnergy) {
+      return dE;
+    }
+  }
   if (use_pair_pot) {
-    dE += pair_pot->EnergyDifference(mols, moved_mol, box_l, npbc);
+    Timing::Clock::time_point start = timing.Start();
+    if (hard_pair_pot && pair_pot->Overlaps(mols, particles, moved_mol, box_l,
+                                            npbc, pair_cells)) {
+      timing.Stop(kTimePair, start);
+      return kVeryLargeEnergy;
+    }
+    dE += pair_pot->EnergyDifference(mols, particles, moved_mol, box_l, npbc,
+                                     pair_cells);
+    timing.Stop(kTimePair, start);
     if (dE >= kVeryLargeEnergy) {
       return dE;
     }
   }
-  if (use_ext_pot) {
+  if (use_ext_pot && !hard_ext_pot) {
+    Timing::Clock::time_point start = timing.Start();
     dE += ext_pot->EnergyDifference(mols, moved_mol, box_l, npbc);
+    timing.Stop(kTimeExt, start);
     if (dE >= kVeryLargeEnergy) {
       return dE;
     }
@@ -423,10 +539,15 @@ double ForceField::EnergyDifference(vector<Molecule>& mols, int moved_mol) {
 
   // We do not use hard potentials for these.
   if (use_ewald_pot) {
-    dE += ewald_pot->EnergyDifference(mols, moved_mol, npbc);
+    Timing::Clock::time_point start = timing.Start();
+    dE += ewald_pot->EnergyDifference(mols, particles, moved_mol, npbc,
+                                      ewald_cells);
+    timing.Stop(kTimeEwald, start);
   }
   if (use_bond_pot) {
+    Timing::Clock::time_point start = timing.Start();
     dE += bond_pot->EnergyDifference(mols, box_l, npbc, moved_mol);
+    timing.Stop(kTimeBond, start);
   }
 
   return dE;
@@ -435,17 +556,21 @@ double ForceField::EnergyDifference(vector<Molecule>& mols, int moved_mol) {
 
 void ForceField::FinalizeEnergies(vector<Molecule>& mols, bool accept,
                                   int moved_mol) {
+  if (accept)  particles.Accept(moved_mol);
+  else         particles.Reject(moved_mol);
   if (use_pair_pot) {
-    pair_pot->FinalizeEnergyBothMaps(mols, moved_mol, accept);
+    pair_pot->FinalizeEnergy(accept);
+    if (accept)  pair_cells.Update(particles, moved_mol);
   }
   if (use_ewald_pot) {
-    ewald_pot->FinalizeEnergyBothMaps(mols, moved_mol, accept);
+    ewald_pot->FinalizeEnergy(accept);
+    if (accept)  ewald_cells.Update(particles, moved_mol);
   }
   if (use_bond_pot) {
     bond_pot->FinalizeEnergy(moved_mol, accept);
   }
   if (use_ext_pot) {
-    ext_pot->FinalizeEnergyBothMaps(mols, moved_mol, accept);
+    ext_pot->FinalizeEnergy(accept);
   }
 
 }
@@ -717,6 +842,18 @@ void ForceField::CalcPressureVirialEL(vector<Molecule>& mols) {
 
 }
 
+void ForceField::StorePairEnergies(Bead& bead, vector<double>& energy) {
+  double pos[3];
+  for (int i = 0; i < 3; i++) {
+    pos[i] = bead.GetCrd(1, i);
+  }
+  int n = particles.Size();
+  energy.resize(n);
+  pair_pot->PairEnergyBatch(pos, bead.Type(), particles.Span(0, n), box_l, npbc,
+                            energy.data());
+
+}
+
 double ForceField::BeadEnergy(Bead& bead, vector<Molecule>& mols,
                               int current_len, int delete_id, int type) {
   double energy = 0;
@@ -724,11 +861,13 @@ double ForceField::BeadEnergy(Bead& bead, vector<Molecule>& mols,
   if (gc_bead_charge != 0)  counterion = gc_chain_len;
 
   // Pairwise interactions for the bead with other molecules.
-  for (int i = 0; i < (int)mols.size(); i++) {
-    if (delete_id == -1 || (i < delete_id || i > delete_id + counterion)) {
-      for (int j = 0; j < mols[i].Size(); j++) {
-        if (use_pair_pot) {
-          energy += pair_pot->PairEnergy(bead, mols[i].bds[j], box_l, npbc);
+  if (use_pair_pot) {
+    vector<double>& pair_e = store_pair_e[0];
+    StorePairEnergies(bead, pair_e);
+    for (int i = 0; i < (int)mols.size(); i++) {
+      if (delete_id == -1 || (i < delete_id || i > delete_id + counterion)) {
+        for (int j = particles.Begin(i); j < particles.End(i); j++) {
+          energy += pair_e[j];
         }
       }
     }
@@ -737,7 +876,7 @@ double ForceField::BeadEnergy(Bead& bead, vector<Molecule>& mols,
   for (int i = 0; i < current_len; i++) {
     if (i < current_len-1 || type == 1) {
       if (use_pair_pot) {
-        energy += pair_pot->PairEnergy(bead, cbmc_chain[i], box_l, npbc);
+        energy += pair_pot->PairEnergy(bead, cbmc.chain[i], box_l, npbc);
       }
     }
   }
@@ -760,7 +899,7 @@ double ForceField::BeadEnergy(Bead& bead, vector<Molecule>& mols,
  * type    : the identity of the bead to be added, 0 for chain, 1 for ion.
  */
 double ForceField::CBMCGenTrialBeads(Bead& end_bead, vector<Molecule>& mols,
-                                     int current_len, mt19937& rand_gen,
+                                     int current_len, RandomGenerator& rand_gen,
                                      int delete_id, int type) {
   double Wi = 0;
 
@@ -793,26 +932,26 @@ double ForceField::CBMCGenTrialBeads(Bead& end_bead, vector<Molecule>& mols,
     }
     // If counterion, grow randomly in box.
     else {
-      bead_coord[0] = (double)rand_gen()/rand_gen.max() * box_l[0];
-      bead_coord[1] = (double)rand_gen()/rand_gen.max() * box_l[1];
-      bead_coord[2] = (double)rand_gen()/rand_gen.max() * box_l[2];
+      bead_coord[0] = rand_gen.Uniform() * box_l[0];
+      bead_coord[1] = rand_gen.Uniform() * box_l[1];
+      bead_coord[2] = rand_gen.Uniform() * box_l[2];
     }
-    cbmc_trial_beads[index].SetAllCrd(bead_coord);
+    cbmc.trial_beads[index].SetAllCrd(bead_coord);
 
     //////////////////////////////
     // Calculating bead energy. //
     //////////////////////////////
-    double bead_energy = BeadEnergy(cbmc_trial_beads[index], mols, current_len,
+    double bead_energy = BeadEnergy(cbmc.trial_beads[index], mols, current_len,
                                     delete_id, type);
-    cbmc_trial_weights[i] = exp(-beta * bead_energy);    
-    Wi += cbmc_trial_weights[i];
+    cbmc.trial_weights[i] = exp(-beta * bead_energy);    
+    Wi += cbmc.trial_weights[i];
   }
 
   return Wi;
 
 }
 
-bool ForceField::CBMCChainInsertion(vector<Molecule>& mols, mt19937& rand_gen) {
+bool ForceField::CBMCChainInsertion(vector<Molecule>& mols, RandomGenerator& rand_gen) {
   bool accept = false;
   double weight = 1.0;
 
@@ -821,9 +960,9 @@ bool ForceField::CBMCChainInsertion(vector<Molecule>& mols, mt19937& rand_gen) {
   ///////////////////
   double xyz[3];
   for (int i = 0; i < 3; i++)
-    xyz[i] = (double)rand_gen() / rand_gen.max() * box_l[i];
-  cbmc_chain[0].SetAllCrd(xyz);
-  weight *= exp(-beta * BeadEnergy(cbmc_chain[0], mols, 0, -1, 0));
+    xyz[i] = rand_gen.Uniform() * box_l[i];
+  cbmc.chain[0].SetAllCrd(xyz);
+  weight *= exp(-beta * BeadEnergy(cbmc.chain[0], mols, 0, -1, 0));
 
   ////////////////////
   // Grow the rest. //
@@ -834,20 +973,20 @@ bool ForceField::CBMCChainInsertion(vector<Molecule>& mols, mt19937& rand_gen) {
   int type = 0;  // 0 means chain, 1 means counterion; starts with chain.
   for (int i = 1; i < toadd && weight > 0; i++) {
     if (i >= gc_chain_len)  type = 1;
-    double Wi = CBMCGenTrialBeads(cbmc_chain[i-1], mols, i, rand_gen, -1, type);
+    double Wi = CBMCGenTrialBeads(cbmc.chain[i-1], mols, i, rand_gen, -1, type);
     weight *= Wi/cbmc_no_of_trials;
-    double rand_num = (double)rand_gen() / rand_gen.max() * Wi;
+    double rand_num = rand_gen.Uniform() * Wi;
     int current_bead = 0;
-    double cumulate_weight = cbmc_trial_weights[0];
+    double cumulate_weight = cbmc.trial_weights[0];
     while (cumulate_weight < rand_num) {
       current_bead++;
-      cumulate_weight += cbmc_trial_weights[current_bead];
+      cumulate_weight += cbmc.trial_weights[current_bead];
     }
     if (type == 1)  current_bead += cbmc_no_of_trials; 
-    xyz[0] = cbmc_trial_beads[current_bead].GetCrd(0, 0);
-    xyz[1] = cbmc_trial_beads[current_bead].GetCrd(0, 1);
-    xyz[2] = cbmc_trial_beads[current_bead].GetCrd(0, 2);
-    cbmc_chain[i].SetAllCrd(xyz);
+    xyz[0] = cbmc.trial_beads[current_bead].GetCrd(0, 0);
+    xyz[1] = cbmc.trial_beads[current_bead].GetCrd(0, 1);
+    xyz[2] = cbmc.trial_beads[current_bead].GetCrd(0, 2);
+    cbmc.chain[i].SetAllCrd(xyz);
   }
 
   ////////////////////////////////
@@ -855,7 +994,8 @@ bool ForceField::CBMCChainInsertion(vector<Molecule>& mols, mt19937& rand_gen) {
   ////////////////////////////////
   double dE = 0;
   if (use_ewald_pot)
-    dE = ewald_pot->TrialChainEnergy(mols, cbmc_chain, toadd, -1, npbc);
+    dE = ewald_pot->TrialChainEnergy(mols, cbmc.chain, toadd, -1, npbc,
+                                     particles, ewald_cells);
 
   //////////////////////////////////
   // Decide acceptance/rejection. //
@@ -884,12 +1024,12 @@ bool ForceField::CBMCChainInsertion(vector<Molecule>& mols, mt19937& rand_gen) {
   vol_over_lam *= pow(vol/(gc_deBroglie_prefactor/pow(m2, 1.5)), spc2_add);
   double C = vol_over_lam * (1.0/(double)factorial);
 
-  double rand_num = (double)rand_gen() / rand_gen.max();
+  double rand_num = rand_gen.Uniform();
   if (rand_num < (exp(beta*chem_pot - beta*dE) * weight) * C) {
     accept = true; 
     mols.push_back(Molecule());
     for (int i = 0; i < gc_chain_len; i++) {
-      mols[(int)mols.size() - 1].AddBead(cbmc_chain[i]); 
+      mols[(int)mols.size() - 1].AddBead(cbmc.chain[i]); 
     }
     // Add bonds to the new chain ASSUMING LINEAR MOLECULE!
     for (int i = 0; i < mols[(int)mols.size() - 1].Size()-1; i++) {
@@ -898,7 +1038,7 @@ bool ForceField::CBMCChainInsertion(vector<Molecule>& mols, mt19937& rand_gen) {
     // Add counterions.
     for (int i = gc_chain_len; i < toadd; i++) {
       mols.push_back(Molecule());
-      mols[(int)mols.size() - 1].AddBead(cbmc_chain[i]);
+      mols[(int)mols.size() - 1].AddBead(cbmc.chain[i]);
     }
   }
 
@@ -909,14 +1049,14 @@ bool ForceField::CBMCChainInsertion(vector<Molecule>& mols, mt19937& rand_gen) {
 
 }
 
-int ForceField::CBMCChainDeletion(vector<Molecule>& mols, mt19937& rand_gen) {
+int ForceField::CBMCChainDeletion(vector<Molecule>& mols, RandomGenerator& rand_gen) {
   UpdateMolCounts(mols);
   int spc1;
   if      (gc_chain_len   >  1)  spc1 = n_chain;
   else if (gc_bead_charge >= 0)  spc1 = n_cion;
   else                           spc1 = n_aion;
 
-  int delete_id = floor((double)rand_gen()/rand_gen.max() * spc1);
+  int delete_id = floor(rand_gen.Uniform() * spc1);
   if (delete_id >= (int)mols.size())  delete_id = (int)mols.size()-1;
   if (gc_bead_charge != 0)
     delete_id = delete_id * (1+gc_chain_len);
@@ -931,7 +1071,7 @@ int ForceField::CBMCChainDeletion(vector<Molecule>& mols, mt19937& rand_gen) {
   double xyz[3] = {mols[delete_id].bds[0].GetCrd(0, 0),
                    mols[delete_id].bds[0].GetCrd(0, 1),
                    mols[delete_id].bds[0].GetCrd(0, 2)};
-  cbmc_chain[0].SetAllCrd(xyz);
+  cbmc.chain[0].SetAllCrd(xyz);
 
   ////////////////////
   // Grow the rest. //
@@ -953,14 +1093,14 @@ int ForceField::CBMCChainDeletion(vector<Molecule>& mols, mt19937& rand_gen) {
       xyz[1] = mols[shift_id].bds[0].GetCrd(0, 1);
       xyz[2] = mols[shift_id].bds[0].GetCrd(0, 2);
     }
-    cbmc_chain[i].SetAllCrd(xyz);
+    cbmc.chain[i].SetAllCrd(xyz);
 
-    CBMCGenTrialBeads(cbmc_chain[i-1], mols, i, rand_gen, delete_id, type);
-    cbmc_trial_weights[0] = exp(-beta * BeadEnergy(cbmc_chain[i], mols, i,
+    CBMCGenTrialBeads(cbmc.chain[i-1], mols, i, rand_gen, delete_id, type);
+    cbmc.trial_weights[0] = exp(-beta * BeadEnergy(cbmc.chain[i], mols, i,
                             delete_id, type));
     double Wi = 0;
     for(int j = 0; j < cbmc_no_of_trials; j++) {
-      Wi += cbmc_trial_weights[j];
+      Wi += cbmc.trial_weights[j];
     }
     weight *= Wi/cbmc_no_of_trials;
   }
@@ -970,7 +1110,8 @@ int ForceField::CBMCChainDeletion(vector<Molecule>& mols, mt19937& rand_gen) {
   ////////////////////////////////
   double dE = 0;
   if (use_ewald_pot)
-    dE = ewald_pot->TrialChainEnergy(mols, cbmc_chain, toadd, delete_id, npbc);
+    dE = ewald_pot->TrialChainEnergy(mols, cbmc.chain, toadd, delete_id, npbc,
+                                     particles, ewald_cells);
 
   //////////////////////////////////
   // Decide acceptance/rejection. //
@@ -993,7 +1134,7 @@ int ForceField::CBMCChainDeletion(vector<Molecule>& mols, mt19937& rand_gen) {
   lam_over_vol *= pow((gc_deBroglie_prefactor/pow(m1, 1.5))/vol, spc1_del);
   lam_over_vol *= pow((gc_deBroglie_prefactor/pow(m2, 1.5))/vol, spc2_del);
   double C = lam_over_vol * (double)factorial;
-  double rand_num = (double)rand_gen() / rand_gen.max();
+  double rand_num = rand_gen.Uniform();
 
   if (rand_num < C / (exp(beta*chem_pot - beta*dE) * weight)) {
     if (use_pair_pot) {
@@ -1003,7 +1144,7 @@ int ForceField::CBMCChainDeletion(vector<Molecule>& mols, mt19937& rand_gen) {
       ewald_pot->AdjustEnergyUponMolDeletion(mols, delete_id);
     }
     if (use_bond_pot) {
-      bond_pot->AdjustEnergyUponMolDeletion(delete_id); 
+      bond_pot->AdjustEnergyUponMolDeletion(mols, delete_id); 
     }
     if (use_ext_pot) {
       ext_pot->AdjustEnergyUponMolDeletion(mols, delete_id); 
@@ -1017,7 +1158,7 @@ int ForceField::CBMCChainDeletion(vector<Molecule>& mols, mt19937& rand_gen) {
 }
 
 double ForceField::CalcChemicalPotential(vector<Molecule>& mols,
-                                         mt19937& rand_gen) {
+                                         RandomGenerator& rand_gen) {
   double total = 0;
 
   int spc1;
@@ -1051,32 +1192,33 @@ double ForceField::CalcChemicalPotential(vector<Molecule>& mols,
     double weight = 1.0;
 
     for (int i = 0; i < 3; i++)
-      xyz[i] = (double)rand_gen() / rand_gen.max() * box_l[i];
-    cbmc_chain[0].SetAllCrd(xyz);
-    weight *= exp(-beta * BeadEnergy(cbmc_chain[0], mols, 0, -1, 0));
+      xyz[i] = rand_gen.Uniform() * box_l[i];
+    cbmc.chain[0].SetAllCrd(xyz);
+    weight *= exp(-beta * BeadEnergy(cbmc.chain[0], mols, 0, -1, 0));
   
     int type = 0;
     for (int i = 1; i < toadd && weight > 0; i++) {
       if (i >= gc_chain_len)  type = 1;
-      double Wi = CBMCGenTrialBeads(cbmc_chain[i-1], mols, i, rand_gen, -1, type);
+      double Wi = CBMCGenTrialBeads(cbmc.chain[i-1], mols, i, rand_gen, -1, type);
       weight *= Wi/cbmc_no_of_trials;
-      double rand_num = (double)rand_gen() / rand_gen.max() * Wi;
+      double rand_num = rand_gen.Uniform() * Wi;
       int current_bead = 0;
-      double cumulate_weight = cbmc_trial_weights[0];
+      double cumulate_weight = cbmc.trial_weights[0];
       while (cumulate_weight < rand_num) {
         current_bead++;
-        cumulate_weight += cbmc_trial_weights[current_bead];
+        cumulate_weight += cbmc.trial_weights[current_bead];
       }
       if (type == 1)  current_bead += cbmc_no_of_trials;
-      xyz[0] = cbmc_trial_beads[current_bead].GetCrd(0, 0);
-      xyz[1] = cbmc_trial_beads[current_bead].GetCrd(0, 1);
-      xyz[2] = cbmc_trial_beads[current_bead].GetCrd(0, 2);
-      cbmc_chain[i].SetAllCrd(xyz);
+      xyz[0] = cbmc.trial_beads[current_bead].GetCrd(0, 0);
+      xyz[1] = cbmc.trial_beads[current_bead].GetCrd(0, 1);
+      xyz[2] = cbmc.trial_beads[current_bead].GetCrd(0, 2);
+      cbmc.chain[i].SetAllCrd(xyz);
     }
   
     double dE = 0;
     if (use_ewald_pot)
-      dE = ewald_pot->TrialChainEnergy(mols, cbmc_chain, toadd, -1, npbc);
+      dE = ewald_pot->TrialChainEnergy(mols, cbmc.chain, toadd, -1, npbc,
+                                       particles, ewald_cells);
  
     total += (exp(-beta*dE)*weight) * C;
   }
@@ -1086,6 +1228,11 @@ double ForceField::CalcChemicalPotential(vector<Molecule>& mols,
 }
 
 void ForceField::EnergyInitForAddedMolecule(vector<Molecule>& mols) {
+  int first = particles.Size();
+  particles.Append(mols);
+  if (use_pair_pot)   pair_cells.AddParticles(particles, first);
+  if (use_ewald_pot)  ewald_cells.AddParticles(particles, first);
+
   if (use_pair_pot) {
     pair_pot->EnergyInitForLastMol(mols, gc_chain_len, gc_bead_charge,
                                    box_l, npbc);
@@ -1095,7 +1242,8 @@ void ForceField::EnergyInitForAddedMolecule(vector<Molecule>& mols) {
                                     npbc);
   }
   if (use_bond_pot) {
-    bond_pot->EnergyInitForLastMol(mols, box_l, npbc);
+    bond_pot->EnergyInitForLastMol(mols, gc_chain_len, gc_bead_charge,
+                                   box_l, npbc);
   }
   if (use_ext_pot) {
     ext_pot->EnergyInitForLastMol(mols, gc_chain_len, gc_bead_charge,
@@ -1138,12 +1286,12 @@ void ForceField::CoordinateObeyRigidBond(vector<Molecule>& mols) {
 
 double ForceField::EnsureGrafting(vector<Molecule>& mols, int mol_id) {
   for (int i = 0; i < mols[mol_id].Size(); i++) {
-    if (mols[mol_id].bds[i].Symbol() == "L" &&
+    if (mols[mol_id].bds[i].IsLeftGraft() &&
         abs(mols[mol_id].bds[i].GetCrd(1, 0) - 0) > rigid_bond &&
         abs(mols[mol_id].bds[i].GetCrd(1, 1) - 0) > rigid_bond &&
         abs(mols[mol_id].bds[i].GetCrd(1, 2) - 0) > rigid_bond)
       return kVeryLargeEnergy;
-    else if (mols[mol_id].bds[i].Symbol() == "R" &&
+    else if (mols[mol_id].bds[i].IsRightGraft() &&
              abs(mols[mol_id].bds[i].GetCrd(1, 0) - 0) > rigid_bond &&
              abs(mols[mol_id].bds[i].GetCrd(1, 1) - 0) > rigid_bond &&
              abs(mols[mol_id].bds[i].GetCrd(1, 2) - box_l[2]) > rigid_bond)
@@ -1159,11 +1307,21 @@ int ForceField::GCFrequency() {
 
 }
 
+double ForceField::ChemPot() {
+  return chem_pot;
+
+}
+
 bool ForceField::UseGC() {
   return use_gc;
 
 }
 
+Timing& ForceField::HotPathTiming() {
+  return timing;
+
+}
+
 bool ForceField::UsePairPot() {
   return use_pair_pot;
 
@@ -1218,6 +1376,14 @@ double ForceField::TotExtEnergy() {
 
 }
 
+double ForceField::BjerrumLength() {
+  if (use_ewald_pot)
+    return ewald_pot->GetlB();
+  else
+    return 0;
+
+}
+
 double ForceField::RigidBondLen() {
   return rigid_bond;
 
@@ -1231,11 +1397,14 @@ void ForceField::GetEwaldEnergyComponents(vector<Molecule>& mols, double *out) {
   for (int i = 0; i < (int)mols.size(); i++) {
     for (int j = i; j < (int)mols.size(); j++) {
       if (mols[i].bds[0].Charge() > 0 && mols[j].bds[0].Charge() > 0)
-        cc += ewald_pot->GetERealRepl(0, mols[i].bds[0].ID(), mols[j].bds[0].ID()); 
+        cc += ewald_pot->GetEReal(mols[i].bds[0].ID(), mols[j].bds[0].ID())
+              + ewald_pot->PairEnergyRepl(mols[i].bds[0], mols[j].bds[0], npbc); 
       if (mols[i].bds[0].Charge() < 0 && mols[j].bds[0].Charge() < 0)
-        aa += ewald_pot->GetERealRepl(0, mols[i].bds[0].ID(), mols[j].bds[0].ID());
+        aa += ewald_pot->GetEReal(mols[i].bds[0].ID(), mols[j].bds[0].ID())
+              + ewald_pot->PairEnergyRepl(mols[i].bds[0], mols[j].bds[0], npbc);
       if (mols[i].bds[0].Charge() != mols[j].bds[0].Charge())
-        ca += ewald_pot->GetERealRepl(0, mols[i].bds[0].ID(), mols[j].bds[0].ID());
+        ca += ewald_pot->GetEReal(mols[i].bds[0].ID(), mols[j].bds[0].ID())
+              + ewald_pot->PairEnergyRepl(mols[i].bds[0], mols[j].bds[0], npbc);
     }
   }
   cout << cc << " " << aa << " " << ca << " " << cc+aa+ca << endl;
@@ -1276,6 +1445,46 @@ void ForceField::UpdateMolCounts(vector<Molecule>& mols) {
 
 }
 
+// The last molecules are moved into the gap, so that only the removed and the
+// moved beads are touched. Only when the two ranges overlap are the molecules
+// after the gap shifted down instead.
+void ForceField::RemoveMolecules(vector<Molecule>& mols, int first,
+                                 int count) {
+  int last = (int)mols.size() - count;
+  bool in_place = particles.CanReplace(first, count);
+  if (in_place) {
+    int p_first = particles.Begin(first);
+    int p_end = particles.Begin(first + count);
+    particles.RemoveMolecules(first, count);
+    if (use_pair_pot)   pair_cells.RemoveParticles(p_first, p_end);
+    if (use_ewald_pot)  ewald_cells.RemoveParticles(p_first, p_end);
+  }
+  if (use_bond_pot)  bond_pot->RemoveMolecules(first, count);
+
+  if (first + count <= last) {
+    for (int i = 0; i < count; i++) {
+      mols[first+i] = move(mols[last+i]);
+      for (int j = 0; j < mols[first+i].Size(); j++)
+        mols[first+i].bds[j].SetChainID(first+i);
+    }
+    mols.erase(mols.begin() + last, mols.end());
+  }
+  else {
+    mols.erase(mols.begin() + first, mols.begin() + first + count);
+    for (int i = first; i < (int)mols.size(); i++) {
+      for (int j = 0; j < mols[i].Size(); j++)
+        mols[i].bds[j].SetChainID(i);
+    }
+  }
+
+  if (!in_place) {
+    particles.Build(mols);
+    if (use_pair_pot)   pair_cells.Build(particles);
+    if (use_ewald_pot)  ewald_cells.Build(particles);
+  }
+
+}
+
 double ForceField::EqBondLen() {
   if (use_bond_pot)
     return bond_pot->EqBondLen();
@@ -1288,4 +1497,109 @@ double ForceField::EqBondLen() {
   return 0;
 }
 
+// The pressure routines that Sample calls only accumulate into p_tensor*
+// and vp_z. The g(r) arrays of the virial routines are not saved.
+void ForceField::SaveAccumulators(ostream& out) {
+  WriteBinary(out, vp_z);
+  WriteBinary(out, p_tensor, 20);
+  WriteBinary(out, p_tensor2, 20);
+  WriteBinary(out, p_tensor3, 20);
+  WriteBinary(out, p_tensor_hs, 20);
+  WriteBinary(out, p_tensor_el, 20);
+  WriteBinary(out, p_tensor_el_tot, 20);
+
+}
+
+void ForceField::LoadAccumulators(istream& in) {
+  ReadBinary(in, vp_z);
+  ReadBinary(in, p_tensor, 20);
+  ReadBinary(in, p_tensor2, 20);
+  ReadBinary(in, p_tensor3, 20);
+  ReadBinary(in, p_tensor_hs, 20);
+  ReadBinary(in, p_tensor_el, 20);
+  ReadBinary(in, p_tensor_el_tot, 20);
+
+}
+
+// Potential parameters other than those listed here are not compared, a
+// restart after changing them needs --rebuild.
+string ForceField::EnergySignature() {
+  ostringstream signature;
+  signature << setprecision(17) << beta << " " << npbc << " " << box_l[0]
+            << " " << box_l[1] << " " << box_l[2] << " " << particles.Size();
+  if (use_pair_pot) {
+    signature << " pair " << pair_pot->PotentialName() << " "
+              << pair_pot->Cutoff();
+  }
+  if (use_ewald_pot) {
+    signature << " ewald " << ewald_pot->PotentialName() << " "
+              << ewald_pot->GetlB() << " " << ewald_pot->RealCutoff() << " "
+              << ewald_pot->UseDipoleCorrection();
+  }
+  if (use_bond_pot) {
+    signature << " bond " << bond_pot->PotentialName();
+  }
+  if (use_ext_pot) {
+    signature << " ext " << ext_pot->PotentialName();
+  }
+  return signature.str();
+
+}
+
+// The energies are written as one block behind the signature, so that a
+// restart that cannot use them skips the block as a whole.
+void ForceField::SaveEnergies(ostream& out) {
+  ostringstream block;
+  if (use_pair_pot) {
+    pair_pot->SaveState(block);
+    pair_cells.SaveState(block);
+  }
+  if (use_ewald_pot) {
+    ewald_pot->SaveState(block);
+    ewald_cells.SaveState(block);
+  }
+  if (use_bond_pot)  bond_pot->SaveState(block);
+  if (use_ext_pot)   ext_pot->SaveState(block);
 
+  WriteBinary(out, EnergySignature());
+  WriteBinary(out, block.str());
+
+}
+
+void ForceField::LoadEnergies(istream& in, vector<Molecule>& mols,
+                              bool rebuild) {
+  string signature;
+  string block;
+  ReadBinary(in, signature);
+  ReadBinary(in, block);
+
+  if (rebuild) {
+    cout << "  Recomputing the energies as requested." << endl;
+    ComputeEnergies(mols);
+  }
+  else if (signature != EnergySignature()) {
+    cout << "  Note: The force field differs from the one of the" << endl;
+    cout << "        checkpoint, recomputing the energies." << endl;
+    ComputeEnergies(mols);
+  }
+  else {
+    istringstream block_in(block);
+    if (use_pair_pot) {
+      pair_pot->LoadState(block_in);
+      pair_cells.LoadState(block_in, particles);
+    }
+    if (use_ewald_pot) {
+      ewald_pot->LoadState(block_in);
+      ewald_cells.LoadState(block_in, particles);
+    }
+    if (use_bond_pot)  bond_pot->LoadState(block_in);
+    if (use_ext_pot)   ext_pot->LoadState(block_in);
+    if (!block_in) {
+      cout << "  The energies in the checkpoint are incomplete. Exiting! "
+           << "Program complete." << endl;
+      exit(1);
+    }
+    cout << "  Loaded the energies from the checkpoint." << endl;
+  }
+
+}
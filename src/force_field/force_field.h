@@ -8,10 +8,14 @@
 #include <string>
 #include <vector>
 #include <fstream>
-#include <random> 
 
 #include "../molecules/bead.h"
 #include "../molecules/molecule.h"
+#include "../molecules/particle_store.h"
+#include "../utilities/random_generator.h"
+#include "../utilities/thread_pool.h"
+#include "../utilities/timing.h"
+#include "cell_list.h"
 #include "potential_bond.h"
 #include "potential_ewald.h"
 #include "potential_external.h"
@@ -19,6 +23,34 @@
 
 using namespace std;
 
+/** The beads and weights a CBMC chain growth works on. Chains that are grown
+    at the same time, such as the Widom insertions, each need their own. */
+struct CBMCGrowth {
+  /** The chain grown so far, followed by its counterions. */
+  vector<Bead> chain;
+  /** The trial beads of the current step, chain beads then counterions. */
+  vector<Bead> trial_beads;
+  /** The Rosenbluth weight of each trial. */
+  vector<double> trial_weights;
+  /** The bond directions and the counterion positions, as fractions of the
+      box, of all trials of a step, drawn in one batch. */
+  vector<double> directions;
+  vector<double> ion_crd;
+};
+
+/** The energy changes of the moves one thread makes in a checkerboard pass,
+    see checkerboard.cc. */
+struct ParallelMove {
+  /** The pairs of the current move. */
+  PairMove pair;
+  /** External energies of the moved beads and bond energy of the molecule
+      after the current move, and the changes they make. */
+  vector<double> ext_e;
+  double ext_dE;
+  double bond_e;
+  double bond_dE;
+};
+
 class ForceField {
  private:
   // Basic simulation parameters.
@@ -64,6 +96,10 @@ class ForceField {
   bool use_dihed_pot;
   /** Record whether to use external potential. */
   bool use_ext_pot;
+  /** Whether the pair and the external potentials are hard, so that most
+      rejected moves are overlaps. EnergyDifference looks for them first. */
+  bool hard_pair_pot;
+  bool hard_ext_pot;
 
   // GC molecular information. Right now all GC beads have the same type and
   // charge, this could be changed in the future.
@@ -93,20 +129,37 @@ class ForceField {
   double gc_deBroglie_prefactor;
   /** The number of trial beads to generate for each CBMC growth. */
   int cbmc_no_of_trials;
-  /** The array to store the weight for each trial, size = cbmc_no_of_trials. */
-  double* cbmc_trial_weights;
-  /** Store the generated trial beads for each CBMC growth. */
-  vector<Bead> cbmc_trial_beads;
-  /** Store the generated CBMC chain. */
-  vector<Bead> cbmc_chain;
+  /** The growth used by the GC insertion and deletion moves. */
+  CBMCGrowth cbmc;
+  /** One growth per thread for the Widom insertions. */
+  vector<CBMCGrowth> widom_growths;
   /** Number of insertion to try for each configuration. */
   int mu_tot_ins;
+  /** The weight of each Widom insertion. */
+  vector<double> widom_weights;
+  /** Number of threads used to score CBMC trials and Widom insertions. */
+  int n_threads;
+  ThreadPool pool;
+  /** Times the potentials in EnergyDifference, and the moves and the output
+      of the Simulation that owns the force field. Off unless switched on. */
+  Timing timing;
 
   // Potential objects.
+  /** Contiguous copy of the bead positions, charges and types that the pair
+      and Ewald potentials read in their energy loops. */
+  ParticleStore particles;
+  /** Pair energies of a CBMC bead with all particles, see StorePairEnergies.
+      Two arrays per thread, for the chain bead and for its counterion. */
+  vector<vector<double> > store_pair_e;
   /** Pair potential, could include dispersive and/or elec. */
   PotentialPair* pair_pot;
+  /** Cell list sized by the pair potential cutoff, used to find the beads a
+      moved bead interacts with. */
+  CellList pair_cells;
   /** Ewald sum potential, could include dispersive and/or elec. */
   PotentialEwald* ewald_pot;
+  /** Cell list sized by the real space cutoff of the Ewald sum. */
+  CellList ewald_cells;
   /** Bond potential. */
   PotentialBond* bond_pot;
   /** The length of the rigid bond if the flag is on. */
@@ -114,6 +167,27 @@ class ForceField {
   /** External potential. */
   PotentialExternal* ext_pot; 
 
+  // Checkerboard moves, see checkerboard.cc.
+  /** Number of domains along each dimension, 1 if the dimension is not
+      split. */
+  int n_domain[3];
+  /** The domain of each pair cell along each dimension, before the shift. */
+  vector<int> cell_domain[3];
+  /** The shift of the domain grid of the current pass, in cells. */
+  int domain_shift[3];
+  /** The domains of the current pass, and the active slot of every domain,
+      -1 for the inactive ones. */
+  vector<int> active_domains;
+  vector<int> active_slot;
+  /** One scratch per thread. */
+  vector<ParallelMove> parallel_moves;
+  /** The accepted energy changes of each active domain in the current pass,
+      summed in domain order at the end so that the totals do not depend on
+      which thread ran which domain. */
+  vector<double> domain_pair_dE;
+  vector<double> domain_ext_dE;
+  vector<double> domain_bond_dE;
+
   ////////////////////////////////////////////////////
   // Pressure calculation variables and parameters. //
   ////////////////////////////////////////////////////
@@ -204,17 +278,44 @@ class ForceField {
   /** Dimension 6: 3 (x, y, z). */
   int vp_d6;
 
+  /** Compute the pair energies between a bead and every particle of the
+      store in one batch. The energy with bead j of molecule i ends up at
+      index particles.Begin(i)+j. */
+  void StorePairEnergies(Bead&, vector<double>&);
+  /** Fill in the stored energies of all potentials from scratch. */
+  void ComputeEnergies(vector<Molecule>&);
+  /** A description of the force field setup that the stored energies depend
+      on, used to decide whether the energies in a checkpoint can be used. */
+  string EnergySignature();
+  /** The domain of a pair cell for the current shift. */
+  int CellDomain(int);
+
  public:
   // Initialization functions.
   /** Constructor. */
   ForceField();
   /** Destructor. */
   ~ForceField();
-  /** The "true constructor" of the force field. */
-  void Initialize(double, int, double[3], vector<Molecule>&, int, int, int, int);
+  /** The "true constructor" of the force field. The energies are computed
+      unless the last argument is false, in which case they must be read with
+      LoadEnergies. */
+  void Initialize(double, int, double[3], vector<Molecule>&, int, int, int, int,
+                  bool);
   /** Initialize all energy maps / vectors in potentials, set up gc if
       necessary. */
-  void InitializeEnergy(vector<Molecule>&);
+  void InitializeEnergy(vector<Molecule>&, bool);
+  /** Take over a different set of molecules in the same box, e.g. the
+      configuration of another replica: rebuild the particle store and the
+      cell lists and compute all energies from scratch. */
+  void ReplaceSystem(vector<Molecule>&);
+  /** Exchange the configurations, given after their molecules were swapped,
+      with another force field whose parameters differ at most in the Bjerrum
+      length: the particle stores, the cell lists and the stored energies
+      change places, and the Ewald energies are rescaled. Only if the Ewald
+      sums differ are the Ewald energies computed from scratch. */
+  void SwapSystem(ForceField&, vector<Molecule>&, vector<Molecule>&);
+  /** Whether SwapSystem with another force field keeps the Ewald energies. */
+  bool SameEwaldSums(ForceField&);
 
   // Energy functions.
   /** Only used in the translational MC moves. */ 
@@ -225,6 +326,28 @@ class ForceField {
       (other beads and external potential). */
   double BeadEnergy(Bead&, vector<Molecule>&, int, int, int);
 
+  // Checkerboard moves.
+  /** Split the box into domains of pair cells for the checkerboard moves,
+      none narrower than the given width, and return the number of colors.
+      Returns 0 if the box is too small to split or the force field is not
+      short-ranged (Ewald sum, GC). */
+  int InitCheckerboard(double);
+  /** Shift the domain grid by a random number of cells, pick the domains of
+      a random color and sort the mobile molecules that lie entirely within
+      one of them into its lists of chains and of single beads. Returns the
+      number of active domains. */
+  int SortIntoDomains(vector<Molecule>&, int, RandomGenerator&, vector<vector<int> >&,
+                      vector<vector<int> >&);
+  /** EnergyDifference and FinalizeEnergies for a molecule of the given
+      active domain, on the given thread. Molecules of different active
+      domains can be moved at the same time. A move that takes a bead out of
+      its domain is rejected. */
+  double ParallelEnergyDifference(vector<Molecule>&, int, int, int);
+  void ParallelFinalize(vector<Molecule>&, int, bool, int, int);
+  /** Add the accepted energy changes of the pass to the totals. */
+  void CommitParallelMoves();
+  ThreadPool& Pool();
+
   /** For a system of netrual, non-interactive hard chains with no other
       molecular species. The current version cannot calculate the pressure
       components. */
@@ -243,26 +366,49 @@ class ForceField {
   // GC functions.
   /** Return the frequency to use GC. */
   int GCFrequency();
+  /** Return the chemical potential of the GC moves, in kBT. */
+  double ChemPot();
   /** Configurational-bias Monte Carlo (CBMC) move to generate a set of trial
       beads to choose from. */
-  double CBMCGenTrialBeads(Bead&, vector<Molecule>&, int, mt19937&, int, int);
+  double CBMCGenTrialBeads(Bead&, vector<Molecule>&, int, RandomGenerator&, int, int);
   /** CBMC move for chain insertion. */
-  bool CBMCChainInsertion(vector<Molecule>&, mt19937&); 
+  bool CBMCChainInsertion(vector<Molecule>&, RandomGenerator&); 
   /** Chain deletion. */
-  int CBMCChainDeletion(vector<Molecule>&, mt19937&);
-  double CalcChemicalPotential(vector<Molecule>&, mt19937&);
+  int CBMCChainDeletion(vector<Molecule>&, RandomGenerator&);
+  double CalcChemicalPotential(vector<Molecule>&, RandomGenerator&);
   ///////////////////////////////
   // Full-bias CBMC functions. //
   ///////////////////////////////
-  double BeadsEnergy(Bead&, Bead&, vector<Molecule>&, int, int);
-  double CBMCFGenTrialBeads(Bead&, vector<Molecule>&, int, mt19937&, int);
-  bool CBMCFChainInsertion(vector<Molecule>&, mt19937&);
-  int CBMCFChainDeletion(vector<Molecule>&, mt19937&);
-  double CalcChemicalPotentialF(vector<Molecule>&, mt19937&);
+  /** The real-space Ewald energy of a trial bead with the existing beads in
+      the neighboring cells, leaving out a molecule being deleted and its
+      counterions. */
+  double BeadRealEnergy(Bead&, vector<Molecule>&, int, int);
+  /** The energy of a chain bead and its counterion with the rest of the
+      system and with the partial chain of the growth. The last argument is
+      the thread number, which selects the scratch arrays. */
+  double BeadsEnergy(Bead&, Bead&, vector<Molecule>&, CBMCGrowth&, int, int,
+                     int);
+  /** Generate and score the trial beads of the next growth step. The trial
+      positions are always drawn in order from the generator; with a thread
+      number of -1 they are then scored in parallel on the thread pool,
+      otherwise serially on the given thread. Either way the results do not
+      depend on the number of threads. */
+  double CBMCFGenTrialBeads(Bead&, vector<Molecule>&, CBMCGrowth&, int,
+                            RandomGenerator&, int, int);
+  /** Grow one Widom test chain and return its Rosenbluth weight. */
+  double WidomInsertion(vector<Molecule>&, CBMCGrowth&, RandomGenerator&, int);
+  bool CBMCFChainInsertion(vector<Molecule>&, RandomGenerator&);
+  int CBMCFChainDeletion(vector<Molecule>&, RandomGenerator&);
+  double CalcChemicalPotentialF(vector<Molecule>&, RandomGenerator&);
   // END.
   /** Does all energy initializing for a new molecule. It requires that all IDs
       are properly assigned before hand. */
   void EnergyInitForAddedMolecule(vector<Molecule>&); 
+  /** Remove the given number of molecules from the given index, after their
+      energies were subtracted by a deletion move. The last as many molecules
+      take their place, and the particle store, the cell lists and the bond
+      energies are patched to match in O(number of beads moved). */
+  void RemoveMolecules(vector<Molecule>&, int, int);
 
   /** For grafted polymers (L, R). */
   double EnsureGrafting(vector<Molecule>&, int);
@@ -270,6 +416,8 @@ class ForceField {
   // Utilities.
   /** Return whether GC is used. */
   bool UseGC();
+  /** The timing of the hot path, see Timing. */
+  Timing& HotPathTiming();
   bool UsePairPot();
   bool UseEwaldPot();
   bool UseBondPot();
@@ -281,6 +429,8 @@ class ForceField {
   double TotEwaldEnergy();
   double TotBondEnergy();
   double TotExtEnergy();
+  /** Return the Bjerrum length of the Ewald potential, 0 if there is none. */
+  double BjerrumLength();
   /** Return the length of the rigid bond. */
   double RigidBondLen();
   void CoordinateObeyRigidBond(vector<Molecule>&);
@@ -291,6 +441,18 @@ class ForceField {
   /** For debug purposes only. */
   void GetEwaldEnergyComponents(vector<Molecule>&, double *);
 
+  // Checkpointing.
+  /** Write the running pressure sums to a checkpoint, and read them back. */
+  void SaveAccumulators(ostream&);
+  void LoadAccumulators(istream&);
+  /** Write the stored energies of all potentials and the contents of the cell
+      lists to a checkpoint, after the EnergySignature. */
+  void SaveEnergies(ostream&);
+  /** Read the stored energies back. They are only used if the signature still
+      matches and the last argument is false; otherwise the energies are
+      computed from scratch. */
+  void LoadEnergies(istream&, vector<Molecule>&, bool);
+
 }; 
 
 #endif
@@ -0,0 +1,116 @@
+/** Building blocks of the batched pair energy kernels. Each function returns
+    the minimum image distances, or their squares, between a probe position
+    and particles of a span, using the same operations in the same order as
+    ParticleStore::Dist and Bead::BBDist. With IEEE division and square root
+    and no fused multiply-add, the SIMD kernels therefore reproduce the scalar
+    energies bit for bit. The SIMD variants are compiled for their instruction
+    set through target attributes and must only be called when SimdLevel()
+    reports it. */
+
+#ifndef SRC_FORCE_FIELD_PAIR_BATCH_H_
+#define SRC_FORCE_FIELD_PAIR_BATCH_H_
+
+#include <cmath>
+
+#include "../molecules/particle_store.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PLUM_X86_SIMD
+// The intrinsics headers of GCC 12 start some vectors from
+// _mm*_undefined_pd(), which -Wmaybe-uninitialized reports once inlined.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#endif
+
+using namespace std;
+
+/** Distance between the probe and particle j of the span. */
+inline double BatchDist(const double pos[], const ParticleSpan& span, int j,
+                        const double box_l[], int npbc) {
+  double dist = 0;
+  for (int i = 0; i < 3; i++) {
+    double di = pos[i] - span.crd[i][j];
+    if (i < npbc) {
+      di -= box_l[i] * round(di / box_l[i]);
+      if (abs(di) > 0.5*box_l[i]) {
+        di = box_l[i] - abs(di);
+      }
+    }
+    dist += (di * di);
+  }
+  return sqrt(dist);
+
+}
+
+#ifdef PLUM_X86_SIMD
+/** Squared distances between the probe and particles j to j+3. */
+__attribute__((target("avx2")))
+inline __m256d BatchDist2AVX2(const double pos[], const ParticleSpan& span,
+                              int j, const double box_l[], int npbc) {
+  const __m256d sign = _mm256_set1_pd(-0.0);
+  const __m256d half = _mm256_set1_pd(0.5);
+  const __m256d one  = _mm256_set1_pd(1.0);
+  __m256d dist = _mm256_setzero_pd();
+  for (int i = 0; i < 3; i++) {
+    __m256d di = _mm256_sub_pd(_mm256_set1_pd(pos[i]),
+                               _mm256_loadu_pd(span.crd[i] + j));
+    if (i < npbc) {
+      __m256d l = _mm256_set1_pd(box_l[i]);
+      // round() takes halfway cases away from zero, unlike the SIMD
+      // rounding modes, so round toward zero and fix up the halves.
+      __m256d q = _mm256_div_pd(di, l);
+      __m256d t = _mm256_round_pd(q, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+      __m256d frac = _mm256_andnot_pd(sign, _mm256_sub_pd(q, t));
+      __m256d step = _mm256_or_pd(one, _mm256_and_pd(sign, q));
+      t = _mm256_add_pd(t, _mm256_and_pd(step, _mm256_cmp_pd(frac, half,
+                                                             _CMP_GE_OQ)));
+      di = _mm256_sub_pd(di, _mm256_mul_pd(l, t));
+      __m256d a = _mm256_andnot_pd(sign, di);
+      __m256d fold = _mm256_cmp_pd(a, _mm256_mul_pd(half, l), _CMP_GT_OQ);
+      di = _mm256_blendv_pd(a, _mm256_sub_pd(l, a), fold);
+    }
+    dist = _mm256_add_pd(dist, _mm256_mul_pd(di, di));
+  }
+  return dist;
+
+}
+
+/** Squared distances between the probe and particles j to j+7. */
+__attribute__((target("avx512f")))
+inline __m512d BatchDist2AVX512(const double pos[], const ParticleSpan& span,
+                                int j, const double box_l[], int npbc) {
+  const __m512d half = _mm512_set1_pd(0.5);
+  const __m512d one  = _mm512_set1_pd(1.0);
+  const __m512d zero = _mm512_setzero_pd();
+  __m512d dist = _mm512_setzero_pd();
+  for (int i = 0; i < 3; i++) {
+    __m512d di = _mm512_sub_pd(_mm512_set1_pd(pos[i]),
+                               _mm512_loadu_pd(span.crd[i] + j));
+    if (i < npbc) {
+      __m512d l = _mm512_set1_pd(box_l[i]);
+      // Round halfway cases away from zero, as round() does.
+      __m512d q = _mm512_div_pd(di, l);
+      __m512d t = _mm512_roundscale_pd(q, _MM_FROUND_TO_ZERO |
+                                          _MM_FROUND_NO_EXC);
+      __m512d frac = _mm512_abs_pd(_mm512_sub_pd(q, t));
+      __mmask8 up = _mm512_cmp_pd_mask(frac, half, _CMP_GE_OQ);
+      __mmask8 neg = _mm512_cmp_pd_mask(q, zero, _CMP_LT_OQ);
+      t = _mm512_mask_add_pd(t, up & ~neg, t, one);
+      t = _mm512_mask_sub_pd(t, up & neg, t, one);
+      di = _mm512_sub_pd(di, _mm512_mul_pd(l, t));
+      __m512d a = _mm512_abs_pd(di);
+      __mmask8 fold = _mm512_cmp_pd_mask(a, _mm512_mul_pd(half, l),
+                                         _CMP_GT_OQ);
+      di = _mm512_mask_sub_pd(a, fold, l, a);
+    }
+    dist = _mm512_add_pd(dist, _mm512_mul_pd(di, di));
+  }
+  return dist;
+
+}
+#endif
+
+#endif
+
@@ -1,5 +1,10 @@
 #include "potential_bond.h"
 
+#include <cmath>
+#include <utility>
+
+#include "../utilities/binary_io.h"
+
 using namespace std;
 
 // Construct with initial no. of mols.
@@ -15,6 +20,8 @@ PotentialBond::PotentialBond(int n_mol, string potential_name) {
 // calc all initial molecular energies, fill in both vectors. 
 void PotentialBond::EnergyInitialization(vector <Molecule>& mols, double length[], int npbc) {
   E_tot = 0;
+  current_energy_array.resize(mols.size());
+  trial_energy_array.resize(mols.size());
 
   for(int i = 0; i < (int)mols.size(); i++){
     double en = MoleculeEnergy(mols[i], length, npbc); 
@@ -25,18 +32,58 @@ void PotentialBond::EnergyInitialization(vector <Molecule>& mols, double length[
 
 }
 
-// EnergyInitializations the last mol in the array (presumed to be new one) 
-void PotentialBond::EnergyInitForLastMol(vector<Molecule>& mols, double length[], int npbc) {
-  double en = MoleculeEnergy(mols[(int)mols.size()-1], length, npbc);
-  current_energy_array.push_back(en); 
-  trial_energy_array.push_back(en); 
-  E_tot += en;  
+// EnergyInitializations the mols at the end of the array (presumed to be the
+// new chain and its counterions).
+void PotentialBond::EnergyInitForLastMol(vector<Molecule>& mols, int chain_len,
+                                         double bead_charge, double length[],
+                                         int npbc) {
+  int added = 1;
+  // Assume monovalent ions.
+  if (bead_charge != 0)
+    added += chain_len;
+
+  for (int i = (int)mols.size()-added; i < (int)mols.size(); i++) {
+    double en = MoleculeEnergy(mols[i], length, npbc);
+    current_energy_array.push_back(en); 
+    trial_energy_array.push_back(en); 
+    E_tot += en;  
+  }
+
 }
 
-void PotentialBond::AdjustEnergyUponMolDeletion(int delete_id){
-  E_tot -= current_energy_array[delete_id]; 
-  current_energy_array.erase(current_energy_array.begin() + delete_id); 
-  trial_energy_array.erase(trial_energy_array.begin() + delete_id); 
+void PotentialBond::AdjustEnergyUponMolDeletion(vector<Molecule>& mols,
+                                                int delete_id) {
+  // Assume monovalent counterion!
+  int counterion = 0;
+  for (int i = 0; i < mols[delete_id].Size(); i++) {
+    counterion += (int)round(abs(mols[delete_id].bds[i].Charge()));
+  }
+
+  for (int i = delete_id; i <= delete_id+counterion; i++) {
+    E_tot -= current_energy_array[i];
+  }
+
+}
+
+// Mirrors ForceField::RemoveMolecules: the entries of the last mols are moved
+// into the gap unless the two ranges overlap, then the gap is erased.
+void PotentialBond::RemoveMolecules(int first, int count) {
+  int last = (int)current_energy_array.size() - count;
+  if (first + count <= last) {
+    for (int i = 0; i < count; i++) {
+      current_energy_array[first+i] = current_energy_array[last+i];
+      trial_energy_array[first+i] = trial_energy_array[last+i];
+    }
+    current_energy_array.resize(last);
+    trial_energy_array.resize(last);
+  }
+  else {
+    current_energy_array.erase(current_energy_array.begin() + first,
+                               current_energy_array.begin() + first + count);
+    trial_energy_array.erase(trial_energy_array.begin() + first,
+                             trial_energy_array.begin() + first + count);
+  }
+
 }
 
 void PotentialBond::SetE(int flag, int index, double val) {
@@ -96,9 +143,36 @@ double PotentialBond::GetTotalEnergy() {
 
 }
 
+void PotentialBond::AddEnergy(double energy) {
+  E_tot += energy;
+
+}
+
 string PotentialBond::PotentialName() {
   return name;
 
 }
 
+void PotentialBond::SaveState(ostream& out) {
+  WriteBinary(out, E_tot);
+  WriteBinary(out, current_energy_array);
 
+}
+
+void PotentialBond::LoadState(istream& in) {
+  ReadBinary(in, E_tot);
+  ReadBinary(in, current_energy_array);
+  trial_energy_array = current_energy_array;
+  dE = 0;
+
+}
+
+void PotentialBond::SwapState(PotentialBond& other) {
+  swap(E_tot, other.E_tot);
+  current_energy_array.swap(other.current_energy_array);
+  trial_energy_array = current_energy_array;
+  other.trial_energy_array = other.current_energy_array;
+  dE = 0;
+  other.dE = 0;
+
+}
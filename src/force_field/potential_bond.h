@@ -10,10 +10,10 @@
 #include <iostream>
 #include <iomanip> 
 #include <numeric> 
-#include <random> 
 #include <vector>
 
 #include "../molecules/molecule.h" 
+#include "../utilities/random_generator.h"
 
 using namespace std; 
 
@@ -33,21 +33,31 @@ class PotentialBond{
  public:
   PotentialBond(int, string);
   void EnergyInitialization(vector <Molecule>&, double[], int);  // args are mol array, length, npbc
-  void EnergyInitForLastMol(vector <Molecule>&, double[], int);  // init one new mol being added 
-  void AdjustEnergyUponMolDeletion(int);  // delete stored energies for a molecule being deleted 
+  void EnergyInitForLastMol(vector <Molecule>&, int, double, double[], int);  // init the chain and counterions just added 
+  void AdjustEnergyUponMolDeletion(vector <Molecule>&, int);  // subtract the energies of a chain and counterions being deleted 
+  void RemoveMolecules(int, int);  // drop the entries of removed mols, the last mols take their place 
   void SetE(int, int, double);  // same array, index, value args 
   double GetE(int, int);
   void FinalizeEnergy(int, bool); 
   double GetTotalEnergy(); 
+  /** Add to the total energy, for moves that set the energies with SetE. */
+  void AddEnergy(double);
   string PotentialName();
 
   virtual double MoleculeEnergy(Molecule&, double[], int) = 0; 
   virtual double EnergyDifference(vector<Molecule>&, double[], int, int) = 0; 
   virtual void ReadParameters() = 0;
-  virtual double RandomBondLen(double, mt19937&) = 0; //for growing mols for gc insertion
+  virtual double RandomBondLen(double, RandomGenerator&) = 0; //for growing mols for gc insertion
   /** Returning the equilibrium bond length. */
   virtual double EqBondLen() = 0;
   double CalcTrialTotalEnergy(vector<Molecule>&, double[], int); //for use in pressure calculation 
+  /** Write the current energies to a checkpoint, and read them back into
+      both arrays. */
+  void SaveState(ostream&);
+  void LoadState(istream&);
+  /** Exchange the current energies with another bond potential of the same
+      parameters. */
+  void SwapState(PotentialBond&);
 
 }; 
 
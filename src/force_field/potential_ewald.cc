@@ -1,8 +1,12 @@
 #include "potential_ewald.h"
 
+#include <algorithm>
 #include <cmath>
 #include <string>
 
+#include "../utilities/binary_io.h"
+#include "../utilities/constants.h"
+
 using namespace std; 
 
 PotentialEwald::PotentialEwald(string potential_name, double box_l_in[3]) {
@@ -10,161 +14,65 @@ PotentialEwald::PotentialEwald(string potential_name, double box_l_in[3]) {
   E_tot = 0;
   current_real_E = 0;
   current_repl_E = 0;
+  trial_repl_E = 0;
   current_self_E = 0;
+  current_dipl_E = 0;
+  trial_dipl_E = 0;
+  dipole_updates = 0;
+  current_Mz = 0;
+  trial_Mz = 0;
   dE = 0;
   for (int i = 0; i < 3; i++) {
     box_l[i] = box_l_in[i];
   }
 
   calc_pphi = false;
-  trial_chain_e = new double [2];
 
 }
 
 PotentialEwald::~PotentialEwald() {
-  delete [] trial_chain_e;
 
 }
 
-void PotentialEwald::SetERealRepl(int flag, int key1, int key2, double val_real,
-                                  double val_repl) {
-  if (flag == 0) {
-    current_real_energy_map[make_pair(key1, key2)] = val_real;
-    current_repl_energy_map[make_pair(key1, key2)] = val_repl;
-  }
-  else if (flag == 1) {
-    trial_real_energy_map[make_pair(key1, key2)] = val_real;
-    trial_repl_energy_map[make_pair(key1, key2)] = val_repl;
-  }
-  else {
-    cout << "PotentialEwald::SetERealRepl:\n  Invalid map requested!" 
-         << endl;
-  }
+pair<int,int> PotentialEwald::PairKey(int id1, int id2) {
+  return make_pair(min(id1, id2), max(id1, id2));
 
 }
 
-void PotentialEwald::SetPPhiRealRepl(int flag, int key1, int key2,
-                                     double val_real, double val_repl) {
-  if (flag == 0) {
-    current_real_pphi_map[make_pair(key1, key2)] = val_real;
-    current_repl_pphi_map[make_pair(key1, key2)] = val_repl;
-  }
-  else if (flag == 1) {
-    trial_real_pphi_map[make_pair(key1, key2)] = val_real;
-    trial_repl_pphi_map[make_pair(key1, key2)] = val_repl;
-  }
-  else {
-    cout << "PotentialEwald::SetERealRepl:\n  Invalid map requested!"
-         << endl;
-  }
+double PotentialEwald::Lookup(const map<pair<int,int>, double>& pair_map,
+                              const pair<int,int>& key) {
+  map<pair<int,int>, double>::const_iterator it = pair_map.find(key);
+  if (it == pair_map.end())  return 0;
+  return it->second;
 
 }
 
-void PotentialEwald::SetESelf(int flag, int key, double val_self) {
-  if (flag == 0) {
-    current_self_energy_map[key] = val_self;
-  }
-  else if (flag == 1) {
-    trial_self_energy_map[key] = val_self;
-  }
-  else {
-    cout << "PotentialEwald::SetESelf:\n  Invalid map requested!" << endl;
-  }
-
-}
-
-void PotentialEwald::SetEBoth2DMaps(int key1, int key2, double val_real,
-                                    double val_repl) {
-  current_real_energy_map[make_pair(key1, key2)] = val_real; 
-  current_repl_energy_map[make_pair(key1, key2)] = val_repl;
-  trial_real_energy_map[make_pair(key1, key2)] = val_real;
-  trial_repl_energy_map[make_pair(key1, key2)] = val_repl;
+void PotentialEwald::SetEReal(int key1, int key2, double val_real) {
+  current_real_energy_map[PairKey(key1, key2)] = val_real;
 
 }
 
-void PotentialEwald::SetPPhiBoth2DMaps(int key1, int key2, double val_real, 
-                                       double val_repl) {
-  current_real_pphi_map[make_pair(key1, key2)] = val_real;
-  current_repl_pphi_map[make_pair(key1, key2)] = val_repl;
-  trial_real_pphi_map[make_pair(key1, key2)] = val_real;
-  trial_repl_pphi_map[make_pair(key1, key2)] = val_repl;
+void PotentialEwald::SetPPhiRealRepl(int key1, int key2, double val_real,
+                                     double val_repl) {
+  current_real_pphi_map[PairKey(key1, key2)] = val_real;
+  current_repl_pphi_map[PairKey(key1, key2)] = val_repl;
 
 }
 
-void PotentialEwald::SetEBothSelfMaps(int key, double val_self) {
+void PotentialEwald::SetESelf(int key, double val_self) {
   current_self_energy_map[key] = val_self;
-  trial_self_energy_map[key] = val_self;
 
 }
 
-double PotentialEwald::GetERealRepl(int flag, int key1, int key2) {
-  double ene_real, ene_repl;
-  if (flag == 0) {
-    ene_real = current_real_energy_map[make_pair(key1, key2)];
-    ene_repl = current_repl_energy_map[make_pair(key1, key2)];
-    return ene_real + ene_repl; 
-  }
-  else if (flag == 1) {
-    ene_real = trial_real_energy_map[make_pair(key1, key2)];
-    ene_repl = trial_repl_energy_map[make_pair(key1, key2)];
-    return ene_real + ene_repl;
-  }
-  else {
-    cout << "PotentialEwald::GetERealRepl:\n  Invalid flag." << endl;
-    return 1; 
-  }
-  return 0;
- 
-}
-
-double PotentialEwald::GetEReal(int flag, int key1, int key2) {
-  double ene_real;
-  if (flag == 0) {
-    ene_real = current_real_energy_map[make_pair(key1, key2)];
-    return ene_real;
-  }
-  else if (flag == 1) {
-    ene_real = trial_real_energy_map[make_pair(key1, key2)];
-    return ene_real;
-  }
-  else {
-    cout << "PotentialEwald::GetEReal:\n  Invalid flag." << endl;
-    return 1;
-  }
-  return 0;
-
-}
-
-double PotentialEwald::GetERepl(int flag, int key1, int key2) {
-  double ene_repl;
-  if (flag == 0) {
-    ene_repl = current_repl_energy_map[make_pair(key1, key2)];
-    return ene_repl;
-  }
-  else if (flag == 1) {
-    ene_repl = trial_repl_energy_map[make_pair(key1, key2)];
-    return ene_repl;
-  }
-  else {
-    cout << "PotentialEwald::GetERepl:\n  Invalid flag." << endl;
-    return 1;
-  }
-  return 0;
+// Looked up without inserting, so that the pairs a rejected move visited do
+// not grow the map.
+double PotentialEwald::GetEReal(int key1, int key2) {
+  return Lookup(current_real_energy_map, PairKey(key1, key2));
 
 }
 
-double PotentialEwald::GetESelf(int flag, int key) {
- if (flag == 0) {
-   return current_self_energy_map[key];
-  }
-  else if (flag == 1) {
-   return trial_self_energy_map[key];
-  }
-  else {
-    cout << "PotentialEwald::GetESelf:\n  Invalid flag." << endl;
-    return 1; 
-  }
-  return 0;
+double PotentialEwald::GetESelf(int key) {
+  return current_self_energy_map[key];
 
 }
 
@@ -174,25 +82,26 @@ double PotentialEwald::GetTotalEnergy() {
 }
 
 void PotentialEwald::EnergyInitialization(vector<Molecule>& mols, int npbc) {
-  double ene_real, ene_repl, ene_self;
+  double ene_real, ene_self;
   double pphi_real, pphi_repl;
   E_tot = 0;
+  current_real_energy_map.clear();
+  current_self_energy_map.clear();
+  current_real_pphi_map.clear();
+  current_repl_pphi_map.clear();
 
-  // Real and repl energies.
+  // Real energies.
   for (int i = 0; i < (int)mols.size(); i++) {      // For every mol.
     for (int j = i; j < (int)mols.size(); j++) {    // For every mol.
       for (int k = 0; k < mols[i].Size(); k++) {    // For every idx in mol 1.
         for (int l = 0; l < mols[j].Size(); l++) {  // For every idx in mol 2.
           if ((j == i && l >= k) || (j > i)) {
             ene_real = PairEnergyReal(mols[i].bds[k], mols[j].bds[l], npbc);
-            ene_repl = PairEnergyRepl(mols[i].bds[k], mols[j].bds[l], npbc); 
             if (j == i && l == k) {
               ene_real *= 0.5; 
-              ene_repl *= 0.5;
             }
-            E_tot += (ene_real + ene_repl); 
-            SetEBoth2DMaps(mols[i].bds[k].ID(), mols[j].bds[l].ID(), ene_real,
-                           ene_repl);
+            E_tot += ene_real; 
+            SetEReal(mols[i].bds[k].ID(), mols[j].bds[l].ID(), ene_real);
 
             if (calc_pphi) {
               pphi_real = PairDForceReal(mols[i].bds[k], mols[j].bds[l],
@@ -203,26 +112,40 @@ void PotentialEwald::EnergyInitialization(vector<Molecule>& mols, int npbc) {
                 pphi_real *= 0.5;
                 pphi_repl *= 0.5;
               }
-              SetPPhiBoth2DMaps(mols[i].bds[k].ID(), mols[j].bds[l].ID(),
-                                ene_real, ene_repl);
+              SetPPhiRealRepl(mols[i].bds[k].ID(), mols[j].bds[l].ID(),
+                              pphi_real, pphi_repl);
             }
           }
         }
       }
     }
   }
+  // Repl energy, from the structure factor of all beads.
+  ClearTrialStructureFactor();
+  for (int i = 0; i < (int)mols.size(); i++) {
+    for (int j = 0; j < mols[i].Size(); j++) {
+      AddToTrialStructureFactor(mols[i].bds[j], 0, 1);
+    }
+  }
+  AcceptTrialStructureFactor();
+  current_repl_E = TrialReplEnergy();
+  trial_repl_E = current_repl_E;
+  E_tot += current_repl_E;
   // Self energy.
   for (int i = 0; i < (int)mols.size(); i++) {  // For every molecule.
     for (int j = 0; j < mols[i].Size(); j++) {  // For every bead in mol.
       ene_self = SelfEnergy(mols[i].bds[j]);
       E_tot += ene_self;
-      SetEBothSelfMaps(mols[i].bds[j].ID(), ene_self);
+      SetESelf(mols[i].bds[j].ID(), ene_self);
     }
   }
 
   // Only used when a confining potential is used.
   if (dipole_correction) {
-    current_dipl_E = DipoleE(mols);
+    current_Mz = MolsDipoleZ(mols, 0, (int)mols.size()-1);
+    trial_Mz = current_Mz;
+    dipole_updates = 0;
+    current_dipl_E = DipoleE(current_Mz);
     trial_dipl_E = current_dipl_E;
     E_tot += current_dipl_E;
   }
@@ -230,63 +153,79 @@ void PotentialEwald::EnergyInitialization(vector<Molecule>& mols, int npbc) {
 }
 
 // chain_len is the total number of beads in the chain plus its counterions.
+// The real energies with the other beads are only taken within the cells
+// around each chain bead, as in EnergyDifference.
 double PotentialEwald::TrialChainEnergy(vector<Molecule>& mols,
                                         vector<Bead>& chain, int chain_len,
-                                        int delete_id, int npbc) {
+                                        int delete_id, int npbc,
+                                        ParticleStore& particles,
+                                        CellList& cells) {
   double dE = 0;
-  double ene_real, ene_repl, ene_self;
-
-  // For insertion.
-  int beads = 0;
-  for (int i = 0; i < (int)mols.size(); i++) 
-    beads += mols[i].Size();
-  int tot = chain_len * (2*(beads+chain_len) + 1);
-  int sub = 2*(beads+chain_len) + 1;
+  double ene_real, ene_self;
+  const double * q = particles.Charges();
+  const int * ids = particles.IDs();
 
   ///////////////////
   // If insertion. //
   ///////////////////
   if (delete_id <= 0) {
-    delete [] trial_chain_e;
-    trial_chain_e = new double[tot];
     // Intramolecular.
+    trial_intra_e.resize(chain_len*(chain_len+1)/2);
     for (int i = 0; i < chain_len; i++) {
       for (int j = 0; j <= i; j++) {
         ene_real = PairEnergyReal(chain[i], chain[j], npbc);
-        ene_repl = PairEnergyRepl(chain[i], chain[j], npbc);
         if (j == i) {
           ene_real *= 0.5;
-          ene_repl *= 0.5;
         }
-        trial_chain_e[i*sub + 2*(beads + j) + 0] = ene_real;
-        trial_chain_e[i*sub + 2*(beads + j) + 1] = ene_repl;
-        dE += ene_real + ene_repl;
+        trial_intra_e[i*(i+1)/2 + j] = ene_real;
+        dE += ene_real;
       }
     }
     // Intermolecular.
+    trial_inter_bead.clear();
+    trial_inter_id.clear();
+    trial_inter_e.clear();
     for (int i = 0; i < chain_len; i++) {
-      int bead_counter = 0;
-      for (int j = 0; j < (int)mols.size(); j++) {
-        for (int k = 0; k < mols[j].Size(); k++) {
-          ene_real = PairEnergyReal(chain[i], mols[j].bds[k], npbc);
-          ene_repl = PairEnergyRepl(chain[i], mols[j].bds[k], npbc);
-          trial_chain_e[i*sub + 2*bead_counter + 0] = ene_real;
-          trial_chain_e[i*sub + 2*bead_counter + 1] = ene_repl;
-          dE += ene_real + ene_repl;
-          bead_counter++;
+      if (chain[i].Charge() == 0)  continue;
+      double pos[3];
+      for (int d = 0; d < 3; d++) {
+        pos[d] = chain[i].GetCrd(1, d);
+      }
+      vector<int>& nearby = cells.Neighbors(cells.CellIndex(pos));
+      for (int c = 0; c < (int)nearby.size(); c++) {
+        vector<int>& list = cells.Beads(nearby[c]);
+        for (int n = 0; n < (int)list.size(); n++) {
+          int p = list[n];
+          if (q[p] == 0)  continue;
+          int m = particles.MolOf(p);
+          ene_real = PairEnergyReal(chain[i],
+                                    mols[m].bds[p - particles.Begin(m)], npbc);
+          trial_inter_bead.push_back(i);
+          trial_inter_id.push_back(ids[p]);
+          trial_inter_e.push_back(ene_real);
+          dE += ene_real;
         }
       }
     }
+    // Repl, by adding the chain to the structure factor.
+    ResetTrialStructureFactor();
+    for (int i = 0; i < chain_len; i++) {
+      AddToTrialStructureFactor(chain[i], 1, 1);
+    }
+    trial_repl_E = TrialReplEnergy();
+    dE += trial_repl_E - current_repl_E;
     // Self.
     for (int i = 0; i < chain_len; i++) {
       ene_self = SelfEnergy(chain[i]);
-      // trial_chain_e[i*sub + 2*(beads + chain_len)] = ene_self;
       dE += ene_self;
     }
     // Only used when a confining potential is used.
     if (dipole_correction) {
-      double dipl_E = DipoleE(mols, chain);
-      dE += dipl_E - current_dipl_E;
+      double Mz = current_Mz;
+      for (int i = 0; i < (int)chain.size(); i++) {
+        Mz += chain[i].Charge() * chain[i].GetCrd(0, 2);
+      }
+      dE += DipoleE(Mz) - current_dipl_E;
     }
   }
   //////////////////
@@ -298,23 +237,42 @@ double PotentialEwald::TrialChainEnergy(vector<Molecule>& mols,
     // Meaning chain is charged.
     if (mols[delete_id].Size() < chain_len)
       end += chain_len/2;
-    // Real/repl.
+    // Real, within the deleted molecules and with the beads in the cells
+    // around them.
     for (int i = start; i <= end; i++) {
       for (int j = 0; j < mols[i].Size(); j++) {
-        for (int k = 0; k < (int)mols.size(); k++) {
-          for (int l = 0; l < mols[k].Size(); l++) {
-            if ((k < start || k > end) || (k == i && l >= j) || (k > i)) {
-              int id1 = min(mols[i].bds[j].ID(), mols[k].bds[l].ID());
-              int id2 = max(mols[i].bds[j].ID(), mols[k].bds[l].ID());
-              pair<int,int> indices = make_pair(id1, id2);
-              ene_real = current_real_energy_map[indices];
-              ene_repl = current_repl_energy_map[indices];
-              dE += ene_real + ene_repl;
-            }
+        for (int k = i; k <= end; k++) {
+          for (int l = (k == i ? j : 0); l < mols[k].Size(); l++) {
+            dE += Lookup(current_real_energy_map,
+                         PairKey(mols[i].bds[j].ID(), mols[k].bds[l].ID()));
           }
         }
       }
     }
+    int del_begin = particles.Begin(start);
+    int del_end = particles.End(end);
+    for (int p = del_begin; p < del_end; p++) {
+      if (q[p] == 0)  continue;
+      vector<int>& nearby = cells.Neighbors(cells.CellIndex(particles, p, 0));
+      for (int c = 0; c < (int)nearby.size(); c++) {
+        vector<int>& list = cells.Beads(nearby[c]);
+        for (int n = 0; n < (int)list.size(); n++) {
+          int other = list[n];
+          if ((other >= del_begin && other < del_end) || q[other] == 0)
+            continue;
+          dE += Lookup(current_real_energy_map, PairKey(ids[p], ids[other]));
+        }
+      }
+    }
+    // Repl, by removing the molecules from the structure factor.
+    ResetTrialStructureFactor();
+    for (int i = start; i <= end; i++) {
+      for (int j = 0; j < mols[i].Size(); j++) {
+        AddToTrialStructureFactor(mols[i].bds[j], 0, -1);
+      }
+    }
+    trial_repl_E = TrialReplEnergy();
+    dE += current_repl_E - trial_repl_E;
     // Self.
     for (int i = start; i <= end; i++) {
       for (int j = 0; j < mols[i].Size(); j++) {
@@ -324,8 +282,8 @@ double PotentialEwald::TrialChainEnergy(vector<Molecule>& mols,
     }
     // Dipole.
     if (dipole_correction) {
-      double dipl_E = DipoleE(mols, delete_id, chain_len/2);
-      dE += current_dipl_E - dipl_E;
+      double Mz = current_Mz - MolsDipoleZ(mols, start, end);
+      dE += current_dipl_E - DipoleE(Mz);
     }
   }
 
@@ -336,100 +294,146 @@ double PotentialEwald::TrialChainEnergy(vector<Molecule>& mols,
 // chain_len here is the actual chain length.
 void PotentialEwald::EnergyInitForLastMol(vector<Molecule>& mols, int chain_len,
                                           double bead_charge, int npbc) {
-  double ene_real, ene_repl, ene_self;
+  double ene_real, ene_self;
   double pphi_real, pphi_repl;
   int added = 1;
   // Assume all chains are the same and always go before their counterions!!!
   // Assume monovalent ions.
   if (bead_charge != 0)
     added += chain_len;
-  int added_b = 0;
-  for (int i = (int)mols.size()-added; i < (int)mols.size(); i++)
-    added_b += mols[i].Size();
-  int exist_b = 0;
-  for (int i = 0; i < (int)mols.size()-added; i++)
-    exist_b += mols[i].Size();
-  int sub = 2*(exist_b + added_b) + 1;
-
-  // Real/repl.
-  int c_add = 0;  // Counter.
+  // Real, from the energies TrialChainEnergy kept. The added beads are in the
+  // order of the trial chain.
+  vector<Bead*> added_beads;
   for (int i = (int)mols.size()-added; i < (int)mols.size(); i++) {
     for (int j = 0; j < mols[i].Size(); j++) {
-      // With existing beads.
-      int c_all = 0;
-      for (int k = 0; k < (int)mols.size()-added; k++) {
-        for (int l = 0; l < mols[k].Size(); l++) {
-          int id1 = mols[k].bds[l].ID();
-          int id2 = mols[i].bds[j].ID();
-          ene_real = trial_chain_e[c_add*sub + 2*c_all + 0];
-          ene_repl = trial_chain_e[c_add*sub + 2*c_all + 1];
-          E_tot += (ene_real + ene_repl);
-          SetEBoth2DMaps(id1, id2, ene_real, ene_repl);
-
-          if (calc_pphi) {
+      added_beads.push_back(&mols[i].bds[j]);
+    }
+  }
+  for (int i = 0; i < (int)added_beads.size(); i++) {
+    for (int j = 0; j <= i; j++) {
+      ene_real = trial_intra_e[i*(i+1)/2 + j];
+      E_tot += ene_real;
+      SetEReal(added_beads[j]->ID(), added_beads[i]->ID(), ene_real);
+    }
+  }
+  for (int n = 0; n < (int)trial_inter_e.size(); n++) {
+    E_tot += trial_inter_e[n];
+    SetEReal(trial_inter_id[n], added_beads[trial_inter_bead[n]]->ID(),
+             trial_inter_e[n]);
+  }
+
+  // Forces, which are long-ranged, for all pairs.
+  if (calc_pphi) {
+    for (int i = (int)mols.size()-added; i < (int)mols.size(); i++) {
+      for (int j = 0; j < mols[i].Size(); j++) {
+        // With existing beads.
+        for (int k = 0; k < (int)mols.size()-added; k++) {
+          for (int l = 0; l < mols[k].Size(); l++) {
             pphi_real = PairDForceReal(mols[k].bds[l], mols[i].bds[j],
                                        mols[k].bds[0], mols[i].bds[0], npbc);
             pphi_repl = PairDForceRepl(mols[k].bds[l], mols[i].bds[j],
                                        mols[k].bds[0], mols[i].bds[0], npbc);
-            SetPPhiBoth2DMaps(id1, id2, pphi_real, pphi_repl);
+            SetPPhiRealRepl(mols[k].bds[l].ID(), mols[i].bds[j].ID(),
+                            pphi_real, pphi_repl);
           }
-          c_all++;
         }
-      }
-      // Within added beads.
-      c_all = 0;
-      for (int k = (int)mols.size()-added; k <= i; k++) {
-        for (int l = 0; l < mols[k].Size(); l++) {
-          if (k < i || (k == i && l <= j)) {
-            int id1 = mols[k].bds[l].ID();
-            int id2 = mols[i].bds[j].ID();
-            ene_real = trial_chain_e[c_add*sub + 2*(exist_b+c_all) + 0];
-            ene_repl = trial_chain_e[c_add*sub + 2*(exist_b+c_all) + 1];
-            E_tot += (ene_real + ene_repl);
-            SetEBoth2DMaps(id1, id2, ene_real, ene_repl);
-
-            if (calc_pphi) {
+        // Within added beads.
+        for (int k = (int)mols.size()-added; k <= i; k++) {
+          for (int l = 0; l < mols[k].Size(); l++) {
+            if (k < i || (k == i && l <= j)) {
               pphi_real = PairDForceReal(mols[k].bds[l], mols[i].bds[j],
-                                         mols[k].bds[0], mols[i].bds[0], npbc);
+                                         mols[k].bds[0], mols[i].bds[0],
+                                         npbc);
               pphi_repl = PairDForceRepl(mols[k].bds[l], mols[i].bds[j],
-                                         mols[k].bds[0], mols[i].bds[0], npbc);
+                                         mols[k].bds[0], mols[i].bds[0],
+                                         npbc);
               if (i == k && j == l) {
                 pphi_real *= 0.5;
                 pphi_repl *= 0.5;
               }
-              SetPPhiBoth2DMaps(id1, id2, pphi_real, pphi_repl);
+              SetPPhiRealRepl(mols[k].bds[l].ID(), mols[i].bds[j].ID(),
+                              pphi_real, pphi_repl);
             }
-            c_all++;
           }
         }
       }
+    }
+  }
 
-      c_add++;
+  // Repl.
+  ResetTrialStructureFactor();
+  for (int i = (int)mols.size()-added; i < (int)mols.size(); i++) {
+    for (int j = 0; j < mols[i].Size(); j++) {
+      AddToTrialStructureFactor(mols[i].bds[j], 1, 1);
     }
   }
+  AcceptTrialStructureFactor();
+  trial_repl_E = TrialReplEnergy();
+  E_tot += trial_repl_E - current_repl_E;
+  current_repl_E = trial_repl_E;
 
   // Self.
   for (int i = (int)mols.size()-added; i < (int)mols.size(); i++) {
     for (int j = 0; j < mols[i].Size(); j++) {
       ene_self = SelfEnergy(mols[i].bds[j]);
       E_tot += ene_self;
-      SetEBothSelfMaps(mols[i].bds[j].ID(), ene_self);
+      SetESelf(mols[i].bds[j].ID(), ene_self);
     }
   }
 
   // Dipole.
   if (dipole_correction) {
-    current_dipl_E = DipoleE(mols);
-    E_tot += current_dipl_E - trial_dipl_E;
-    trial_dipl_E = current_dipl_E;
+    current_Mz += MolsDipoleZ(mols, (int)mols.size()-added,
+                              (int)mols.size()-1);
+    trial_Mz = current_Mz;
+    double dipl_E = DipoleE(current_Mz);
+    E_tot += dipl_E - current_dipl_E;
+    current_dipl_E = dipl_E;
+    trial_dipl_E = dipl_E;
+    dipole_updates++;
   }
 
 }
 
-double PotentialEwald::EnergyDifference(vector<Molecule>& mols, int active_mol,
-                                        int npbc) {
+void PotentialEwald::InitializeRealCells(CellList& cells) {
+  cells.Initialize(box_l, 3, RealCutoff());
+
+}
+
+void PotentialEwald::RealEnergyDifference(Bead& moved, Bead& other, int npbc) {
+  double new_ene_real = PairEnergyReal(moved, other, npbc);
+  int id1 = min(moved.ID(), other.ID());
+  int id2 = max(moved.ID(), other.ID());
+  dE += (new_ene_real - GetEReal(id1, id2));
+  changed_real.push_back(make_pair(id1, id2));
+  new_real_e.push_back(new_ene_real);
+
+}
+
+void PotentialEwald::RealEnergyDifference(ParticleStore& particles, int moved,
+                                          int other, int npbc) {
+  const int * ids = particles.IDs();
+  double new_ene_real = PairEnergyReal(particles, moved, other, npbc);
+  int id1 = min(ids[moved], ids[other]);
+  int id2 = max(ids[moved], ids[other]);
+  dE += (new_ene_real - GetEReal(id1, id2));
+  changed_real.push_back(make_pair(id1, id2));
+  new_real_e.push_back(new_ene_real);
+
+}
+
+double PotentialEwald::EnergyDifference(vector<Molecule>& mols,
+                                        ParticleStore& particles,
+                                        int active_mol, int npbc,
+                                        CellList& cells) {
   dE = 0;
-  double new_ene_real, new_ene_repl, new_ene_self;
+  changed_real.clear();
+  new_real_e.clear();
+  new_real_pphi.clear();
+  new_repl_pphi.clear();
+  changed_self.clear();
+  new_self_e.clear();
+  double new_ene_real, new_ene_self;
   double new_pphi_real, new_pphi_repl;
 
   // For all pairs in the active molecule that moved.
@@ -440,19 +444,15 @@ double PotentialEwald::EnergyDifference(vector<Molecule>& mols, int active_mol,
           mols[active_mol].bds[j].GetMoved()) {
         new_ene_real = PairEnergyReal(mols[active_mol].bds[i],
                                       mols[active_mol].bds[j], npbc);
-        new_ene_repl = PairEnergyRepl(mols[active_mol].bds[i],
-                                      mols[active_mol].bds[j], npbc);
         if (j == i) {
           new_ene_real *= 0.5;
-          new_ene_repl *= 0.5;
         }
 
-        SetERealRepl(1, mols[active_mol].bds[i].ID(),
-                        mols[active_mol].bds[j].ID(),
-                        new_ene_real, new_ene_repl);
-        dE += (new_ene_real + new_ene_repl -
-                       GetERealRepl(0, mols[active_mol].bds[i].ID(),
+        dE += (new_ene_real - GetEReal(mols[active_mol].bds[i].ID(),
+                                       mols[active_mol].bds[j].ID()));
+        changed_real.push_back(PairKey(mols[active_mol].bds[i].ID(),
                                        mols[active_mol].bds[j].ID()));
+        new_real_e.push_back(new_ene_real);
 
         if (calc_pphi) {
           new_pphi_real = PairDForceReal(mols[active_mol].bds[i],
@@ -467,36 +467,24 @@ double PotentialEwald::EnergyDifference(vector<Molecule>& mols, int active_mol,
             new_pphi_real *= 0.5;
             new_pphi_repl *= 0.5;
           }
-          SetPPhiRealRepl(1, mols[active_mol].bds[i].ID(),
-                             mols[active_mol].bds[j].ID(),
-                             new_pphi_real, new_pphi_repl);
+          new_real_pphi.push_back(new_pphi_real);
+          new_repl_pphi.push_back(new_pphi_repl);
         }
 
       }
     }
   }
-  // For all pairs with other molecules.
-  for (int i = 0; i < (int)mols.size(); i++) {
-    if (i != active_mol) {
-      for (int j = 0; j < mols[i].Size(); j++) {
-        for (int k = 0; k < mols[active_mol].Size(); k++) {
-          // Only do it for moved beads.
-          if (mols[active_mol].bds[k].GetMoved()) {
-            new_ene_real = PairEnergyReal(mols[active_mol].bds[k],
-                                          mols[i         ].bds[j],
-                                          npbc);
-            new_ene_repl = PairEnergyRepl(mols[active_mol].bds[k],
-                                          mols[i         ].bds[j],
-                                          npbc);
-            int id1 = min(mols[active_mol].bds[k].ID(),
-                          mols[i         ].bds[j].ID());
-            int id2 = max(mols[active_mol].bds[k].ID(),
-                          mols[i         ].bds[j].ID());
-            SetERealRepl(1, id1, id2, new_ene_real, new_ene_repl);
-            dE += (new_ene_real + new_ene_repl -
-                           GetERealRepl(0, id1, id2));
-
-            if (calc_pphi) {
+  // For all pairs with other molecules. Forces are long-ranged in reciprocal
+  // space, so all pairs are visited when they are tracked.
+  if (calc_pphi) {
+    for (int i = 0; i < (int)mols.size(); i++) {
+      if (i != active_mol) {
+        for (int j = 0; j < mols[i].Size(); j++) {
+          for (int k = 0; k < mols[active_mol].Size(); k++) {
+            // Only do it for moved beads.
+            if (mols[active_mol].bds[k].GetMoved()) {
+              RealEnergyDifference(mols[active_mol].bds[k], mols[i].bds[j],
+                                   npbc);
               new_pphi_real = PairDForceReal(mols[active_mol].bds[k],
                                              mols[i         ].bds[j],
                                              mols[active_mol].bds[0],
@@ -505,28 +493,75 @@ double PotentialEwald::EnergyDifference(vector<Molecule>& mols, int active_mol,
                                              mols[i         ].bds[j],
                                              mols[active_mol].bds[0],
                                              mols[i         ].bds[0], npbc);
-              SetPPhiRealRepl(1, id1, id2, new_pphi_real, new_pphi_repl);
+              new_real_pphi.push_back(new_pphi_real);
+              new_repl_pphi.push_back(new_pphi_repl);
             }
           }
         }
       }
     }
   }
+  else {
+    const double * q = particles.Charges();
+    int begin = particles.Begin(active_mol);
+    int end = particles.End(active_mol);
+    for (int i = begin; i < end; i++) {
+      // Only do it for moved, charged beads.
+      if (!mols[active_mol].bds[i-begin].GetMoved() || q[i] == 0)  continue;
+
+      vector<int>& old_cells = cells.Neighbors(cells.CellIndex(particles, i, 0));
+      vector<int>& new_cells = cells.Neighbors(cells.CellIndex(particles, i, 1));
+      nearby_cells.assign(old_cells.begin(), old_cells.end());
+      nearby_cells.insert(nearby_cells.end(), new_cells.begin(),
+                          new_cells.end());
+      sort(nearby_cells.begin(), nearby_cells.end());
+      nearby_cells.erase(unique(nearby_cells.begin(), nearby_cells.end()),
+                         nearby_cells.end());
+
+      for (int c = 0; c < (int)nearby_cells.size(); c++) {
+        vector<int>& list = cells.Beads(nearby_cells[c]);
+        for (int n = 0; n < (int)list.size(); n++) {
+          int j = list[n];
+          if ((j >= begin && j < end) || q[j] == 0)  continue;
+          RealEnergyDifference(particles, i, j, npbc);
+        }
+      }
+    }
+  }
+  // Repl energy, moving the charges of the moved beads in the structure
+  // factor from their current to their trial positions.
+  ResetTrialStructureFactor();
+  for (int i = 0; i < mols[active_mol].Size(); i++) {
+    if (mols[active_mol].bds[i].GetMoved()) {
+      AddToTrialStructureFactor(mols[active_mol].bds[i], 0, -1);
+      AddToTrialStructureFactor(mols[active_mol].bds[i], 1,  1);
+    }
+  }
+  trial_repl_E = TrialReplEnergy();
+  dE += trial_repl_E - current_repl_E;
   // Self-energy.
   for (int i = 0; i < mols[active_mol].Size(); i++) {
     // Only when i is moved.
     if (mols[active_mol].bds[i].GetMoved()) {
       new_ene_self = SelfEnergy(mols[active_mol].bds[i]);
-      SetESelf(1, mols[active_mol].bds[i].ID(), new_ene_self);
-      dE += (new_ene_self -
-                     GetESelf(0, mols[active_mol].bds[i].ID()));
+      dE += (new_ene_self - GetESelf(mols[active_mol].bds[i].ID()));
+      changed_self.push_back(mols[active_mol].bds[i].ID());
+      new_self_e.push_back(new_ene_self);
     }
   }
 
 
   // Only used when a confining potential is used.
   if (dipole_correction) {
-    trial_dipl_E = DipoleE(mols);
+    if (dipole_updates >= kDipoleRefreshFreq)  RefreshDipole(mols);
+    trial_Mz = current_Mz;
+    for (int i = 0; i < mols[active_mol].Size(); i++) {
+      Bead& bead = mols[active_mol].bds[i];
+      if (bead.GetMoved()) {
+        trial_Mz += bead.Charge() * (bead.GetCrd(1, 2) - bead.GetCrd(0, 2));
+      }
+    }
+    trial_dipl_E = DipoleE(trial_Mz);
     dE += trial_dipl_E - current_dipl_E;
   }
  
@@ -534,90 +569,47 @@ double PotentialEwald::EnergyDifference(vector<Molecule>& mols, int active_mol,
 
 }
 
-void PotentialEwald::FinalizeEnergyBothMaps(vector<Molecule>& mols,
-                                            int active_mol, bool accepted) {
-  // Adjust total energy variable.
+void PotentialEwald::FinalizeEnergy(bool accepted) {
+  // Adjust total energy variable and the maps, which a rejected move leaves
+  // as they were.
   if (accepted) {
-     E_tot += dE;
-  }
-
-  // Within the active molecule.
-  for (int i = 0; i < mols[active_mol].Size(); i++) {
-    for (int j = i; j < mols[active_mol].Size(); j++) {
-      if (mols[active_mol].bds[i].GetMoved() ||
-          mols[active_mol].bds[j].GetMoved()) {
-        pair<int,int> indices = make_pair(mols[active_mol].bds[i].ID(),
-                                          mols[active_mol].bds[j].ID());
-        if (accepted) {
-          // Update the current energy map if accepted.
-          current_real_energy_map[indices] = trial_real_energy_map[indices];
-          current_repl_energy_map[indices] = trial_repl_energy_map[indices];
-          current_real_pphi_map[indices] = trial_real_pphi_map[indices];
-          current_repl_pphi_map[indices] = trial_repl_pphi_map[indices];
-        }
-        else {
-          // Cover up the trial energy map if rejected.
-          trial_real_energy_map[indices] = current_real_energy_map[indices];
-          trial_repl_energy_map[indices] = current_repl_energy_map[indices];
-          trial_real_pphi_map[indices] = current_real_pphi_map[indices];
-          trial_repl_pphi_map[indices] = current_repl_pphi_map[indices];
-        }
-      }
+    E_tot += dE;
+    for (int i = 0; i < (int)changed_real.size(); i++) {
+      current_real_energy_map[changed_real[i]] = new_real_e[i];
     }
-  }
-  // Between the active molecule and the other molecules.
-  for (int i = 0; i < (int)mols.size(); i++) {
-    if(i != active_mol) {
-      for (int j = 0; j < mols[i].Size(); j++) {
-        for (int k = 0; k < mols[active_mol].Size(); k++) {
-          if (mols[active_mol].bds[k].GetMoved()) {
-            int id1 = min(mols[active_mol].bds[k].ID(),
-                          mols[i         ].bds[j].ID());
-            int id2 = max(mols[active_mol].bds[k].ID(),
-                          mols[i         ].bds[j].ID());
-            pair<int,int> indices = make_pair(id1, id2);
-            if (accepted) {
-              // Update the current energy map if accepted.
-              current_real_energy_map[indices] = trial_real_energy_map[indices];
-              current_repl_energy_map[indices] = trial_repl_energy_map[indices];
-              current_real_pphi_map[indices] = trial_real_pphi_map[indices];
-              current_repl_pphi_map[indices] = trial_repl_pphi_map[indices];
-            }
-            else {
-              // Cover up the trial energy map if rejected.
-              trial_real_energy_map[indices] = current_real_energy_map[indices];
-              trial_repl_energy_map[indices] = current_repl_energy_map[indices];
-              trial_real_pphi_map[indices] = current_real_pphi_map[indices];
-              trial_repl_pphi_map[indices] = current_repl_pphi_map[indices];
-            }
-          }
-        }
-      }
+    for (int i = 0; i < (int)new_real_pphi.size(); i++) {
+      current_real_pphi_map[changed_real[i]] = new_real_pphi[i];
+      current_repl_pphi_map[changed_real[i]] = new_repl_pphi[i];
+    }
+    for (int i = 0; i < (int)changed_self.size(); i++) {
+      current_self_energy_map[changed_self[i]] = new_self_e[i];
     }
   }
-  // Self-energy.
-  for (int i = 0; i < mols[active_mol].Size(); i++) {
-    if (mols[active_mol].bds[i].GetMoved()) {
-      int index = mols[active_mol].bds[i].ID();
-      if (accepted) {
-        // Update the current energy map if accepted.
-        current_self_energy_map[index] = trial_self_energy_map[index];
-      }
-      else {
-        // Cover up the trial energy map if rejected.
-        trial_self_energy_map[index] = current_self_energy_map[index];
-      }
-    } 
+  changed_real.clear();
+  new_real_e.clear();
+  new_real_pphi.clear();
+  new_repl_pphi.clear();
+  changed_self.clear();
+  new_self_e.clear();
+  // Structure factor.
+  if (accepted) {
+    AcceptTrialStructureFactor();
+    current_repl_E = trial_repl_E;
+  }
+  else {
+    trial_repl_E = current_repl_E;
   }
-
 
   // Only used when a confining potential is used.
   if (dipole_correction) {
     if (accepted) {
       current_dipl_E = trial_dipl_E;
+      current_Mz = trial_Mz;
+      dipole_updates++;
     }
     else {
       trial_dipl_E = current_dipl_E;
+      trial_Mz = current_Mz;
     }
   }
 
@@ -642,15 +634,9 @@ void PotentialEwald::AdjustEnergyUponMolDeletion(vector<Molecule>& mols,
           int id2 = max(mols[delete_id].bds[k].ID(), mols[i].bds[j].ID());
           pair<int,int> indices = make_pair(id1, id2);
           E_tot -= current_real_energy_map[indices];
-          E_tot -= current_repl_energy_map[indices];
           current_real_energy_map.erase(indices);
-          trial_real_energy_map.erase(indices);
-          current_repl_energy_map.erase(indices);
-          trial_repl_energy_map.erase(indices);
           current_real_pphi_map.erase(indices);
-          trial_real_pphi_map.erase(indices);
           current_repl_pphi_map.erase(indices);
-          trial_repl_pphi_map.erase(indices);
         }
       }
     }
@@ -667,21 +653,29 @@ void PotentialEwald::AdjustEnergyUponMolDeletion(vector<Molecule>& mols,
           int id2 = max(mols[i].bds[0].ID(), mols[j].bds[k].ID());
           pair<int,int> indices = make_pair(id1, id2);
           E_tot -= current_real_energy_map[indices];
-          E_tot -= current_repl_energy_map[indices];
           current_real_energy_map.erase(indices);
-          trial_real_energy_map.erase(indices);
-          current_repl_energy_map.erase(indices);
-          trial_repl_energy_map.erase(indices);
           current_real_pphi_map.erase(indices);
-          trial_real_pphi_map.erase(indices);
           current_repl_pphi_map.erase(indices);
-          trial_repl_pphi_map.erase(indices);
         }
       }
     }
   }
 
 
+  ///////////
+  // Repl. //
+  ///////////
+  ResetTrialStructureFactor();
+  for (int i = delete_id; i <= delete_id+counterion; i++) {
+    for (int j = 0; j < mols[i].Size(); j++) {
+      AddToTrialStructureFactor(mols[i].bds[j], 0, -1);
+    }
+  }
+  AcceptTrialStructureFactor();
+  trial_repl_E = TrialReplEnergy();
+  E_tot += trial_repl_E - current_repl_E;
+  current_repl_E = trial_repl_E;
+
   ///////////
   // Self. //
   ///////////
@@ -690,7 +684,6 @@ void PotentialEwald::AdjustEnergyUponMolDeletion(vector<Molecule>& mols,
       int index = mols[i].bds[j].ID();
       E_tot -= current_self_energy_map[index];
       current_self_energy_map.erase(index);
-      trial_self_energy_map.erase(index);
     }
   }
 
@@ -698,29 +691,30 @@ void PotentialEwald::AdjustEnergyUponMolDeletion(vector<Molecule>& mols,
   // Dipole correction. //
   ////////////////////////
   if (dipole_correction) {
-    double dipl_E = DipoleE(mols, delete_id, counterion);
+    current_Mz -= MolsDipoleZ(mols, delete_id, delete_id+counterion);
+    trial_Mz = current_Mz;
+    double dipl_E = DipoleE(current_Mz);
     E_tot += dipl_E - current_dipl_E;
     current_dipl_E = dipl_E;
     trial_dipl_E = dipl_E;
+    dipole_updates++;
   }
 
 }
 
 void PotentialEwald::UpdateEnergyComponents(vector<Molecule>& mols, int npbc) {
   current_real_E = 0;
-  current_repl_E = 0;
   current_self_E = 0;
 
-  // Real/repl energies.
+  // Real energies. The repl energy is always kept up to date.
   for (int i = 0; i < (int)mols.size(); i++) {
     for (int j = i; j < (int)mols.size(); j++) {
       for (int k = 0; k < mols[i].Size(); k++) {
         for (int l = 0; l < mols[j].Size(); l++) {
           if ((j == i && l >= k) || (j > i)) {
-            pair<int,int> indices = make_pair(mols[i].bds[k].ID(),
-                                              mols[j].bds[l].ID());
-            current_real_E += current_real_energy_map[indices];
-            current_repl_E += current_repl_energy_map[indices];
+            current_real_E += Lookup(current_real_energy_map,
+                                     PairKey(mols[i].bds[k].ID(),
+                                             mols[j].bds[l].ID()));
           }
         }
       }
@@ -746,24 +740,25 @@ double PotentialEwald::PUPV(vector<Molecule>& mols, double vol, int npbc) {
       for (int k = 0; k < i_s; k++) {    // For every idx in mol 1.
         for (int l = 0; l < j_s; l++) {  // For every idx in mol 2.
           if ((j == i && l >= k) || (j > i)) {
-            int id1 = mols[i].bds[k].ID();
-            int id2 = mols[j].bds[l].ID(); 
-            pair<int,int> indices = make_pair(id1, id2);
-            double phi_r = current_real_energy_map[indices];
-            double phi_k = current_repl_energy_map[indices];
-            double ddphi_r = current_real_pphi_map[indices];
-            double ddphi_k = current_repl_pphi_map[indices];
+            pair<int,int> indices = PairKey(mols[i].bds[k].ID(),
+                                            mols[j].bds[l].ID());
+            double phi_r = Lookup(current_real_energy_map, indices);
+            double ddphi_r = Lookup(current_real_pphi_map, indices);
+            double ddphi_k = Lookup(current_repl_pphi_map, indices);
             if (j == i && l == k) {
               ddphi_r = 0;
               ddphi_k = 0;
             }
-            pUpV += - phi_r - phi_k - ddphi_r - ddphi_k;
+            pUpV += - phi_r - ddphi_r - ddphi_k;
           }
         }
       }
     }
   }
 
+  // Add repl energy, which is the sum of all repl pair energies.
+  pUpV += - current_repl_E;
+
   // Add self energy.
   for (int i = 0; i < (int)mols.size(); i++) {
     int i_s = mols[i].Size();
@@ -788,11 +783,10 @@ double PotentialEwald::RDotF(vector<Molecule>& mols, double vol, int npbc) {
       for (int k = 0; k < i_s; k++) {
         for (int l = 0; l < j_s; l++) {
           if ((j == i && l >= k) || (j > i)) {
-            int id1 = mols[i].bds[k].ID();
-            int id2 = mols[j].bds[l].ID();
-            pair<int,int> indices = make_pair(id1, id2);
-            double pphi_r = current_real_pphi_map[indices];
-            double pphi_k = current_repl_pphi_map[indices];
+            pair<int,int> indices = PairKey(mols[i].bds[k].ID(),
+                                            mols[j].bds[l].ID());
+            double pphi_r = Lookup(current_real_pphi_map, indices);
+            double pphi_k = Lookup(current_repl_pphi_map, indices);
             if (j == i && l == k) {
               pphi_r = 0;
               pphi_k = 0;
@@ -833,4 +827,123 @@ bool PotentialEwald::UseDipoleCorrection() {
 
 }
 
+double PotentialEwald::MolsDipoleZ(vector<Molecule>& mols, int first,
+                                   int last) {
+  double Mz = 0;
+  for (int i = first; i <= last; i++) {
+    for (int j = 0; j < mols[i].Size(); j++) {
+      // If the simulation is done correctly, the z coordinates should all be
+      // within the unit cell.
+      Mz += mols[i].bds[j].Charge() * mols[i].bds[j].GetCrd(0, 2);
+    }
+  }
+  return Mz;
+
+}
+
+// Called between moves, when the current positions of the beads are the ones
+// current_Mz describes.
+void PotentialEwald::RefreshDipole(vector<Molecule>& mols) {
+  current_Mz = MolsDipoleZ(mols, 0, (int)mols.size()-1);
+  trial_Mz = current_Mz;
+  double dipl_E = DipoleE(current_Mz);
+  E_tot += dipl_E - current_dipl_E;
+  current_dipl_E = dipl_E;
+  trial_dipl_E = dipl_E;
+  dipole_updates = 0;
+
+}
+
+void PotentialEwald::SaveState(ostream& out) {
+  WriteBinary(out, E_tot);
+  WriteBinary(out, current_real_E);
+  WriteBinary(out, current_repl_E);
+  WriteBinary(out, current_self_E);
+  WriteBinary(out, current_dipl_E);
+  WriteBinary(out, current_Mz);
+  WriteBinary(out, dipole_updates);
+  WriteBinary(out, current_real_energy_map);
+  WriteBinary(out, current_self_energy_map);
+  WriteBinary(out, current_real_pphi_map);
+  WriteBinary(out, current_repl_pphi_map);
+  SaveStructureFactor(out);
+
+}
+
+void PotentialEwald::LoadState(istream& in) {
+  ReadBinary(in, E_tot);
+  ReadBinary(in, current_real_E);
+  ReadBinary(in, current_repl_E);
+  ReadBinary(in, current_self_E);
+  ReadBinary(in, current_dipl_E);
+  ReadBinary(in, current_Mz);
+  ReadBinary(in, dipole_updates);
+  ReadBinary(in, current_real_energy_map);
+  ReadBinary(in, current_self_energy_map);
+  ReadBinary(in, current_real_pphi_map);
+  ReadBinary(in, current_repl_pphi_map);
+  trial_repl_E = current_repl_E;
+  trial_dipl_E = current_dipl_E;
+  trial_Mz = current_Mz;
+  changed_real.clear();
+  new_real_e.clear();
+  new_real_pphi.clear();
+  new_repl_pphi.clear();
+  changed_self.clear();
+  new_self_e.clear();
+  dE = 0;
+  LoadStructureFactor(in);
+
+}
+
+void PotentialEwald::SwapState(PotentialEwald& other) {
+  double ratio = GetlB() / other.GetlB();
+  swap(E_tot, other.E_tot);
+  swap(current_real_E, other.current_real_E);
+  swap(current_repl_E, other.current_repl_E);
+  swap(current_self_E, other.current_self_E);
+  swap(current_dipl_E, other.current_dipl_E);
+  swap(current_Mz, other.current_Mz);
+  swap(dipole_updates, other.dipole_updates);
+  current_real_energy_map.swap(other.current_real_energy_map);
+  current_self_energy_map.swap(other.current_self_energy_map);
+  current_real_pphi_map.swap(other.current_real_pphi_map);
+  current_repl_pphi_map.swap(other.current_repl_pphi_map);
+  ScaleEnergies(ratio);
+  other.ScaleEnergies(1/ratio);
+  SwapStructureFactor(other);
 
+}
+
+void PotentialEwald::ScaleEnergies(double factor) {
+  E_tot *= factor;
+  current_real_E *= factor;
+  current_repl_E *= factor;
+  current_self_E *= factor;
+  current_dipl_E *= factor;
+  map<pair<int,int>, double>::iterator it;
+  for (it = current_real_energy_map.begin();
+       it != current_real_energy_map.end(); it++)
+    it->second *= factor;
+  for (it = current_real_pphi_map.begin();
+       it != current_real_pphi_map.end(); it++)
+    it->second *= factor;
+  for (it = current_repl_pphi_map.begin();
+       it != current_repl_pphi_map.end(); it++)
+    it->second *= factor;
+  map<int, double>::iterator self;
+  for (self = current_self_energy_map.begin();
+       self != current_self_energy_map.end(); self++)
+    self->second *= factor;
+  trial_repl_E = current_repl_E;
+  trial_dipl_E = current_dipl_E;
+  trial_Mz = current_Mz;
+  changed_real.clear();
+  new_real_e.clear();
+  new_real_pphi.clear();
+  new_repl_pphi.clear();
+  changed_self.clear();
+  new_self_e.clear();
+  dE = 0;
+
+}
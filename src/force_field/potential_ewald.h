@@ -7,6 +7,8 @@
 
 #include "../molecules/bead.h"
 #include "../molecules/molecule.h"
+#include "../molecules/particle_store.h"
+#include "cell_list.h"
 
 /** The "ewald potential" here refer to long-ranged potentials that interact
     across multiple periodic boxes. Electrostatic potentials are commonly
@@ -22,23 +24,14 @@ class PotentialEwald {
   ////////////////////////////
   // Energy and force maps. //
   ////////////////////////////
-  /** Real energy of the current configuration. */
+  /** Real energy of the current configuration. The reciprocal energy is not
+      stored per pair, it is kept as a total through the structure factor. */
   map<pair<int,int>, double> current_real_energy_map;
-  /** Reciprocal energy of the current configuration. */
-  map<pair<int,int>, double> current_repl_energy_map;
   /** Self energy of the current configuration. */
   map<int,           double> current_self_energy_map;
-  /** Real energy of the MC trial configuration. */
-  map<pair<int,int>, double> trial_real_energy_map;
-  /** Reciprocal energy of the MC trial configuration. */
-  map<pair<int,int>, double> trial_repl_energy_map;
-  /** Self energy of the MC trial configuration. (unchanged) */
-  map<int,           double> trial_self_energy_map;
-  // The corresponding force maps for the current and the trial configurations.
+  // The corresponding force maps for the current configuration.
   map<pair<int,int>, double> current_real_pphi_map;
   map<pair<int,int>, double> current_repl_pphi_map;
-  map<pair<int,int>, double> trial_real_pphi_map;
-  map<pair<int,int>, double> trial_repl_pphi_map;
 
   //////////////////
   // Energy sums. //
@@ -49,24 +42,68 @@ class PotentialEwald {
   double current_real_E;
   /** Total current reciprocal energy of the system. */
   double current_repl_E;
+  /** Total reciprocal energy of the MC trial configuration. */
+  double trial_repl_E;
   /** Total current self energy of the system. */
   double current_self_E;
   /** Total current dipole correction energy of the system. */
   double current_dipl_E;
   /** Total trial dipole correction energy of the system. */
   double trial_dipl_E;
+  /** Number of updates of current_Mz since it was last summed from scratch. */
+  int dipole_updates;
   /** Total energy change upon MC move. */
   double dE;
 
   ////////////
   // Other. //
   ////////////
-  /** Temporarily store the energies for the trial chain for the GCMC routine to
-      avoid recalculation (Actually, this has not been fully utilized, the
-      current simulation code is still doing repetative calcultions). */
-  double * trial_chain_e;
+  /** Real-space energies kept by TrialChainEnergy for EnergyInitForLastMol.
+      Pairs within the trial chain, indexed i*(i+1)/2 + j for j <= i. */
+  vector<double> trial_intra_e;
+  /** Pairs of the trial chain with existing particles in neighboring cells:
+      the chain index, the ID of the existing particle and the energy. */
+  vector<int> trial_inter_bead;
+  vector<int> trial_inter_id;
+  vector<double> trial_inter_e;
   /** Decide whether forces are calculated when energies are calculated. */
   bool calc_pphi;
+  /** The bead ID pairs whose real energies the last EnergyDifference call
+      computed, with their real energies after the move and, if forces are
+      calculated, their real and reciprocal forces. They are only written to
+      the maps if the move is accepted. */
+  vector<pair<int,int> > changed_real;
+  vector<double> new_real_e;
+  vector<double> new_real_pphi;
+  vector<double> new_repl_pphi;
+  /** The same for the self energies of the moved beads. */
+  vector<int> changed_self;
+  vector<double> new_self_e;
+  /** Scratch list of the cells around the moved beads. */
+  vector<int> nearby_cells;
+
+  /** Compute the real energy between a moved bead and a bead of another
+      molecule, keep it with the changed pairs and add the change to dE. */
+  void RealEnergyDifference(Bead&, Bead&, int);
+  /** Same as above for two particles in the particle store. */
+  void RealEnergyDifference(ParticleStore&, int, int, int);
+  /** The key of a pair of bead IDs in the pair maps, the smaller ID first.
+      Molecule order does not follow ID order once GC deletions have moved
+      molecules into the gaps, so every key goes through here. */
+  static pair<int,int> PairKey(int, int);
+  /** The value of a pair map for a key, zero if it was never set. Unlike
+      operator[] it does not insert the key. */
+  static double Lookup(const map<pair<int,int>, double>&,
+                       const pair<int,int>&);
+  /** The z dipole moment sum q*z of the current positions of the molecules
+      first to last, both included. */
+  double MolsDipoleZ(vector<Molecule>&, int, int);
+  /** Sum current_Mz from scratch and correct the dipole energy for the
+      rounding errors the updates have piled up. */
+  void RefreshDipole(vector<Molecule>&);
+  /** Multiply all stored energies and forces, which are proportional to the
+      Bjerrum length, by a factor, and drop the last MC move. */
+  void ScaleEnergies(double);
 
  protected:
   /** The dimesion of the simulation unit cell. They will be the padded
@@ -82,6 +119,12 @@ class PotentialEwald {
   /** Decide whether to use dipole correction. Dipole correction should be used
       for systems confined along the z-direction. */
   bool dipole_correction;
+  /** The total z dipole moment Mz = sum q*z of the current configuration,
+      updated by the moved, inserted and deleted beads, so that the dipole
+      correction costs O(beads changed) instead of a sum over all beads. */
+  double current_Mz;
+  /** Mz of the MC trial configuration. */
+  double trial_Mz;
 
  public:
   /////////////////////
@@ -96,15 +139,55 @@ class PotentialEwald {
   ///////////////////////
   /** Compute real pair energy. */
   virtual double PairEnergyReal(Bead&, Bead&, int) = 0;
-  /** Compute reciprocal pair energy. */
-  virtual double PairEnergyRepl(Bead&, Bead&, int) = 0;
+  /** Compute real pair energy between the trial positions of two particles in
+      the particle store. */
+  virtual double PairEnergyReal(ParticleStore&, int, int, int) = 0;
+  /** Compute reciprocal pair energy. The last argument is the index of the
+      pool thread that calls it, to pick its scratch buffers. */
+  virtual double PairEnergyRepl(Bead&, Bead&, int, int = 0) = 0;
+  /** Compute the reciprocal energy of a bead, at its trial position, with
+      all charges of the current configuration, i.e. the sum of
+      PairEnergyRepl with every bead, from the structure factor. The last
+      argument is the pool thread, as for PairEnergyRepl. */
+  virtual double BeadReplEnergy(Bead&, int = 0) = 0;
+  /** Bring the current structure factor up to date for BeadReplEnergy.
+      Called outside the thread pool, after the last accepted move. */
+  virtual void PrepareBeadReplEnergy() = 0;
   /** Compute the self energy for each bead. */
   virtual double SelfEnergy(Bead&) = 0;
+  /** The distance beyond which all real pair energies are neglected. */
+  virtual double RealCutoff() = 0;
+  /** Zero the structure factor of the trial configuration. */
+  virtual void ClearTrialStructureFactor() = 0;
+  /** Copy the current structure factor into the trial one. */
+  virtual void ResetTrialStructureFactor() = 0;
+  /** Add the charge of a bead, times the sign (+1 or -1), to the trial
+      structure factor. The flag selects the current (0) or the trial (1)
+      position of the bead. */
+  virtual void AddToTrialStructureFactor(Bead&, int, double) = 0;
+  /** Compute the total reciprocal energy from the trial structure factor. */
+  virtual double TrialReplEnergy() = 0;
+  /** Make the trial structure factor the current one. */
+  virtual void AcceptTrialStructureFactor() = 0;
+  /** Write the current structure factor to a checkpoint, and read it back
+      as both the current and the trial one. */
+  virtual void SaveStructureFactor(ostream&) = 0;
+  virtual void LoadStructureFactor(istream&) = 0;
+  /** Exchange the current structure factor with another Ewald potential for
+      which SameSums holds. */
+  virtual void SwapStructureFactor(PotentialEwald&) = 0;
+  /** Whether another Ewald potential sums over the same images and k vectors,
+      so that its energies of a configuration are those of this one times
+      the ratio of the Bjerrum lengths. */
+  virtual bool SameSums(PotentialEwald&) = 0;
   /** Compute real pair energy for scaled volume in pressure calculations. */
   virtual double PairEnergyRealForP(Bead&, Bead&, int) = 0;
-  /** Compute reciprocalpair energy for scaled volume in pressure calculations.
-      */
-  virtual double PairEnergyReplForP(Bead&, Bead&, int) = 0;
+  /** The change of the reciprocal energy between groups of molecules when
+      the volume is scaled for pressure calculations, from the structure
+      factor of each group. The group of each molecule is given, -1 leaves it
+      out, and the change for groups a <= b goes to [a*n_groups + b]. */
+  virtual void GroupReplEnergyForP(vector<Molecule>&, vector<int>&, int,
+                                   double[]) = 0;
   /** Compute real pair force along Z direction, for pressure calculations. */
   virtual double PairForceZReal(Bead&, Bead&, int) = 0;
   /** Compute reciprocal pair force along Z direction, for pressure
@@ -114,53 +197,58 @@ class PotentialEwald {
   virtual double ForceZDipole(Bead&, double) = 0;
   virtual double PairDForceReal(Bead&, Bead&, Bead&, Bead&, int) = 0;
   virtual double PairDForceRepl(Bead&, Bead&, Bead&, Bead&, int) = 0;
-  virtual double DipoleE(vector<Molecule>&) = 0;
-  virtual double DipoleE(vector<Molecule>&, vector<Bead>&) = 0;
-  virtual double DipoleE(vector<Molecule>&, int, int) = 0;
+  /** The dipole correction energy for a total z dipole moment. */
+  virtual double DipoleE(double) = 0;
   virtual double DipoleEDiff(vector<Molecule>&, vector<Bead>&, Bead&, Bead&,
                              int, int, double, int) = 0;
   // Partial U partial V.
   double PUPV(vector<Molecule>&, double, int);
   double RDotF(vector<Molecule>&, double, int);
 
-  /** Set energy between a specific pair in the designated energy maps.\n
-      Input arguments:\n
-        int - 0 sets current real and repl maps, 1 sets the trial ones.\n
-        int - Index for bead 1.\n
-        int - Index for bead 2.\n
-        double - The real energy value.\n
-        double - The repl energy value. */
-  void SetERealRepl(int, int, int, double, double);
-  void SetPPhiRealRepl(int, int, int, double, double);
-  /** Similar to above, set self-energy in the designated map. */
-  void SetESelf(int, int, double);
-  /** Set energy between a specific pair in both trial and current, real and
-      repl energy maps. */
-  void SetEBoth2DMaps(int, int, double, double);
-  void SetPPhiBoth2DMaps(int, int, double, double);
-  /** Set energy between a specific pair in both trial and current self-energy
-      maps. */
-  void SetEBothSelfMaps(int, double);
-  /** Get real energy + repl energy between a specific pair in the designated
-      energy map. */
-  double GetERealRepl(int, int, int);
-  double GetEReal(int, int, int);
-  double GetERepl(int, int, int);
+  /** Set the real energy between a pair of bead IDs, in either order. */
+  void SetEReal(int, int, double);
+  /** Set the real and reciprocal forces between a pair of bead IDs, in
+      either order. */
+  void SetPPhiRealRepl(int, int, double, double);
+  /** Set the self energy of a bead ID. */
+  void SetESelf(int, double);
+  /** Get the real energy between a pair of bead IDs, in either order, zero
+      if it was never set. The reciprocal pair energy is not stored, use PairEnergyRepl. */
+  double GetEReal(int, int);
   /** Get the self-energy for a bead. */
-  double GetESelf(int, int);
+  double GetESelf(int);
   /** Return total energy. */
   double GetTotalEnergy();
   // Part 2.
   /** Fill in all energy maps with values for initial configuration. */
   void EnergyInitialization(vector<Molecule>&, int); 
-  /** Calculate the dE due to a MC move. */
-  double EnergyDifference(vector<Molecule>&, int, int);
-  /** Update all energy maps after the decision of a MC move is made. */
-  void FinalizeEnergyBothMaps(vector<Molecule>&, int, bool);
+  /** Size a cell list for the real space sum. The cells cover the (possibly
+      padded) Ewald unit cell, periodic along all three dimensions like the
+      image sum. */
+  void InitializeRealCells(CellList&);
+  /** Calculate the dE due to a MC move. Real energies with other molecules
+      are only computed in the cells around the old and new positions of the
+      moved beads, reading the positions from the particle store. */
+  double EnergyDifference(vector<Molecule>&, ParticleStore&, int, int,
+                          CellList&);
+  /** Write the new energies of an accepted MC move to the maps, and drop
+      them if it was rejected. Costs O(pairs visited by the move). */
+  void FinalizeEnergy(bool);
+  /** Write the current energies and structure factor to a checkpoint. */
+  void SaveState(ostream&);
+  /** Read them back, the structure factor as both the current and the trial
+      one. */
+  void LoadState(istream&);
+  /** Exchange the current energies and structure factor with another Ewald
+      potential for which SameSums holds, e.g. the one of another replica,
+      and rescale them to the Bjerrum length of each. */
+  void SwapState(PotentialEwald&);
 
   /** Calculate the energy between the CBMC trial chain and the rest of the
-      system. */
-  double TrialChainEnergy(vector<Molecule>&, vector<Bead>&, int, int, int);
+      system. The real-space part only visits the neighboring cells of the
+      real cell list. */
+  double TrialChainEnergy(vector<Molecule>&, vector<Bead>&, int, int, int,
+                          ParticleStore&, CellList&);
   /** Initialize a new molecule (requires that the beads have proper IDs).
       Assumes mol is inserted at end of mol array! */
   void EnergyInitForLastMol(vector<Molecule>&, int, double, int);
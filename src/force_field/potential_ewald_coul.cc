@@ -1,15 +1,26 @@
 #include "potential_ewald_coul.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iomanip>
 #include <vector>
 
 #include "../molecules/molecule.h"
+#include "../utilities/binary_io.h"
 #include "../utilities/constants.h"
 #include "../utilities/misc.h"
 
-PotentialEwaldCoul::PotentialEwaldCoul(string potential_name, double box_l[3])
+/** Bounds on the number of intervals of the real space kernel table. */
+const int kMinRealTable = 1024;
+const int kMaxRealTable = 262144;
+/** Samples per interval when validating the table against libm. */
+const int kRealTableSamples = 16;
+
+PotentialEwaldCoul::PotentialEwaldCoul(string potential_name, double box_l[3],
+                                       int n_charges_in, int n_threads_in)
                                      : PotentialEwald(potential_name, box_l) {
+  n_charges = n_charges_in;
+  n_threads = n_threads_in;
   ReadParameters(); 
 
 }
@@ -18,22 +29,34 @@ PotentialEwaldCoul::~PotentialEwaldCoul() {
   delete [] kx;
   delete [] ky;
   delete [] kz;
-  delete [] k2;
-  delete [] ek2;
-  delete [] kz_forP;
-  delete [] k2_forP;
-  delete [] ek2_forP;
+  delete [] half_l;
+  delete [] half_k;
+  delete [] half_ek2;
+  delete [] half_l_forP;
+  delete [] half_ek2_forP;
+  delete [] s_re;
+  delete [] s_im;
+  delete [] s_trial_re;
+  delete [] s_trial_im;
+  delete [] phase_scratch;
+  delete [] real_table;
 
 }
 
 void PotentialEwaldCoul::ReadParameters() {
-  cout << setw(35) << "[EP] Ewald potential type   : " << "Coul" << endl;
+  cout << setw(35) << "[EP] Ewald potential type   : " << PotentialName()
+       << endl;
 
   string flag;
   cin >> flag >> lB
       >> flag >> dielectric
       >> flag >> alpha
       >> flag >> dipole_correction;
+  // Without a tolerance the real space kernel is not tabulated.
+  table_tol = 0;
+  table_validate = false;
+  ReadOptional(cin, "s3_Ewald_table_tolerance", table_tol);
+  ReadOptional(cin, "s3_Ewald_table_validate", table_validate);
   // e2 * kKe / (dielectric * lB), in unit J*A/(unit length)
   kBT_derived = kKe / (dielectric * lB);
   // In unit K*A/(unit length)
@@ -52,6 +75,17 @@ void PotentialEwaldCoul::ReadParameters() {
     box_vol_forP = box_l[0]*box_l[1]*(box_l[2]+kDz);
   else
     box_vol_forP = box_l[0]*box_l[1]*(box_l[2]+kDz);
+  // A non-positive alpha asks for the value that balances the real and the
+  // reciprocal work of a single particle move at fixed accuracy. The number of
+  // real space neighbors grows as N/V*(s/sqrt(alpha))^3 and the number of k
+  // vectors as V*(s*sqrt(alpha))^3, which are equal at
+  // alpha = pi*(N/V^2)^(1/3).
+  bool tune_alpha = (alpha <= 0);
+  if (tune_alpha) {
+    alpha = kPi * pow(max(n_charges, 1)/(box_vol*box_vol), 1.0/3);
+  }
+  sqrt_alpha = sqrt(alpha);
+  gauss_prefactor = 2*sqrt(alpha/kPi);
   // Automatically decide real space cutoff. Using unit charge as a criteria.
   real_cutoff = 1;
   while (0.5*lB*1*1*erfc(sqrt(alpha)*real_cutoff)/real_cutoff
@@ -81,11 +115,6 @@ void PotentialEwaldCoul::ReadParameters() {
   kx = new double[repl_ceto[0]];
   ky = new double[repl_ceto[1]];
   kz = new double[repl_ceto[2]];
-  k2 = new double[repl_ceto[0]*repl_ceto[1]*repl_ceto[2]];
-  ek2 = new double[repl_ceto[0]*repl_ceto[1]*repl_ceto[2]];
-  kz_forP = new double[repl_ceto[2]];
-  k2_forP = new double[repl_ceto[0]*repl_ceto[1]*repl_ceto[2]];
-  ek2_forP = new double[repl_ceto[0]*repl_ceto[1]*repl_ceto[2]];
   for (int lx = -repl_cell[0]; lx <= repl_cell[0]; lx++) {
     kx[lx+repl_cell[0]] = lx * 2*kPi / box_l[0];
   }
@@ -94,66 +123,251 @@ void PotentialEwaldCoul::ReadParameters() {
   }
   for (int lz = -repl_cell[2]; lz <= repl_cell[2]; lz++) {
     kz[lz+repl_cell[2]] = lz * 2*kPi / box_l[2];
-    if (dipole_correction)
-      kz_forP[lz+repl_cell[2]] = lz * 2*kPi / (box_l[2] + kDz);
-    else
-      kz_forP[lz+repl_cell[2]] = lz * 2*kPi / (box_l[2] + kDz);
   }
-  for (int lx = -repl_cell[0]; lx <= repl_cell[0]; lx++) {
+  // The half space of k vectors within the cutoff.
+  // The box scaled along z for the pressure takes the same l indices, with
+  // the vectors of the scaled box that are within the cutoff.
+  vector<int> l_list;
+  vector<int> l_list_forP;
+  vector<double> ek2_list_forP;
+  for (int lx = 0; lx <= repl_cell[0]; lx++) {
     for (int ly = -repl_cell[1]; ly <= repl_cell[1]; ly++) {
       for (int lz = -repl_cell[2]; lz <= repl_cell[2]; lz++) {
-        int idx = lx+repl_cell[0];
-        int idy = ly+repl_cell[1];
-        int idz = lz+repl_cell[2];
-        int index = repl_ceto[1]*repl_ceto[2]*idx + repl_ceto[2]*idy + idz;
-        k2[index] = kx[idx]*kx[idx] + ky[idy]*ky[idy] + kz[idz]*kz[idz];
-        k2_forP[index] = kx[idx]*kx[idx] + ky[idy]*ky[idy] + kz_forP[idz]*kz_forP[idz];
-        ek2[index] = exp(-k2[index]/(4*alpha)) / k2[index];
-        ek2_forP[index] = exp(-k2_forP[index]/(4*alpha)) / k2_forP[index];
+        if (lx == 0 && (ly < 0 || (ly == 0 && lz <= 0)))  continue;
+        double k2 = kx[lx+repl_cell[0]]*kx[lx+repl_cell[0]] +
+                    ky[ly+repl_cell[1]]*ky[ly+repl_cell[1]] +
+                    kz[lz+repl_cell[2]]*kz[lz+repl_cell[2]];
+        if (k2 <= repl_cutoff) {
+          l_list.push_back(lx);
+          l_list.push_back(ly);
+          l_list.push_back(lz);
+        }
+        double kz_forP = lz * 2*kPi / (box_l[2] + kDz);
+        double k2_forP = kx[lx+repl_cell[0]]*kx[lx+repl_cell[0]] +
+                         ky[ly+repl_cell[1]]*ky[ly+repl_cell[1]] +
+                         kz_forP*kz_forP;
+        if (k2_forP <= repl_cutoff) {
+          l_list_forP.push_back(lx);
+          l_list_forP.push_back(ly);
+          l_list_forP.push_back(lz);
+          ek2_list_forP.push_back(exp(-k2_forP/(4*alpha)) / k2_forP);
+        }
       }
     }
   }
+  n_half_k = (int)l_list.size() / 3;
+  half_l = new int[3*n_half_k];
+  half_k = new double[3*n_half_k];
+  half_ek2 = new double[n_half_k];
+  for (int n = 0; n < n_half_k; n++) {
+    half_l[3*n]   = l_list[3*n];
+    half_l[3*n+1] = l_list[3*n+1];
+    half_l[3*n+2] = l_list[3*n+2];
+    half_k[3*n]   = kx[l_list[3*n]   + repl_cell[0]];
+    half_k[3*n+1] = ky[l_list[3*n+1] + repl_cell[1]];
+    half_k[3*n+2] = kz[l_list[3*n+2] + repl_cell[2]];
+    double k2 = half_k[3*n]*half_k[3*n] + half_k[3*n+1]*half_k[3*n+1] +
+                half_k[3*n+2]*half_k[3*n+2];
+    half_ek2[n] = exp(-k2/(4*alpha)) / k2;
+  }
+  n_half_k_forP = (int)l_list_forP.size() / 3;
+  half_l_forP = new int[3*n_half_k_forP];
+  half_ek2_forP = new double[n_half_k_forP];
+  for (int n = 0; n < n_half_k_forP; n++) {
+    half_l_forP[3*n]   = l_list_forP[3*n];
+    half_l_forP[3*n+1] = l_list_forP[3*n+1];
+    half_l_forP[3*n+2] = l_list_forP[3*n+2];
+    half_ek2_forP[n] = ek2_list_forP[n];
+  }
+  phase_size = 2*(repl_ceto[0] + repl_ceto[1] + repl_ceto[2]);
+  phase_scratch = new double[n_threads*phase_size];
+  s_re = new double[n_half_k]();
+  s_im = new double[n_half_k]();
+  s_trial_re = new double[n_half_k]();
+  s_trial_im = new double[n_half_k]();
   ////////////////////////
 
+  real_table = NULL;
+  if (table_tol > 0)  BuildRealTable();
+
   cout << setw(35) << "[EP] Bjerrum length (ul)    : " << lB          << endl;
   cout << setw(35) << "[EP] Dielectric constant    : " << dielectric  << endl;
   cout << setw(35) << "[EP] Derived kBT in J*A/ul  : " << kBT_derived << endl;
   cout << setw(35) << "[EP] Derived T K*A/ul       : " << T_derived   << endl;
-  cout << setw(35) << "[EP] Ewald alpha (ul^-2)    : " << alpha       << endl;
+  cout << setw(35) << "[EP] Ewald alpha (ul^-2)    : " << alpha
+       << (tune_alpha ? " (tuned)" : "") << endl;
   cout << setw(35) << "[EP] Real space cutoff (ul) : " << real_cutoff << endl;
   cout << setw(35) << "[EP] (cell sum number)      : "
        << ceil((real_cell[0]+real_cell[1]+real_cell[2])/3.0) << endl;
   cout << setw(35) << "[EP] k space cutoff (ul^-2) : " << repl_cutoff << endl;
   cout << setw(35) << "[EP] (k sum number)         : "
        << ceil((repl_cell[0]+repl_cell[1]+repl_cell[2])/3.0) << endl;
+  cout << setw(35) << "[EP] (k vectors, half)      : " << n_half_k << endl;
   cout << setw(35) << "[EP] Use dipole correction? : " 
        << YesOrNo(dipole_correction) << endl;
+  if (table_tol > 0) {
+    cout << setw(35) << "[EP] Real kernel table tol  : " << table_tol << endl;
+    cout << setw(35) << "[EP] (table intervals)      : " << table_n << endl;
+    cout << setw(35) << "[EP] (libm below r, ul)     : "
+         << sqrt(table_start*table_h) << endl;
+    if (table_validate)  ValidateRealTable();
+  }
+  else {
+    cout << setw(35) << "[EP] Real kernel table tol  : " << "off (libm)"
+         << endl;
+  }
 
 }
 
-double PotentialEwaldCoul::PairEnergyReal(Bead& bead1, Bead& bead2, int npbc) {
-  double q1 = bead1.Charge();
-  double q2 = bead2.Charge();
+// The grid is refined until the part of it that meets the tolerance starts
+// below r = 1, or the table reaches kMaxRealTable intervals. The Hermite
+// error is largest near the middle of an interval, which is where each
+// interval is checked against libm.
+void PotentialEwaldCoul::BuildRealTable() {
+  double s_max = real_cutoff * real_cutoff;
+  table_n = kMinRealTable / 2;
+  do {
+    table_n *= 2;
+    table_h = s_max / table_n;
+    table_inv_h = 1.0 / table_h;
+    delete [] real_table;
+    real_table = new double[4*(table_n+1)];
+    // s = 0 is never evaluated from the table.
+    for (int i = 0; i < 4; i++)  real_table[i] = 0;
+    for (int i = 1; i <= table_n; i++) {
+      double s = i * table_h;
+      double f, g;
+      ExactRealKernel(s, f, g);
+      double dg = -(1.5*g + alpha*gauss_prefactor*exp(-alpha*s)) / s;
+      real_table[4*i]   = f;
+      real_table[4*i+1] = -0.5 * g * table_h;
+      real_table[4*i+2] = g;
+      real_table[4*i+3] = dg * table_h;
+    }
+    table_start = 1;
+    for (int i = 1; i < table_n; i++) {
+      double f, g;
+      ExactRealKernel((i+0.5) * table_h, f, g);
+      if (fabs(InterpolateRealTable(i, 0.5, 0) - f) > table_tol * fabs(f) ||
+          fabs(InterpolateRealTable(i, 0.5, 2) - g) > table_tol * fabs(g)) {
+        table_start = i + 1;
+      }
+    }
+  } while (table_start * table_h > 1 && table_n < kMaxRealTable);
+
+}
+
+void PotentialEwaldCoul::ValidateRealTable() {
+  double max_err_e;
+  double max_err_f;
+  RealTableErrors(max_err_e, max_err_f);
+  cout << setw(35) << "[EP] Table max rel err (E)  : " << max_err_e << endl;
+  cout << setw(35) << "[EP] Table max rel err (F)  : " << max_err_f << endl;
+
+}
+
+void PotentialEwaldCoul::ExactRealKernel(double s, double& f, double& g) {
+  double r = sqrt(s);
+  f = erfc(sqrt_alpha*r) / r;
+  g = (f + gauss_prefactor*exp(-alpha*s)) / s;
+
+}
+
+double PotentialEwaldCoul::InterpolateRealTable(int i, double t, int offset) {
+  double * lo = real_table + 4*i + offset;
+  double * hi = lo + 4;
+  double t2 = t*t;
+  double t3 = t2*t;
+  return (2*t3 - 3*t2 + 1)*lo[0] + (t3 - 2*t2 + t)*lo[1]
+         + (3*t2 - 2*t3)*hi[0] + (t3 - t2)*hi[1];
+
+}
+
+double PotentialEwaldCoul::RealKernelE(double s) {
+  if (real_table != NULL) {
+    double x = s * table_inv_h;
+    int i = (int)x;
+    if (i >= table_start && i < table_n)
+      return InterpolateRealTable(i, x - i, 0);
+  }
+  double r = sqrt(s);
+  return erfc(sqrt_alpha*r) / r;
+
+}
+
+double PotentialEwaldCoul::RealKernelF(double s) {
+  if (real_table != NULL) {
+    double x = s * table_inv_h;
+    int i = (int)x;
+    if (i >= table_start && i < table_n)
+      return InterpolateRealTable(i, x - i, 2);
+  }
+  double f, g;
+  ExactRealKernel(s, f, g);
+  return g;
+
+}
+
+// The set of images n with |dist + n*box_l| <= real_cutoff along one
+// dimension is an interval, found by shrinking [-real_cell, real_cell] from
+// both ends. Images outside of it along any dimension are beyond the cutoff.
+void PotentialEwaldCoul::ImageRange(double dist[], int lo[], int hi[]) {
+  for (int i = 0; i < 3; i++) {
+    lo[i] = -real_cell[i];
+    hi[i] =  real_cell[i];
+    while (lo[i] <= hi[i] && fabs(dist[i] + lo[i]*box_l[i]) > real_cutoff)
+      lo[i]++;
+    while (hi[i] >= lo[i] && fabs(dist[i] + hi[i]*box_l[i]) > real_cutoff)
+      hi[i]--;
+  }
+
+}
+
+double PotentialEwaldCoul::RealCutoff() {
+  return real_cutoff;
+
+}
+
+double PotentialEwaldCoul::RealTableStart() {
+  if (real_table == NULL)  return real_cutoff;
+  return sqrt(table_start * table_h);
+
+}
+
+// The samples go through RealKernelE and RealKernelF, as the energies do,
+// over the part of the table that is used.
+void PotentialEwaldCoul::RealTableErrors(double& max_err_e,
+                                         double& max_err_f) {
+  max_err_e = 0;
+  max_err_f = 0;
+  if (real_table == NULL)  return;
+  for (int i = table_start; i < table_n; i++) {
+    for (int j = 0; j < kRealTableSamples; j++) {
+      double s = (i + (j + 0.5) / kRealTableSamples) * table_h;
+      double f, g;
+      ExactRealKernel(s, f, g);
+      max_err_e = max(max_err_e, fabs(RealKernelE(s) - f) / fabs(f));
+      max_err_f = max(max_err_f, fabs(RealKernelF(s) - g) / fabs(g));
+    }
+  }
+
+}
+
+double PotentialEwaldCoul::RealImageSum(double prefactor, double dist[]) {
   double energy = 0;
+  int lo[3], hi[3];
+  ImageRange(dist, lo, hi);
 
-  if (q1*q2 == 0)
-    return energy;
-  else {
-    double dist[3];
-    GetDistVector(bead1, bead2, box_l, npbc, dist);
-    double prefactor = lB*q1*q2;
-  
-    for (int i = -real_cell[0]; i <= real_cell[0]; i++) {
-      for (int j = -real_cell[1]; j <= real_cell[1]; j++) {
-        for (int k = -real_cell[2]; k <= real_cell[2]; k++) {
-          double r_vec[3];
-          r_vec[0] = dist[0] + i*box_l[0];
-          r_vec[1] = dist[1] + j*box_l[1];
-          r_vec[2] = dist[2] + k*box_l[2];
-          double r = sqrt(r_vec[0]*r_vec[0]+r_vec[1]*r_vec[1]+r_vec[2]*r_vec[2]);
-          if (r > 0 && r <= real_cutoff) {
-            energy += prefactor * erfc(sqrt(alpha)*r)/r;
-          }
+  for (int i = lo[0]; i <= hi[0]; i++) {
+    for (int j = lo[1]; j <= hi[1]; j++) {
+      for (int k = lo[2]; k <= hi[2]; k++) {
+        double r_vec[3];
+        r_vec[0] = dist[0] + i*box_l[0];
+        r_vec[1] = dist[1] + j*box_l[1];
+        r_vec[2] = dist[2] + k*box_l[2];
+        double r2 = r_vec[0]*r_vec[0]+r_vec[1]*r_vec[1]+r_vec[2]*r_vec[2];
+        if (r2 > 0 && r2 <= real_cutoff*real_cutoff) {
+          energy += prefactor * RealKernelE(r2);
         }
       }
     }
@@ -163,6 +377,71 @@ double PotentialEwaldCoul::PairEnergyReal(Bead& bead1, Bead& bead2, int npbc) {
 
 }
 
+// Along every dimension, the table holds exp(i*theta*l) for l from -c to c,
+// with the l >= 0 powers of exp(i*theta) built up by complex multiplication
+// and the negative ones their conjugates.
+void PotentialEwaldCoul::PhaseTables(const double r[], double table[]) {
+  double * t = table;
+  for (int d = 0; d < 3; d++) {
+    int c = repl_cell[d];
+    double theta = 2*kPi * r[d] / box_l[d];
+    double re1 = cos(theta);
+    double im1 = sin(theta);
+    double * mid = t + 2*c;
+    mid[0] = 1;
+    mid[1] = 0;
+    for (int l = 1; l <= c; l++) {
+      double re = mid[2*(l-1)];
+      double im = mid[2*(l-1)+1];
+      mid[2*l]    = re*re1 - im*im1;
+      mid[2*l+1]  = re*im1 + im*re1;
+      mid[-2*l]   =  mid[2*l];
+      mid[-2*l+1] = -mid[2*l+1];
+    }
+    t += 2*(2*c + 1);
+  }
+
+}
+
+void PotentialEwaldCoul::Phase(const double table[], const int l[],
+                               double& re, double& im) {
+  const double * ex = table + 2*(l[0] + repl_cell[0]);
+  const double * ey = table + 2*repl_ceto[0] + 2*(l[1] + repl_cell[1]);
+  const double * ez = table + 2*(repl_ceto[0] + repl_ceto[1]) +
+                      2*(l[2] + repl_cell[2]);
+  double re_xy = ex[0]*ey[0] - ex[1]*ey[1];
+  double im_xy = ex[0]*ey[1] + ex[1]*ey[0];
+  re = re_xy*ez[0] - im_xy*ez[1];
+  im = re_xy*ez[1] + im_xy*ez[0];
+
+}
+
+double PotentialEwaldCoul::PairEnergyReal(Bead& bead1, Bead& bead2, int npbc) {
+  double q1 = bead1.Charge();
+  double q2 = bead2.Charge();
+
+  if (q1*q2 == 0)
+    return 0;
+
+  double dist[3];
+  GetDistVector(bead1, bead2, box_l, npbc, dist);
+  return RealImageSum(lB*q1*q2, dist);
+
+}
+
+double PotentialEwaldCoul::PairEnergyReal(ParticleStore& particles, int p1,
+                                          int p2, int npbc) {
+  const double * q = particles.Charges();
+
+  if (q[p1]*q[p2] == 0)
+    return 0;
+
+  double dist[3];
+  particles.DistVector(p1, p2, box_l, npbc, dist);
+  return RealImageSum(lB*q[p1]*q[p2], dist);
+
+}
+
 // [Deprecated function] PairEnergyReal for scaled volume.
 double PotentialEwaldCoul::PairEnergyRealForP(Bead& bead1, Bead& bead2, int npbc) {
   double energy = 0;
@@ -195,7 +474,9 @@ double PotentialEwaldCoul::PairEnergyRealForP(Bead& bead1, Bead& bead2, int npbc
 
 }
 
-double PotentialEwaldCoul::PairEnergyRepl(Bead& bead1, Bead& bead2, int npbc) {
+// The sum of cos(k.r) over +k and -k is twice the real part of exp(ik.r).
+double PotentialEwaldCoul::PairEnergyRepl(Bead& bead1, Bead& bead2, int npbc,
+                                          int thread) {
   double q1 = bead1.Charge();
   double q2 = bead2.Charge();
   double energy = 0;
@@ -206,47 +487,112 @@ double PotentialEwaldCoul::PairEnergyRepl(Bead& bead1, Bead& bead2, int npbc) {
     double r[3];
     GetDistVector(bead1, bead2, box_l, npbc, r);
     double prefactor = lB * q1*q2/(kPi*box_vol) * (4*kPi*kPi);
-  
-    for (int lx = 0; lx < repl_ceto[0]; lx++) {
-      for (int ly = 0; ly < repl_ceto[1]; ly++) {
-        for (int lz = 0; lz < repl_ceto[2]; lz++) {
-          int idx = repl_ceto[1]*repl_ceto[2]*lx + repl_ceto[2]*ly + lz;
-          if (k2[idx] > 0 && k2[idx] <= repl_cutoff) {
-            energy += prefactor * ek2[idx]
-                      * cos(kx[lx]*r[0] + ky[ly]*r[1] + kz[lz]*r[2]);
-          }
-        }
-      }
+    double * table = phase_scratch + thread*phase_size;
+    PhaseTables(r, table);
+
+    for (int n = 0; n < n_half_k; n++) {
+      double re, im;
+      Phase(table, half_l + 3*n, re, im);
+      energy += half_ek2[n] * re;
     }
+    energy *= 2*prefactor;
   }
 
   return energy;
 
 }
 
-// [Deprecated function] PairEnergyRepl for volume scaling.
-double PotentialEwaldCoul::PairEnergyReplForP(Bead& bead1, Bead& bead2, int npbc) {
+// With the phases of the bead p_k = exp(ik.r) and the structure factor S(k),
+// the sum of PairEnergyRepl over the beads is the one of a single pair with
+// q2*exp(-ik.r2) replaced by conj(S(k)), i.e. Re(p_k*conj(S(k))).
+double PotentialEwaldCoul::BeadReplEnergy(Bead& bead, int thread) {
+  double q = bead.Charge();
+  if (q == 0)  return 0;
+
+  double pos[3] = {bead.GetCrd(1, 0), bead.GetCrd(1, 1), bead.GetCrd(1, 2)};
+  double prefactor = lB * q/(kPi*box_vol) * (4*kPi*kPi);
+  double * table = phase_scratch + thread*phase_size;
+  PhaseTables(pos, table);
   double energy = 0;
-  double r[3];
-  double box_l_scaled[3] = {box_l[0], box_l[1], box_l[2]+kDz};
-  GetDistVector(bead1, bead2, box_l_scaled, npbc, r);
-  double q1 = bead1.Charge();
-  double q2 = bead2.Charge();
-  double prefactor = lB * q1*q2/(kPi*box_vol_forP) * (4*kPi*kPi);
-
-  for (int lx = 0; lx < repl_ceto[0]; lx++) {
-    for (int ly = 0; ly < repl_ceto[1]; ly++) {
-      for (int lz = 0; lz < repl_ceto[2]; lz++) {
-        int idx = repl_ceto[1]*repl_ceto[2]*lx + repl_ceto[2]*ly + lz;
-        if (k2_forP[idx] > 0 && k2_forP[idx] <= repl_cutoff) {
-          energy += prefactor * ek2_forP[idx]
-                    * cos(kx[lx]*r[0] + ky[ly]*r[1] + kz_forP[lz]*r[2]);
-        }
+  for (int n = 0; n < n_half_k; n++) {
+    double re, im;
+    Phase(table, half_l + 3*n, re, im);
+    energy += half_ek2[n] * (re*s_re[n] + im*s_im[n]);
+  }
+
+  return 2*prefactor * energy;
+
+}
+
+// The structure factor is updated on every accepted move.
+void PotentialEwaldCoul::PrepareBeadReplEnergy() {
+
+}
+
+// The reciprocal energy of the pairs between two groups is
+// 2*prefactor * sum_k exp(-k2/(4*alpha))/k2 * Re(S_a(k)*conj(S_b(k))) over the
+// half space, and half of that within a group, with the i == j terms halved,
+// as in TrialReplEnergy. The scaled box takes the trial coordinates, whose
+// phases along z are those of z*box_l[2]/(box_l[2]+kDz) in the original box.
+void PotentialEwaldCoul::GroupReplEnergyForP(vector<Molecule>& mols,
+                                             vector<int>& group, int n_groups,
+                                             double d_energy[]) {
+  vector<double> s_old(2*n_groups*n_half_k, 0);
+  vector<double> s_new(2*n_groups*n_half_k_forP, 0);
+  double scale_z = box_l[2] / (box_l[2] + kDz);
+  for (int i = 0; i < (int)mols.size(); i++) {
+    int g = group[i];
+    if (g < 0)  continue;
+    for (int j = 0; j < mols[i].Size(); j++) {
+      double q = mols[i].bds[j].Charge();
+      if (q == 0)  continue;
+      double pos[3];
+      double re, im;
+      for (int d = 0; d < 3; d++) {
+        pos[d] = mols[i].bds[j].GetCrd(0, d);
+      }
+      PhaseTables(pos, phase_scratch);
+      double * s = &s_old[2*g*n_half_k];
+      for (int n = 0; n < n_half_k; n++) {
+        Phase(phase_scratch, half_l + 3*n, re, im);
+        s[2*n]   += q * re;
+        s[2*n+1] += q * im;
+      }
+      for (int d = 0; d < 3; d++) {
+        pos[d] = mols[i].bds[j].GetCrd(1, d);
+      }
+      pos[2] *= scale_z;
+      PhaseTables(pos, phase_scratch);
+      s = &s_new[2*g*n_half_k_forP];
+      for (int n = 0; n < n_half_k_forP; n++) {
+        Phase(phase_scratch, half_l_forP + 3*n, re, im);
+        s[2*n]   += q * re;
+        s[2*n+1] += q * im;
       }
     }
   }
 
-  return energy;
+  double prefactor_old = lB/(kPi*box_vol) * (4*kPi*kPi);
+  double prefactor_new = lB/(kPi*box_vol_forP) * (4*kPi*kPi);
+  for (int a = 0; a < n_groups; a++) {
+    for (int b = a; b < n_groups; b++) {
+      double e_old = 0;
+      double e_new = 0;
+      double * sa = &s_old[2*a*n_half_k];
+      double * sb = &s_old[2*b*n_half_k];
+      for (int n = 0; n < n_half_k; n++) {
+        e_old += half_ek2[n] * (sa[2*n]*sb[2*n] + sa[2*n+1]*sb[2*n+1]);
+      }
+      sa = &s_new[2*a*n_half_k_forP];
+      sb = &s_new[2*b*n_half_k_forP];
+      for (int n = 0; n < n_half_k_forP; n++) {
+        e_new += half_ek2_forP[n] * (sa[2*n]*sb[2*n] + sa[2*n+1]*sb[2*n+1]);
+      }
+      double factor = (a == b)? 1 : 2;
+      d_energy[a*n_groups + b] = factor * (prefactor_new*e_new -
+                                           prefactor_old*e_old);
+    }
+  }
 
 }
 
@@ -256,6 +602,118 @@ double PotentialEwaldCoul::SelfEnergy(Bead& bead) {
 
 }
 
+void PotentialEwaldCoul::ClearTrialStructureFactor() {
+  for (int i = 0; i < n_half_k; i++) {
+    s_trial_re[i] = 0;
+    s_trial_im[i] = 0;
+  }
+
+}
+
+void PotentialEwaldCoul::ResetTrialStructureFactor() {
+  for (int i = 0; i < n_half_k; i++) {
+    s_trial_re[i] = s_re[i];
+    s_trial_im[i] = s_im[i];
+  }
+
+}
+
+// Adds sign*q*exp(ik.r) of the bead to the trial structure factor. The flag
+// chooses between the current (0) and the trial (1) position of the bead.
+void PotentialEwaldCoul::AddToTrialStructureFactor(Bead& bead, int flag,
+                                                   double sign) {
+  double q = sign * bead.Charge();
+  if (q == 0)  return;
+
+  double pos[3] = {bead.GetCrd(flag, 0), bead.GetCrd(flag, 1),
+                   bead.GetCrd(flag, 2)};
+  PhaseTables(pos, phase_scratch);
+  for (int n = 0; n < n_half_k; n++) {
+    double re, im;
+    Phase(phase_scratch, half_l + 3*n, re, im);
+    s_trial_re[n] += q * re;
+    s_trial_im[n] += q * im;
+  }
+
+}
+
+// Equals the sum of PairEnergyRepl over all pairs, with the i == j terms
+// halved, i.e. 0.5 * sum_k 4*pi*lB/V * exp(-k2/(4*alpha))/k2 * |S(k)|^2,
+// where |S(-k)| = |S(k)| doubles the sum over the half space.
+double PotentialEwaldCoul::TrialReplEnergy() {
+  double prefactor = lB/(kPi*box_vol) * (4*kPi*kPi);
+  double energy = 0;
+  for (int i = 0; i < n_half_k; i++) {
+    energy += half_ek2[i] * (s_trial_re[i]*s_trial_re[i] +
+                             s_trial_im[i]*s_trial_im[i]);
+  }
+
+  return prefactor * energy;
+
+}
+
+void PotentialEwaldCoul::AcceptTrialStructureFactor() {
+  for (int i = 0; i < n_half_k; i++) {
+    s_re[i] = s_trial_re[i];
+    s_im[i] = s_trial_im[i];
+  }
+
+}
+
+void PotentialEwaldCoul::SaveStructureFactor(ostream& out) {
+  int n_k = n_half_k;
+  WriteBinary(out, n_k);
+  WriteBinary(out, s_re, n_k);
+  WriteBinary(out, s_im, n_k);
+
+}
+
+// The k vectors follow from alpha, which may be tuned to the number of charges
+// at start-up, so a restart of a GC run can end up with a different set.
+void PotentialEwaldCoul::LoadStructureFactor(istream& in) {
+  int n_k = n_half_k;
+  int n_k_saved = 0;
+  ReadBinary(in, n_k_saved);
+  if (n_k_saved != n_k) {
+    cout << "  The checkpoint has " << n_k_saved << " k vectors but the "
+         << "current Ewald" << endl;
+    cout << "  parameters give " << n_k << ". Restart with --rebuild to "
+         << "recompute the" << endl;
+    cout << "  energies. Exiting! Program complete." << endl;
+    exit(1);
+  }
+  ReadBinary(in, s_re, n_k);
+  ReadBinary(in, s_im, n_k);
+  ResetTrialStructureFactor();
+
+}
+
+// S(k) only holds the charges, it does not depend on the Bjerrum length.
+void PotentialEwaldCoul::SwapStructureFactor(PotentialEwald& other) {
+  PotentialEwaldCoul& coul = static_cast<PotentialEwaldCoul&>(other);
+  swap(s_re, coul.s_re);
+  swap(s_im, coul.s_im);
+  ResetTrialStructureFactor();
+  coul.ResetTrialStructureFactor();
+
+}
+
+// The cutoffs are tuned to the Bjerrum length, so replicas that differ in it
+// do not always share their sums.
+bool PotentialEwaldCoul::SameSums(PotentialEwald& other) {
+  PotentialEwaldCoul * coul = dynamic_cast<PotentialEwaldCoul *>(&other);
+  if (coul == NULL || PotentialName() != other.PotentialName())
+    return false;
+  for (int i = 0; i < 3; i++) {
+    if (box_l[i] != coul->box_l[i])  return false;
+  }
+  return alpha == coul->alpha && real_cutoff == coul->real_cutoff &&
+         repl_cutoff == coul->repl_cutoff &&
+         dipole_correction == coul->dipole_correction &&
+         table_tol == coul->table_tol;
+
+}
+
 // Bead 1 should be the wall particle, the calculated force will be the force
 // on bead 1.
 double PotentialEwaldCoul::PairForceZReal(Bead& bead1, Bead& bead2, int npbc) {
@@ -269,19 +727,19 @@ double PotentialEwaldCoul::PairForceZReal(Bead& bead1, Bead& bead2, int npbc) {
     double r[3];
     GetDistVector(bead2, bead1, box_l, npbc, r);
     double prefactor = lB*q1*q2;
-    double prefactor2 = 2*sqrt(alpha/kPi);
+    int lo[3], hi[3];
+    ImageRange(r, lo, hi);
   
-    for (int i = -real_cell[0]; i <= real_cell[0]; i++) {
-      for (int j = -real_cell[1]; j <= real_cell[1]; j++) {
-        for (int k = -real_cell[2]; k <= real_cell[2]; k++) {
+    for (int i = lo[0]; i <= hi[0]; i++) {
+      for (int j = lo[1]; j <= hi[1]; j++) {
+        for (int k = lo[2]; k <= hi[2]; k++) {
           double r_vec[3];
           r_vec[0] = r[0] + i*box_l[0];
           r_vec[1] = r[1] + j*box_l[1];
           r_vec[2] = r[2] + k*box_l[2];
-          double d = sqrt(r_vec[0]*r_vec[0]+r_vec[1]*r_vec[1]+r_vec[2]*r_vec[2]);
-          if (d > 0 && d <= real_cutoff) {
-            force_z += prefactor * ((prefactor2*exp(-alpha*d*d))
-                       + (erfc(sqrt(alpha)*d)/d)) * r_vec[2]/(d*d);
+          double d2 = r_vec[0]*r_vec[0]+r_vec[1]*r_vec[1]+r_vec[2]*r_vec[2];
+          if (d2 > 0 && d2 <= real_cutoff*real_cutoff) {
+            force_z += prefactor * RealKernelF(d2) * r_vec[2];
           }
         }
       }
@@ -305,18 +763,15 @@ double PotentialEwaldCoul::PairForceZRepl(Bead& bead1, Bead& bead2, int npbc) {
     double r[3];
     GetDistVector(bead2, bead1, box_l, npbc, r);
     double prefactor = lB * 4*kPi * q1*q2/box_vol;
-  
-    for (int lx = 0; lx < repl_ceto[0]; lx++) {
-      for (int ly = 0; ly < repl_ceto[1]; ly++) {
-        for (int lz = 0; lz < repl_ceto[2]; lz++) {
-          int idx = repl_ceto[1]*repl_ceto[2]*lx + repl_ceto[2]*ly + lz;
-          if (k2[idx] > 0 && k2[idx] <= repl_cutoff) {
-            force_z += prefactor * kz[lz]*ek2[idx]  
-                       * sin(kx[lx]*r[0] + ky[ly]*r[1] + kz[lz]*r[2]);
-          }
-        }
-      }
+    PhaseTables(r, phase_scratch);
+
+    // kz*sin(k.r) is even in k.
+    for (int n = 0; n < n_half_k; n++) {
+      double re, im;
+      Phase(phase_scratch, half_l + 3*n, re, im);
+      force_z += half_k[3*n+2] * half_ek2[n] * im;
     }
+    force_z *= 2*prefactor;
   }
 
   return force_z;
@@ -349,23 +804,24 @@ double PotentialEwaldCoul::PairDForceReal(Bead& bead1, Bead& bead2,
   double q1 = bead1.Charge();
   double q2 = bead2.Charge();
   double prefactor = lB*q1*q2;
+  int lo[3], hi[3];
+  ImageRange(dist, lo, hi);
 
-  for (int i = -real_cell[0]; i <= real_cell[0]; i++) {
-    for (int j = -real_cell[1]; j <= real_cell[1]; j++) {
-      for (int k = -real_cell[2]; k <= real_cell[2]; k++) {
+  for (int i = lo[0]; i <= hi[0]; i++) {
+    for (int j = lo[1]; j <= hi[1]; j++) {
+      for (int k = lo[2]; k <= hi[2]; k++) {
         double r_vec[3];
         r_vec[0] = dist[0] + i*box_l[0];
         r_vec[1] = dist[1] + j*box_l[1];
         r_vec[2] = dist[2] + k*box_l[2];
-        double r = sqrt(r_vec[0]*r_vec[0] +
-                        r_vec[1]*r_vec[1] +
-                        r_vec[2]*r_vec[2]);
-        if (r > 0 && r <= real_cutoff) {
-          // d * r over r^3.
-          //double dror3 = (d[0]*r_vec[0] + d[1]*r_vec[1] + d[2]*r_vec[2])/(r*r*r);
-          double dror3 = (dist[0]*r_vec[0]+dist[1]*r_vec[1]+dist[2]*r_vec[2])/(r*r*r);
-          dforce += -prefactor * dror3 * (erfc(sqrt(alpha)*r) +
-                                          2*sqrt(alpha/kPi)*r*exp(-alpha*r*r));
+        double r2 = r_vec[0]*r_vec[0] +
+                    r_vec[1]*r_vec[1] +
+                    r_vec[2]*r_vec[2];
+        if (r2 > 0 && r2 <= real_cutoff*real_cutoff) {
+          // d * r, the 1/r^3 is part of the force kernel.
+          //double dr = d[0]*r_vec[0] + d[1]*r_vec[1] + d[2]*r_vec[2];
+          double dr = dist[0]*r_vec[0]+dist[1]*r_vec[1]+dist[2]*r_vec[2];
+          dforce += -prefactor * dr * RealKernelF(r2);
         }
       }
     }
@@ -392,79 +848,24 @@ double PotentialEwaldCoul::PairDForceRepl(Bead& bead1, Bead& bead2,
   double q1 = bead1.Charge();
   double q2 = bead2.Charge();
   double prefactor = lB * q1*q2/(kPi*box_vol) * (4*kPi*kPi);
-
-  for (int lx = 0; lx < repl_ceto[0]; lx++) {
-    for (int ly = 0; ly < repl_ceto[1]; ly++) {
-      for (int lz = 0; lz < repl_ceto[2]; lz++) {
-        int idx = repl_ceto[1]*repl_ceto[2]*lx + repl_ceto[2]*ly + lz;
-        if (k2[idx] > 0 && k2[idx] <= repl_cutoff) {
-          //double dk = d[0]*kx[lx] + d[1]*ky[ly] + d[2]*kz[lz];
-          double dk = r[0]*kz[lx] + r[1]*kz[ly] +  r[2]*kz[lz];
-          dforce += -dk * prefactor * ek2[idx]
-                    * sin(kx[lx]*r[0] + ky[ly]*r[1] + kz[lz]*r[2]);
-        }
-      }
-    }
+  PhaseTables(r, phase_scratch);
+
+  // (k.r)*sin(k.r) is even in k.
+  for (int n = 0; n < n_half_k; n++) {
+    //double dk = d[0]*kx + d[1]*ky + d[2]*kz;
+    double dk = r[0]*half_k[3*n] + r[1]*half_k[3*n+1] + r[2]*half_k[3*n+2];
+    double re, im;
+    Phase(phase_scratch, half_l + 3*n, re, im);
+    dforce += -dk * half_ek2[n] * im;
   }
+  dforce *= 2*prefactor;
 
   return dforce;
 
 }
 
 
-double PotentialEwaldCoul::DipoleE(vector<Molecule>& mols) {
-  double Mz = 0;
-  for (int i = 0; i < (int)mols.size(); i++) {
-    for (int j = 0; j < mols[i].Size(); j++) {
-      // If the simulation is done correctly, the z coordinates should all be
-      // within the unit cell.
-      double z = mols[i].bds[j].GetCrd(0, 2);
-      double c = mols[i].bds[j].Charge();
-      Mz += c*z;
-    }
-  }
-  return lB * 2*kPi/(box_vol/1.0) * Mz * Mz;
-
-}
-
-double PotentialEwaldCoul::DipoleE(vector<Molecule>& mols,
-                                   vector<Bead>& chain) {
-  double Mz = 0;
-  for (int i = 0; i < (int)mols.size(); i++) {
-    for (int j = 0; j < mols[i].Size(); j++) {
-      // If the simulation is done correctly, the z coordinates should all be
-      // within the unit cell.
-      double z = mols[i].bds[j].GetCrd(0, 2);
-      double c = mols[i].bds[j].Charge();
-      Mz += c*z;
-    }
-  }
-  for (int i = 0; i < (int)chain.size(); i++) {
-    double z = chain[i].GetCrd(0, 2);
-    double c = chain[i].Charge();
-    Mz += c*z;
-  }
-
-  return lB * 2*kPi/(box_vol/1.0) * Mz * Mz;
-
-}
-
-// The dipole energy without the deleted molecule.
-// Here, the delete_id should be >= 0.
-double PotentialEwaldCoul::DipoleE(vector<Molecule>& mols, int delete_id,
-                                   int counterion) {
-  double Mz = 0;
-  for (int i = 0; i < (int)mols.size(); i++) {
-    if (i < delete_id || i > delete_id+counterion) {
-      for (int j = 0; j < mols[i].Size(); j++) {
-        // If the simulation is done correctly, the z coordinates should all be
-        // within the unit cell.
-        double z = mols[i].bds[j].GetCrd(0, 2);
-        double c = mols[i].bds[j].Charge();
-        Mz += c*z;
-      }
-    }
-  }
+double PotentialEwaldCoul::DipoleE(double Mz) {
   return lB * 2*kPi/(box_vol/1.0) * Mz * Mz;
 
 }
@@ -480,24 +881,14 @@ double PotentialEwaldCoul::DipoleEDiff(vector<Molecule>& mols,
   int counterion = 0;
   if (gc_bead_charge != 0)  counterion = gc_chain_len;
 
-  // Mols.
+  // Mols, from the running total without the deleted molecules.
+  Mz_o = current_Mz;
   if (delete_id >= 0) {
-    for (int i = 0; i < (int)mols.size(); i++) {
-      if (i < delete_id || i > delete_id+counterion) {
-        for (int j = 0; j < mols[i].Size(); j++) {
-          double z = mols[i].bds[j].GetCrd(0, 2);
-          double c = mols[i].bds[j].Charge();
-          Mz_o += c*z;
-        }
-      }
-    }
-  }
-  else {
-    for (int i = 0; i < (int)mols.size(); i++) {
+    for (int i = delete_id; i <= delete_id+counterion; i++) {
       for (int j = 0; j < mols[i].Size(); j++) {
         double z = mols[i].bds[j].GetCrd(0, 2);
         double c = mols[i].bds[j].Charge();
-        Mz_o += c*z;
+        Mz_o -= c*z;
       }
     }
   }
@@ -534,4 +925,9 @@ double PotentialEwaldCoul::GetlB() {
 
 }
 
+double PotentialEwaldCoul::GetAlpha() {
+  return alpha;
+
+}
+
 
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "../molecules/bead.h"
 #include "potential_ewald.h"
@@ -11,7 +12,7 @@
 using namespace std; 
 
 class PotentialEwaldCoul : public PotentialEwald {
- private:
+ protected:
   /** The dielectric constant, unitless. */
   double dielectric;
   /** Bjerrum length. Derived from the dielectric constant. */
@@ -28,9 +29,17 @@ class PotentialEwaldCoul : public PotentialEwald {
   double repl_cutoff;
   /** Maximum number of cells to encompass. */
   int repl_cell[3];
-  /** Proportional to the inverse of the STD of the Gaussians, unit A^-1. */
+  /** Proportional to the inverse of the STD of the Gaussians, unit A^-1.
+      Tuned from the number of charges and the box if the input value is not
+      positive. */
   double alpha;
+  /** Number of charged beads at start-up, used to tune alpha. */
+  int n_charges;
+  /** sqrt(alpha) and 2*sqrt(alpha/pi), used by the real space kernel. */
+  double sqrt_alpha;
+  double gauss_prefactor;
 
+ private:
   // For efficiency of calculating the reciprocal component.
   /** The total number of k number according to repl_cell[3]. */
   int repl_ceto[3];
@@ -38,17 +47,90 @@ class PotentialEwaldCoul : public PotentialEwald {
   double * kx;
   double * ky;
   double * kz;
-  /** "k2" for all vector k. */
-  double * k2;
-  /** "exp(-k2/(4*alpha))/k2" for all vector k. */
-  double * ek2;
-  double * kz_forP;
-  double * k2_forP;
-  double * ek2_forP;
+  /** The k vectors within repl_cutoff, one of each pair +k, -k: the first
+      nonzero index is positive. For real charges S(-k) = conj(S(k)), so
+      every reciprocal sum is twice its sum over these vectors. */
+  int n_half_k;
+  /** The indices (lx, ly, lz) of each vector, k = 2*pi*l/box_l. lx >= 0. */
+  int * half_l;
+  /** kx, ky, kz of each vector. */
+  double * half_k;
+  /** "exp(-k2/(4*alpha))/k2" of each vector. */
+  double * half_ek2;
+  /** Number of doubles PhaseTables fills. */
+  int phase_size;
+  /** Threads of the force field pool, which may compute reciprocal pair
+      energies at the same time. */
+  int n_threads;
+  /** Preallocated PhaseTables output, phase_size doubles for each thread.
+      Only PairEnergyRepl is called from the pool, the other users run on
+      the calling thread and take the first block. */
+  double * phase_scratch;
+  /** The k vectors of the box scaled along z by kDz for the pressure, with
+      the l indices of the original box that are within repl_cutoff. */
+  int n_half_k_forP;
+  int * half_l_forP;
+  double * half_ek2_forP;
+  /** Real and imaginary parts of the structure factor S(k) = sum q*exp(ik.r)
+      of the current configuration, for the vectors of half_l. */
+  double * s_re;
+  double * s_im;
+  /** The structure factor of the MC trial configuration. */
+  double * s_trial_re;
+  double * s_trial_im;
+
+  /** The range of periodic images, along each dimension, that can lie within
+      the real space cutoff for the given distance vector. */
+  void ImageRange(double[], int[], int[]);
+  /** Sum the real space energy of a pair, with lB*q1*q2 as the first argument
+      and the minimum image distance vector as the second, over the periodic
+      images within the cutoff. */
+  double RealImageSum(double, double[]);
+  /** Fill the table of exp(i*2*pi*l*r_d/box_l_d), l = -repl_cell_d ..
+      repl_cell_d, along every dimension d, as (re, im) pairs. Each
+      dimension takes one sin and cos, the other powers follow by complex
+      multiplication. The second argument holds phase_size doubles. */
+  void PhaseTables(const double[], double[]);
+  /** exp(ik.r) of the vector with the indices l, from the tables. */
+  void Phase(const double[], const int[], double&, double&);
+
+  // Tabulated real space kernel. With s = r^2, the energy kernel is
+  // f(s) = erfc(sqrt(alpha)*r)/r and the force kernel is
+  // g(s) = (f(s) + 2*sqrt(alpha/pi)*exp(-alpha*s))/s = -2 df/ds. Both are
+  // interpolated by cubic Hermite polynomials on a uniform grid in s over
+  // [0, real_cutoff^2], which avoids the sqrt and the libm calls.
+  /** Relative accuracy requested for the table, 0 to always use libm. */
+  double table_tol;
+  /** Compare the table against libm on a dense sample and report the
+      maximum errors. */
+  bool table_validate;
+  /** Number of grid intervals. */
+  int table_n;
+  /** Grid spacing in s and its inverse. */
+  double table_h;
+  double table_inv_h;
+  /** Intervals below this index did not meet table_tol, where f and g
+      diverge as s goes to 0. They are evaluated with libm instead. */
+  int table_start;
+  /** For every grid node: f, h*df/ds, g, h*dg/ds. */
+  double * real_table;
+  /** Set up the table for the current alpha and real_cutoff. */
+  void BuildRealTable();
+  /** Print the largest errors of the table against libm. */
+  void ValidateRealTable();
+  /** The energy and force kernels from libm. */
+  void ExactRealKernel(double, double&, double&);
+  /** Interpolate one of the kernels (offset 0 for f, 2 for g) in an
+      interval. */
+  double InterpolateRealTable(int, double, int);
+  /** The energy kernel f(s). */
+  double RealKernelE(double);
+  /** The force kernel g(s). */
+  double RealKernelF(double);
 
  public: 
   // Initialization functions.
-  PotentialEwaldCoul(string, double[3]);
+  PotentialEwaldCoul(string, double[3], int, int);
   ~PotentialEwaldCoul();
   /** Read parameters from file, can read in the sigmas and epsilons from
       multiple chain types (symbols). */
@@ -57,13 +139,24 @@ class PotentialEwaldCoul : public PotentialEwald {
   // Energy functions.
   /** Energy between two beads. */
   double PairEnergyReal(Bead&, Bead&, int);   
-  double PairEnergyRepl(Bead&, Bead&, int);
+  double PairEnergyReal(ParticleStore&, int, int, int);
+  double PairEnergyRepl(Bead&, Bead&, int, int = 0);
+  double BeadReplEnergy(Bead&, int = 0);
+  void PrepareBeadReplEnergy();
   double PairEnergyRealForP(Bead&, Bead&, int);
-  double PairEnergyReplForP(Bead&, Bead&, int);
+  void GroupReplEnergyForP(vector<Molecule>&, vector<int>&, int, double[]);
   double SelfEnergy(Bead&);
-  double DipoleE(vector<Molecule>&);
-  double DipoleE(vector<Molecule>&, vector<Bead>&);
-  double DipoleE(vector<Molecule>&, int, int);
+  /** Structure factor bookkeeping for the reciprocal energy. */
+  void ClearTrialStructureFactor();
+  void ResetTrialStructureFactor();
+  void AddToTrialStructureFactor(Bead&, int, double);
+  double TrialReplEnergy();
+  void AcceptTrialStructureFactor();
+  void SaveStructureFactor(ostream&);
+  void LoadStructureFactor(istream&);
+  void SwapStructureFactor(PotentialEwald&);
+  bool SameSums(PotentialEwald&);
+  double DipoleE(double);
   double DipoleEDiff(vector<Molecule>&, vector<Bead>&, Bead&, Bead&, int, int,
                      double, int);
   /** The forces along Z direction. */
@@ -75,6 +168,15 @@ class PotentialEwaldCoul : public PotentialEwald {
   double PairDForceRepl(Bead&, Bead&, Bead&, Bead&, int);
 
   double GetlB();
+  double GetAlpha();
+  double RealCutoff();
+  /** The smallest r taken from the real kernel table, below which libm is
+      used, or the real cutoff if the table is off. */
+  double RealTableStart();
+  /** The largest relative errors of the energy and the force kernels
+      against libm, sampled densely from RealTableStart() to the real
+      cutoff. */
+  void RealTableErrors(double&, double&);
 
 }; 
 
@@ -0,0 +1,487 @@
+#include "potential_ewald_pme.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+
+#include "../utilities/binary_io.h"
+#include "../utilities/constants.h"
+#include "../utilities/misc.h"
+
+/** Highest B-spline order accepted from the input. */
+const int kMaxSplineOrder = 12;
+
+PotentialEwaldPME::PotentialEwaldPME(string potential_name, double box_l[3],
+                                     int n_charges, int n_threads)
+                                   : PotentialEwaldCoul(potential_name, box_l,
+                                                        n_charges, n_threads) {
+  ReadGridParameters();
+
+}
+
+PotentialEwaldPME::~PotentialEwaldPME() {
+  fftw_destroy_plan(plan_forward);
+  fftw_destroy_plan(plan_backward);
+  fftw_free(fft_real);
+  fftw_free(fft_cplx);
+  delete [] q_grid;
+  delete [] q_trial;
+  delete [] phi;
+  delete [] phi_trial;
+  delete [] g_real;
+  delete [] theta;
+  delete [] pending_dq;
+  delete [] mark;
+
+}
+
+void PotentialEwaldPME::ReadGridParameters() {
+  // By default the spacing is a fifth of the screening length 1/sqrt(alpha),
+  // which with order 6 gives a relative error of about 1e-5.
+  grid_spacing = 0.2 / sqrt(alpha);
+  order = 6;
+  ReadOptional(cin, "s3_PME_grid_spacing", grid_spacing);
+  ReadOptional(cin, "s3_PME_order", order);
+
+  if (order < 4 || order > kMaxSplineOrder || order % 2 != 0) {
+    cout << "PotentialEwaldPME::ReadGridParameters:" << endl;
+    cout << "  The spline order has to be even and between 4 and "
+         << kMaxSplineOrder << "! Exiting." << endl;
+    exit(1);
+  }
+  if (grid_spacing <= 0) {
+    cout << "PotentialEwaldPME::ReadGridParameters:" << endl;
+    cout << "  The grid spacing has to be positive! Exiting." << endl;
+    exit(1);
+  }
+
+  // box_l is the (possibly padded) Ewald box set up by PotentialEwaldCoul.
+  for (int i = 0; i < 3; i++) {
+    grid[i] = (int)ceil(box_l[i] / grid_spacing);
+    if (grid[i] < order)  grid[i] = order;
+  }
+  grid_size = grid[0]*grid[1]*grid[2];
+  grid_size_k = grid[0]*grid[1]*(grid[2]/2+1);
+
+  fft_real = (double *)fftw_malloc(sizeof(double)*grid_size);
+  fft_cplx = (fftw_complex *)fftw_malloc(sizeof(fftw_complex)*grid_size_k);
+  plan_forward = fftw_plan_dft_r2c_3d(grid[0], grid[1], grid[2], fft_real,
+                                      fft_cplx, FFTW_MEASURE);
+  plan_backward = fftw_plan_dft_c2r_3d(grid[0], grid[1], grid[2], fft_cplx,
+                                       fft_real, FFTW_MEASURE);
+
+  q_grid = new double[grid_size]();
+  q_trial = new double[grid_size]();
+  phi = new double[grid_size]();
+  phi_trial = new double[grid_size]();
+  g_real = new double[grid_size]();
+  pending_dq = new double[grid_size]();
+  mark = new char[grid_size]();
+  theta = new double[grid_size_k];
+
+  // |b(m)|^2 of the B-spline interpolation along each dimension.
+  vector<double> bmod[3];
+  for (int d = 0; d < 3; d++) {
+    bmod[d].resize(grid[d]);
+    for (int m = 0; m < grid[d]; m++) {
+      double re = 0;
+      double im = 0;
+      for (int k = 0; k <= order-2; k++) {
+        double arg = 2*kPi*m*k/grid[d];
+        re += BSpline(order, k+1) * cos(arg);
+        im += BSpline(order, k+1) * sin(arg);
+      }
+      bmod[d][m] = 1.0 / (re*re + im*im);
+    }
+  }
+
+  // The Ewald kernel in k space, same convention as PotentialEwaldCoul.
+  double prefactor = lB/(kPi*box_vol) * (4*kPi*kPi);
+  for (int i = 0; i < grid[0]; i++) {
+    for (int j = 0; j < grid[1]; j++) {
+      for (int k = 0; k <= grid[2]/2; k++) {
+        int mx = (i <= grid[0]/2)? i : i-grid[0];
+        int my = (j <= grid[1]/2)? j : j-grid[1];
+        double kx = mx * 2*kPi / box_l[0];
+        double ky = my * 2*kPi / box_l[1];
+        double kz = k  * 2*kPi / box_l[2];
+        double k2 = kx*kx + ky*ky + kz*kz;
+        int index = (i*grid[1] + j)*(grid[2]/2+1) + k;
+        if (k2 > 0)
+          theta[index] = prefactor * exp(-k2/(4*alpha)) / k2
+                         * bmod[0][i] * bmod[1][j] * bmod[2][k];
+        else
+          theta[index] = 0;
+      }
+    }
+  }
+
+  // Real space kernel.
+  for (int i = 0; i < grid_size_k; i++) {
+    fft_cplx[i][0] = theta[i];
+    fft_cplx[i][1] = 0;
+  }
+  fftw_execute(plan_backward);
+  for (int i = 0; i < grid_size; i++) {
+    g_real[i] = fft_real[i];
+  }
+
+  // Balances the cost of applying the pending changes against the cost of
+  // the two FFTs of a refresh.
+  pending_max = (int)sqrt(10.0*grid_size*log2((double)grid_size));
+
+  full_rebuild = false;
+  phi_trial_valid = false;
+  grid_E = 0;
+  trial_E = 0;
+  trial_E_valid = true;
+
+  cout << setw(35) << "[EP] PME grid spacing (ul)  : " << grid_spacing << endl;
+  cout << setw(35) << "[EP] PME grid points        : " << grid[0] << " x "
+       << grid[1] << " x " << grid[2] << endl;
+  cout << setw(35) << "[EP] PME spline order       : " << order << endl;
+
+}
+
+double PotentialEwaldPME::BSpline(int n, double x) {
+  if (x <= 0 || x >= n)  return 0;
+  if (n == 2)  return 1 - abs(x-1);
+  return (x*BSpline(n-1, x) + (n-x)*BSpline(n-1, x-1)) / (n-1);
+
+}
+
+void PotentialEwaldPME::Stencil(Bead& bead, int flag, double * w, int * id) {
+  for (int d = 0; d < 3; d++) {
+    double u = bead.GetCrd(flag, d) / box_l[d] * grid[d];
+    u -= grid[d] * floor(u / grid[d]);
+    int base = (int)floor(u);
+    double frac = u - base;
+    for (int j = 0; j < order; j++) {
+      w[d*kMaxSplineOrder + j] = BSpline(order, frac+j);
+      id[d*kMaxSplineOrder + j] = ((base-j) % grid[d] + grid[d]) % grid[d];
+    }
+  }
+
+}
+
+void PotentialEwaldPME::Spread(Bead& bead, int flag, double sign) {
+  double q = sign * bead.Charge();
+  if (q == 0)  return;
+
+  double w[3][kMaxSplineOrder];
+  int id[3][kMaxSplineOrder];
+  Stencil(bead, flag, w[0], id[0]);
+
+  for (int i = 0; i < order; i++) {
+    for (int j = 0; j < order; j++) {
+      double qw = q * w[0][i] * w[1][j];
+      int row = (id[0][i]*grid[1] + id[1][j])*grid[2];
+      for (int k = 0; k < order; k++) {
+        int index = row + id[2][k];
+        q_trial[index] += qw * w[2][k];
+        if (!full_rebuild && !(mark[index] & 1)) {
+          mark[index] |= 1;
+          touched.push_back(index);
+        }
+      }
+    }
+  }
+
+}
+
+void PotentialEwaldPME::GridPotential(double * q_in, double * phi_out) {
+  for (int i = 0; i < grid_size; i++) {
+    fft_real[i] = q_in[i];
+  }
+  fftw_execute(plan_forward);
+  for (int i = 0; i < grid_size_k; i++) {
+    fft_cplx[i][0] *= theta[i];
+    fft_cplx[i][1] *= theta[i];
+  }
+  fftw_execute(plan_backward);
+  for (int i = 0; i < grid_size; i++) {
+    phi_out[i] = fft_real[i];
+  }
+
+}
+
+double PotentialEwaldPME::Kernel(int index1, int index2) {
+  int d2 = index1 % grid[2] - index2 % grid[2];
+  int d1 = (index1 / grid[2]) % grid[1] - (index2 / grid[2]) % grid[1];
+  int d0 = index1 / (grid[1]*grid[2]) - index2 / (grid[1]*grid[2]);
+  if (d0 < 0)  d0 += grid[0];
+  if (d1 < 0)  d1 += grid[1];
+  if (d2 < 0)  d2 += grid[2];
+  return g_real[(d0*grid[1] + d1)*grid[2] + d2];
+
+}
+
+double PotentialEwaldPME::CurrentPotential(int index) {
+  double potential = phi[index];
+  for (int i = 0; i < (int)pending.size(); i++) {
+    potential += Kernel(index, pending[i]) * pending_dq[pending[i]];
+  }
+  return potential;
+
+}
+
+void PotentialEwaldPME::Refresh() {
+  GridPotential(q_grid, phi);
+  grid_E = 0;
+  for (int i = 0; i < grid_size; i++) {
+    grid_E += 0.5 * q_grid[i] * phi[i];
+  }
+  for (int i = 0; i < (int)pending.size(); i++) {
+    pending_dq[pending[i]] = 0;
+    mark[pending[i]] &= ~2;
+  }
+  pending.clear();
+
+}
+
+void PotentialEwaldPME::ClearTrialStructureFactor() {
+  for (int i = 0; i < (int)touched.size(); i++) {
+    mark[touched[i]] &= ~1;
+  }
+  touched.clear();
+  for (int i = 0; i < grid_size; i++) {
+    q_trial[i] = 0;
+  }
+  full_rebuild = true;
+  phi_trial_valid = false;
+  trial_E_valid = false;
+
+}
+
+void PotentialEwaldPME::ResetTrialStructureFactor() {
+  if (full_rebuild) {
+    for (int i = 0; i < grid_size; i++) {
+      q_trial[i] = q_grid[i];
+    }
+  }
+  else {
+    for (int i = 0; i < (int)touched.size(); i++) {
+      q_trial[touched[i]] = q_grid[touched[i]];
+      mark[touched[i]] &= ~1;
+    }
+  }
+  touched.clear();
+  full_rebuild = false;
+  phi_trial_valid = false;
+  trial_E = grid_E;
+  trial_E_valid = true;
+
+}
+
+void PotentialEwaldPME::AddToTrialStructureFactor(Bead& bead, int flag,
+                                                  double sign) {
+  Spread(bead, flag, sign);
+  phi_trial_valid = false;
+  trial_E_valid = false;
+
+}
+
+double PotentialEwaldPME::TrialReplEnergy() {
+  int n_touched = (int)touched.size();
+  double fft_cost = 10.0*grid_size*log2((double)grid_size);
+
+  // Large changes are cheaper to redo from scratch.
+  if (full_rebuild ||
+      (double)n_touched*(n_touched + (int)pending.size()) > fft_cost) {
+    GridPotential(q_trial, phi_trial);
+    trial_E = 0;
+    for (int i = 0; i < grid_size; i++) {
+      trial_E += 0.5 * q_trial[i] * phi_trial[i];
+    }
+    phi_trial_valid = true;
+  }
+  // dE = sum_a dq_a*phi_a + 0.5 * sum_ab dq_a*dq_b*G(a-b).
+  else {
+    vector<double> dq(n_touched);
+    for (int i = 0; i < n_touched; i++) {
+      dq[i] = q_trial[touched[i]] - q_grid[touched[i]];
+    }
+    double dE = 0;
+    for (int i = 0; i < n_touched; i++) {
+      dE += dq[i] * CurrentPotential(touched[i]);
+      dE += 0.5 * dq[i] * dq[i] * g_real[0];
+      for (int j = i+1; j < n_touched; j++) {
+        dE += dq[i] * dq[j] * Kernel(touched[i], touched[j]);
+      }
+    }
+    trial_E = grid_E + dE;
+  }
+  trial_E_valid = true;
+
+  return trial_E;
+
+}
+
+void PotentialEwaldPME::AcceptTrialStructureFactor() {
+  if (full_rebuild) {
+    for (int i = 0; i < grid_size; i++) {
+      q_grid[i] = q_trial[i];
+    }
+    Refresh();
+  }
+  else {
+    if (!trial_E_valid)
+      TrialReplEnergy();
+
+    if (phi_trial_valid) {
+      for (int i = 0; i < (int)touched.size(); i++) {
+        q_grid[touched[i]] = q_trial[touched[i]];
+      }
+      double * temp = phi;
+      phi = phi_trial;
+      phi_trial = temp;
+      grid_E = trial_E;
+      for (int i = 0; i < (int)pending.size(); i++) {
+        pending_dq[pending[i]] = 0;
+        mark[pending[i]] &= ~2;
+      }
+      pending.clear();
+    }
+    else {
+      for (int i = 0; i < (int)touched.size(); i++) {
+        int index = touched[i];
+        pending_dq[index] += q_trial[index] - q_grid[index];
+        q_grid[index] = q_trial[index];
+        if (!(mark[index] & 2)) {
+          mark[index] |= 2;
+          pending.push_back(index);
+        }
+      }
+      grid_E = trial_E;
+      if ((int)pending.size() > pending_max)
+        Refresh();
+    }
+  }
+
+  for (int i = 0; i < (int)touched.size(); i++) {
+    mark[touched[i]] &= ~1;
+  }
+  touched.clear();
+  full_rebuild = false;
+  phi_trial_valid = false;
+  trial_E = grid_E;
+  trial_E_valid = true;
+
+}
+
+// The energy of a charge spread onto the grid with the current grid charges
+// is q times the grid potential summed over its stencil. Only phi is read, so
+// the threads can share it.
+double PotentialEwaldPME::BeadReplEnergy(Bead& bead, int thread) {
+  double q = bead.Charge();
+  if (q == 0)  return 0;
+
+  double w[3][kMaxSplineOrder];
+  int id[3][kMaxSplineOrder];
+  Stencil(bead, 1, w[0], id[0]);
+  double potential = 0;
+  for (int i = 0; i < order; i++) {
+    for (int j = 0; j < order; j++) {
+      double wij = w[0][i] * w[1][j];
+      int row = (id[0][i]*grid[1] + id[1][j])*grid[2];
+      for (int k = 0; k < order; k++) {
+        potential += wij * w[2][k] * phi[row + id[2][k]];
+      }
+    }
+  }
+
+  return q * potential;
+
+}
+
+// Applying the pending changes to the stencil of every bead would cost more
+// than the two FFTs of a refresh.
+void PotentialEwaldPME::PrepareBeadReplEnergy() {
+  if (pending.empty())  return;
+  Refresh();
+  trial_E = grid_E;
+  trial_E_valid = true;
+
+}
+
+// The grid is saved together with the changes that are still pending, so that
+// the restarted run refreshes the grid potential at the same steps.
+void PotentialEwaldPME::SaveStructureFactor(ostream& out) {
+  WriteBinary(out, grid_size);
+  WriteBinary(out, q_grid, grid_size);
+  WriteBinary(out, phi, grid_size);
+  WriteBinary(out, grid_E);
+  WriteBinary(out, pending);
+  for (int i = 0; i < (int)pending.size(); i++) {
+    WriteBinary(out, pending_dq[pending[i]]);
+  }
+
+}
+
+void PotentialEwaldPME::LoadStructureFactor(istream& in) {
+  int grid_size_saved = 0;
+  ReadBinary(in, grid_size_saved);
+  if (grid_size_saved != grid_size) {
+    cout << "  The checkpoint has " << grid_size_saved << " PME grid points "
+         << "but the current" << endl;
+    cout << "  parameters give " << grid_size << ". Restart with --rebuild to "
+         << "recompute the" << endl;
+    cout << "  energies. Exiting! Program complete." << endl;
+    exit(1);
+  }
+  ReadBinary(in, q_grid, grid_size);
+  ReadBinary(in, phi, grid_size);
+  ReadBinary(in, grid_E);
+  for (int i = 0; i < grid_size; i++) {
+    q_trial[i] = q_grid[i];
+    pending_dq[i] = 0;
+    mark[i] = 0;
+  }
+  ReadBinary(in, pending);
+  for (int i = 0; i < (int)pending.size(); i++) {
+    ReadBinary(in, pending_dq[pending[i]]);
+    mark[pending[i]] |= 2;
+  }
+  touched.clear();
+  full_rebuild = false;
+  phi_trial_valid = false;
+  trial_E = grid_E;
+  trial_E_valid = true;
+
+}
+
+// The grid charges move with the configuration. The grid potential holds the
+// Bjerrum length, so it is refreshed by FFT on both sides.
+void PotentialEwaldPME::SwapStructureFactor(PotentialEwald& other) {
+  PotentialEwaldPME& pme = static_cast<PotentialEwaldPME&>(other);
+  swap(q_grid, pme.q_grid);
+  swap(pending_dq, pme.pending_dq);
+  swap(mark, pme.mark);
+  pending.swap(pme.pending);
+  touched.swap(pme.touched);
+  PotentialEwaldPME * sides[2] = {this, &pme};
+  for (int s = 0; s < 2; s++) {
+    PotentialEwaldPME * p = sides[s];
+    p->Refresh();
+    for (int i = 0; i < (int)p->touched.size(); i++) {
+      p->mark[p->touched[i]] &= ~1;
+    }
+    p->touched.clear();
+    for (int i = 0; i < p->grid_size; i++) {
+      p->q_trial[i] = p->q_grid[i];
+    }
+    p->full_rebuild = false;
+    p->phi_trial_valid = false;
+    p->trial_E = p->grid_E;
+    p->trial_E_valid = true;
+  }
+
+}
+
+bool PotentialEwaldPME::SameSums(PotentialEwald& other) {
+  if (!PotentialEwaldCoul::SameSums(other))  return false;
+  PotentialEwaldPME& pme = static_cast<PotentialEwaldPME&>(other);
+  return grid[0] == pme.grid[0] && grid[1] == pme.grid[1] &&
+         grid[2] == pme.grid[2] && order == pme.order;
+
+}
@@ -0,0 +1,118 @@
+#ifndef SRC_FORCE_FIELD_POTENTIAL_EWALD_PME_H_
+#define SRC_FORCE_FIELD_POTENTIAL_EWALD_PME_H_
+
+#include <fftw3.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../molecules/bead.h"
+#include "potential_ewald_coul.h"
+
+using namespace std; 
+
+/** Smooth particle-mesh Ewald (Essmann et al., J. Chem. Phys. 103, 8577). The
+    real space part, the self energy, the dipole correction and all pair
+    kernels are those of PotentialEwaldCoul. Only the total reciprocal energy
+    is computed differently: charges are spread onto a grid with cardinal
+    B-splines and the grid is convolved with the Ewald kernel by FFT.\n
+    For local MC moves, the convolved grid potential of the last FFT is kept
+    together with the grid charges that changed since then. The potential at
+    a grid point is the cached value plus the kernel applied to those pending
+    changes, so a move only touches the p^3 grid points around each moved
+    bead. The potential is refreshed by FFT once too many changes pile up. */
+class PotentialEwaldPME : public PotentialEwaldCoul {
+ private:
+  /** Grid spacing requested in the input, in unit length. */
+  double grid_spacing;
+  /** Order of the B-spline (even, 4 or higher). */
+  int order;
+  /** Number of grid points along each dimension. */
+  int grid[3];
+  /** Total number of grid points. */
+  int grid_size;
+  /** Number of complex values from the real-to-complex FFT. */
+  int grid_size_k;
+
+  /** Grid charges of the current configuration. */
+  double * q_grid;
+  /** Grid charges of the MC trial configuration. */
+  double * q_trial;
+  /** Grid potential of q_grid at the last FFT refresh. */
+  double * phi;
+  /** Grid potential of q_trial, valid when the trial energy was computed by
+      FFT. */
+  double * phi_trial;
+  bool phi_trial_valid;
+  /** Real space kernel, the inverse FFT of theta. */
+  double * g_real;
+  /** 4*pi*lB/V * exp(-k2/(4*alpha))/k2 * |b(k)|^2 on the r2c grid. */
+  double * theta;
+
+  /** Grid points whose trial charge differs from the current one. */
+  vector<int> touched;
+  /** Grid charge changes accepted since the last refresh. */
+  vector<int> pending;
+  double * pending_dq;
+  /** 1 if a grid point is in touched, 2 if in pending, 3 if in both. */
+  char * mark;
+  /** Refresh the grid potential once pending grows beyond this size. */
+  int pending_max;
+  /** True when the trial grid is built from scratch. */
+  bool full_rebuild;
+
+  /** Reciprocal energy of the current and the trial grid. */
+  double grid_E;
+  double trial_E;
+  /** True when trial_E matches the trial grid. */
+  bool trial_E_valid;
+
+  /** FFT buffers and plans. */
+  double * fft_real;
+  fftw_complex * fft_cplx;
+  fftw_plan plan_forward;
+  fftw_plan plan_backward;
+
+  /** Read the grid parameters and set up the grid. */
+  void ReadGridParameters();
+  /** Cardinal B-spline of order n at x. */
+  double BSpline(int, double);
+  /** The B-spline weights of a bead, at the position the flag selects, and
+      the grid indices they apply to. Along dimension d, the order values
+      start at index d*kMaxSplineOrder. */
+  void Stencil(Bead&, int, double *, int *);
+  /** Spread sign*q of a bead onto q_trial. */
+  void Spread(Bead&, int, double);
+  /** Convolve a grid of charges with the Ewald kernel. */
+  void GridPotential(double *, double *);
+  /** Potential of the current configuration at a grid point. */
+  double CurrentPotential(int);
+  /** Kernel between two grid points. */
+  double Kernel(int, int);
+  /** Recompute phi and grid_E from q_grid and clear pending. */
+  void Refresh();
+
+ public: 
+  PotentialEwaldPME(string, double[3], int, int);
+  ~PotentialEwaldPME();
+
+  /** Grid based replacements of the structure factor routines. */
+  void ClearTrialStructureFactor();
+  void ResetTrialStructureFactor();
+  void AddToTrialStructureFactor(Bead&, int, double);
+  double TrialReplEnergy();
+  void AcceptTrialStructureFactor();
+  void SaveStructureFactor(ostream&);
+  void LoadStructureFactor(istream&);
+  void SwapStructureFactor(PotentialEwald&);
+  bool SameSums(PotentialEwald&);
+  /** The bead with the charges on the grid, from the grid potential, which
+      PrepareBeadReplEnergy refreshes if changes are pending. */
+  double BeadReplEnergy(Bead&, int = 0);
+  void PrepareBeadReplEnergy();
+
+}; 
+
+#endif
+
@@ -1,5 +1,9 @@
 #include "potential_external.h"
 
+#include <cmath>
+#include <utility>
+
+#include "../utilities/binary_io.h"
 #include "../utilities/constants.h"
 
 using namespace std;
@@ -12,36 +16,15 @@ PotentialExternal::PotentialExternal(string potential_name) {
 
 }
 
-void PotentialExternal::SetE(int flag, int key, double val) {
-  if (flag == 0) {
-    current_energy_map[key] = val; 
-  }
-  else if (flag == 1) {
-    trial_energy_map[key] = val; 
-  }
-  else {
-    cout << "  Invalid map requested!" << endl;
-  }
+void PotentialExternal::SetE(int key, double val) {
+  if (key >= (int)current_energy.size())  current_energy.resize(key+1, 0);
+  current_energy[key] = val;
 
 }
 
-void PotentialExternal::SetEBothMaps(int key, double val) {
-  current_energy_map[key] = val;
-  trial_energy_map[key] = val;
-
-}
-
-double PotentialExternal::GetE(int flag, int key) {
-  if (flag == 0) {
-    return current_energy_map[key]; 
-  }
-  else if (flag == 1) {
-    return trial_energy_map[key]; 
-  }
-  else {
-    cout << "  Invalid map requested!" << endl; 
-  }
-  return 1;
+double PotentialExternal::GetE(int key) {
+  if (key < 0 || key >= (int)current_energy.size())  return 0;
+  return current_energy[key];
 
 }
 
@@ -49,12 +32,13 @@ void PotentialExternal::EnergyInitialization(vector<Molecule>& mols,
                                              double box_l[],
                                              int npbc) {
   E_tot = 0;
+  current_energy.clear();
 
   for (int i = 0; i < (int)mols.size(); i++) {
     for (int j = 0; j < mols[i].Size(); j++) {
       double en = BeadEnergy(mols[i].bds[j], box_l); 
       E_tot += en; 
-      SetEBothMaps(mols[i].bds[j].ID(), en); 
+      SetE(mols[i].bds[j].ID(), en); 
     }
   }
 
@@ -73,7 +57,7 @@ void PotentialExternal::EnergyInitForLastMol(vector<Molecule>& mols, int chain_l
     for (int j = 0; j < mols[i].Size(); j++) {
       double en = BeadEnergy(mols[i].bds[j], box_l);
       E_tot += en;
-      SetEBothMaps(mols[i].bds[j].ID(), en);
+      SetE(mols[i].bds[j].ID(), en);
     }
   }
 
@@ -89,9 +73,8 @@ void PotentialExternal::AdjustEnergyUponMolDeletion(vector<Molecule>& mols,
 
   for (int i = delete_id; i <= delete_id+counterion; i++) {
     for (int j = 0; j < mols[i].Size(); j++) {
-      E_tot -= current_energy_map[mols[i].bds[j].ID()]; 
-      current_energy_map.erase(mols[i].bds[j].ID()); 
-      trial_energy_map.erase(mols[i].bds[j].ID());
+      E_tot -= GetE(mols[i].bds[j].ID());
+      SetE(mols[i].bds[j].ID(), 0);
     }
   }
 
@@ -101,6 +84,8 @@ double PotentialExternal::EnergyDifference(vector<Molecule>& mols,
                                            int active_mol, double box_l[],
                                            int npbc) {
   dE = 0; 
+  changed.clear();
+  new_energy.clear();
   for (int i = 0; i < (int)mols[active_mol].Size(); i++) {
     if (mols[active_mol].bds[i].GetMoved()) {
       double eNew = BeadEnergy(mols[active_mol].bds[i], box_l); 
@@ -108,29 +93,24 @@ double PotentialExternal::EnergyDifference(vector<Molecule>& mols,
         dE = kVeryLargeEnergy;
         return dE;
       }
-      SetE(1, mols[active_mol].bds[i].ID(), eNew); 
-      dE += eNew - GetE(0, mols[active_mol].bds[i].ID()); 
+      changed.push_back(mols[active_mol].bds[i].ID());
+      new_energy.push_back(eNew);
+      dE += eNew - GetE(mols[active_mol].bds[i].ID()); 
     }
   }
   return dE; 
 
 }
 
-void PotentialExternal::FinalizeEnergyBothMaps(vector<Molecule>& mols,
-                                               int active_mol, bool accepted) {
-  if (accepted)  E_tot += dE; 
-  for (int i = 0; i < (int) mols[active_mol].Size(); i++) {
-    if (mols[active_mol].bds[i].GetMoved()) {
-      if (accepted) {
-        SetE(0, mols[active_mol].bds[i].ID(),
-             GetE(1, mols[active_mol].bds[i].ID())); 
-      }
-      else {
-        SetE(1, mols[active_mol].bds[i].ID(),
-             GetE(0, mols[active_mol].bds[i].ID()));
-      }
+void PotentialExternal::FinalizeEnergy(bool accepted) {
+  if (accepted) {
+    E_tot += dE; 
+    for (int i = 0; i < (int)changed.size(); i++) {
+      current_energy[changed[i]] = new_energy[i];
     }
   }
+  changed.clear();
+  new_energy.clear();
 
 }
 
@@ -139,6 +119,11 @@ double PotentialExternal::GetTotalEnergy() {
 
 }
 
+void PotentialExternal::AddEnergy(double energy) {
+  E_tot += energy;
+
+}
+
 double PotentialExternal::CalcTrialTotalEnergy(vector < Molecule >& mols,
                                                double box_l[], int npbc) {
   double total_energy = 0;
@@ -157,4 +142,29 @@ string PotentialExternal::PotentialName() {
 
 }
 
+void PotentialExternal::SaveState(ostream& out) {
+  WriteBinary(out, E_tot);
+  WriteBinary(out, current_energy);
+
+}
+
+void PotentialExternal::LoadState(istream& in) {
+  ReadBinary(in, E_tot);
+  ReadBinary(in, current_energy);
+  dE = 0;
+  changed.clear();
+  new_energy.clear();
+
+}
 
+void PotentialExternal::SwapState(PotentialExternal& other) {
+  swap(E_tot, other.E_tot);
+  current_energy.swap(other.current_energy);
+  dE = 0;
+  changed.clear();
+  new_energy.clear();
+  other.dE = 0;
+  other.changed.clear();
+  other.new_energy.clear();
+
+}
@@ -2,7 +2,6 @@
 #define SRC_FORCE_FIELD_POTENTIAL_EXTERNAL_H_
 
 #include <vector>
-#include <map> 
 #include <iostream>
 #include <iomanip> 
 #include <numeric> 
@@ -18,10 +17,16 @@ using namespace std;
 class PotentialExternal{
  private:
   string name;
-  map<int, double> current_energy_map; 
-  map<int, double> trial_energy_map; 
+  /** Energy of every bead ID, zero for IDs without a bead. It is extended
+      only when beads are added, so the moves of a checkerboard pass write
+      distinct entries and can share it. */
+  vector<double> current_energy;
   double E_tot;
   double dE;
+  /** The IDs of the beads the last EnergyDifference call moved and their
+      energies after the move, written to the map if it is accepted. */
+  vector<int> changed;
+  vector<double> new_energy;
 
  public:
   /////////////////////
@@ -40,10 +45,11 @@ class PotentialExternal{
   /////////////////////////////////
   // Reading and storing energy. //
   /////////////////////////////////
-  void SetE(int, int, double);
-  double GetE(int, int);
-  void SetEBothMaps(int, double);
+  void SetE(int, double);
+  double GetE(int);
   double GetTotalEnergy();
+  /** Add to the total energy, for moves that set the energies with SetE. */
+  void AddEnergy(double);
   double CalcTrialTotalEnergy(vector < Molecule >& mols, double[], int);
 
   ///////////////////
@@ -52,7 +58,18 @@ class PotentialExternal{
   void EnergyInitForLastMol(vector < Molecule >& mols, int, double, double[], int);
   void AdjustEnergyUponMolDeletion(vector < Molecule >& mols, int);
   double EnergyDifference(vector < Molecule >& mols, int, double[], int);
-  void FinalizeEnergyBothMaps(vector < Molecule >& mols, int, bool);
+  /** Write the new energies of an accepted MC move, drop them otherwise. */
+  void FinalizeEnergy(bool);
+
+  ////////////////////
+  // Checkpointing. //
+  ////////////////////
+  /** Write the current energies to a checkpoint, and read them back. */
+  void SaveState(ostream&);
+  void LoadState(istream&);
+  /** Exchange the current energies with another external potential of the
+      same parameters. */
+  void SwapState(PotentialExternal&);
 
   ////////////
   // Other. //
@@ -3,11 +3,14 @@
 
 #include "potential_hard_sphere.h"
 
+#include <algorithm>
 #include <iomanip>
 #include <vector>
 
 #include "../molecules/molecule.h"
 #include "../utilities/constants.h"
+#include "../utilities/misc.h"
+#include "pair_batch.h"
 
 PotentialHardSphere::PotentialHardSphere(string potential_name) :
                      PotentialPair(potential_name) {
@@ -27,18 +30,32 @@ void PotentialHardSphere::ReadParameters() {
     if (symbol == "end")  break;
     else {
       cin >> flag >> radius;
-      radii[symbol] = radius;
+      int type = BeadTypeID(symbol);
+      if (type >= (int)radii.size())  radii.resize(type+1, 0);
+      radii[type] = radius;
       cout << setw(35) << "[PP] Bead type and r (ul)   : "  << symbol << " - "
            << radius << endl;
     }
   }
 
+  // Types without a radius are points.
+  n_types = NumBeadTypes();
+  radii.resize(n_types, 0);
+  pair_contact.resize(n_types*n_types);
+  for (int i = 0; i < n_types; i++) {
+    for (int j = 0; j < n_types; j++) {
+      pair_contact[i*n_types + j] = radii[i] + radii[j];
+    }
+  }
+  cout << setw(35) << "[PP] Batched pair kernel    : " << SimdName(simd_level)
+       << endl;
+
 }
 
 double PotentialHardSphere::PairEnergy(Bead& bead1, Bead& bead2,
                                        double box_l[], int npbc) {
   double r = bead1.BBDist(bead2, box_l, npbc);
-  double allowed_r = radii[bead1.Symbol()] + radii[bead2.Symbol()];
+  double allowed_r = pair_contact[bead1.Type()*n_types + bead2.Type()];
   if (r <= allowed_r) {
     return kVeryLargeEnergy;
   }
@@ -48,6 +65,95 @@ double PotentialHardSphere::PairEnergy(Bead& bead1, Bead& bead2,
 
 }
 
+double PotentialHardSphere::PairEnergy(ParticleStore& particles, int p1,
+                                       int p2, double box_l[], int npbc) {
+  double r = particles.Dist(p1, p2, box_l, npbc);
+  const int * types = particles.Types();
+  if (r <= pair_contact[types[p1]*n_types + types[p2]]) {
+    return kVeryLargeEnergy;
+  }
+  else {
+    return 0;
+  }
+
+}
+
+void PotentialHardSphere::PairEnergyBatch(const double pos[], int type,
+                                          const ParticleSpan& span,
+                                          double box_l[], int npbc,
+                                          double energy[]) {
+#ifdef PLUM_X86_SIMD
+  if (simd_level == kSimdAVX512) {
+    PairEnergyBatchAVX512(pos, type, span, box_l, npbc, energy);
+    return;
+  }
+  if (simd_level == kSimdAVX2) {
+    PairEnergyBatchAVX2(pos, type, span, box_l, npbc, energy);
+    return;
+  }
+#endif
+  PairEnergyBatchScalar(pos, type, span, 0, box_l, npbc, energy);
+
+}
+
+void PotentialHardSphere::PairEnergyBatchScalar(const double pos[], int type,
+                                                const ParticleSpan& span,
+                                                int start, double box_l[],
+                                                int npbc, double energy[]) {
+  for (int j = start; j < span.n; j++) {
+    double r = BatchDist(pos, span, j, box_l, npbc);
+    if (r <= pair_contact[type*n_types + span.type[j]]) {
+      energy[j] = kVeryLargeEnergy;
+    }
+    else {
+      energy[j] = 0;
+    }
+  }
+
+}
+
+#ifdef PLUM_X86_SIMD
+__attribute__((target("avx2")))
+void PotentialHardSphere::PairEnergyBatchAVX2(const double pos[], int type,
+                                              const ParticleSpan& span,
+                                              double box_l[], int npbc,
+                                              double energy[]) {
+  const __m128i row = _mm_set1_epi32(type*n_types);
+  const __m256d large = _mm256_set1_pd(kVeryLargeEnergy);
+  int j = 0;
+  for (; j+4 <= span.n; j += 4) {
+    __m256d r = _mm256_sqrt_pd(BatchDist2AVX2(pos, span, j, box_l, npbc));
+    __m128i idx = _mm_add_epi32(row, _mm_loadu_si128((const __m128i*)
+                                                     (span.type + j)));
+    __m256d contact = _mm256_i32gather_pd(pair_contact.data(), idx, 8);
+    _mm256_storeu_pd(energy + j, _mm256_and_pd(large,
+                                   _mm256_cmp_pd(r, contact, _CMP_LE_OQ)));
+  }
+  PairEnergyBatchScalar(pos, type, span, j, box_l, npbc, energy);
+
+}
+
+__attribute__((target("avx512f")))
+void PotentialHardSphere::PairEnergyBatchAVX512(const double pos[], int type,
+                                                const ParticleSpan& span,
+                                                double box_l[], int npbc,
+                                                double energy[]) {
+  const __m256i row = _mm256_set1_epi32(type*n_types);
+  const __m512d large = _mm512_set1_pd(kVeryLargeEnergy);
+  int j = 0;
+  for (; j+8 <= span.n; j += 8) {
+    __m512d r = _mm512_sqrt_pd(BatchDist2AVX512(pos, span, j, box_l, npbc));
+    __m256i idx = _mm256_add_epi32(row, _mm256_loadu_si256((const __m256i*)
+                                                           (span.type + j)));
+    __m512d contact = _mm512_i32gather_pd(idx, pair_contact.data(), 8);
+    _mm512_storeu_pd(energy + j, _mm512_maskz_mov_pd(
+                       _mm512_cmp_pd_mask(r, contact, _CMP_LE_OQ), large));
+  }
+  PairEnergyBatchScalar(pos, type, span, j, box_l, npbc, energy);
+
+}
+#endif
+
 double PotentialHardSphere::PairForce(Bead& bead1, Bead& bead2,
                                       double box_l[], int npbc) {
   // Force for hard sphere potential is not well-defined. This function should
@@ -57,3 +163,12 @@ double PotentialHardSphere::PairForce(Bead& bead1, Bead& bead2,
 }
 
 
+double PotentialHardSphere::Cutoff() {
+  double max_contact = 0;
+  for (int i = 0; i < (int)pair_contact.size(); i++) {
+    max_contact = max(max_contact, pair_contact[i]);
+  }
+  return max_contact;
+
+}
+
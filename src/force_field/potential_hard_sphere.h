@@ -4,6 +4,7 @@
 #include <iostream>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "../molecules/bead.h"
 #include "potential_pair.h"
@@ -13,8 +14,23 @@ using namespace std;
 /** Hard sphere potential is self-explanatory. */
 class PotentialHardSphere : public PotentialPair {
  private:
-  /** The radius for different types of beads. */
-  map<string, double> radii; 
+  /** The radius for different types of beads, indexed by type ID. */
+  vector<double> radii; 
+  /** Number of bead types covered by the contact table. */
+  int n_types;
+  /** The contact distance of every pair of bead types, indexed by
+      type1*n_types+type2. */
+  vector<double> pair_contact;
+
+  /** PairEnergyBatch for the particles of the span from the fourth argument
+      on, one at a time. */
+  void PairEnergyBatchScalar(const double[], int, const ParticleSpan&, int,
+                             double[], int, double[]);
+  /** PairEnergyBatch with 4 and 8 particles at a time. */
+  void PairEnergyBatchAVX2(const double[], int, const ParticleSpan&,
+                           double[], int, double[]);
+  void PairEnergyBatchAVX512(const double[], int, const ParticleSpan&,
+                             double[], int, double[]);
 
  public: 
   /////////////////////
@@ -27,7 +43,11 @@ class PotentialHardSphere : public PotentialPair {
   // Energy and force. //
   ///////////////////////
   double PairEnergy(Bead&, Bead&, double[], int);   
+  double PairEnergy(ParticleStore&, int, int, double[], int);
+  void PairEnergyBatch(const double[], int, const ParticleSpan&, double[], int,
+                       double[]);
   double PairForce(Bead&, Bead&, double[], int);
+  double Cutoff();
 
 }; 
 
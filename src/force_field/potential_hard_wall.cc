@@ -25,12 +25,17 @@ void PotentialHardWall::ReadParameters() {
     }
     else {
       cin >> flag >> radius;
-      radii[symbol] = radius;
+      int type = BeadTypeID(symbol);
+      if (type >= (int)radii.size())  radii.resize(type+1, 0);
+      radii[type] = radius;
       cout << setw(35) << "[eP] Radius for bead type   : " << symbol << " - "
            << radius << endl;
     }
   }
 
+  // Types without a radius are points.
+  radii.resize(NumBeadTypes(), 0);
+
 }
 
 double PotentialHardWall::BeadEnergy(Bead& bead, double box_l[]) {
@@ -38,7 +43,7 @@ double PotentialHardWall::BeadEnergy(Bead& bead, double box_l[]) {
   // Get the z coordinate from the trial coordinate array.
   double z = bead.GetCrd(1, 2);
   // If the bead falls outside of the box in the z-direction.
-  if (z <= radii[bead.Symbol()] || z+radii[bead.Symbol()] >= box_l[2]) {
+  if (z <= radii[bead.Type()] || z+radii[bead.Type()] >= box_l[2]) {
     energy = kVeryLargeEnergy;
   }
 
@@ -19,8 +19,8 @@ using namespace std;
     the walls and infinite otherwise. */
 class PotentialHardWall : public PotentialExternal {
  private:
-  /** The radius for different bead types. */
-  map<string, double> radii;
+  /** The radius for different bead types, indexed by type ID. */
+  vector<double> radii;
 
  public:
   /////////////////////
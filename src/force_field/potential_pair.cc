@@ -1,67 +1,115 @@
 #include "potential_pair.h"
 
+#include <algorithm>
 #include <cmath>
 #include <vector> 
 
+#include "../utilities/binary_io.h"
 #include "../utilities/constants.h"
+#include "../utilities/misc.h"
 
 using namespace std; 
 
 // Default constructor.
 PotentialPair::PotentialPair(string potential_name) {
   name = potential_name;
-  dE = 0;
+  hard_sphere = (name == "HardSphere");
+  last_move.dE = 0;
   E_tot = 0;
+  n_slots = 0;
+  simd_level = SimdLevel();
 
 }
 
-// Sets a pairwise energy value in either array.
-void PotentialPair::SetE(int flag, int key1, int key2, double val) {
-  if (flag == 0) {
-    current_energy_map[make_pair(min(key1, key2), max(key1, key2))] = val; 
-  }
-  else if (flag == 1) {
-    trial_energy_map[make_pair(min(key1, key2), max(key1, key2))] = val;
+void PotentialPair::SetSimdLevel(int level) {
+  simd_level = min(level, SimdLevel());
+
+}
+
+// Returns the slot of a bead ID, taking a recycled slot or appending a new
+// row to the array when the ID is seen for the first time.
+int PotentialPair::AcquireSlot(int id) {
+  if (id >= (int)id_to_slot.size()) {
+    id_to_slot.resize(id+1, -1);
   }
-  else {
-    cout << "PotentialPair::SetE:\n  Invalid map requested!" << endl;
+  if (id_to_slot[id] < 0) {
+    int slot;
+    if (!free_slots.empty()) {
+      slot = free_slots.back();
+      free_slots.pop_back();
+    }
+    else {
+      slot = n_slots++;
+      current_energy.resize(PairIndex(slot, slot)+1, 0);
+    }
+    id_to_slot[id] = slot;
   }
+  return id_to_slot[id];
 
 }
 
-// Puts the value into all pair slots in both arrays.
-void PotentialPair::SetEBothMaps(int key1, int key2, double val) {
-  current_energy_map[make_pair(min(key1, key2), max(key1, key2))] = val;
-  trial_energy_map[make_pair(min(key1, key2), max(key1, key2))] = val;
+int PotentialPair::FindSlot(int id) {
+  if (id < 0 || id >= (int)id_to_slot.size())  return -1;
+  return id_to_slot[id];
 
 }
 
-// Gets a pairwise energy value from either array.
-double PotentialPair::GetE(int flag, int key1, int key2) {
-  if (flag == 0) {
-    return current_energy_map[make_pair(min(key1, key2), max(key1, key2))]; 
-  }
-  else if (flag == 1) {
-    return trial_energy_map[make_pair(min(key1, key2), max(key1, key2))];
-  }
-  else {
-    cout << "PotentialPair::GetE:\n  Invalid flag." << endl;
-    return 1; 
+// Zeroes the row and column of the slot so that the next bead taking it
+// starts with no stale energies.
+void PotentialPair::ReleaseSlot(int id) {
+  int slot = FindSlot(id);
+  if (slot < 0)  return;
+
+  for (int i = 0; i < n_slots; i++) {
+    current_energy[PairIndex(slot, i)] = 0;
   }
-  return 0;
- 
+  id_to_slot[id] = -1;
+  free_slots.push_back(slot);
+
+}
+
+long PotentialPair::PairIndex(int slot1, int slot2) {
+  long a = max(slot1, slot2);
+  long b = min(slot1, slot2);
+  return a*(a+1)/2 + b;
+
+}
+
+void PotentialPair::SetE(int key1, int key2, double val) {
+  current_energy[PairIndex(AcquireSlot(key1), AcquireSlot(key2))] = val;
+
+}
+
+// Pairs that were never set read as zero.
+double PotentialPair::GetE(int key1, int key2) {
+  int slot1 = FindSlot(key1);
+  int slot2 = FindSlot(key2);
+  if (slot1 < 0 || slot2 < 0)  return 0;
+  return current_energy[PairIndex(slot1, slot2)];
+
 }
 
 void PotentialPair::EnergyInitialization(vector<Molecule>& mols, double box_l[],
                                          int npbc) {
   E_tot = 0;
+  // Start without slots, the molecules need not be the ones the slots were
+  // handed out to. Then every bead takes one.
+  current_energy.clear();
+  id_to_slot.clear();
+  free_slots.clear();
+  n_slots = 0;
+  for (int i = 0; i < (int)mols.size(); i++) {
+    for (int j = 0; j < mols[i].Size(); j++) {
+      AcquireSlot(mols[i].bds[j].ID());
+    }
+  }
 
   // First put in intramolecular pair energies.
   for (int i = 0; i < (int)mols.size(); i++) {
     for (int j = 0; j < mols[i].Size()-1; j++) {
       for (int k = j+1; k < mols[i].Size(); k++) {
         double energy;
-        if (name == "HardSphere" && k == j+1) {
+        if (hard_sphere && k == j+1) {
           //energy = PairEnergy(mols[i].bds[j], mols[i].bds[k], box_l, npbc);
           energy = 0;
         }
@@ -69,7 +117,7 @@ void PotentialPair::EnergyInitialization(vector<Molecule>& mols, double box_l[],
           energy = PairEnergy(mols[i].bds[j], mols[i].bds[k], box_l, npbc); 
         }
         E_tot += energy;
-        SetEBothMaps(mols[i].bds[j].ID(), mols[i].bds[k].ID(), energy); 
+        SetE(mols[i].bds[j].ID(), mols[i].bds[k].ID(), energy); 
         if (energy >= kVeryLargeEnergy) {
           cout << "  Overlap: "
                << mols[i].bds[j].BBDist(mols[i].bds[k], box_l, npbc) << ", "
@@ -87,7 +135,7 @@ void PotentialPair::EnergyInitialization(vector<Molecule>& mols, double box_l[],
           double energy;
           energy = PairEnergy(mols[i].bds[k], mols[j].bds[l], box_l, npbc);
           E_tot += energy;
-          SetEBothMaps(mols[i].bds[k].ID(), mols[j].bds[l].ID(), energy); 
+          SetE(mols[i].bds[k].ID(), mols[j].bds[l].ID(), energy); 
           if (energy >= kVeryLargeEnergy) {
             cout << "  Overlap: " << i << " " << k
                  << " | " << j << " " << l << endl;
@@ -109,6 +157,11 @@ void PotentialPair::EnergyInitForLastMol(vector<Molecule>& mols, int chain_len,
   if (bead_charge != 0)
     added += chain_len;
 
+  for (int i = (int)mols.size()-added; i < (int)mols.size(); i++) {
+    for (int j = 0; j < mols[i].Size(); j++) {
+      AcquireSlot(mols[i].bds[j].ID());
+    }
+  }
   for (int i = (int)mols.size()-added; i < (int)mols.size(); i++) {
     for (int j = 0; j < mols[i].Size(); j++) {
       // With existing beads.
@@ -116,14 +169,14 @@ void PotentialPair::EnergyInitForLastMol(vector<Molecule>& mols, int chain_len,
         for (int l = 0; l < mols[k].Size(); l++) {
           int id1 = min(mols[k].bds[l].ID(), mols[i].bds[j].ID());
           int id2 = max(mols[k].bds[l].ID(), mols[i].bds[j].ID());
-          if (name == "HardSphere") {
+          if (hard_sphere) {
             energy = 0;
           }
           else {
             energy = PairEnergy(mols[i].bds[j], mols[k].bds[l], box_l, npbc);
           }
           E_tot += energy;
-          SetEBothMaps(id1, id2, energy);
+          SetE(id1, id2, energy);
         }
       }
 
@@ -133,14 +186,14 @@ void PotentialPair::EnergyInitForLastMol(vector<Molecule>& mols, int chain_len,
           if (k < i || (k == i && l < j)) {
             int id1 = min(mols[k].bds[l].ID(), mols[i].bds[j].ID());
             int id2 = max(mols[k].bds[l].ID(), mols[i].bds[j].ID());
-            if (name == "HardSphere") {
+            if (hard_sphere) {
               energy = 0;
             }
             else {
               energy = PairEnergy(mols[i].bds[j], mols[k].bds[l], box_l, npbc);
             }
             E_tot += energy;
-            SetEBothMaps(id1, id2, energy);
+            SetE(id1, id2, energy);
           }
         }
       }
@@ -149,100 +202,184 @@ void PotentialPair::EnergyInitForLastMol(vector<Molecule>& mols, int chain_len,
 
 }
 
-double PotentialPair::EnergyDifference(vector<Molecule>& mols, int moved_mol,
-                                       double box_l[], int npbc) {
+double PotentialPair::EnergyDifference(vector<Molecule>& mols,
+                                       ParticleStore& particles, int moved_mol,
+                                       double box_l[], int npbc,
+                                       CellList& cells) {
+  return EnergyDifference(mols, particles, moved_mol, box_l, npbc, cells,
+                          last_move);
+
+}
+
+double PotentialPair::EnergyDifference(vector<Molecule>& mols,
+                                       ParticleStore& particles, int moved_mol,
+                                       double box_l[], int npbc,
+                                       CellList& cells, PairMove& move) {
+  double& dE = move.dE;
+  vector<long>& changed = move.changed;
+  vector<double>& new_energy = move.new_energy;
+  vector<int>& nearby_cells = move.nearby_cells;
   dE = 0;
+  changed.clear();
+  new_energy.clear();
+  const int * ids = particles.IDs();
+  int begin = particles.Begin(moved_mol);
+  int end = particles.End(moved_mol);
 
   // For all pairs in the molecule that moved.
-  for (int i = 0; i < mols[moved_mol].Size()-1; i++) {
-    int id1 = mols[moved_mol].bds[i].ID();
-    for (int j = i+1; j < mols[moved_mol].Size(); j++) {
+  for (int i = begin; i < end-1; i++) {
+    bool moved_i = mols[moved_mol].bds[i-begin].GetMoved();
+    for (int j = i+1; j < end; j++) {
       // Only when either i or j is moved.
-      if (mols[moved_mol].bds[i].GetMoved() ||
-          mols[moved_mol].bds[j].GetMoved()) {
+      if (moved_i || mols[moved_mol].bds[j-begin].GetMoved()) {
         double new_e;
-        int id2 = mols[moved_mol].bds[j].ID();
-        if (name == "HardSphere" && j == i+1) {
+        if (hard_sphere && j == i+1) {
           new_e = 0;
-          //new_e = PairEnergy(mols[moved_mol].bds[i], mols[moved_mol].bds[j],
-          //                   box_l, npbc);
         }
         else {
-          new_e = PairEnergy(mols[moved_mol].bds[i], mols[moved_mol].bds[j],
-                             box_l, npbc);
+          new_e = PairEnergy(particles, i, j, box_l, npbc);
         }
-        SetE(1, id1, id2, new_e);
-        dE += (new_e - GetE(0, id1, id2));
+        long idx = PairIndex(FindSlot(ids[i]), FindSlot(ids[j]));
+        changed.push_back(idx);
+        new_energy.push_back(new_e);
+        dE += (new_e - current_energy[idx]);
       }
     }
   }
 
-  // For all pairs with other molecules.
-  for (int i = 0; i < (int)mols.size(); i++) {
-    if (i != moved_mol) {
-      for (int j = 0; j < mols[i].Size(); j++) {
-        for (int k = 0; k < mols[moved_mol].Size(); k++) {
-          // Only do it for moved beads.
-          if (mols[moved_mol].bds[k].GetMoved()) {
-            int id1 = min(mols[moved_mol].bds[k].ID(), mols[i].bds[j].ID());
-            int id2 = max(mols[moved_mol].bds[k].ID(), mols[i].bds[j].ID());
-            double new_e = PairEnergy(mols[moved_mol].bds[k], mols[i].bds[j],
-                                      box_l, npbc);
-            SetE(1, id1, id2, new_e);
-            dE += (new_e - GetE(0, id1, id2));
-          }
+  // For all pairs with other molecules. Beads outside of the cells around
+  // both the old and the new position of a moved bead have zero energy with
+  // it before and after the move.
+  for (int i = begin; i < end; i++) {
+    // Only do it for moved beads.
+    if (!mols[moved_mol].bds[i-begin].GetMoved())  continue;
+
+    vector<int>& old_cells = cells.Neighbors(cells.CellIndex(particles, i, 0));
+    vector<int>& new_cells = cells.Neighbors(cells.CellIndex(particles, i, 1));
+    nearby_cells.assign(old_cells.begin(), old_cells.end());
+    nearby_cells.insert(nearby_cells.end(), new_cells.begin(), new_cells.end());
+    sort(nearby_cells.begin(), nearby_cells.end());
+    nearby_cells.erase(unique(nearby_cells.begin(), nearby_cells.end()),
+                       nearby_cells.end());
+
+    // Gather the beads of the other molecules in these cells.
+    const int * types = particles.Types();
+    move.batch_index.clear();
+    move.batch_type.clear();
+    for (int d = 0; d < 3; d++) {
+      move.batch_crd[d].clear();
+    }
+    for (int c = 0; c < (int)nearby_cells.size(); c++) {
+      vector<int>& list = cells.Beads(nearby_cells[c]);
+      for (int n = 0; n < (int)list.size(); n++) {
+        int j = list[n];
+        if (j >= begin && j < end)  continue;
+        move.batch_index.push_back(j);
+        move.batch_type.push_back(types[j]);
+        for (int d = 0; d < 3; d++) {
+          move.batch_crd[d].push_back(particles.Crd(1, d)[j]);
         }
       }
     }
+
+    ParticleSpan span;
+    for (int d = 0; d < 3; d++) {
+      span.crd[d] = move.batch_crd[d].data();
+    }
+    span.type = move.batch_type.data();
+    span.n = (int)move.batch_index.size();
+    double pos[3];
+    for (int d = 0; d < 3; d++) {
+      pos[d] = particles.Crd(1, d)[i];
+    }
+    move.batch_energy.resize(span.n);
+    PairEnergyBatch(pos, types[i], span, box_l, npbc,
+                    move.batch_energy.data());
+
+    int slot1 = FindSlot(ids[i]);
+    for (int n = 0; n < span.n; n++) {
+      long idx = PairIndex(slot1, FindSlot(ids[move.batch_index[n]]));
+      changed.push_back(idx);
+      new_energy.push_back(move.batch_energy[n]);
+      dE += (move.batch_energy[n] - current_energy[idx]);
+    }
   }
 
   return dE; 
 
 }
 
-void PotentialPair::FinalizeEnergyBothMaps(vector<Molecule>& mols,
-                                           int moved_mol, bool accept) {
-  // Adjust total energy variable.
-  if (accept) {
-     E_tot += dE;
+// Bonded hard spheres do not overlap, as in EnergyDifference.
+bool PotentialPair::Overlaps(vector<Molecule>& mols, ParticleStore& particles,
+                             int moved_mol, double box_l[], int npbc,
+                             CellList& cells) {
+  int begin = particles.Begin(moved_mol);
+  int end = particles.End(moved_mol);
+
+  for (int i = begin; i < end; i++) {
+    if (!mols[moved_mol].bds[i-begin].GetMoved())  continue;
+    int own_cell = cells.CellIndex(particles, i, 1);
+    if (CellOverlaps(particles, i, own_cell, begin, end, box_l, npbc, cells))
+      return true;
+    vector<int>& nearby_cells = cells.Neighbors(own_cell);
+    for (int c = 0; c < (int)nearby_cells.size(); c++) {
+      if (nearby_cells[c] == own_cell)  continue;
+      if (CellOverlaps(particles, i, nearby_cells[c], begin, end, box_l, npbc,
+                       cells))
+        return true;
+    }
   }
 
-  // Within the moved molecule.
-  for (int i = 0; i < mols[moved_mol].Size()-1; i++) {
-    for (int j = i+1; j < mols[moved_mol].Size(); j++) {
-      if (mols[moved_mol].bds[i].GetMoved() ||
-          mols[moved_mol].bds[j].GetMoved()) {
-        int id1 = mols[moved_mol].bds[i].ID();
-        int id2 = mols[moved_mol].bds[j].ID();
-        if (accept) {
-          SetE(0, id1, id2, GetE(1, id1, id2));
-        }
-        else {
-          SetE(1, id1, id2, GetE(0, id1, id2));
-        }
-      }
+  for (int i = begin; i < end-1; i++) {
+    bool moved_i = mols[moved_mol].bds[i-begin].GetMoved();
+    for (int j = i+1; j < end; j++) {
+      if (!moved_i && !mols[moved_mol].bds[j-begin].GetMoved())  continue;
+      if (hard_sphere && j == i+1)  continue;
+      if (PairEnergy(particles, i, j, box_l, npbc) >= kVeryLargeEnergy)
+        return true;
     }
   }
+  return false;
 
-  // Between the moved molecule and the other molecules.
-  for (int i = 0; i < (int)mols.size(); i++) {
-    if (i != moved_mol) {
-      for (int j = 0; j < mols[i].Size(); j++) {
-        for (int k = 0; k < mols[moved_mol].Size(); k++) {
-          if (mols[moved_mol].bds[k].GetMoved()) {
-            int id1 = min(mols[moved_mol].bds[k].ID(), mols[i].bds[j].ID());
-            int id2 = max(mols[moved_mol].bds[k].ID(), mols[i].bds[j].ID());
-            if (accept) {
-              SetE(0, id1, id2, GetE(1, id1, id2)); 
-            }
-            else {
-              SetE(1, id1, id2, GetE(0, id1, id2));
-            }
-          }
-        }
-      }
+}
+
+bool PotentialPair::CellOverlaps(ParticleStore& particles, int moved,
+                                 int cell, int begin, int end, double box_l[],
+                                 int npbc, CellList& cells) {
+  vector<int>& list = cells.Beads(cell);
+  for (int n = 0; n < (int)list.size(); n++) {
+    int j = list[n];
+    if (j >= begin && j < end)  continue;
+    if (PairEnergy(particles, moved, j, box_l, npbc) >= kVeryLargeEnergy)
+      return true;
+  }
+  return false;
+
+}
+
+void PotentialPair::FinalizeEnergy(bool accept) {
+  // Adjust total energy variable.
+  if (accept) {
+     E_tot += last_move.dE;
+  }
+  FinalizeMove(last_move, accept);
+
+}
+
+// A rejected move leaves the energy array as it was.
+void PotentialPair::FinalizeMove(PairMove& move, bool accept) {
+  if (accept) {
+    for (int i = 0; i < (int)move.changed.size(); i++) {
+      current_energy[move.changed[i]] = move.new_energy[i];
     }
   }
+  move.changed.clear();
+  move.new_energy.clear();
+
+}
+
+void PotentialPair::AddEnergy(double energy) {
+  E_tot += energy;
 
 }
 
@@ -255,7 +392,7 @@ void PotentialPair::AdjustEnergyUponMolDeletion(vector<Molecule>& mols,
   }
 
   int gap = 0;
-  if (name == "HardSphere")  gap = 1;
+  if (hard_sphere)  gap = 1;
 
   ////////////
   // Chain. //
@@ -264,11 +401,7 @@ void PotentialPair::AdjustEnergyUponMolDeletion(vector<Molecule>& mols,
     for (int j = 0; j < mols[i].Size(); j++) {
       for (int k = 0; k < mols[delete_id].Size(); k++) {
         if (i != delete_id || j > k+gap) {
-          int id1 = min(mols[delete_id].bds[k].ID(), mols[i].bds[j].ID());
-          int id2 = max(mols[delete_id].bds[k].ID(), mols[i].bds[j].ID());
-          E_tot -= current_energy_map[make_pair(id1, id2)];
-          current_energy_map.erase(make_pair(id1, id2));
-          trial_energy_map.erase(make_pair(id1, id2));
+          E_tot -= GetE(mols[delete_id].bds[k].ID(), mols[i].bds[j].ID());
         }
       }
     }
@@ -281,16 +414,21 @@ void PotentialPair::AdjustEnergyUponMolDeletion(vector<Molecule>& mols,
     for (int j = 0; j < (int)mols.size(); j++) {
       if (j < delete_id || j > i) {
         for (int k = 0; k < mols[j].Size(); k++) {
-          int id1 = min(mols[i].bds[0].ID(), mols[j].bds[k].ID());
-          int id2 = max(mols[i].bds[0].ID(), mols[j].bds[k].ID());
-          E_tot -= current_energy_map[make_pair(id1, id2)];
-          current_energy_map.erase(make_pair(id1, id2));
-          trial_energy_map.erase(make_pair(id1, id2));
+          E_tot -= GetE(mols[i].bds[0].ID(), mols[j].bds[k].ID());
         }
       }
     }
   }
 
+  ////////////////////
+  // Recycle slots. //
+  ////////////////////
+  for (int i = delete_id; i <= delete_id+counterion; i++) {
+    for (int j = 0; j < mols[i].Size(); j++) {
+      ReleaseSlot(mols[i].bds[j].ID());
+    }
+  }
+
 }
 
 double PotentialPair::GetTotalEnergy() {
@@ -303,3 +441,38 @@ string PotentialPair::PotentialName() {
 
 }
 
+void PotentialPair::SaveState(ostream& out) {
+  WriteBinary(out, E_tot);
+  WriteBinary(out, n_slots);
+  WriteBinary(out, id_to_slot);
+  WriteBinary(out, free_slots);
+  WriteBinary(out, current_energy);
+
+}
+
+void PotentialPair::LoadState(istream& in) {
+  ReadBinary(in, E_tot);
+  ReadBinary(in, n_slots);
+  ReadBinary(in, id_to_slot);
+  ReadBinary(in, free_slots);
+  ReadBinary(in, current_energy);
+  last_move.changed.clear();
+  last_move.new_energy.clear();
+  last_move.dE = 0;
+
+}
+
+void PotentialPair::SwapState(PotentialPair& other) {
+  swap(E_tot, other.E_tot);
+  swap(n_slots, other.n_slots);
+  id_to_slot.swap(other.id_to_slot);
+  free_slots.swap(other.free_slots);
+  current_energy.swap(other.current_energy);
+  last_move.changed.clear();
+  last_move.new_energy.clear();
+  last_move.dE = 0;
+  other.last_move.changed.clear();
+  other.last_move.new_energy.clear();
+  other.last_move.dE = 0;
+
+}
@@ -10,10 +10,31 @@
 
 #include "../molecules/bead.h"
 #include "../molecules/molecule.h"
+#include "../molecules/particle_store.h"
 #include "../utilities/misc.h"
+#include "cell_list.h"
 
 using namespace std; 
 
+/** The new energies of the pairs one EnergyDifference call visited, their
+    energy change, and the scratch space of the call. The new energies are
+    only written to the energy array if the move is accepted. Moves that run
+    at the same time each need their own. */
+struct PairMove {
+  double dE;
+  /** Array indices of the pairs and their energies after the move. */
+  vector<long> changed;
+  vector<double> new_energy;
+  /** The cells around the moved beads. */
+  vector<int> nearby_cells;
+  /** The beads of the nearby cells are gathered here, so that their energies
+      with a moved bead are computed in one batch. */
+  vector<double> batch_crd[3];
+  vector<int> batch_type;
+  vector<int> batch_index;
+  vector<double> batch_energy;
+};
+
 /** "Pair potential" are those short-ranged potentials, such as Lennard-Jones
     potential, whose interaction range is not longer than the dimension of the
     simulation box. The dimensions of the simulation box and the strength of
@@ -22,12 +43,43 @@ using namespace std;
 class PotentialPair {
  private:
   string name;
-  map<pair<int,int>, double> current_energy_map;
-  map<pair<int,int>, double> trial_energy_map;
+  /** Whether this is the hard sphere potential, set once so that the pair
+      loops do not compare the name. */
+  bool hard_sphere;
+  /** Pair energies of the current configuration, stored in a dense
+      lower-triangular array indexed by slot, where each bead ID is assigned
+      a slot on first use. Entry (a, b) with a >= b lives at a*(a+1)/2+b. The
+      energies of a trial configuration are kept in its PairMove. */
+  vector<double> current_energy;
+  /** Slot of each bead ID, -1 if the ID holds no slot. Every bead of the
+      system takes its slot when its energies are initialized, so that
+      EnergyDifference only looks slots up and moves can run in parallel. */
+  vector<int> id_to_slot;
+  /** Slots released by deleted molecules, reused before new ones. */
+  vector<int> free_slots;
+  /** Number of slots ever allocated. */
+  int n_slots;
   /** Total pair energy of the system. */
   double E_tot;
-  /** Pair energy difference upon MC move */
-  double dE;
+  /** The move of EnergyDifference and FinalizeEnergy. */
+  PairMove last_move;
+
+  /** Return the slot of a bead ID, allocating one if needed. */
+  int AcquireSlot(int);
+  /** Return the slot of a bead ID, or -1 if it has none. */
+  int FindSlot(int);
+  /** Zero all energies of a bead ID and return its slot to the free list. */
+  void ReleaseSlot(int);
+  /** Array index of the pair of two slots. */
+  long PairIndex(int, int);
+  /** Whether a moved particle, given by its index in the store, overlaps
+      with a particle of a cell outside of the molecule [begin, end). */
+  bool CellOverlaps(ParticleStore&, int, int, int, int, double[], int,
+                    CellList&);
+
+ protected:
+  /** The instruction set used by the batched kernels, see SimdLevel(). */
+  int simd_level;
 
  public:
   /////////////////////
@@ -35,7 +87,7 @@ class PotentialPair {
   /////////////////////
   PotentialPair(string);
   virtual void ReadParameters() = 0;
-  /** Fill in trial and current energy maps for the initial configuration. */
+  /** Fill in the energy array for the initial configuration. */
   void EnergyInitialization(vector<Molecule>&, double[], int);
 
   ////////////////////////////////////
@@ -43,18 +95,29 @@ class PotentialPair {
   ////////////////////////////////////
   /** Calculate pair energy. */
   virtual double PairEnergy(Bead&, Bead&, double[], int) = 0;
+  /** Calculate pair energy between the trial positions of two particles in
+      the particle store. */
+  virtual double PairEnergy(ParticleStore&, int, int, double[], int) = 0;
+  /** Calculate the pair energies between a probe, given by its position and
+      bead type, and the trial positions of all particles of a span, and store
+      them in the last argument. The results are identical to PairEnergy. */
+  virtual void PairEnergyBatch(const double[], int, const ParticleSpan&,
+                               double[], int, double[]) = 0;
+  /** Run the batched kernels of a lower SIMD level than the host supports,
+      to compare the levels. */
+  void SetSimdLevel(int);
   /** Calculate pair force (scalar as a function of r). */
   virtual double PairForce(Bead&, Bead&, double[], int) = 0;
+  /** The distance beyond which the pair energy is zero for all bead types. */
+  virtual double Cutoff() = 0;
 
   ///////////////////////////////////
   // Reading and storing energies. //
   ///////////////////////////////////
-  /** Set the energy between a pair in the designated energy map. */
-  void SetE(int, int, int, double);
-  /** Set the energy between a pair in both trial and current energy maps. */
-  void SetEBothMaps(int, int, double);
-  /** Get the energy between a pair from the designated energy map. */
-  double GetE(int, int, int);
+  /** Set the energy between a pair of bead IDs. */
+  void SetE(int, int, double);
+  /** Get the energy between a pair of bead IDs. */
+  double GetE(int, int);
   /** Return total pair energy of the system. */
   double GetTotalEnergy();
 
@@ -68,10 +131,42 @@ class PotentialPair {
   void EnergyInitForLastMol(vector<Molecule>&, int, double, double[], int);
   /** Erase the energy of the deleted molecule for the GCMC routine. */
   void AdjustEnergyUponMolDeletion(vector<Molecule>&, int);
-  /** Calculate the pair dE of the system due to a MC move. */
-  double EnergyDifference(vector<Molecule>&, int, double[], int);
-  /** Update all energy maps after the decision of a MC move is made. */
-  void FinalizeEnergyBothMaps(vector<Molecule>&, int, bool);
+  /** Calculate the pair dE of the system due to a MC move. Intermolecular
+      pairs are only visited in the cells around the old and new positions of
+      the moved beads. The positions are read from the particle store, which
+      must hold the trial positions of the moved molecule. */
+  double EnergyDifference(vector<Molecule>&, ParticleStore&, int, double[], int,
+                          CellList&);
+  /** Write the new pair energies of an accepted MC move, and drop them if
+      it was rejected. Costs O(pairs visited by the move). */
+  void FinalizeEnergy(bool);
+  /** Whether a moved bead of the molecule has an infinite pair energy with
+      another bead at the trial positions, as an overlap of hard spheres
+      has. The beads of the cell of the new position of a moved bead are
+      looked at first, then those of the adjacent cells and last the beads of
+      its own molecule, and the search stops at the first overlap. It writes
+      nothing, so a move found to overlap can be rejected right away. */
+  bool Overlaps(vector<Molecule>&, ParticleStore&, int, double[], int,
+                CellList&);
+  /** The two above for moves that run at the same time, each with its own
+      PairMove, on molecules none of which interact with each other. The
+      total energy is not changed, the accepted dE go to AddEnergy. All bead
+      IDs must already hold a slot. */
+  double EnergyDifference(vector<Molecule>&, ParticleStore&, int, double[], int,
+                          CellList&, PairMove&);
+  void FinalizeMove(PairMove&, bool);
+  /** Add to the total energy. */
+  void AddEnergy(double);
+
+  ////////////////////
+  // Checkpointing. //
+  ////////////////////
+  /** Write the current energies to a checkpoint, and read them back. */
+  void SaveState(ostream&);
+  void LoadState(istream&);
+  /** Exchange the current energies with another pair potential of the same
+      parameters, e.g. the one of another replica. */
+  void SwapState(PotentialPair&);
 
   ////////////
   // Other. //
@@ -1,5 +1,7 @@
 #include "potential_spring.h" 
 
+#include <cmath>
+
 using namespace std; 
 
 PotentialSpring::PotentialSpring(int n_mol, string potential_name)
@@ -47,14 +49,14 @@ double PotentialSpring::MoleculeEnergy(Molecule& mol, double box_l[],
 }
 
 // Returns a bond length from appropriate distribution for harmonic bond.
-double PotentialSpring::RandomBondLen(double beta, mt19937& ranGen) {
+double PotentialSpring::RandomBondLen(double beta, RandomGenerator& ranGen) {
   double len = 0; 
   double sigma = sqrt(1/(beta * m_kBond));
   double a = (m_r0 + 3*sigma) * (m_r0 + 3*sigma);
   bool ready = false;
   while (!ready) {
     len = gasdev(m_r0, sigma, ranGen); 
-    ready = ((double)ranGen()/ranGen.max() < (len * len/a)); 
+    ready = (ranGen.Uniform() < (len * len/a)); 
   }
   return len; 
 
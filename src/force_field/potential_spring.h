@@ -8,11 +8,11 @@
 #include <stdlib.h> 
 #include <iomanip> 
 #include <iostream> 
-#include <random> 
 
 #include "../molecules/bead.h"
 #include "../molecules/molecule.h"
 #include "../utilities/misc.h"
+#include "../utilities/random_generator.h"
 #include "potential_bond.h"
 
 class PotentialSpring: public PotentialBond {
@@ -24,7 +24,7 @@ class PotentialSpring: public PotentialBond {
   PotentialSpring(int, string); 
   void ReadParameters();
   double MoleculeEnergy(Molecule&, double[], int);
-  double RandomBondLen(double, mt19937&); 
+  double RandomBondLen(double, RandomGenerator&); 
   double EnergyDifference(vector < Molecule >&, double[], int, int);
   double EqBondLen();
 
@@ -5,11 +5,14 @@
 
 #include "potential_truncated_lj.h"
 
+#include <algorithm>
 #include <iomanip>
 #include <vector>
 
 #include "../molecules/molecule.h"
 #include "../utilities/constants.h"
+#include "../utilities/misc.h"
+#include "pair_batch.h"
 
 PotentialTruncatedLJ::PotentialTruncatedLJ(string potential_name) :
                       PotentialPair(potential_name) {
@@ -35,90 +38,219 @@ void PotentialTruncatedLJ::ReadParameters() {
     }
     else {
       cin >> flag >> sigma >> flag >> epsilon;
-      sigmas[symbol] = sigma; 
-      epsilons[symbol] = epsilon; 
+      int type = BeadTypeID(symbol);
+      if (type >= (int)sigmas.size()) {
+        sigmas.resize(type+1, 0);
+        epsilons.resize(type+1, 0);
+      }
+      sigmas[type] = sigma; 
+      epsilons[type] = epsilon; 
       cout << setw(35) << "[PP] Sigma for bead type    : " << symbol << " - "
            << sigma << endl;
       cout << setw(35) << "[PP] Epsilon for bead type  : " << symbol << " - "
            << epsilon << endl;
     }
   }
+  BuildPairTables();
+  cout << setw(35) << "[PP] Batched pair kernel    : " << SimdName(simd_level)
+       << endl;
+
+}
+
+// Types without parameters get zero sigma and epsilon, and so do not
+// interact.
+void PotentialTruncatedLJ::BuildPairTables() {
+  n_types = NumBeadTypes();
+  sigmas.resize(n_types, 0);
+  epsilons.resize(n_types, 0);
+  pair_sigma.resize(n_types*n_types);
+  pair_sigma6.resize(n_types*n_types);
+  pair_epsilon.resize(n_types*n_types);
+  pair_cutoff.resize(n_types*n_types);
+  pair_shift.resize(n_types*n_types);
+  for (int i = 0; i < n_types; i++) {
+    for (int j = 0; j < n_types; j++) {
+      int idx = i*n_types + j;
+      double sigma = (sigmas[i] + sigmas[j]) / 2;
+      double epsilon = sqrt(epsilons[i] * epsilons[j]);
+      pair_sigma[idx] = sigma;
+      pair_sigma6[idx] = pow(sigma, 6);
+      pair_epsilon[idx] = epsilon;
+      // Repulsive Lennard-Jones.
+      if (lj_cutoff < 0) {
+        double r6_ref = pow((1.0/k216), 6);
+        pair_cutoff[idx] = k216*sigma;
+        pair_shift[idx] = 4 * epsilon * (r6_ref*r6_ref - r6_ref);
+      }
+      // Full Lennard-Jones.
+      else {
+        double r6_ref = pow((sigma/lj_cutoff), 6);
+        pair_cutoff[idx] = lj_cutoff;
+        pair_shift[idx] = 4 * epsilon * (r6_ref*r6_ref - r6_ref);
+      }
+    }
+  }
+
+}
+
+double PotentialTruncatedLJ::EnergyAtDist(double r, int idx) {
+  if (r <= 0)  return kVeryLargeEnergy;
+
+  double energy = 0;
+  if (r < pair_cutoff[idx]) {
+    double r2 = r*r;
+    double r6 = pair_sigma6[idx] / (r2*r2*r2);
+    energy = 4 * pair_epsilon[idx] * (r6*r6 - r6) - pair_shift[idx];
+  }
+
+  return energy;
 
 }
 
 double PotentialTruncatedLJ::PairEnergy(Bead& bead1, Bead& bead2,
                                         double box_l[], int npbc) {
-  double energy = 0;
-  double r = 0;
-  r = bead1.BBDist(bead2, box_l, npbc);
+  double r = bead1.BBDist(bead2, box_l, npbc);
+  return EnergyAtDist(r, bead1.Type()*n_types + bead2.Type());
 
-  double sigma = (sigmas[bead1.Symbol()] + sigmas[bead2.Symbol()]) / 2;
-  double epsilon = sqrt((epsilons[bead1.Symbol()] * epsilons[bead2.Symbol()]));
-  double r6 = 0;
+}
 
-  if (r <= 0) {
-    r6 = -1;
-  }
+double PotentialTruncatedLJ::PairEnergy(ParticleStore& particles, int p1,
+                                        int p2, double box_l[], int npbc) {
+  double r = particles.Dist(p1, p2, box_l, npbc);
+  const int * types = particles.Types();
+  return EnergyAtDist(r, types[p1]*n_types + types[p2]);
+
+}
 
-  if (r6 == -1) {
-    energy = kVeryLargeEnergy;
+void PotentialTruncatedLJ::PairEnergyBatch(const double pos[], int type,
+                                           const ParticleSpan& span,
+                                           double box_l[], int npbc,
+                                           double energy[]) {
+#ifdef PLUM_X86_SIMD
+  if (simd_level == kSimdAVX512) {
+    PairEnergyBatchAVX512(pos, type, span, box_l, npbc, energy);
+    return;
   }
-  // Repulsive Lennard-Jones.
-  else if (lj_cutoff < 0) {
-    double r6_ref = pow((1.0/k216), 6);
-    double energy_ref = 4 * epsilon * (r6_ref*r6_ref - r6_ref);
-    if (r < k216*sigma) {
-      r6 = pow((sigma/r), 6);
-      energy = 4 * epsilon * (r6*r6 - r6) - energy_ref;
-    }
+  if (simd_level == kSimdAVX2) {
+    PairEnergyBatchAVX2(pos, type, span, box_l, npbc, energy);
+    return;
+  }
+#endif
+  PairEnergyBatchScalar(pos, type, span, 0, box_l, npbc, energy);
+
+}
+
+void PotentialTruncatedLJ::PairEnergyBatchScalar(const double pos[], int type,
+                                                 const ParticleSpan& span,
+                                                 int start, double box_l[],
+                                                 int npbc, double energy[]) {
+  for (int j = start; j < span.n; j++) {
+    double r = BatchDist(pos, span, j, box_l, npbc);
+    energy[j] = EnergyAtDist(r, type*n_types + span.type[j]);
   }
-  // Full Lennard-Jones.
-  else if (r < lj_cutoff) {
-    double r6_ref = pow((sigma/lj_cutoff), 6);
-    double energy_ref = 4 * epsilon * (r6_ref*r6_ref - r6_ref);
-    r6 = pow((sigma/r), 6);
-    energy = 4 * epsilon * (r6*r6 - r6) - energy_ref;
+
+}
+
+#ifdef PLUM_X86_SIMD
+// The vector form of EnergyAtDist: the parameters are gathered from the pair
+// tables, and the cutoff and overlap branches become blends.
+__attribute__((target("avx2")))
+void PotentialTruncatedLJ::PairEnergyBatchAVX2(const double pos[], int type,
+                                               const ParticleSpan& span,
+                                               double box_l[], int npbc,
+                                               double energy[]) {
+  const __m128i row = _mm_set1_epi32(type*n_types);
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d four = _mm256_set1_pd(4);
+  const __m256d large = _mm256_set1_pd(kVeryLargeEnergy);
+  int j = 0;
+  for (; j+4 <= span.n; j += 4) {
+    __m256d r = _mm256_sqrt_pd(BatchDist2AVX2(pos, span, j, box_l, npbc));
+    __m128i idx = _mm_add_epi32(row, _mm_loadu_si128((const __m128i*)
+                                                     (span.type + j)));
+    __m256d cutoff  = _mm256_i32gather_pd(pair_cutoff.data(), idx, 8);
+    __m256d sigma6  = _mm256_i32gather_pd(pair_sigma6.data(), idx, 8);
+    __m256d epsilon = _mm256_i32gather_pd(pair_epsilon.data(), idx, 8);
+    __m256d shift   = _mm256_i32gather_pd(pair_shift.data(), idx, 8);
+    __m256d r2 = _mm256_mul_pd(r, r);
+    __m256d r6 = _mm256_div_pd(sigma6, _mm256_mul_pd(_mm256_mul_pd(r2, r2),
+                                                     r2));
+    __m256d e = _mm256_sub_pd(_mm256_mul_pd(_mm256_mul_pd(four, epsilon),
+                                            _mm256_sub_pd(_mm256_mul_pd(r6, r6),
+                                                          r6)),
+                              shift);
+    e = _mm256_and_pd(e, _mm256_cmp_pd(r, cutoff, _CMP_LT_OQ));
+    e = _mm256_blendv_pd(e, large, _mm256_cmp_pd(r, zero, _CMP_LE_OQ));
+    _mm256_storeu_pd(energy + j, e);
   }
+  PairEnergyBatchScalar(pos, type, span, j, box_l, npbc, energy);
 
-  return energy;
+}
+
+__attribute__((target("avx512f")))
+void PotentialTruncatedLJ::PairEnergyBatchAVX512(const double pos[], int type,
+                                                 const ParticleSpan& span,
+                                                 double box_l[], int npbc,
+                                                 double energy[]) {
+  const __m256i row = _mm256_set1_epi32(type*n_types);
+  const __m512d zero = _mm512_setzero_pd();
+  const __m512d four = _mm512_set1_pd(4);
+  const __m512d large = _mm512_set1_pd(kVeryLargeEnergy);
+  int j = 0;
+  for (; j+8 <= span.n; j += 8) {
+    __m512d r = _mm512_sqrt_pd(BatchDist2AVX512(pos, span, j, box_l, npbc));
+    __m256i idx = _mm256_add_epi32(row, _mm256_loadu_si256((const __m256i*)
+                                                           (span.type + j)));
+    __m512d cutoff  = _mm512_i32gather_pd(idx, pair_cutoff.data(), 8);
+    __m512d sigma6  = _mm512_i32gather_pd(idx, pair_sigma6.data(), 8);
+    __m512d epsilon = _mm512_i32gather_pd(idx, pair_epsilon.data(), 8);
+    __m512d shift   = _mm512_i32gather_pd(idx, pair_shift.data(), 8);
+    __m512d r2 = _mm512_mul_pd(r, r);
+    __m512d r6 = _mm512_div_pd(sigma6, _mm512_mul_pd(_mm512_mul_pd(r2, r2),
+                                                     r2));
+    __m512d e = _mm512_sub_pd(_mm512_mul_pd(_mm512_mul_pd(four, epsilon),
+                                            _mm512_sub_pd(_mm512_mul_pd(r6, r6),
+                                                          r6)),
+                              shift);
+    e = _mm512_maskz_mov_pd(_mm512_cmp_pd_mask(r, cutoff, _CMP_LT_OQ), e);
+    e = _mm512_mask_mov_pd(e, _mm512_cmp_pd_mask(r, zero, _CMP_LE_OQ), large);
+    _mm512_storeu_pd(energy + j, e);
+  }
+  PairEnergyBatchScalar(pos, type, span, j, box_l, npbc, energy);
 
 }
+#endif
 
 double PotentialTruncatedLJ::PairForce(Bead& bead1, Bead& bead2,
                                        double box_l[], int npbc) {
-  double force = 0;
-  double r = 0;
-  r = bead1.BBDist(bead2, box_l, npbc);
+  double r = bead1.BBDist(bead2, box_l, npbc);
+  if (r <= 0)  return kVeryLargeEnergy;
 
-  double sigma = (sigmas[bead1.Symbol()] + sigmas[bead2.Symbol()]) / 2;
-  double epsilon = sqrt((epsilons[bead1.Symbol()] * epsilons[bead2.Symbol()]));
-  double r6;
-
-  if (r <= 0)
-    r6 = -1;
-
-  if (r6 == -1) {
-    force = kVeryLargeEnergy;
-  }
-  // Repulsive Lennard-Jones.
-  else if (lj_cutoff < 0) {
-    if (r < k216*sigma) {
-      r6 = pow((sigma/r), 6);
-      force = 4 * epsilon * (r6*r6*12/r - r6*6/r);
-    }
-  }
-  // Full Lennard-Jones.
-  else if (r < lj_cutoff) {
-    r6 = pow((sigma/r), 6);
-    force = 4 * epsilon * (r6*r6*12/r - r6*6/r);
+  int idx = bead1.Type()*n_types + bead2.Type();
+  double force = 0;
+  double r6 = 0;
+  if (r < pair_cutoff[idx]) {
+    double r2 = r*r;
+    r6 = pair_sigma6[idx] / (r2*r2*r2);
   }
-  else {
-    r6 = pow((sigma/lj_cutoff), 6);
-    force = 4 * epsilon * (r6*r6*12/r - r6*6/r);
+  // The full Lennard-Jones force beyond the cutoff is that at the cutoff.
+  else if (lj_cutoff >= 0) {
+    r6 = pow((pair_sigma[idx]/lj_cutoff), 6);
   }
+  force = 4 * pair_epsilon[idx] * (r6*r6*12/r - r6*6/r);
 
   return force;
 
 }
 
+double PotentialTruncatedLJ::Cutoff() {
+  if (lj_cutoff >= 0)  return lj_cutoff;
+
+  double max_cutoff = 0;
+  for (int i = 0; i < (int)pair_cutoff.size(); i++) {
+    max_cutoff = max(max_cutoff, pair_cutoff[i]);
+  }
+  return max_cutoff;
+
+}
 
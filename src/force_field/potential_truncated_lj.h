@@ -4,6 +4,7 @@
 #include <iostream>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "../molecules/bead.h"
 #include "potential_pair.h"
@@ -17,10 +18,38 @@ class PotentialTruncatedLJ : public PotentialPair {
  private:
   /** The cutoff for Lennard-Jones potential. */
   double lj_cutoff;
-  /** Sigma values for different types of beads. */
-  map<string, double> sigmas; 
-  /** Epsilon values for different types of beads. */
-  map<string, double> epsilons; 
+  /** Sigma values for different types of beads, indexed by type ID. */
+  vector<double> sigmas; 
+  /** Epsilon values for different types of beads, indexed by type ID. */
+  vector<double> epsilons; 
+  /** Number of bead types covered by the pair tables. */
+  int n_types;
+  // Mixed parameters of every pair of bead types, indexed by
+  // type1*n_types+type2.
+  /** Mixed sigma. */
+  vector<double> pair_sigma;
+  /** Mixed sigma^6. */
+  vector<double> pair_sigma6;
+  /** Mixed epsilon. */
+  vector<double> pair_epsilon;
+  /** The distance at which the potential is cut off. */
+  vector<double> pair_cutoff;
+  /** The energy shift that makes the potential zero at the cutoff. */
+  vector<double> pair_shift;
+
+  /** Fill in the pair tables from the per-type parameters. */
+  void BuildPairTables();
+  /** The energy at a distance for the pair table entry. */
+  double EnergyAtDist(double, int);
+  /** PairEnergyBatch for the particles of the span from the fourth argument
+      on, one at a time. */
+  void PairEnergyBatchScalar(const double[], int, const ParticleSpan&, int,
+                             double[], int, double[]);
+  /** PairEnergyBatch with 4 and 8 particles at a time. */
+  void PairEnergyBatchAVX2(const double[], int, const ParticleSpan&,
+                           double[], int, double[]);
+  void PairEnergyBatchAVX512(const double[], int, const ParticleSpan&,
+                             double[], int, double[]);
 
  public:
   /////////////////////
@@ -33,7 +62,11 @@ class PotentialTruncatedLJ : public PotentialPair {
   // Energy and force. //
   ///////////////////////
   double PairEnergy(Bead&, Bead&, double[], int);   
+  double PairEnergy(ParticleStore&, int, int, double[], int);
+  void PairEnergyBatch(const double[], int, const ParticleSpan&, double[], int,
+                       double[]);
   double PairForce(Bead&, Bead&, double[], int);
+  double Cutoff();
 
 }; 
 
@@ -1,5 +1,7 @@
 #include "potential_truncated_lj_wall.h" 
 
+#include <cmath>
+
 #include "../utilities/constants.h"
 
 using namespace std; 
@@ -32,14 +34,22 @@ void PotentialTruncatedLJWall::ReadParameters() {
     else { 
       cin >> flag >> sigma 
           >> flag >> epsilon;  
-      sigmas[symbol] = sigma;  
-      epsilons[symbol] = epsilon;  
+      int type = BeadTypeID(symbol);
+      if (type >= (int)sigmas.size()) {
+        sigmas.resize(type+1, 0);
+        epsilons.resize(type+1, 0);
+      }
+      sigmas[type] = sigma;  
+      epsilons[type] = epsilon;  
       cout << setw(35) << "[eP] Sigma for bead type    : " << symbol << " - "
            << sigma << endl;
       cout << setw(35) << "[eP] Epsilon for bead type  : " << symbol << " - "
            << epsilon << endl;
     }
   }
+  // Types without parameters do not feel the walls.
+  sigmas.resize(NumBeadTypes(), 0);
+  epsilons.resize(NumBeadTypes(), 0);
 
 }
 
@@ -47,8 +57,8 @@ double PotentialTruncatedLJWall::BeadEnergy(Bead& bead, double box_l[]) {
   double energy = 0;
   // Get the z coordinate from the trial coordinate array.
   double z = bead.GetCrd(1, 2);
-  double sigma = sigmas[bead.Symbol()];
-  double epsilon = epsilons[bead.Symbol()];
+  double sigma = sigmas[bead.Type()];
+  double epsilon = epsilons[bead.Type()];
   double R0 = 3*k213*sigma;  // For FENE potential. A bead can only be one bead
                              // away from the surface.
   double K = 1;              // For FENE potential.
@@ -63,7 +73,7 @@ double PotentialTruncatedLJWall::BeadEnergy(Bead& bead, double box_l[]) {
   }
   else {
     // Use purely repulsive wall for non-grafted beads.
-    if (m_cut < 0 && bead.Symbol() != "R" && bead.Symbol() != "L") {
+    if (m_cut < 0 && !bead.IsRightGraft() && !bead.IsLeftGraft()) {
       double r3_ref = pow((1.0/k213), 3);
       double energy_ref = 2.59807621135 * epsilon * (r3_ref*r3_ref - r3_ref);
       // 1.20093695518 = 3^(1/6)
@@ -79,7 +89,7 @@ double PotentialTruncatedLJWall::BeadEnergy(Bead& bead, double box_l[]) {
       }
     }
     // For left (z=0) grafted beads.
-    else if (bead.Symbol() == "L") {
+    else if (bead.IsLeftGraft()) {
       // The left attractive well.
       double r3 = pow((sigma/z), 3);
       energy += 2.59807621135 * epsilon * (r3*r3 - r3);
@@ -96,7 +106,7 @@ double PotentialTruncatedLJWall::BeadEnergy(Bead& bead, double box_l[]) {
       }
     }
     // For right (z=box_l[2]) grafted beads.
-    else if (bead.Symbol() == "R") {
+    else if (bead.IsRightGraft()) {
       // The right attractive well.
       double r3 = pow((sigma/(box_l[2] - z)), 3);
       energy +=  2.59807621135 * epsilon * (r3*r3 - r3);
@@ -137,8 +147,8 @@ double PotentialTruncatedLJWall::BeadForceOnWall(Bead& bead, double box_l[]) {
   double force = 0;
   // Get the z coordinate from the trial coordinate array.
   double z = bead.GetCrd(1, 2);
-  double sigma = sigmas[bead.Symbol()];
-  double epsilon = epsilons[bead.Symbol()];
+  double sigma = sigmas[bead.Type()];
+  double epsilon = epsilons[bead.Type()];
   double R0 = 3*k213*sigma;
   double K = 1;
 
@@ -151,7 +161,7 @@ double PotentialTruncatedLJWall::BeadForceOnWall(Bead& bead, double box_l[]) {
   }
   else {
     // Use purely repulsive wall for non-grafted beads.
-    if (m_cut < 0 && bead.Symbol() != "R" && bead.Symbol() != "L") {
+    if (m_cut < 0 && !bead.IsRightGraft() && !bead.IsLeftGraft()) {
       if (z < k213*sigma) {
         double r3 = pow((sigma/z), 3);
         force += 2.59807621135 * epsilon * (r3*r3*6/z - r3*3/z);
@@ -163,7 +173,7 @@ double PotentialTruncatedLJWall::BeadForceOnWall(Bead& bead, double box_l[]) {
       }
     }
     // For left (z=0) grafted beads.
-    else if (bead.Symbol() == "L") {
+    else if (bead.IsLeftGraft()) {
       // The left attractive well.
       double r3 = pow((sigma/z), 3);
       force += 2.59807621135 * epsilon * (r3*r3*6/z - r3*3/z);
@@ -177,7 +187,7 @@ double PotentialTruncatedLJWall::BeadForceOnWall(Bead& bead, double box_l[]) {
       }
     }
     // For right (z=box_l[2]) grafted beads.
-    else if (bead.Symbol() == "R") {
+    else if (bead.IsRightGraft()) {
       // The right attractive well.
       double r3 = pow((sigma/(box_l[2] - z)), 3);
       force += 2.59807621135 * epsilon * (r3*r3*6/(box_l[2]-z) -
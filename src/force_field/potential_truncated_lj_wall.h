@@ -22,8 +22,9 @@ using namespace std;
 class PotentialTruncatedLJWall : public PotentialExternal {
  private:
   double m_cut;
-  map<string, double> sigmas;
-  map<string, double> epsilons;
+  /** Sigma and epsilon for different bead types, indexed by type ID. */
+  vector<double> sigmas;
+  vector<double> epsilons;
   double m_sigWall;
   double m_epWall;
 
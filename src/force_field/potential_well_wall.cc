@@ -30,12 +30,17 @@ void PotentialWellWall::ReadParameters() {
     }
     else {
       cin >> flag >> radius;
-      radii[symbol] = radius;
+      int type = BeadTypeID(symbol);
+      if (type >= (int)radii.size())  radii.resize(type+1, 0);
+      radii[type] = radius;
       cout << setw(31) << "Radius for bead type    " << setw(3) << symbol
            << " = " << radius << endl;
     }
   }
 
+  // Types without a radius are points.
+  radii.resize(NumBeadTypes(), 0);
+
 }
 
 double PotentialWellWall::BeadEnergy(Bead& bead, double box_l[]) {
@@ -43,7 +48,7 @@ double PotentialWellWall::BeadEnergy(Bead& bead, double box_l[]) {
   // Get the z coordinate from the trial coordinate array.
   double z = bead.GetCrd(1, 2);
   // If the bead falls outside of the box in the z-direction.
-  if (z <= radii[bead.Symbol()] || z >= box_l[2] - radii[bead.Symbol()]) {
+  if (z <= radii[bead.Type()] || z >= box_l[2] - radii[bead.Type()]) {
     energy = kVeryLargeEnergy;
   }
   else if (z < well_width || z >  box_l[2] - well_width)  {
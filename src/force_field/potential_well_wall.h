@@ -22,7 +22,7 @@ class PotentialWellWall : public PotentialExternal {
   /** Has to be negative for an attractive well. */
   double well_depth;
   /** The radius for the beads in each chain type. */
-  map<string, double> radii;
+  vector<double> radii;
 
  public: 
   /////////////////////
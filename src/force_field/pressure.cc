@@ -1,5 +1,7 @@
-#include <string>
+#include <cmath>
 #include <sstream>
+#include <string>
+#include <vector>
 
 #include "force_field.h"
 
@@ -215,9 +217,9 @@ void ForceField::CalcPressureVolScalingHSELSlit(vector<Molecule>& mols) {
     // Find out how much the com should move.
     d_com_z[i] = kDz * (com_z / box_l[2]);
     // For grafted polymers.
-    if (mols[i].bds[0].Symbol() == "R")
+    if (mols[i].bds[0].IsRightGraft())
       d_com_z[i] = kDz;
-    else if (mols[i].bds[0].Symbol() == "L")
+    else if (mols[i].bds[0].IsLeftGraft())
       d_com_z[i] = 0;
   }
   /*
@@ -243,8 +245,8 @@ void ForceField::CalcPressureVolScalingHSELSlit(vector<Molecule>& mols) {
   // Scaling all coordinates first.
   for (int i = 0; i < n_mol; i++) {
     for (int j = 0; j < mols[i].Size(); j++) {
-      if (use_bond_pot && mols[i].bds[j].Symbol() != "R" &&
-          mols[i].bds[j].Symbol() != "L")
+      if (use_bond_pot && !mols[i].bds[j].IsRightGraft() &&
+          !mols[i].bds[j].IsLeftGraft())
         mols[i].bds[j].SetCrd(1, 2, mols[i].bds[j].GetCrd(0, 2)*(1.0+kDz/box_l[2]));
       else
         mols[i].bds[j].SetCrd(1, 2, mols[i].bds[j].GetCrd(0, 2) + d_com_z[i]);
@@ -277,10 +279,10 @@ void ForceField::CalcPressureVolScalingHSELSlit(vector<Molecule>& mols) {
             index1 = min(mols[i].bds[j].ID(), mols[k].bds[l].ID());
             index2 = max(mols[i].bds[j].ID(), mols[k].bds[l].ID());
 
+            // The repl part is added up by species below.
             if (use_ewald_pot) {
-              oldE = ewald_pot->GetERealRepl(0, index1, index2);
+              oldE = ewald_pot->GetEReal(index1, index2);
               newE = ewald_pot->PairEnergyRealForP(mols[i].bds[j], mols[k].bds[l], npbc);
-              newE += ewald_pot->PairEnergyReplForP(mols[i].bds[j], mols[k].bds[l], npbc);
               if (mols[i].bds[j].ID() == mols[k].bds[l].ID())
                 newE *= 0.5;
               dU += newE - oldE;
@@ -288,7 +290,7 @@ void ForceField::CalcPressureVolScalingHSELSlit(vector<Molecule>& mols) {
             }
             if (use_pair_pot && i >= phantom && k >= phantom &&
                 mols[i].bds[j].ID() != mols[k].bds[l].ID()) {
-              oldE = pair_pot->GetE(0, index1, index2);
+              oldE = pair_pot->GetE(index1, index2);
               newE = pair_pot->PairEnergy(mols[i].bds[j], mols[k].bds[l], box_l_scaled, npbc);
               dU += newE - oldE;
               p_tensor_hs[index] += newE - oldE;
@@ -302,7 +304,7 @@ void ForceField::CalcPressureVolScalingHSELSlit(vector<Molecule>& mols) {
         int index1 = (id_i < 3)? id_i : 3;  // The smaller index.
         int index2 = (id_i > 3)? id_i : 3;  // The bigger index.
         int index = index1 * 4 + index2;
-        oldE = ext_pot->GetE(0, mols[i].bds[j].ID());
+        oldE = ext_pot->GetE(mols[i].bds[j].ID());
         newE = ext_pot->BeadEnergy(mols[i].bds[j], box_l_scaled);
         dU += newE - oldE;
         p_tensor_hs[index] += newE - oldE;
@@ -318,6 +320,32 @@ void ForceField::CalcPressureVolScalingHSELSlit(vector<Molecule>& mols) {
     }
   }
 
+  // The repl part, from the structure factor of each species. The two walls
+  // are apart, only the pairs of the wall at z=0 with the system and with the
+  // other wall are counted, as above.
+  if (use_ewald_pot) {
+    const int n_groups = 5;  // Cation, anion, polymer, wall z=0, the other.
+    vector<int> group(n_mol);
+    for (int i = 0; i < n_mol; i++) {
+      if (i < phantom/2)                      group[i] = 3;
+      else if (i < phantom)                   group[i] = 4;
+      else if (mols[i].Size() > 1)            group[i] = 2;
+      else if (mols[i].bds[0].Charge() >= 0)  group[i] = 0;
+      else                                    group[i] = 1;
+    }
+    double d_repl[n_groups*n_groups];
+    ewald_pot->GroupReplEnergyForP(mols, group, n_groups, d_repl);
+    for (int a = 0; a < 4; a++) {
+      for (int b = a; b < n_groups; b++) {
+        if (b == 4 && a != 3)  continue;
+        if (a == 3 && b == 3)  continue;
+        int index = a * 4 + (b < 4 ? b : 3);
+        dU += d_repl[a*n_groups + b];
+        p_tensor_el[index] += d_repl[a*n_groups + b];
+      }
+    }
+  }
+
   // Calculate the dipole part of pressure.
   if (use_ewald_pot && ewald_pot->UseDipoleCorrection()) {
     double Mz_old = 0;
@@ -1,5 +1,9 @@
+#include <stdlib.h>
 #include <iostream>
+#include <sstream>
+#include <string>
 
+#include "simulation/replica_exchange.h"
 #include "simulation/simulation.h"
 
 using namespace std; 
@@ -14,10 +18,52 @@ int main(int argc, char * argv[]) {
   cout << "  All lengths are in unit length (ul)." << endl;
   cout << "\n  Starting program!" << endl;
 
-  // Initialize the simulation.
-  Simulation simulation;
-  // Run the simulation.
-  simulation.Run();
+  // Command line options. "--restart <file>" continues a run from its
+  // checkpoint, "--rebuild" recomputes the energies instead of loading them,
+  // "--replicas <file>" runs the replicas of the file with replica exchange.
+  string restart_name = "";
+  string replica_name = "";
+  bool rebuild = false;
+  for (int i = 1; i < argc; i++) {
+    string option = argv[i];
+    if (option == "--restart" && i+1 < argc) {
+      restart_name = argv[++i];
+    }
+    else if (option == "--replicas" && i+1 < argc) {
+      replica_name = argv[++i];
+    }
+    else if (option == "--rebuild") {
+      rebuild = true;
+    }
+    else {
+      cout << "  Unknown option " << option << ". Exiting! Program complete."
+           << endl;
+      exit(1);
+    }
+  }
+
+  // The input is read from memory, so that optional keys can be looked ahead
+  // at also when it comes through a pipe, see ReadOptional.
+  stringstream input;
+  input << cin.rdbuf();
+  cin.rdbuf(input.rdbuf());
+
+  if (replica_name != "") {
+    if (restart_name != "") {
+      cout << "  Replica exchange runs cannot be restarted. Exiting! Program "
+           << "complete." << endl;
+      exit(1);
+    }
+    // Initialize and run the replicas.
+    ReplicaExchange exchange(replica_name);
+    exchange.Run();
+  }
+  else {
+    // Initialize the simulation.
+    Simulation simulation(restart_name, rebuild, "");
+    // Run the simulation.
+    simulation.Run();
+  }
 
   cout << "  END." << endl;
 
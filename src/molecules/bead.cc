@@ -5,9 +5,43 @@
 #include <iostream> 
 #include <fstream> 
 #include <sstream>
+#include <vector>
 
 using namespace std; 
 
+/** Symbols of the registered bead types, indexed by type ID. */
+static vector<string> type_symbols;
+/** Flags of the registered bead types. */
+static vector<int> type_flags;
+
+int BeadTypeID(string symbol) {
+  for (int i = 0; i < (int)type_symbols.size(); i++) {
+    if (type_symbols[i] == symbol)  return i;
+  }
+  type_symbols.push_back(symbol);
+  int flags = 0;
+  if (symbol == "L")  flags |= kGraftLeft;
+  if (symbol == "R")  flags |= kGraftRight;
+  type_flags.push_back(flags);
+  return (int)type_symbols.size() - 1;
+
+}
+
+int NumBeadTypes() {
+  return (int)type_symbols.size();
+
+}
+
+string BeadTypeSymbol(int type) {
+  return type_symbols[type];
+
+}
+
+int BeadTypeFlags(int type) {
+  return type_flags[type];
+
+}
+
 Bead::Bead() {
   for(int i = 0; i < 3; i++) {
     trial_pos[i] = 0; 
@@ -15,6 +49,7 @@ Bead::Bead() {
   }
   q = 0; 
   symbol = "NONE";
+  type = BeadTypeID(symbol);
   moved = false;
 
 }
@@ -28,6 +63,7 @@ Bead::Bead(string symbol_in, int id_in, int c_id_in, double q_in, double x,
     current_pos[i] = trial_pos[i]; 
   }
   symbol = symbol_in;
+  type = BeadTypeID(symbol);
   q = q_in;
   moved = false;  
   id = id_in;
@@ -124,8 +160,14 @@ bool Bead::GetMoved() {
   return moved; 
 }
 
-void Bead::SetType(int type_in) {
-  type = type_in; 
+bool Bead::IsLeftGraft() {
+  return (BeadTypeFlags(type) & kGraftLeft) != 0;
+
+}
+
+bool Bead::IsRightGraft() {
+  return (BeadTypeFlags(type) & kGraftRight) != 0;
+
 }
 
 void Bead::SetID(int id_in) {
@@ -139,6 +181,7 @@ void Bead::SetChainID(int c_id_in) {
 
 void Bead::SetSymbol(string symbol_in) {
   symbol = symbol_in; 
+  type = BeadTypeID(symbol);
 }
 
 void Bead::SetCharge(double q_in) {
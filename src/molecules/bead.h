@@ -25,7 +25,8 @@ class Bead {
   int c_id;
   /** Bead symbol is used to decide what parameter to use for the bead. */
   string symbol;
-  /** The type of this bead, ion, monomer etc. */
+  /** Integer type ID of the symbol, see BeadTypeID. Potentials index their
+      parameter tables by it. */
   int type;
   /** Record is the bead was moved. */
   bool moved; //did the bead move this time? 
@@ -49,7 +50,10 @@ class Bead {
   string Symbol();
   void SetSymbol(string); 
   int Type();
-  void SetType(int); 
+  /** Whether the bead is grafted to the left (z=0, symbol "L") or the right
+      (z=box_l[2], symbol "R") wall. */
+  bool IsLeftGraft();
+  bool IsRightGraft();
   bool GetMoved();
   void SetMoved();
   void UnsetMoved();
@@ -87,6 +91,24 @@ class Bead {
   string DistToWall(double[3]);      // Nuo added: 9/7/2016.
 
 };
+
+/** Bead symbols are resolved to dense integer type IDs, in the order they are
+    first seen, so that potentials can look up parameters by Bead::Type()
+    instead of by string. All symbols of the simulation are registered while
+    reading the input, before the potentials build their tables. Returns the
+    type ID of a symbol, registering it if needed. */
+int BeadTypeID(string);
+/** Number of registered bead types. */
+int NumBeadTypes();
+/** Symbol of a bead type. */
+string BeadTypeSymbol(int);
+/** Type flags of a bead type, a combination of kGraftLeft and kGraftRight. */
+int BeadTypeFlags(int);
+
+/** Flag for the type of beads grafted to the z=0 wall. */
+const int kGraftLeft = 1;
+/** Flag for the type of beads grafted to the z=box_l[2] wall. */
+const int kGraftRight = 2;
  
 #endif
 
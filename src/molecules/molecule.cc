@@ -4,7 +4,6 @@
 #include <cmath>
 #include <iostream> 
 #include <iomanip>
-#include <random>
 #include <vector>
 
 #include <Eigen/Dense>
@@ -101,7 +100,7 @@ int Molecule::NDihed() {
 }
 
 void Molecule::BeadTranslate(double move_size, double box_l[3],
-                             mt19937& rand_gen) {
+                             RandomGenerator& rand_gen) {
   double vec[3];
 
   // Routine for translating beads.
@@ -121,9 +120,9 @@ void Molecule::BeadTranslate(double move_size, double box_l[3],
 
   /* 
   // Routine for dropping beads randomly in the box.
-  vec[0] = (double)rand_gen()/rand_gen.max() * box_l[0];
-  vec[1] = (double)rand_gen()/rand_gen.max() * box_l[1];
-  vec[2] = (double)rand_gen()/rand_gen.max() * box_l[2];
+  vec[0] = rand_gen.Uniform() * box_l[0];
+  vec[1] = rand_gen.Uniform() * box_l[1];
+  vec[2] = rand_gen.Uniform() * box_l[2];
   bds[0].SetMoved();
   for (int i = 0; i < 3; i++) {
     bds[0].SetCrd(1, i, vec[i]);
@@ -132,10 +131,10 @@ void Molecule::BeadTranslate(double move_size, double box_l[3],
 
 }
 
-void Molecule::COMTranslate(double move_size, mt19937& rand_gen) {
-  double vec[3] = {0.5*move_size * (double)rand_gen()/rand_gen.max(),
-                   0.5*move_size * (double)rand_gen()/rand_gen.max(),
-                   0.5*move_size * (double)rand_gen()/rand_gen.max()};
+void Molecule::COMTranslate(double move_size, RandomGenerator& rand_gen) {
+  double vec[3] = {0.5*move_size * rand_gen.Uniform(),
+                   0.5*move_size * rand_gen.Uniform(),
+                   0.5*move_size * rand_gen.Uniform()};
   if (rand_gen()%2 == 0)  vec[0] = -vec[0];
   if (rand_gen()%2 == 0)  vec[1] = -vec[1];
   if (rand_gen()%2 == 0)  vec[2] = -vec[2];
@@ -150,18 +149,18 @@ void Molecule::COMTranslate(double move_size, mt19937& rand_gen) {
 
 }
 
-void Molecule::Pivot(double move_size, mt19937& rand_gen, double eq_bond_len,
+void Molecule::Pivot(double move_size, RandomGenerator& rand_gen, double eq_bond_len,
                      bool vary_bond) {
   // Choose the pivot bead.
-  int pivot = floor(len * (double)rand_gen()/rand_gen.max());
+  int pivot = floor(len * rand_gen.Uniform());
   if (pivot == len)  pivot--;
   
   // This if for hard grafted polymers.
-  //if (bds[0].Symbol() == "R" || bds[0].Symbol() == "L")
+  //if (bds[0].IsRightGraft() || bds[0].IsLeftGraft())
   //  pivot = 0;
 
   // Determine the move size.
-  double move_size_rand = move_size * (double)rand_gen()/rand_gen.max();
+  double move_size_rand = move_size * rand_gen.Uniform();
 
   // Forward rotation.
   for (int i = pivot+1; i < len; i++) {
@@ -177,7 +176,7 @@ void Molecule::Pivot(double move_size, mt19937& rand_gen, double eq_bond_len,
     double bond_len = eq_bond_len;
     if (vary_bond) {
       // Vary bond up to +/- 10%.
-      bond_len += (eq_bond_len/5.0)*((double)rand_gen()/rand_gen.max()-0.5);
+      bond_len += (eq_bond_len/5.0)*(rand_gen.Uniform()-0.5);
     }
     double norm = bond_len / sqrt(distx*distx + disty*disty + distz*distz);
     // This is the new center.
@@ -210,7 +209,7 @@ void Molecule::Pivot(double move_size, mt19937& rand_gen, double eq_bond_len,
     double bond_len = eq_bond_len;
     if (vary_bond) {
       // Vary bond up to +/- 10%.
-      bond_len += (eq_bond_len/5.0)*((double)rand_gen()/rand_gen.max()-0.5);
+      bond_len += (eq_bond_len/5.0)*(rand_gen.Uniform()-0.5);
     }
     double norm = bond_len / sqrt(distx*distx + disty*disty + distz*distz);
     // This is the new center.
@@ -236,15 +235,15 @@ void Molecule::Pivot(double move_size, mt19937& rand_gen, double eq_bond_len,
 
 }
 
-void Molecule::Crankshaft(double move_size, mt19937& rand_gen) {
-  int first = floor((len-2) * (double)rand_gen()/rand_gen.max()); 
-  int last = floor((len - first) * (double)rand_gen()/rand_gen.max()) + first; 
+void Molecule::Crankshaft(double move_size, RandomGenerator& rand_gen) {
+  int first = floor((len-2) * rand_gen.Uniform()); 
+  int last = floor((len - first) * rand_gen.Uniform()) + first; 
   Vector3d axis; 
   for (int i = 0; i < 3; i++) {
     axis(i) = bds[last].GetCrd(0,i) - bds[first].GetCrd(0,i); 
   }
   axis.normalize();
-  double angle = move_size * ((double)rand_gen()/rand_gen.max() * 2 * M_PI - M_PI);
+  double angle = move_size * (rand_gen.Uniform() * 2 * M_PI - M_PI);
   AngleAxisd a = AngleAxisd(angle, axis); 
   Matrix3d rot;
   rot = a.toRotationMatrix(); 
@@ -264,7 +263,7 @@ void Molecule::Crankshaft(double move_size, mt19937& rand_gen) {
   
 }
 
-void Molecule::RandomReptation(mt19937& rand_gen, double eq_bond_len,
+void Molecule::RandomReptation(RandomGenerator& rand_gen, double eq_bond_len,
                                bool vary_bond) {
   if (eq_bond_len < 0) {
     cout << "Rigid bond is not properly defined. The current reptation move "
@@ -277,7 +276,7 @@ void Molecule::RandomReptation(mt19937& rand_gen, double eq_bond_len,
   double bond_len = eq_bond_len;
   if (vary_bond) {
     // Vary bond up to +/- 10%.
-    bond_len += (eq_bond_len/5.0)*((double)rand_gen()/rand_gen.max()-0.5);
+    bond_len += (eq_bond_len/5.0)*(rand_gen.Uniform()-0.5);
   }
 
   // Forward direction.
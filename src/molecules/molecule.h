@@ -2,9 +2,9 @@
 #define SRC_MOLECULES_MOLECULE_H_
 
 #include <iostream>
-#include <random>
 #include <vector>
 
+#include "../utilities/random_generator.h"
 #include "bead.h"
 
 /** A molecule contains a vector of monomer beads. For single particles, this
@@ -22,6 +22,12 @@ class Molecule {
  public: 
   Molecule(); 
   Molecule(const Molecule&); 
+  /** Moving a molecule hands over its bead and topology vectors, so that
+      molecules can be relocated in the molecule vector without copying their
+      beads. */
+  Molecule(Molecule&&) = default;
+  Molecule& operator=(const Molecule&) = default;
+  Molecule& operator=(Molecule&&) = default;
 
   /** Storing the array of monomers/beads belonging to the molecule. */
   vector<Bead> bds;
@@ -49,21 +55,21 @@ class Molecule {
   ////////////////////////
   /** Translate a random monomer or a single-bead molecule by a small random
       distance. */
-  void BeadTranslate(double, double[3],  std::mt19937&); 
+  void BeadTranslate(double, double[3],  RandomGenerator&); 
   /** Translate the entire molecule by a small random distance. */
-  void COMTranslate(double delta, std::mt19937&);
+  void COMTranslate(double delta, RandomGenerator&);
   /** Pivot algorithm changed by Nuo from rotating around an existing bond to
       rotating around a point such that pivot itself is ergodic. [9/28/2016]\n
       Now it also can choose to rotate either the left or right part of the
       chain. [9/28/2016].\n
       The current pivot algorithm does not require rigid bond to use.  */
-  void Pivot(double delta, std::mt19937&, double, bool);
+  void Pivot(double delta, RandomGenerator&, double, bool);
   /** Basically (Rachel's original) pivot for an internal section of the
       molecule. */
-  void Crankshaft(double delta, std::mt19937&); 
+  void Crankshaft(double delta, RandomGenerator&); 
   /** Unbiased reptation in both forward and backward direcitons. Currently,
       the routine has to be used with the "rigid bond" setting. */
-  void RandomReptation(std::mt19937&, double, bool);
+  void RandomReptation(RandomGenerator&, double, bool);
 
 }; 
 
@@ -0,0 +1,204 @@
+#include "particle_store.h"
+
+#include <cmath>
+
+using namespace std;
+
+ParticleStore::ParticleStore() {
+  mol_begin.push_back(0);
+
+}
+
+void ParticleStore::Build(vector<Molecule>& mols) {
+  mol_begin.assign(1, 0);
+  Append(mols);
+
+}
+
+void ParticleStore::Append(vector<Molecule>& mols) {
+  int first = (int)mol_begin.size() - 1;
+  for (int i = first; i < (int)mols.size(); i++) {
+    mol_begin.push_back(mol_begin.back() + mols[i].Size());
+  }
+  int n = mol_begin.back();
+
+  for (int f = 0; f < 2; f++) {
+    for (int d = 0; d < 3; d++) {
+      crd[f][d].resize(n);
+    }
+  }
+  q.resize(n);
+  type.resize(n);
+  id.resize(n);
+  mol_of.resize(n);
+  for (int i = first; i < (int)mols.size(); i++) {
+    for (int j = 0; j < mols[i].Size(); j++) {
+      int p = mol_begin[i] + j;
+      Bead& bead = mols[i].bds[j];
+      for (int d = 0; d < 3; d++) {
+        crd[0][d][p] = bead.GetCrd(0, d);
+        crd[1][d][p] = bead.GetCrd(1, d);
+      }
+      q[p] = bead.Charge();
+      type[p] = bead.Type();
+      id[p] = bead.ID();
+      mol_of[p] = i;
+    }
+  }
+
+}
+
+bool ParticleStore::CanReplace(int first, int count) {
+  int last = (int)mol_begin.size() - 1 - count;
+  if (first == last)  return true;
+  if (first + count > last)  return false;
+  for (int i = 0; i < count; i++) {
+    if (End(first+i) - Begin(first+i) != End(last+i) - Begin(last+i))
+      return false;
+  }
+  return true;
+
+}
+
+// The molecules keep their index ranges, only the particles of the last
+// molecules are copied down and the arrays are cut at the new end.
+void ParticleStore::RemoveMolecules(int first, int count) {
+  int n_mol = (int)mol_begin.size() - 1;
+  int last = n_mol - count;
+  int n = mol_begin[last];
+
+  if (first != last) {
+    int to = mol_begin[first];
+    for (int from = n; from < mol_begin[n_mol]; from++, to++) {
+      for (int f = 0; f < 2; f++) {
+        for (int d = 0; d < 3; d++) {
+          crd[f][d][to] = crd[f][d][from];
+        }
+      }
+      q[to] = q[from];
+      type[to] = type[from];
+      id[to] = id[from];
+      mol_of[to] = mol_of[from] - last + first;
+    }
+  }
+
+  mol_begin.resize(last+1);
+  for (int f = 0; f < 2; f++) {
+    for (int d = 0; d < 3; d++) {
+      crd[f][d].resize(n);
+    }
+  }
+  q.resize(n);
+  type.resize(n);
+  id.resize(n);
+  mol_of.resize(n);
+
+}
+
+void ParticleStore::LoadTrial(vector<Molecule>& mols, int mol) {
+  for (int j = 0; j < mols[mol].Size(); j++) {
+    int p = mol_begin[mol] + j;
+    for (int d = 0; d < 3; d++) {
+      crd[1][d][p] = mols[mol].bds[j].GetCrd(1, d);
+    }
+  }
+
+}
+
+void ParticleStore::Accept(int mol) {
+  for (int d = 0; d < 3; d++) {
+    for (int p = mol_begin[mol]; p < mol_begin[mol+1]; p++) {
+      crd[0][d][p] = crd[1][d][p];
+    }
+  }
+
+}
+
+void ParticleStore::Reject(int mol) {
+  for (int d = 0; d < 3; d++) {
+    for (int p = mol_begin[mol]; p < mol_begin[mol+1]; p++) {
+      crd[1][d][p] = crd[0][d][p];
+    }
+  }
+
+}
+
+int ParticleStore::Size() {
+  return mol_begin.back();
+
+}
+
+int ParticleStore::Begin(int mol) {
+  return mol_begin[mol];
+
+}
+
+int ParticleStore::End(int mol) {
+  return mol_begin[mol+1];
+
+}
+
+int ParticleStore::MolOf(int p) {
+  return mol_of[p];
+
+}
+
+const double * ParticleStore::Crd(int flag, int dim) {
+  return crd[flag][dim].data();
+
+}
+
+const double * ParticleStore::Charges() {
+  return q.data();
+
+}
+
+const int * ParticleStore::Types() {
+  return type.data();
+
+}
+
+const int * ParticleStore::IDs() {
+  return id.data();
+
+}
+
+ParticleSpan ParticleStore::Span(int begin, int end) {
+  ParticleSpan span;
+  for (int d = 0; d < 3; d++) {
+    span.crd[d] = crd[1][d].data() + begin;
+  }
+  span.type = type.data() + begin;
+  span.n = end - begin;
+  return span;
+
+}
+
+void ParticleStore::DistVector(int p1, int p2, double box_l[], int npbc,
+                               double dist[]) {
+  for (int d = 0; d < 3; d++) {
+    double di = crd[1][d][p2] - crd[1][d][p1];
+    if (d < npbc) {
+      di -= box_l[d] * round(di / box_l[d]);
+    }
+    dist[d] = di;
+  }
+
+}
+
+double ParticleStore::Dist(int p1, int p2, double box_l[], int npbc) {
+  double dist = 0;
+  for (int d = 0; d < 3; d++) {
+    double di = crd[1][d][p1] - crd[1][d][p2];
+    if (d < npbc) {
+      di -= box_l[d] * round(di / box_l[d]);
+      if (abs(di) > 0.5*box_l[d]) {
+        di = box_l[d] - abs(di);
+      }
+    }
+    dist += (di * di);
+  }
+  return sqrt(dist);
+
+}
+
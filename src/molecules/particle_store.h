@@ -0,0 +1,91 @@
+#ifndef SRC_MOLECULES_PARTICLE_STORE_H_
+#define SRC_MOLECULES_PARTICLE_STORE_H_
+
+#include <vector>
+
+#include "bead.h"
+#include "molecule.h"
+
+using namespace std;
+
+/** A run of n particles given by pointers to their x, y and z coordinates and
+    their types. This is what the batched pair kernels take. */
+struct ParticleSpan {
+  const double * crd[3];
+  const int * type;
+  int n;
+};
+
+/** The particle store keeps the data the energy loops need for every bead of
+    the system in contiguous arrays: x, y, z of the current and the trial
+    positions, the charge, the type and the ID. Beads are laid out molecule
+    by molecule, so that a molecule is the index range [Begin, End). The
+    Bead objects keep their own positions for the MC moves; the store mirrors
+    them and is kept in sync by the force field: extended when molecules are
+    added, patched when they are removed, and updated for the moved molecule
+    on every MC move. */
+class ParticleStore {
+ private:
+  /** Positions, indexed by flag (0 - current, 1 - trial), dimension and
+      particle. */
+  vector<double> crd[2][3];
+  /** Charge of each particle. */
+  vector<double> q;
+  /** Bead type ID of each particle. */
+  vector<int> type;
+  /** Bead ID of each particle. */
+  vector<int> id;
+  /** The molecule each particle belongs to. */
+  vector<int> mol_of;
+  /** The first particle of each molecule, with one extra entry holding the
+      total number of particles. */
+  vector<int> mol_begin;
+
+ public:
+  ParticleStore();
+  /** Copy all beads of the molecules into the store. */
+  void Build(vector<Molecule>&);
+  /** Copy the beads of the molecules that are not in the store yet, i.e.
+      those appended to the molecule vector since the last Build or Append. */
+  void Append(vector<Molecule>&);
+  /** Whether RemoveMolecules can take the given number of molecules out from
+      the given index: the last as many molecules do not overlap them and have
+      the same sizes, or they are the last molecules themselves. */
+  bool CanReplace(int, int);
+  /** Remove the given number of molecules from the given index and copy the
+      particles of the last as many molecules into their place, in O(number
+      of beads removed). Requires CanReplace. */
+  void RemoveMolecules(int, int);
+  /** Copy the trial positions of the beads of a molecule into the store. */
+  void LoadTrial(vector<Molecule>&, int);
+  /** Make the trial positions of a molecule the current ones. */
+  void Accept(int);
+  /** Reset the trial positions of a molecule to the current ones. */
+  void Reject(int);
+
+  /** Number of particles. */
+  int Size();
+  /** Index range of the beads of a molecule. */
+  int Begin(int);
+  int End(int);
+  int MolOf(int);
+  /** Contiguous array of one coordinate: the first argument is the flag (0 -
+      current, 1 - trial), the second the dimension. */
+  const double * Crd(int, int);
+  const double * Charges();
+  const int * Types();
+  const int * IDs();
+  /** The trial positions and types of the particles [begin, end). */
+  ParticleSpan Span(int, int);
+  /** The vector from the trial position of particle 1 to that of particle 2,
+      with the minimum image convention along the first npbc dimensions. This
+      is GetDistVector for particles in the store. */
+  void DistVector(int, int, double[], int, double[]);
+  /** The minimum image distance between the trial positions of two
+      particles, same as Bead::BBDist. */
+  double Dist(int, int, double[], int);
+
+};
+
+#endif
+
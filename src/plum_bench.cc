@@ -0,0 +1,622 @@
+/** plum_bench times the hot routines of Plum on synthetic systems and prints
+    the results as JSON.
+
+      plum_bench [quick] [threads <n>]
+
+    The systems are built in memory at several sizes from a fixed seed, so
+    every run times the same configurations and the same sequences of moves:
+
+      electrolyte   bulk 1:1 salt of charged LJ beads, Ewald sum.
+      brush         charged chains grafted to the lower wall of a slit, with
+                    their counterions and uncharged surface sites (phantoms).
+      gcmc_polymer  bulk polyelectrolyte solution with counterions and GC
+                    chain insertion.
+
+    For every system the pair kernels (PairEnergy, PairEnergyReal and
+    PairEnergyRepl) are timed on the pairs of mobile beads closer than the
+    real space cutoff, EnergyDifference on every move type the system has,
+    and then EnergyInitialization, CBMC insertion and the pressure routines.
+    quick only runs the smallest size. The JSON goes to stdout and the output
+    of the force field to stderr. */
+
+#include <stdlib.h>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "force_field/force_field.h"
+#include "force_field/potential_ewald_coul.h"
+#include "force_field/potential_truncated_lj.h"
+#include "utilities/constants.h"
+#include "utilities/random_generator.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+const unsigned long kBenchSeed = 20161004;
+/** Each benchmark repeats its operation until it ran for this long... */
+const double kMinSeconds = 0.25;
+/** ...or this many times, but at least once. */
+const long kMaxOps = 1000000;
+/** Maximum number of pairs the pair kernels are timed on. */
+const int kMaxPairs = 4096;
+const double kSigma = 2.22724679535;
+const double kBondLength = 2.5;
+const double kMoveSize = 2;
+/** Closest distance of two beads in the generated configurations. */
+const double kMinDist = 2.0;
+/** Number density of the bulk systems, in beads per ul^3. */
+const double kDensity = 0.01;
+/** The GC chains are inserted at this chemical potential (kBT), so that
+    every insertion is grown in full and then rejected and the system does not
+    change. */
+const double kGCChemPot = -1000;
+const char * kMoveNames[] = {"bead", "com", "pivot", "crankshaft",
+                             "reptation"};
+/** The sums of the pair kernels end up here, so that the calls are not
+    optimized away. */
+volatile double kernel_sink = 0;
+
+struct System {
+  string name;
+  int npbc;
+  double box_l[3];
+  int phantom;
+  int grafted;
+  bool use_ext;
+  bool use_gc;
+  int gc_chain_len;
+  vector<Molecule> mols;
+  /** The next bead ID. */
+  int n_id;
+};
+
+struct BenchResult {
+  string system;
+  int beads;
+  string name;
+  long ops;
+  double seconds;
+  /** The time of the complete moves, for the move benchmarks, else 0. */
+  double move_seconds;
+};
+
+double Seconds(Clock::time_point start) {
+  return chrono::duration<double>(Clock::now() - start).count();
+
+}
+
+int NumBeads(System& sys) {
+  int n_bead = 0;
+  for (int i = 0; i < (int)sys.mols.size(); i++) {
+    n_bead += sys.mols[i].Size();
+  }
+  return n_bead;
+
+}
+
+void AddMolecule(System& sys) {
+  sys.mols.push_back(Molecule());
+
+}
+
+void AddBead(System& sys, string symbol, double charge, double xyz[3]) {
+  int mol_id = (int)sys.mols.size() - 1;
+  sys.mols[mol_id].AddBead(Bead(symbol, sys.n_id++, mol_id, charge, xyz[0],
+                                xyz[1], xyz[2]));
+
+}
+
+// Whether a position is at least kMinDist away from all beads, and inside the
+// slit if the box is not periodic along z.
+bool IsFree(System& sys, double xyz[3]) {
+  if (sys.npbc < 3 && (xyz[2] < kSigma || xyz[2] > sys.box_l[2] - kSigma))
+    return false;
+  Bead probe("X", -1, -1, 0, xyz[0], xyz[1], xyz[2]);
+  for (int i = sys.phantom; i < (int)sys.mols.size(); i++) {
+    for (int j = 0; j < sys.mols[i].Size(); j++) {
+      if (probe.BBDist(sys.mols[i].bds[j], sys.box_l, sys.npbc) < kMinDist)
+        return false;
+    }
+  }
+  return true;
+
+}
+
+// A free position anywhere in the box. Gives up after a while and returns the
+// last one tried, which the first moves then resolve.
+void RandomPosition(System& sys, RandomGenerator& gen, double xyz[3]) {
+  for (int n = 0; n < 1000; n++) {
+    for (int d = 0; d < 3; d++) {
+      xyz[d] = gen.Uniform() * sys.box_l[d];
+    }
+    if (IsFree(sys, xyz))  return;
+  }
+
+}
+
+// A free position one bond away from the given one. Falls back as above.
+void NextPosition(System& sys, RandomGenerator& gen, double from[3],
+                  double xyz[3]) {
+  for (int n = 0; n < 1000; n++) {
+    double vec[3];
+    gen.UnitSphere(vec, 1);
+    for (int d = 0; d < 3; d++) {
+      xyz[d] = from[d] + kBondLength*vec[d];
+      if (d < sys.npbc)  xyz[d] -= sys.box_l[d]*floor(xyz[d]/sys.box_l[d]);
+    }
+    if (IsFree(sys, xyz))  return;
+  }
+
+}
+
+// A linear chain that starts at the given position and a counterion for
+// every charged bead.
+void AddChain(System& sys, RandomGenerator& gen, string first_symbol,
+              double first[3], int length) {
+  AddMolecule(sys);
+  double xyz[3] = {first[0], first[1], first[2]};
+  AddBead(sys, first_symbol, -1, xyz);
+  for (int i = 1; i < length; i++) {
+    double next[3];
+    NextPosition(sys, gen, xyz, next);
+    AddBead(sys, "P", -1, next);
+    sys.mols.back().AddBond(i-1, i);
+    for (int d = 0; d < 3; d++) {
+      xyz[d] = next[d];
+    }
+  }
+
+}
+
+void AddCounterions(System& sys, RandomGenerator& gen, int n) {
+  for (int i = 0; i < n; i++) {
+    double xyz[3];
+    RandomPosition(sys, gen, xyz);
+    AddMolecule(sys);
+    AddBead(sys, "C", 1, xyz);
+  }
+
+}
+
+System Electrolyte(int n_bead) {
+  System sys;
+  sys.name = "electrolyte";
+  sys.npbc = 3;
+  sys.box_l[0] = sys.box_l[1] = sys.box_l[2] = cbrt(n_bead/kDensity);
+  sys.phantom = 0;
+  sys.grafted = 0;
+  sys.use_ext = false;
+  sys.use_gc = false;
+  sys.gc_chain_len = 0;
+  sys.n_id = 0;
+  RandomGenerator gen(kBenchSeed, 0);
+  AddCounterions(sys, gen, n_bead/2);
+  for (int i = 0; i < n_bead/2; i++) {
+    double xyz[3];
+    RandomPosition(sys, gen, xyz);
+    AddMolecule(sys);
+    AddBead(sys, "A", -1, xyz);
+  }
+  return sys;
+
+}
+
+// The chains are grafted on a square grid with 100 ul^2 per chain, and the
+// surface sites sit on the same grid on both walls, all of the lower wall
+// first as CalcPressureForceLJELSlit expects.
+System Brush(int n_side, int length) {
+  System sys;
+  sys.name = "brush";
+  sys.npbc = 2;
+  sys.box_l[0] = sys.box_l[1] = 10.0*n_side;
+  sys.box_l[2] = 60;
+  sys.phantom = 2*n_side*n_side;
+  sys.grafted = n_side*n_side;
+  sys.use_ext = true;
+  sys.use_gc = false;
+  sys.gc_chain_len = 0;
+  sys.n_id = 0;
+  RandomGenerator gen(kBenchSeed, 1);
+  for (int wall = 0; wall < 2; wall++) {
+    for (int i = 0; i < n_side*n_side; i++) {
+      double xyz[3] = {10.0*(i/n_side) + 5, 10.0*(i%n_side) + 5,
+                       wall*sys.box_l[2]};
+      AddMolecule(sys);
+      AddBead(sys, "Z", 0, xyz);
+    }
+  }
+  for (int i = 0; i < n_side*n_side; i++) {
+    double xyz[3] = {10.0*(i/n_side) + 5, 10.0*(i%n_side) + 5, kSigma};
+    AddChain(sys, gen, "L", xyz, length);
+  }
+  AddCounterions(sys, gen, n_side*n_side*length);
+  return sys;
+
+}
+
+System GCMCPolymer(int n_chain, int length) {
+  System sys;
+  sys.name = "gcmc_polymer";
+  sys.npbc = 3;
+  sys.box_l[0] = sys.box_l[1] = sys.box_l[2] =
+      cbrt(2*n_chain*length/kDensity);
+  sys.phantom = 0;
+  sys.grafted = 0;
+  sys.use_ext = false;
+  sys.use_gc = true;
+  sys.gc_chain_len = length;
+  sys.n_id = 0;
+  RandomGenerator gen(kBenchSeed, 2);
+  for (int i = 0; i < n_chain; i++) {
+    double xyz[3];
+    RandomPosition(sys, gen, xyz);
+    AddChain(sys, gen, "P", xyz, length);
+  }
+  AddCounterions(sys, gen, n_chain*length);
+  return sys;
+
+}
+
+// The parameters of the pair potential, as they appear in the input file.
+string PairInput() {
+  ostringstream in;
+  in << "s3_short_range_potential_type   TruncatedLJ\n"
+     << "s3_LJ_cutoff                    -1\n";
+  const char * symbols[] = {"P", "L", "C", "A", "Z"};
+  for (int i = 0; i < 5; i++) {
+    in << "s3_bead_type                    " << symbols[i] << '\n'
+       << "s3_sigma_for_bead_type          " << setprecision(12) << kSigma
+       << '\n'
+       << "s3_epsilon_for_bead_type        " << (i < 4 ? 0.1 : 0.0) << '\n';
+  }
+  in << "s3_end_flag                     end\n";
+  return in.str();
+
+}
+
+// An alpha of 0 lets the Ewald potential pick it for the number of charges.
+string EwaldInput(bool dipole_correction) {
+  ostringstream in;
+  in << "s3_Ewald_potential_type         Coul\n"
+     << "s3_Bjerrum_length               2.5\n"
+     << "s3_dielectric_constant          80\n"
+     << "s3_Ewald_alpha                  0\n"
+     << "s3_use_dipole_correction        " << dipole_correction << '\n'
+     << "s3_Ewald_table_tolerance        1e-8\n"
+     << "s3_Ewald_table_validate         0\n";
+  return in.str();
+
+}
+
+// The force field part of the input file, from s1_vp_bin_resolution_in_ul on.
+string ForceFieldInput(System& sys, int n_threads) {
+  ostringstream in;
+  in << "s1_vp_bin_resolution_in_ul      10\n"
+     << "s1_bead_size_virial_pressure    2.5\n"
+     << "s2_use_short_range_potential    1\n"
+     << "s2_use_Ewald_potential          1\n"
+     << "s2_use_bond_potential           0\n"
+     << "s2_use_rigid_bond               1\n"
+     << "s2_use_angle_potential          0\n"
+     << "s2_use_dihedral_potential       0\n"
+     << "s2_use_external_potential       " << sys.use_ext << '\n'
+     << "s2_use_grand_canonical_MC_move  " << sys.use_gc << '\n'
+     << "s2_number_of_threads            " << n_threads << '\n';
+  if (sys.use_gc) {
+    in << "s3_chemical_potential_in_kT     " << kGCChemPot << '\n'
+       << "s3_deBroglie_prefactor          1\n"
+       << "s3_GCMC_move_frequency          1\n"
+       << "s3_chain_length                 " << sys.gc_chain_len << '\n'
+       << "s3_bead_charge_in_e             -1\n"
+       << "s3_bead_type                    P\n"
+       << "s3_no_of_CBMC_trials            30\n";
+  }
+  in << PairInput() << EwaldInput(sys.npbc < 3)
+     << "s3_rigid_bond_length            " << kBondLength << '\n';
+  if (sys.use_ext) {
+    in << "s3_external_potential_type      TruncatedLJWall\n"
+       << "s3_LJ_cutoff                    -1\n"
+       << "s3_wall_sigma                   " << setprecision(12) << kSigma
+       << '\n'
+       << "s3_wall_epsilon                 0.1\n";
+    const char * symbols[] = {"P", "L", "C", "Z"};
+    for (int i = 0; i < 4; i++) {
+      in << "s3_bead_type                    " << symbols[i] << '\n'
+         << "s3_sigma_for_bead_type          " << kSigma << '\n'
+         << "s3_epsilon_for_bead_type        " << (i < 3 ? 0.1 : 0.0) << '\n';
+    }
+    in << "s3_end_flag                     end\n";
+  }
+  return in.str();
+
+}
+
+class Bench {
+ private:
+  vector<BenchResult> results;
+  int n_threads;
+
+  void Add(System& sys, string name, long ops, double seconds,
+           double move_seconds) {
+    BenchResult result = {sys.name, NumBeads(sys), name, ops, seconds,
+                          move_seconds};
+    results.push_back(result);
+    cerr << "  " << sys.name << " " << result.beads << " " << name << ": "
+         << 1e9*seconds/ops << " ns/op" << endl;
+
+  }
+
+  // Repeat an operation, which returns the number of operations it did,
+  // until it ran for kMinSeconds or kMaxOps operations.
+  template <typename Op>
+  void Time(System& sys, string name, Op op) {
+    long ops = 0;
+    double seconds = 0;
+    Clock::time_point start = Clock::now();
+    while (ops == 0 || (ops < kMaxOps && seconds < kMinSeconds)) {
+      ops += op();
+      seconds = Seconds(start);
+    }
+    Add(sys, name, ops, seconds, 0);
+
+  }
+
+  void PairKernels(System&);
+  void Moves(System&, ForceField&);
+  void Pressures(System&, ForceField&);
+
+ public:
+  Bench(int n_threads_in) : n_threads(n_threads_in) {}
+  void Run(System);
+  void WriteJson(ostream&);
+
+};
+
+// The kernels are timed on standalone potentials with the parameters of the
+// force field, since those of the force field are not exposed.
+void Bench::PairKernels(System& sys) {
+  vector<Bead*> beads;
+  int n_charges = 0;
+  for (int i = sys.phantom; i < (int)sys.mols.size(); i++) {
+    for (int j = 0; j < sys.mols[i].Size(); j++) {
+      beads.push_back(&sys.mols[i].bds[j]);
+      if (sys.mols[i].bds[j].Charge() != 0)  n_charges++;
+    }
+  }
+  streambuf * cin_buf = cin.rdbuf();
+  istringstream pair_in(PairInput());
+  cin.rdbuf(pair_in.rdbuf());
+  string flag, name;
+  cin >> flag >> name;
+  PotentialTruncatedLJ pair_pot(name);
+  istringstream ewald_in(EwaldInput(sys.npbc < 3));
+  cin.rdbuf(ewald_in.rdbuf());
+  cin >> flag >> name;
+  double box_l[3] = {sys.box_l[0], sys.box_l[1], sys.box_l[2]};
+  PotentialEwaldCoul ewald_pot(name, box_l, n_charges, 1);
+  cin.rdbuf(cin_buf);
+
+  vector<pair<Bead*, Bead*> > pairs;
+  double cutoff = ewald_pot.RealCutoff();
+  for (int i = 0; i < (int)beads.size() && (int)pairs.size() < kMaxPairs;
+       i++) {
+    for (int j = i+1; j < (int)beads.size(); j++) {
+      if (beads[i]->BBDist(*beads[j], sys.box_l, sys.npbc) < cutoff)
+        pairs.push_back(make_pair(beads[i], beads[j]));
+    }
+  }
+  if ((int)pairs.size() > kMaxPairs)  pairs.resize(kMaxPairs);
+  if (pairs.empty())  return;
+
+  double sum = 0;
+  Time(sys, "pair_energy", [&]() {
+    for (int i = 0; i < (int)pairs.size(); i++)
+      sum += pair_pot.PairEnergy(*pairs[i].first, *pairs[i].second,
+                                 sys.box_l, sys.npbc);
+    return (long)pairs.size();
+  });
+  Time(sys, "pair_energy_real", [&]() {
+    for (int i = 0; i < (int)pairs.size(); i++)
+      sum += ewald_pot.PairEnergyReal(*pairs[i].first, *pairs[i].second,
+                                      sys.npbc);
+    return (long)pairs.size();
+  });
+  Time(sys, "pair_energy_repl", [&]() {
+    for (int i = 0; i < (int)pairs.size(); i++)
+      sum += ewald_pot.PairEnergyRepl(*pairs[i].first, *pairs[i].second,
+                                      sys.npbc);
+    return (long)pairs.size();
+  });
+  kernel_sink = sum;
+
+}
+
+// The moves of Simulation::TranslationalMove, one move type at a time, with
+// the single beads for the bead translation and the chains for the others.
+// ns/op is the time spent in EnergyDifference and moves/sec counts the
+// complete moves.
+void Bench::Moves(System& sys, ForceField& force_field) {
+  vector<int> chains;
+  vector<int> ions;
+  for (int i = sys.phantom; i < (int)sys.mols.size(); i++) {
+    if (sys.mols[i].Size() > 1)  chains.push_back(i);
+    else                         ions.push_back(i);
+  }
+  double bond_len = force_field.RigidBondLen();
+
+  for (int move_type = 0; move_type < kNoMoveType; move_type++) {
+    vector<int>& list = (move_type == 0 ? ions : chains);
+    if (list.empty())  continue;
+    RandomGenerator gen(kBenchSeed, 100 + move_type);
+    long ops = 0;
+    double dE_seconds = 0;
+    double seconds = 0;
+    Clock::time_point start = Clock::now();
+    while (ops == 0 || (ops < kMaxOps && seconds < kMinSeconds)) {
+      int mol_id = list[gen() % list.size()];
+      Molecule& mol = sys.mols[mol_id];
+      switch (move_type) {
+        case 0:
+          mol.BeadTranslate(kMoveSize, sys.box_l, gen);
+          break;
+        case 1:
+          mol.COMTranslate(kMoveSize, gen);
+          break;
+        case 2:
+          mol.Pivot(kMoveSize, gen, bond_len, false);
+          break;
+        case 3:
+          mol.Crankshaft(kMoveSize, gen);
+          break;
+        case 4:
+          mol.RandomReptation(gen, bond_len, false);
+          break;
+      }
+      Clock::time_point dE_start = Clock::now();
+      double dE = force_field.EnergyDifference(sys.mols, mol_id);
+      dE_seconds += Seconds(dE_start);
+      bool accept = (dE < kVeryLargeEnergy && gen.Uniform() < exp(-dE));
+      force_field.FinalizeEnergies(sys.mols, accept, mol_id);
+      for (int i = 0; i < mol.Size(); i++) {
+        if (accept)  mol.bds[i].UpdateCurrentPos();
+        else         mol.bds[i].UpdateTrialPos();
+        mol.bds[i].UnsetMoved();
+      }
+      ops++;
+      seconds = Seconds(start);
+    }
+    Add(sys, string("energy_difference_") + kMoveNames[move_type], ops,
+        dE_seconds, seconds);
+  }
+
+}
+
+// The pressure routines of the geometry of the system. The volume scaling
+// routines leave the scaled positions in the trial coordinates, which are
+// reset afterwards.
+void Bench::Pressures(System& sys, ForceField& force_field) {
+  double rho = (sys.mols.size() - sys.phantom) /
+               (sys.box_l[0]*sys.box_l[1]*sys.box_l[2]);
+  if (sys.use_ext) {
+    Time(sys, "pressure_force_lj_el_slit", [&]() {
+      force_field.CalcPressureForceLJELSlit(sys.mols);
+      return 1L;
+    });
+    Time(sys, "pressure_virial_hs_el_slit", [&]() {
+      force_field.CalcPressureVirialHSELSlit(sys.mols, rho);
+      return 1L;
+    });
+  }
+  else {
+    Time(sys, "pressure_virial_hs_el", [&]() {
+      force_field.CalcPressureVirialHSEL(sys.mols, rho);
+      return 1L;
+    });
+    Time(sys, "pressure_virial_el", [&]() {
+      force_field.CalcPressureVirialEL(sys.mols);
+      return 1L;
+    });
+  }
+  Time(sys, "pressure_vol_scaling_hs_el_slit", [&]() {
+    force_field.CalcPressureVolScalingHSELSlit(sys.mols);
+    return 1L;
+  });
+  for (int i = 0; i < (int)sys.mols.size(); i++) {
+    for (int j = 0; j < sys.mols[i].Size(); j++) {
+      sys.mols[i].bds[j].UpdateTrialPos();
+    }
+  }
+
+}
+
+void Bench::Run(System sys) {
+  cerr << "\n  Benchmarking " << sys.name << " with " << NumBeads(sys)
+       << " beads." << endl;
+  PairKernels(sys);
+
+  ForceField force_field;
+  streambuf * cin_buf = cin.rdbuf();
+  istringstream ff_in(ForceFieldInput(sys, n_threads));
+  cin.rdbuf(ff_in.rdbuf());
+  force_field.Initialize(1.0, sys.npbc, sys.box_l, sys.mols, sys.phantom, 0,
+                         sys.grafted, 0, true);
+  cin.rdbuf(cin_buf);
+
+  Moves(sys, force_field);
+  Time(sys, "energy_initialization", [&]() {
+    force_field.ReplaceSystem(sys.mols);
+    return 1L;
+  });
+  if (sys.use_gc) {
+    RandomGenerator gen(kBenchSeed, 200);
+    Time(sys, "cbmc_insertion", [&]() {
+      force_field.CBMCFChainInsertion(sys.mols, gen);
+      return 1L;
+    });
+  }
+  Pressures(sys, force_field);
+
+}
+
+void Bench::WriteJson(ostream& out) {
+  out << "{\n"
+      << "  \"seed\": " << kBenchSeed << ",\n"
+      << "  \"threads\": " << n_threads << ",\n"
+      << "  \"results\": [\n";
+  for (int i = 0; i < (int)results.size(); i++) {
+    BenchResult& r = results[i];
+    out << "    {\"system\": \"" << r.system << "\", \"beads\": " << r.beads
+        << ", \"benchmark\": \"" << r.name << "\", \"ops\": " << r.ops
+        << ", \"ns_per_op\": " << setprecision(6) << 1e9*r.seconds/r.ops;
+    if (r.move_seconds > 0)
+      out << ", \"moves_per_sec\": " << r.ops/r.move_seconds;
+    out << "}" << (i+1 < (int)results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n"
+      << "}" << endl;
+
+}
+
+int main(int argc, char * argv[]) {
+  bool quick = false;
+  int n_threads = 1;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "quick") {
+      quick = true;
+    }
+    else if (arg == "threads" && i+1 < argc) {
+      n_threads = atoi(argv[++i]);
+    }
+    else {
+      cerr << "  Usage: plum_bench [quick] [threads <n>]" << endl;
+      exit(1);
+    }
+  }
+
+  // The force field reports its parameters on cout, which carries the JSON.
+  streambuf * cout_buf = cout.rdbuf();
+  cout.rdbuf(cerr.rdbuf());
+  Bench bench(n_threads);
+  int n_sizes = quick ? 1 : 3;
+  const int electrolyte_beads[] = {200, 500, 1200};
+  const int brush_side[] = {3, 4, 6};
+  const int gc_chains[] = {10, 25, 60};
+  for (int i = 0; i < n_sizes; i++) {
+    bench.Run(Electrolyte(electrolyte_beads[i]));
+    bench.Run(Brush(brush_side[i], 10));
+    bench.Run(GCMCPolymer(gc_chains[i], 8));
+  }
+  cout.rdbuf(cout_buf);
+  bench.WriteJson(cout);
+
+  return 0;
+
+}
+
@@ -0,0 +1,542 @@
+/** plum_check compares the fast paths of Plum against the straightforward
+    computations they replace, and prints one line per check.
+
+      plum_check
+
+    simd   PairEnergyBatch of the truncated LJ and the hard sphere potentials,
+           at every SIMD level the host supports, against PairEnergy. The
+           kernels claim to be bit for bit identical, so any difference
+           fails. The spans have every length up to kMaxSpan, and hold
+           random particles, particles around the fold at half the box and
+           particles on top of the probe.
+
+    pme    The Ewald energy of an electrolyte with PotentialEwaldPME against
+           PotentialEwaldCoul, whose reciprocal sum is exact up to its k
+           cutoff, within kPmeTolerance for the grid spacing kPmeSpacing and
+           the spline order kPmeOrder. The running energy of either sum after
+           kPmeMoves translations, kept up by EnergyDifference and
+           FinalizeEnergies, against the energy recomputed from scratch,
+           within kDriftTolerance.
+
+    bead   BeadReplEnergy of PotentialEwaldCoul and PotentialEwaldPME, which
+           the CBMC moves score their trial beads with, against the sum of
+           PairEnergyRepl over all beads, for probes in the electrolyte of
+           the pme check after kBeadMoves moves through the structure factor
+           routines. The largest difference has to stay below
+           kBeadTolerance of the largest energy for the Ewald sum, and below
+           kPmeTolerance of it for PME.
+
+    table  The interpolated real space kernels of PotentialEwaldCoul against
+           libm, from the smallest tabulated r to the real cutoff, for the
+           alpha the potential tunes for the number of charges and the box.
+           The relative error of the energy and the force kernels has to stay
+           below the table tolerance.
+
+    The configurations are drawn from a fixed seed. The output of the force
+    field goes to stderr. plum_check exits with 1 if a check failed. */
+
+#include <stdlib.h>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "force_field/force_field.h"
+#include "force_field/potential_ewald_coul.h"
+#include "force_field/potential_ewald_pme.h"
+#include "force_field/potential_hard_sphere.h"
+#include "force_field/potential_truncated_lj.h"
+#include "molecules/bead.h"
+#include "molecules/molecule.h"
+#include "utilities/constants.h"
+#include "utilities/misc.h"
+#include "utilities/random_generator.h"
+
+using namespace std;
+
+const unsigned long kCheckSeed = 20161004;
+/** The spans of the batched kernels have 0 to kMaxSpan particles, which
+    covers every remainder of the 4 and 8 particles the SIMD loops take. */
+const int kMaxSpan = 19;
+/** Spans of every length and kind, per number of periodic dimensions. */
+const int kSpanRepeats = 40;
+/** Tries to place a fold particle where the minimum image folds. */
+const int kFoldTries = 64;
+const char * kSymbols[] = {"A", "B", "C"};
+const int kNumSymbols = 3;
+/** The electrolyte of the PME check: kPmeIons monovalent ions in a periodic
+    cube of side kPmeBoxL. */
+const int kPmeIons = 100;
+const double kPmeBoxL = 20;
+/** The Ewald alpha of the PME check, which balances the real and the
+    reciprocal sums of the electrolyte. 1/sqrt(alpha) is about 5.2 ul. */
+const double kPmeAlpha = 0.0365;
+/** Grid spacing and spline order of the PME check. The spacing is a fifth of
+    the screening length. */
+const double kPmeSpacing = 1.0;
+const int kPmeOrder = 6;
+/** The largest relative difference of the reciprocal energies of PME and the
+    Ewald sum at kPmeSpacing and kPmeOrder. The error of PME falls by about
+    (h*sqrt(alpha))^p with the spacing h and the order p, so the tolerance
+    holds for finer grids and higher orders only. */
+const double kPmeTolerance = 1e-4;
+/** Translations between the checks of the running energy, with a step of
+    kPmeStep ul. They touch enough grid points to refresh the grid potential
+    of PME several times. */
+const int kPmeMoves = 400;
+const double kPmeStep = 2.0;
+/** The largest relative difference of the running and the recomputed Ewald
+    energies, which only differ by rounding. */
+const double kDriftTolerance = 1e-9;
+/** Moves of the bead check, which leave grid charges of PME pending, and the
+    probes it compares. */
+const int kBeadMoves = 20;
+const int kBeadProbes = 50;
+/** The Ewald sum takes the same phases for both, so only the order of the
+    sums differs. */
+const double kBeadTolerance = 1e-10;
+/** The systems of the table check: the number of charges, the side of the
+    cubic box and the table tolerance. The auto-tuned alpha spans about two
+    orders of magnitude over them. */
+const int kTableSystems = 5;
+const double kTableSystem[kTableSystems][3] = {{10, 10, 1e-8},
+                                               {100, 20, 1e-8},
+                                               {1000, 40, 1e-8},
+                                               {10000, 40, 1e-6},
+                                               {100, 200, 1e-10}};
+
+/** Whether the minimum image of a distance along a dimension is folded by
+    Bead::BBDist, i.e. round() leaves it longer than half the box. */
+bool Folds(double di, double l) {
+  di -= l * round(di / l);
+  return abs(di) > 0.5*l;
+
+}
+
+class Check {
+ private:
+  int n_failed;
+  /** The box of the SIMD check. Half of it lies within the LJ cutoffs, so
+      that a folded image changes the energy, and the lengths have full
+      mantissas, so that round() can leave an image longer than half the
+      box. */
+  double box_l[3];
+  RandomGenerator rand_gen;
+
+  /** A particle position of the given kind relative to the probe: 0 for a
+      random position in and around the box, 1 for a distance of about an
+      odd multiple of half the box along every dimension, where the minimum
+      image folds if it can be made to, and 2 for the probe position
+      itself. */
+  void SpanPosition(const double[], int, double[]);
+  /** Compare PairEnergyBatch against PairEnergy at every SIMD level. */
+  void BatchAgainstPairEnergy(string, PotentialPair&);
+  /** The ions of the PME check. */
+  vector<Molecule> Electrolyte();
+  /** The parameters of an Ewald potential of the given type, as they follow
+      its type in the input. */
+  string EwaldParameters(string);
+  /** The force field input of an electrolyte with only the Ewald potential
+      of the given type. */
+  string EwaldInput(string);
+  /** Move ions at random, accepted with probability one half, and compare
+      the running Ewald energy against the one of a force field initialized
+      on the moved ions. */
+  void RunningEwaldEnergy(string, ForceField&, vector<Molecule>&);
+  /** Compare BeadReplEnergy against the sum of PairEnergyRepl. */
+  void BeadAgainstPairEnergyRepl(string, PotentialEwald&, double);
+
+ public:
+  Check();
+  void Report(string, bool, string);
+  void Simd();
+  void Pme();
+  void BeadRepl();
+  void Table();
+  int Failed();
+
+};
+
+Check::Check() : rand_gen(kCheckSeed) {
+  n_failed = 0;
+  box_l[0] = 6.7;
+  box_l[1] = 7.3;
+  box_l[2] = 9.1;
+
+}
+
+void Check::Report(string name, bool ok, string detail) {
+  cout << "  " << left << setw(40) << name << right
+       << (ok ? "ok     " : "FAILED ") << detail << endl;
+  if (!ok)  n_failed++;
+
+}
+
+int Check::Failed() {
+  return n_failed;
+
+}
+
+// The fold cases step a few ulps around the halfway points of round(), until
+// the rounding of the division leaves the image longer than half the box.
+void Check::SpanPosition(const double probe[], int kind, double xyz[]) {
+  for (int i = 0; i < 3; i++) {
+    if (kind == 0) {
+      xyz[i] = (2*rand_gen.Uniform() - 0.5) * box_l[i];
+    }
+    else if (kind == 1) {
+      for (int k = 0; k < kFoldTries; k++) {
+        double d = (0.5 + rand_gen() % 5) * box_l[i];
+        int ulps = (int)(rand_gen() % 17) - 8;
+        for (int u = 0; u < abs(ulps); u++)
+          d = nextafter(d, ulps > 0 ? 2*d : 0);
+        xyz[i] = probe[i] + (rand_gen.Uniform() < 0.5 ? d : -d);
+        if (Folds(probe[i] - xyz[i], box_l[i]))  break;
+      }
+    }
+    else {
+      xyz[i] = probe[i];
+    }
+  }
+
+}
+
+void Check::BatchAgainstPairEnergy(string name, PotentialPair& pot) {
+  vector<double> crd[3];
+  vector<int> type;
+  vector<Bead> beads;
+  vector<double> expected;
+  vector<double> energy;
+  for (int level = kSimdScalar; level <= SimdLevel(); level++) {
+    pot.SetSimdLevel(level);
+    rand_gen.seed(kCheckSeed, level);
+    long n_energies = 0;
+    long n_differ = 0;
+    long n_folded = 0;
+    for (int npbc = 0; npbc <= 3; npbc++) {
+      for (int rep = 0; rep < kSpanRepeats; rep++) {
+        for (int n = 0; n <= kMaxSpan; n++) {
+          double probe[3];
+          for (int i = 0; i < 3; i++)
+            probe[i] = rand_gen.Uniform() * box_l[i];
+          int probe_type = rand_gen() % kNumSymbols;
+          Bead probe_bead(kSymbols[probe_type], 0, 0, 0, probe[0], probe[1],
+                          probe[2]);
+          beads.clear();
+          for (int i = 0; i < 3; i++)  crd[i].resize(n);
+          type.resize(n);
+          for (int j = 0; j < n; j++) {
+            double xyz[3];
+            SpanPosition(probe, (rep + j) % 3, xyz);
+            int t = rand_gen() % kNumSymbols;
+            beads.push_back(Bead(kSymbols[t], j+1, j+1, 0, xyz[0], xyz[1],
+                                 xyz[2]));
+            for (int i = 0; i < 3; i++)  crd[i][j] = xyz[i];
+            type[j] = beads[j].Type();
+            for (int i = 0; i < npbc; i++) {
+              if (Folds(probe[i] - xyz[i], box_l[i]))  n_folded++;
+            }
+          }
+          ParticleSpan span;
+          for (int i = 0; i < 3; i++)  span.crd[i] = crd[i].data();
+          span.type = type.data();
+          span.n = n;
+
+          expected.resize(n);
+          energy.assign(n+1, 0);
+          for (int j = 0; j < n; j++)
+            expected[j] = pot.PairEnergy(probe_bead, beads[j], box_l, npbc);
+          pot.PairEnergyBatch(probe, probe_bead.Type(), span, box_l, npbc,
+                              energy.data());
+          for (int j = 0; j < n; j++) {
+            if (memcmp(&expected[j], &energy[j], sizeof(double)) != 0)
+              n_differ++;
+          }
+          n_energies += n;
+        }
+      }
+    }
+    ostringstream detail;
+    detail << n_energies << " energies, " << n_folded << " folded, "
+           << n_differ << " differ";
+    Report("simd " + name + " " + SimdName(level), n_differ == 0,
+           detail.str());
+  }
+  pot.SetSimdLevel(SimdLevel());
+
+}
+
+void Check::Simd() {
+  istringstream lj_in("s3_lj_cutoff -1\n"
+                      "s3_bead_type_1 A s3_sigma 2.2 s3_epsilon 1.0\n"
+                      "s3_bead_type_2 B s3_sigma 3.1 s3_epsilon 0.5\n"
+                      "s3_bead_type_3 C s3_sigma 0.0 s3_epsilon 0.0\n"
+                      "s3_end_flag end\n");
+  istringstream lj_cut_in("s3_lj_cutoff 7.5\n"
+                          "s3_bead_type_1 A s3_sigma 2.2 s3_epsilon 1.0\n"
+                          "s3_bead_type_2 B s3_sigma 3.1 s3_epsilon 0.5\n"
+                          "s3_end_flag end\n");
+  istringstream hs_in("s3_bead_type_1 A s3_radius 1.1\n"
+                      "s3_bead_type_2 B s3_radius 1.6\n"
+                      "s3_end_flag end\n");
+  // The potentials report their parameters on cout, which carries the
+  // results.
+  streambuf * cin_buf = cin.rdbuf();
+  streambuf * cout_buf = cout.rdbuf();
+  cout.rdbuf(cerr.rdbuf());
+  cin.rdbuf(lj_in.rdbuf());
+  PotentialTruncatedLJ lj("LJ");
+  cin.rdbuf(lj_cut_in.rdbuf());
+  PotentialTruncatedLJ lj_cut("LJ");
+  cin.rdbuf(hs_in.rdbuf());
+  PotentialHardSphere hs("HardSphere");
+  cin.rdbuf(cin_buf);
+  cout.rdbuf(cout_buf);
+
+  BatchAgainstPairEnergy("truncated_lj", lj);
+  BatchAgainstPairEnergy("truncated_lj_cut", lj_cut);
+  BatchAgainstPairEnergy("hard_sphere", hs);
+
+}
+
+vector<Molecule> Check::Electrolyte() {
+  rand_gen.seed(kCheckSeed, 100);
+  vector<Molecule> mols;
+  for (int i = 0; i < kPmeIons; i++) {
+    mols.push_back(Molecule());
+    double x = rand_gen.Uniform()*kPmeBoxL;
+    double y = rand_gen.Uniform()*kPmeBoxL;
+    double z = rand_gen.Uniform()*kPmeBoxL;
+    mols[i].AddBead(Bead(i % 2 ? "A" : "C", i, i, i % 2 ? -1 : 1, x, y, z));
+  }
+  return mols;
+
+}
+
+// The grid spacing and the spline order follow the Coul parameters of PME.
+string Check::EwaldParameters(string type) {
+  ostringstream in;
+  in << "s3_Bjerrum_length               2.5\n"
+     << "s3_dielectric_constant          80\n"
+     << "s3_Ewald_alpha                  " << kPmeAlpha << '\n'
+     << "s3_use_dipole_correction        0\n"
+     << "s3_Ewald_table_tolerance        1e-8\n"
+     << "s3_Ewald_table_validate         0\n";
+  if (type == "PME") {
+    in << "s3_PME_grid_spacing             " << kPmeSpacing << '\n'
+       << "s3_PME_order                    " << kPmeOrder << '\n';
+  }
+  return in.str();
+
+}
+
+string Check::EwaldInput(string type) {
+  ostringstream in;
+  in << "s1_vp_bin_resolution_in_ul      10\n"
+     << "s1_bead_size_virial_pressure    2.5\n"
+     << "s2_use_short_range_potential    0\n"
+     << "s2_use_Ewald_potential          1\n"
+     << "s2_use_bond_potential           0\n"
+     << "s2_use_rigid_bond               0\n"
+     << "s2_use_angle_potential          0\n"
+     << "s2_use_dihedral_potential       0\n"
+     << "s2_use_external_potential       0\n"
+     << "s2_use_grand_canonical_MC_move  0\n"
+     << "s2_number_of_threads            1\n"
+     << "s3_Ewald_potential_type         " << type << '\n'
+     << EwaldParameters(type);
+  return in.str();
+
+}
+
+void Check::RunningEwaldEnergy(string name, ForceField& force_field,
+                               vector<Molecule>& mols) {
+  double box[3] = {kPmeBoxL, kPmeBoxL, kPmeBoxL};
+  for (int n = 0; n < kPmeMoves; n++) {
+    int mol_id = rand_gen() % mols.size();
+    Molecule& mol = mols[mol_id];
+    mol.BeadTranslate(kPmeStep, box, rand_gen);
+    force_field.EnergyDifference(mols, mol_id);
+    bool accept = (rand_gen.Uniform() < 0.5);
+    force_field.FinalizeEnergies(mols, accept, mol_id);
+    for (int i = 0; i < mol.Size(); i++) {
+      if (accept)  mol.bds[i].UpdateCurrentPos();
+      else         mol.bds[i].UpdateTrialPos();
+      mol.bds[i].UnsetMoved();
+    }
+  }
+  double running = force_field.TotEwaldEnergy();
+  streambuf * cin_buf = cin.rdbuf();
+  streambuf * cout_buf = cout.rdbuf();
+  cout.rdbuf(cerr.rdbuf());
+  istringstream in(EwaldInput(name == "pme" ? "PME" : "Coul"));
+  cin.rdbuf(in.rdbuf());
+  ForceField fresh;
+  fresh.Initialize(1.0, 3, box, mols, 0, 0, 0, 0, true);
+  cin.rdbuf(cin_buf);
+  cout.rdbuf(cout_buf);
+  double recomputed = fresh.TotEwaldEnergy();
+  double rel = abs(running - recomputed) / abs(recomputed);
+  ostringstream detail;
+  detail << kPmeMoves << " moves, relative drift " << setprecision(3) << rel;
+  Report("pme running energy " + name, rel < kDriftTolerance, detail.str());
+
+}
+
+// Both sums share the real space and self energies, so the reciprocal
+// energies are compared on their own.
+void Check::Pme() {
+  double box[3] = {kPmeBoxL, kPmeBoxL, kPmeBoxL};
+  vector<Molecule> mols = Electrolyte();
+
+  streambuf * cin_buf = cin.rdbuf();
+  streambuf * cout_buf = cout.rdbuf();
+  cout.rdbuf(cerr.rdbuf());
+  istringstream coul_in(EwaldInput("Coul"));
+  cin.rdbuf(coul_in.rdbuf());
+  ForceField coul;
+  coul.Initialize(1.0, 3, box, mols, 0, 0, 0, 0, true);
+  istringstream pme_in(EwaldInput("PME"));
+  cin.rdbuf(pme_in.rdbuf());
+  ForceField pme;
+  pme.Initialize(1.0, 3, box, mols, 0, 0, 0, 0, true);
+  cin.rdbuf(cin_buf);
+  cout.rdbuf(cout_buf);
+
+  double coul_parts[3];
+  double pme_parts[3];
+  coul.GetEwaldEnergyComponents(mols, coul_parts);
+  pme.GetEwaldEnergyComponents(mols, pme_parts);
+  double rel = abs(pme_parts[1] - coul_parts[1]) / abs(coul_parts[1]);
+  ostringstream detail;
+  detail << "spacing " << kPmeSpacing << ", order " << kPmeOrder
+         << ", relative difference " << setprecision(3) << rel;
+  Report("pme reciprocal energy", rel < kPmeTolerance, detail.str());
+  rel = abs(pme.TotEwaldEnergy() - coul.TotEwaldEnergy()) /
+        abs(coul.TotEwaldEnergy());
+  detail.str("");
+  detail << "relative difference " << setprecision(3) << rel;
+  Report("pme total energy", rel < kPmeTolerance, detail.str());
+
+  vector<Molecule> coul_mols = mols;
+  RunningEwaldEnergy("coul", coul, coul_mols);
+  RunningEwaldEnergy("pme", pme, mols);
+
+}
+
+// The moves go through the structure factor routines the way
+// EnergyDifference and FinalizeEnergies drive them.
+void Check::BeadAgainstPairEnergyRepl(string name, PotentialEwald& ewald,
+                                      double tol) {
+  vector<Molecule> mols = Electrolyte();
+  streambuf * cout_buf = cout.rdbuf();
+  cout.rdbuf(cerr.rdbuf());
+  ewald.EnergyInitialization(mols, 3);
+  cout.rdbuf(cout_buf);
+  for (int n = 0; n < kBeadMoves; n++) {
+    Bead& bead = mols[rand_gen() % mols.size()].bds[0];
+    ewald.ResetTrialStructureFactor();
+    ewald.AddToTrialStructureFactor(bead, 0, -1);
+    for (int i = 0; i < 3; i++)
+      bead.SetCrd(1, i, rand_gen.Uniform()*kPmeBoxL);
+    ewald.AddToTrialStructureFactor(bead, 1, 1);
+    ewald.TrialReplEnergy();
+    ewald.AcceptTrialStructureFactor();
+    bead.UpdateCurrentPos();
+  }
+  ewald.PrepareBeadReplEnergy();
+
+  double max_diff = 0;
+  double max_energy = 0;
+  for (int n = 0; n < kBeadProbes; n++) {
+    Bead probe("A", -1, -1, n % 2 ? -1 : 1, rand_gen.Uniform()*kPmeBoxL,
+               rand_gen.Uniform()*kPmeBoxL, rand_gen.Uniform()*kPmeBoxL);
+    double expected = 0;
+    for (int i = 0; i < (int)mols.size(); i++) {
+      expected += ewald.PairEnergyRepl(probe, mols[i].bds[0], 3);
+    }
+    max_diff = max(max_diff, abs(ewald.BeadReplEnergy(probe) - expected));
+    max_energy = max(max_energy, abs(expected));
+  }
+  ostringstream detail;
+  detail << kBeadProbes << " probes, largest energy " << setprecision(3)
+         << max_energy << ", difference " << max_diff;
+  Report("bead repl energy " + name, max_diff < tol*max_energy,
+         detail.str());
+
+}
+
+void Check::BeadRepl() {
+  double box[3] = {kPmeBoxL, kPmeBoxL, kPmeBoxL};
+  rand_gen.seed(kCheckSeed, 200);
+  streambuf * cin_buf = cin.rdbuf();
+  streambuf * cout_buf = cout.rdbuf();
+  cout.rdbuf(cerr.rdbuf());
+  istringstream coul_in(EwaldParameters("Coul"));
+  cin.rdbuf(coul_in.rdbuf());
+  PotentialEwaldCoul coul("Coul", box, kPmeIons, 1);
+  istringstream pme_in(EwaldParameters("PME"));
+  cin.rdbuf(pme_in.rdbuf());
+  PotentialEwaldPME pme("PME", box, kPmeIons, 1);
+  cin.rdbuf(cin_buf);
+  cout.rdbuf(cout_buf);
+
+  BeadAgainstPairEnergyRepl("coul", coul, kBeadTolerance);
+  BeadAgainstPairEnergyRepl("pme", pme, kPmeTolerance);
+
+}
+
+void Check::Table() {
+  for (int n = 0; n < kTableSystems; n++) {
+    int n_charges = (int)kTableSystem[n][0];
+    double box[3] = {kTableSystem[n][1], kTableSystem[n][1],
+                     kTableSystem[n][1]};
+    double tol = kTableSystem[n][2];
+    ostringstream in;
+    in << "s3_Bjerrum_length 2.5 s3_dielectric_constant 80 s3_Ewald_alpha 0\n"
+       << "s3_use_dipole_correction 0 s3_Ewald_table_tolerance " << tol
+       << " s3_Ewald_table_validate 0\n";
+    istringstream ewald_in(in.str());
+    streambuf * cin_buf = cin.rdbuf();
+    streambuf * cout_buf = cout.rdbuf();
+    cout.rdbuf(cerr.rdbuf());
+    cin.rdbuf(ewald_in.rdbuf());
+    PotentialEwaldCoul ewald("Coul", box, n_charges, 1);
+    cin.rdbuf(cin_buf);
+    cout.rdbuf(cout_buf);
+
+    double err_e, err_f;
+    ewald.RealTableErrors(err_e, err_f);
+    ostringstream name;
+    name << "table " << n_charges << " charges, box " << box[0];
+    ostringstream detail;
+    detail << setprecision(3) << "alpha " << ewald.GetAlpha() << ", r "
+           << ewald.RealTableStart() << " to " << ewald.RealCutoff()
+           << ", tol " << tol << ", errors " << err_e << " " << err_f;
+    Report(name.str(), err_e < tol && err_f < tol, detail.str());
+  }
+
+}
+
+int main(int argc, char * argv[]) {
+  if (argc > 1) {
+    cerr << "  Usage: plum_check" << endl;
+    exit(1);
+  }
+  Check check;
+  check.Simd();
+  check.Pme();
+  check.BeadRepl();
+  check.Table();
+
+  if (check.Failed() > 0) {
+    cout << "\n  " << check.Failed() << " checks failed." << endl;
+    return 1;
+  }
+  cout << "\n  All checks passed." << endl;
+  return 0;
+
+}
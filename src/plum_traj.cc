@@ -0,0 +1,168 @@
+/** plum_traj converts between the .xyz trajectories of Plum and its binary
+    .trj trajectories, see utilities/trajectory.h.
+
+      plum_traj info   <in.trj>
+      plum_traj to-xyz <in.trj> <out.xyz>
+      plum_traj to-trj <in.xyz> <out.trj> <box x> <box y> <box z>
+                       [float | fixed <precision>]
+
+    The .xyz files do not hold the box, so it is given to to-trj. */
+
+#include <stdlib.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "utilities/trajectory.h"
+
+using namespace std;
+
+void Usage() {
+  cout << "  Usage: plum_traj info   <in.trj>" << endl;
+  cout << "         plum_traj to-xyz <in.trj> <out.xyz>" << endl;
+  cout << "         plum_traj to-trj <in.xyz> <out.trj> <box x> <box y> "
+       << "<box z>" << endl;
+  cout << "                          [float | fixed <precision>]" << endl;
+  exit(1);
+
+}
+
+void Info(string in_name) {
+  TrajectoryReader reader;
+  if (!reader.Open(in_name)) {
+    cout << "  Error: " << in_name << " is not a trajectory file!" << endl;
+    exit(1);
+  }
+  const double* box = reader.Box();
+  cout << "  Box (ul)        : " << box[0] << " " << box[1] << " " << box[2]
+       << endl;
+  cout << "  Coordinates     : ";
+  if (reader.Mode() == kTrajFloat)  cout << "float" << endl;
+  else  cout << "fixed, precision " << reader.Precision() << " ul" << endl;
+  cout << "  Bead types      :";
+  for (size_t i = 0; i < reader.Symbols().size(); i++)
+    cout << " " << reader.Symbols()[i];
+  cout << endl;
+  cout << "  Frames          : " << reader.NumFrames() << endl;
+  if (reader.NumFrames() > 0) {
+    int last = reader.NumFrames() - 1;
+    cout << "  Steps           : " << reader.Step(0) << " to "
+         << reader.Step(last) << endl;
+    cout << "  Beads (last)    : " << reader.NumBeads(last) << endl;
+  }
+
+}
+
+void ToXyz(string in_name, string out_name) {
+  TrajectoryReader reader;
+  if (!reader.Open(in_name)) {
+    cout << "  Error: " << in_name << " is not a trajectory file!" << endl;
+    exit(1);
+  }
+  ofstream out(out_name.c_str());
+  const vector<string>& symbols = reader.Symbols();
+  vector<double> crd;
+  for (int f = 0; f < reader.NumFrames(); f++) {
+    int n = reader.NumBeads(f);
+    const unsigned short* types = reader.Types(f);
+    reader.ReadCoordinates(f, crd);
+    out << n << '\n';
+    out << "STEP: " << reader.Step(f) << '\n';
+    for (int i = 0; i < n; i++) {
+      out << symbols[types[i]] << " " << crd[3*i] << " " << crd[3*i+1] << " "
+          << crd[3*i+2] << '\n';
+    }
+  }
+  cout << "  Wrote " << reader.NumFrames() << " frames to " << out_name << "."
+       << endl;
+
+}
+
+void ToTrj(string in_name, string out_name, double box[3], int mode,
+           double precision) {
+  ifstream in(in_name.c_str());
+  if (!in) {
+    cout << "  Error: Cannot open " << in_name << "!" << endl;
+    exit(1);
+  }
+  // First pass for the bead type symbols, in the order they appear.
+  vector<string> symbols;
+  map<string, int> ids;
+  string label, symbol;
+  int n;
+  long step;
+  double x, y, z;
+  while (in >> n >> label >> step) {
+    for (int i = 0; i < n; i++) {
+      in >> symbol >> x >> y >> z;
+      if (ids.find(symbol) == ids.end()) {
+        ids[symbol] = (int)symbols.size();
+        symbols.push_back(symbol);
+      }
+    }
+  }
+
+  in.clear();
+  in.seekg(0);
+  TrajectoryWriter writer;
+  writer.Open(out_name, box, symbols, mode, precision, -1);
+  vector<int> types;
+  vector<double> crd;
+  int frames = 0;
+  while (in >> n >> label >> step) {
+    types.resize(n);
+    crd.resize(3*n);
+    for (int i = 0; i < n; i++) {
+      in >> symbol >> crd[3*i] >> crd[3*i+1] >> crd[3*i+2];
+      types[i] = ids[symbol];
+    }
+    if (!in) {
+      cout << "  Warning: The last frame of " << in_name << " is incomplete"
+           << endl
+           << "           and is skipped." << endl;
+      break;
+    }
+    writer.WriteFrame(step, n, n > 0 ? &types[0] : NULL,
+                      n > 0 ? &crd[0] : NULL);
+    frames++;
+  }
+  writer.Close();
+  cout << "  Wrote " << frames << " frames to " << out_name << "." << endl;
+
+}
+
+int main(int argc, char * argv[]) {
+  if (argc < 3)  Usage();
+  string command = argv[1];
+
+  if (command == "info" && argc == 3) {
+    Info(argv[2]);
+  }
+  else if (command == "to-xyz" && argc == 4) {
+    ToXyz(argv[2], argv[3]);
+  }
+  else if (command == "to-trj" && argc >= 7) {
+    double box[3] = {atof(argv[4]), atof(argv[5]), atof(argv[6])};
+    int mode = kTrajFloat;
+    double precision = 0;
+    if (argc == 8 && string(argv[7]) == "float") {
+      mode = kTrajFloat;
+    }
+    else if (argc == 9 && string(argv[7]) == "fixed") {
+      mode = kTrajFixed;
+      precision = atof(argv[8]);
+    }
+    else if (argc != 7) {
+      Usage();
+    }
+    ToTrj(argv[2], argv[3], box, mode, precision);
+  }
+  else {
+    Usage();
+  }
+
+  return 0;
+
+}
@@ -0,0 +1,58 @@
+#include "simulation.h"
+
+#include <cmath>
+
+// A pass moves the molecules of the active domains of one color, see
+// ForceField::SortIntoDomains. Within a domain the molecule and the move type
+// are picked as in TranslationalMove, from the molecules that lie entirely in
+// the domain, and a move that takes a bead out of the domain is rejected. The
+// lists do not change during the pass, so the pick is the same for the
+// forward and the reverse move and detailed balance holds. Every domain draws
+// from its own stream of a seed drawn from rand_gen.
+void Simulation::CheckerboardMove() {
+  int n_active = force_field.SortIntoDomains(mols, phantom, rand_gen,
+                                             domain_chains, domain_ions);
+  pass_seed = rand_gen();
+  domain_accepted.assign(n_active*kNoMoveType, 0);
+  domain_attempted.assign(n_active*kNoMoveType, 0);
+
+  force_field.Pool().Run(n_active, [this](int a, int thread) {
+    DomainMoves(a, thread);
+  });
+  force_field.CommitParallelMoves();
+
+  for (int a = 0; a < n_active; a++) {
+    for (int i = 0; i < kNoMoveType; i++) {
+      accepted[i] += domain_accepted[a*kNoMoveType + i];
+      attempted[i] += domain_attempted[a*kNoMoveType + i];
+    }
+  }
+
+}
+
+void Simulation::DomainMoves(int active, int thread) {
+  RandomGenerator gen(pass_seed, active);
+  vector<int>& chains = domain_chains[active];
+  vector<int>& ions = domain_ions[active];
+
+  for (int n = 0; n < checkerboard_moves; n++) {
+    int move_type = PickMoveType(gen);
+    vector<int>& list = (move_type == 0 ? ions : chains);
+    if (list.empty())  continue;
+    int mol_id = list[gen() % list.size()];
+
+    TrialMove(mol_id, move_type, gen);
+    domain_attempted[active*kNoMoveType + move_type]++;
+    double dE = force_field.ParallelEnergyDifference(mols, mol_id, active,
+                                                     thread);
+    bool accept = false;
+    if (dE < kVeryLargeEnergy)
+      accept = (gen.Uniform() < exp(-beta*dE));
+
+    force_field.ParallelFinalize(mols, mol_id, accept, active, thread);
+    EndMove(mol_id, accept);
+    if (accept)  domain_accepted[active*kNoMoveType + move_type]++;
+  }
+
+}
+
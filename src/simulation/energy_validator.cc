@@ -0,0 +1,155 @@
+#include "energy_validator.h"
+
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+const char * kCheckedPotentials[4] = {"Pair", "Ewald", "Bond", "Ext"};
+
+EnergyValidator::EnergyValidator() {
+  pending = false;
+  stop = false;
+  snapshot_step = 0;
+  n_checks = 0;
+  n_skipped = 0;
+  for (int i = 0; i < 4; i++) {
+    running[i] = 0;
+    used[i] = false;
+    max_drift[i] = 0;
+    max_drift_energy[i] = 0;
+  }
+
+}
+
+EnergyValidator::~EnergyValidator() {
+  Stop();
+
+}
+
+// The force field reports its parameters again, which the output of the
+// simulation already holds, so they are dropped.
+void EnergyValidator::Start(string input, double beta, int npbc,
+                            double box_l[3], vector<Molecule>& mols,
+                            int phantom, int coion, int grafted,
+                            int grafted_counterion, string check_name,
+                            bool append) {
+  streambuf * cin_buf = cin.rdbuf();
+  streambuf * cout_buf = cout.rdbuf();
+  istringstream ff_in(input);
+  ostringstream ff_log;
+  cin.rdbuf(ff_in.rdbuf());
+  cout.rdbuf(ff_log.rdbuf());
+  force_field.reset(new ForceField());
+  force_field->Initialize(beta, npbc, box_l, mols, phantom, coion, grafted,
+                          grafted_counterion, true);
+  cin.rdbuf(cin_buf);
+  cout.rdbuf(cout_buf);
+
+  used[0] = force_field->UsePairPot();
+  used[1] = force_field->UseEwaldPot();
+  used[2] = force_field->UseBondPot();
+  used[3] = force_field->UseExtPot();
+  check_out.open(check_name.c_str(), append ? ios::app : ios::out);
+  if (!append) {
+    check_out << "#Step";
+    for (int i = 0; i < 4; i++) {
+      if (used[i])
+        check_out << " " << kCheckedPotentials[i] << "Ene d"
+                  << kCheckedPotentials[i] << "Ene";
+    }
+    check_out << endl;
+  }
+  worker = thread(&EnergyValidator::WorkerLoop, this);
+
+}
+
+// The worker only reads the snapshot while pending is set, so it can be
+// filled without the lock once pending was seen unset.
+bool EnergyValidator::Check(long step, vector<Molecule>& mols,
+                            ForceField& sim_force_field) {
+  {
+    unique_lock<mutex> guard(lock);
+    if (pending) {
+      n_skipped++;
+      return false;
+    }
+  }
+  snapshot = mols;
+  snapshot_step = step;
+  running[0] = used[0] ? sim_force_field.TotPairEnergy() : 0;
+  running[1] = used[1] ? sim_force_field.TotEwaldEnergy() : 0;
+  running[2] = used[2] ? sim_force_field.TotBondEnergy() : 0;
+  running[3] = used[3] ? sim_force_field.TotExtEnergy() : 0;
+  {
+    unique_lock<mutex> guard(lock);
+    pending = true;
+  }
+  posted.notify_one();
+  return true;
+
+}
+
+void EnergyValidator::Stop() {
+  if (!worker.joinable())  return;
+  {
+    unique_lock<mutex> guard(lock);
+    stop = true;
+  }
+  posted.notify_one();
+  worker.join();
+  check_out.close();
+
+}
+
+void EnergyValidator::PrintSummary(ostream& out) {
+  out << "\n  Energy checks: " << n_checks << " done, " << n_skipped
+      << " skipped while the previous check was running." << endl;
+  for (int i = 0; i < 4; i++) {
+    if (!used[i] || n_checks == 0)  continue;
+    out << "    Largest " << kCheckedPotentials[i] << " energy drift: "
+        << max_drift[i];
+    if (max_drift_energy[i] != 0)
+      out << " (relative " << abs(max_drift[i] / max_drift_energy[i]) << ")";
+    out << endl;
+  }
+
+}
+
+// A posted check is finished before the worker stops.
+void EnergyValidator::WorkerLoop() {
+  while (true) {
+    {
+      unique_lock<mutex> guard(lock);
+      posted.wait(guard, [this] { return stop || pending; });
+      if (!pending)  return;
+    }
+    force_field->ReplaceSystem(snapshot);
+    double recomputed[4] = {0, 0, 0, 0};
+    if (used[0])  recomputed[0] = force_field->TotPairEnergy();
+    if (used[1])  recomputed[1] = force_field->TotEwaldEnergy();
+    if (used[2])  recomputed[2] = force_field->TotBondEnergy();
+    if (used[3])  recomputed[3] = force_field->TotExtEnergy();
+
+    check_out << snapshot_step;
+    for (int i = 0; i < 4; i++) {
+      if (!used[i])  continue;
+      double drift = running[i] - recomputed[i];
+      check_out << " " << setprecision(12) << running[i] << " "
+                << setprecision(4) << drift;
+      if (abs(drift) > abs(max_drift[i]) || n_checks == 0) {
+        max_drift[i] = drift;
+        max_drift_energy[i] = recomputed[i];
+      }
+    }
+    check_out << '\n';
+    n_checks++;
+    {
+      unique_lock<mutex> guard(lock);
+      pending = false;
+    }
+  }
+
+}
+
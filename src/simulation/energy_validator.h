@@ -0,0 +1,75 @@
+#ifndef SRC_SIMULATION_ENERGY_VALIDATOR_H_
+#define SRC_SIMULATION_ENERGY_VALIDATOR_H_
+
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../force_field/force_field.h"
+#include "../molecules/molecule.h"
+
+using namespace std;
+
+/** Checks the running energy totals of a force field, which are kept up to
+    date by the incremental updates of every move, against the energies
+    computed from scratch. A check copies the molecules and the totals, and
+    the energies of the copy are then computed on a thread of its own, by a
+    second force field built from the same input, while the simulation goes
+    on. A check that is due while the previous one still runs is skipped, so
+    the simulation never waits for it. Every check writes the totals and their
+    drift, running minus recomputed, as a line of the check file. */
+class EnergyValidator {
+ private:
+  /** The force field the energies are recomputed with, made by Start, as a
+      force field cannot be destroyed before it is initialized. */
+  unique_ptr<ForceField> force_field;
+  thread worker;
+  mutex lock;
+  /** Signals the worker that a check is posted or that it should stop. */
+  condition_variable posted;
+  bool pending;
+  bool stop;
+
+  /** The copy of the molecules, the step and the running totals of the
+      pair, Ewald, bond and external potentials of the posted check. */
+  vector<Molecule> snapshot;
+  long snapshot_step;
+  double running[4];
+  /** Which of the four potentials are used. */
+  bool used[4];
+
+  ofstream check_out;
+  long n_checks;
+  long n_skipped;
+  /** The largest drift of each potential, and the recomputed energy it was
+      found at. */
+  double max_drift[4];
+  double max_drift_energy[4];
+
+  void WorkerLoop();
+
+ public:
+  EnergyValidator();
+  ~EnergyValidator();
+  /** Build the force field from the force field part of the input, with the
+      arguments of ForceField::Initialize, open the check file, appending to
+      it if the last argument is true, and start the thread. */
+  void Start(string, double, int, double[3], vector<Molecule>&, int, int, int,
+             int, string, bool);
+  /** Post a check of the current molecules and running totals at the given
+      step. Returns false if the previous check still runs. */
+  bool Check(long, vector<Molecule>&, ForceField&);
+  /** Finish the running check and stop the thread. */
+  void Stop();
+  /** Print the number of checks and the largest drift of each potential. */
+  void PrintSummary(ostream&);
+
+};
+
+#endif
+
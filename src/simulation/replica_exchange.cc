@@ -0,0 +1,195 @@
+#include "replica_exchange.h"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+// Returns the input with the lines that start with one of the flags carrying
+// the value of replica k instead, and counts the replaced lines of every flag.
+string ReplicaInput(const string& input, const vector<string>& flags,
+                    const vector<vector<string> >& values, int k,
+                    vector<int>& replaced) {
+  istringstream input_in(input);
+  ostringstream replica_in;
+  replaced.assign(flags.size(), 0);
+  string line;
+  while (getline(input_in, line)) {
+    istringstream words(line);
+    string flag;
+    words >> flag;
+    for (int i = 0; i < (int)flags.size(); i++) {
+      if (flag == flags[i]) {
+        line = flag + " " + values[i][k];
+        replaced[i]++;
+      }
+    }
+    replica_in << line << '\n';
+  }
+  return replica_in.str();
+
+}
+
+ReplicaExchange::ReplicaExchange(string replica_name) {
+  cout << "  Replica exchange parameters." << endl;
+  ifstream replica_in(replica_name.c_str());
+  if (!replica_in) {
+    cout << "  Cannot open replica file " << replica_name << ". Exiting! "
+         << "Program complete." << endl;
+    exit(1);
+  }
+  swap_freq = 0;
+  vector<string> flags;
+  vector<vector<string> > values;
+  string line;
+  while (getline(replica_in, line)) {
+    istringstream words(line);
+    string flag, value;
+    if (!(words >> flag))  continue;
+    vector<string> list;
+    while (words >> value)  list.push_back(value);
+    if (flag == "s0_replica_swap_frequency") {
+      if (!list.empty())  swap_freq = atol(list[0].c_str());
+    }
+    else {
+      flags.push_back(flag);
+      values.push_back(list);
+    }
+  }
+  int n_replicas = values.empty() ? 0 : (int)values[0].size();
+  for (int i = 0; i < (int)values.size(); i++) {
+    if ((int)values[i].size() != n_replicas) {
+      cout << "  " << flags[i] << " does not list a value for every replica. "
+           << "Exiting! Program complete." << endl;
+      exit(1);
+    }
+  }
+  if (n_replicas < 2 || swap_freq <= 0) {
+    cout << "  A replica exchange run needs at least two replicas and a "
+         << "positive swap frequency. Exiting! Program complete." << endl;
+    exit(1);
+  }
+  cout << setw(35) << "Number of replicas          : " << n_replicas << endl;
+  cout << setw(35) << "Swap frequency              : " << swap_freq << endl;
+  for (int i = 0; i < (int)flags.size(); i++) {
+    cout << "  " << flags[i] << " :";
+    for (int k = 0; k < n_replicas; k++)
+      cout << " " << values[i][k];
+    cout << endl;
+  }
+
+  // Every replica reads its own copy of the input from cin, one after the
+  // other, so that all bead types are registered before the threads start.
+  ostringstream input;
+  input << cin.rdbuf();
+  streambuf * cin_buf = cin.rdbuf();
+  for (int k = 0; k < n_replicas; k++) {
+    vector<int> replaced;
+    istringstream replica_input(ReplicaInput(input.str(), flags, values, k,
+                                             replaced));
+    for (int i = 0; i < (int)flags.size(); i++) {
+      if (replaced[i] == 0) {
+        cout << "  " << flags[i] << " is not a flag of the input file. "
+             << "Exiting! Program complete." << endl;
+        exit(1);
+      }
+    }
+    cout << "\n  Replica " << k << "." << endl;
+    cin.rdbuf(replica_input.rdbuf());
+    ostringstream suffix;
+    suffix << "_r" << k;
+    replicas.emplace_back(new Simulation("", false, suffix.str()));
+  }
+  cin.rdbuf(cin_buf);
+  for (int k = 1; k < n_replicas; k++) {
+    if (replicas[k]->Steps() != replicas[0]->Steps()) {
+      cout << "  The replicas must run the same number of steps. Exiting! "
+           << "Program complete." << endl;
+      exit(1);
+    }
+  }
+
+  // Replica k draws from stream k of the seed of the first replica, which is
+  // the one of the input or the clock, and the swaps from the stream after
+  // the last replica.
+  unsigned long s = replicas[0]->Seed();
+  rand_gen.seed(s, n_replicas);
+  cout << "\n  The replica exchange random number seed is: " << s << endl;
+  for (int k = 0; k < n_replicas; k++)
+    replicas[k]->Seed(s, k);
+
+  rounds = 0;
+  swap_attempted.assign(n_replicas-1, 0);
+  swap_accepted.assign(n_replicas-1, 0);
+  pool.Start(n_replicas);
+  for (int k = 0; k+1 < n_replicas; k++) {
+    if (!replicas[k]->SameEwaldSums(*replicas[k+1])) {
+      cout << "  Note: The Ewald cutoffs of replicas " << k << " and " << k+1
+           << " differ, their swaps" << endl;
+      cout << "        recompute the Ewald energies." << endl;
+    }
+  }
+
+  string run_name = replicas[0]->RunName();
+  run_name.erase(run_name.size() - 3);
+  log_out.open((run_name + "_replica.dat").c_str());
+  log_out << "# step replica_i replica_j delta accepted" << endl;
+
+}
+
+ReplicaExchange::~ReplicaExchange() {
+  cout << "\n  Replica exchange acceptance:" << endl;
+  for (int i = 0; i < (int)swap_attempted.size(); i++) {
+    cout << "    " << i << " <-> " << i+1 << " : " << swap_accepted[i]
+         << " / " << swap_attempted[i];
+    if (swap_attempted[i] > 0)
+      cout << " (" << (double)swap_accepted[i]/swap_attempted[i] << ")";
+    cout << endl;
+  }
+  log_out.close();
+
+}
+
+void ReplicaExchange::Run() {
+  int n_replicas = (int)replicas.size();
+  long steps = replicas[0]->Steps();
+  long step = replicas[0]->Step();
+
+  while (step < steps) {
+    long next = min(step + swap_freq, steps);
+    pool.Run(n_replicas, [this, next](int k, int t) {
+      replicas[k]->Run(next);
+    });
+    step = next;
+    if (step < steps) {
+      for (int i = rounds % 2; i+1 < n_replicas; i += 2)
+        AttemptSwap(i);
+      rounds++;
+    }
+  }
+
+}
+
+// Swapping the configurations x_i and x_j is accepted with probability
+// min(1, exp(-delta)), where delta = u_i(x_j) + u_j(x_i) - u_i(x_i) - u_j(x_j)
+// and u is the reduced energy, see Simulation::ReducedEnergy.
+void ReplicaExchange::AttemptSwap(int i) {
+  Simulation& a = *replicas[i];
+  Simulation& b = *replicas[i+1];
+  double delta = a.ReducedEnergy(b) + b.ReducedEnergy(a) -
+                 a.ReducedEnergy(a) - b.ReducedEnergy(b);
+  bool accept = (delta <= 0 || rand_gen.Uniform() < exp(-delta));
+  swap_attempted[i]++;
+  if (accept) {
+    a.SwapSystem(b);
+    swap_accepted[i]++;
+  }
+  log_out << a.Step() << " " << i << " " << i+1 << " " << delta << " "
+          << accept << '\n';
+
+}
+
@@ -0,0 +1,65 @@
+/** The ReplicaExchange object runs several Simulation replicas side by side,
+    each with its own beta, Bjerrum length or chemical potential, and swaps
+    the configurations of neighboring replicas now and then (parallel
+    tempering). The replicas at the easy end help the ones at the hard end
+    out of the states they get stuck in.
+*/
+
+#ifndef SRC_SIMULATION_REPLICA_EXCHANGE_H_
+#define SRC_SIMULATION_REPLICA_EXCHANGE_H_
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../utilities/random_generator.h"
+#include "../utilities/thread_pool.h"
+#include "simulation.h"
+
+using namespace std;
+
+class ReplicaExchange {
+ private:
+  /** The replicas, in the order of the parameter sets. Only neighbors are
+      swapped. */
+  vector<unique_ptr<Simulation> > replicas;
+  /** The number of steps between two rounds of swap attempts. */
+  long swap_freq;
+  /** Number of rounds of swap attempts so far. Rounds alternate between the
+      pairs (0,1), (2,3), ... and the pairs (1,2), (3,4), ... */
+  long rounds;
+  /** Attempted and accepted swaps of replica i with replica i+1. */
+  vector<long> swap_attempted;
+  vector<long> swap_accepted;
+  /** Runs every replica on its own thread. */
+  ThreadPool pool;
+  /** Decides the swaps. */
+  RandomGenerator rand_gen;
+  /** The log of all swap attempts. */
+  ofstream log_out;
+
+  /** Attempt to swap replicas i and i+1, and log the attempt. */
+  void AttemptSwap(int);
+
+ public:
+  /** Constructor. The argument is the replica file. Its lines are
+        s0_replica_swap_frequency  <steps>
+      and any number of
+        <flag>  <value for replica 0>  <value for replica 1>  ...
+      where flag is one of the flags of the input file read from the
+      standard input, and replica k runs with the input whose lines that
+      start with flag carry the k-th value instead. All such lines must list
+      the same number of values, which is the number of replicas. Only beta,
+      the Bjerrum length and the chemical potential may differ between
+      replicas, the swap criterion assumes all else to be the same. */
+  ReplicaExchange(string);
+  /** Destructor. Prints the swap acceptance of every pair of neighbors. */
+  ~ReplicaExchange();
+  /** Run all replicas to their last step. */
+  void Run();
+
+};
+
+#endif
+
@@ -1,26 +1,33 @@
 #include "simulation.h" 
 
 #include <stdlib.h>
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
 #include <cmath>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <map>
-#include <random>
+#include <memory>
 #include <set> 
 #include <sstream>
 #include <string>
 #include <vector> 
 
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "../force_field/force_field.h"
 #include "../molecules/bead.h"
 #include "../molecules/molecule.h"
+#include "../utilities/binary_io.h"
 #include "../utilities/constants.h"
+#include "../utilities/misc.h"
 
 using namespace std; 
 
-Simulation::Simulation() {
+Simulation::Simulation(string restart_name, bool rebuild, string suffix) {
   cout << "  General simulation parameters." << endl;
   string flag;
 
@@ -30,11 +37,19 @@ Simulation::Simulation() {
   cin >> flag >> crd_name;
   cin >> flag >> top_name;
   cin >> flag >> run_name;
+  run_name += suffix;
   cin >> flag >> steps;
   cin >> flag >> steps_eq;
   cin >> flag >> sample_freq;
   cin >> flag >> stat_out_freq;
   cin >> flag >> traj_out_freq;
+  // The keys read with ReadOptional were added later on and can be left out.
+  traj_format = "xyz";
+  traj_precision = 0.001;
+  checkpoint_freq = 0;
+  ReadOptional(cin, "s1_trajectory_format", traj_format);
+  ReadOptional(cin, "s1_trajectory_precision_ul", traj_precision);
+  ReadOptional(cin, "s1_checkpoint_frequency", checkpoint_freq);
   cin >> flag >> npbc;
   cin >> flag >> beta;
   cin >> flag >> move_size;
@@ -48,6 +63,16 @@ Simulation::Simulation() {
   cin >> flag >> move_prob[2];
   cin >> flag >> move_prob[3];
   cin >> flag >> move_prob[4];
+  checkerboard_moves = 0;
+  checkerboard_width = 0;
+  seed = 0;
+  hot_path_timing = 0;
+  energy_check_freq = 0;
+  ReadOptional(cin, "s1_checkerboard_moves", checkerboard_moves);
+  ReadOptional(cin, "s1_checkerboard_domain_ul", checkerboard_width);
+  ReadOptional(cin, "s1_random_seed", seed);
+  ReadOptional(cin, "s1_hot_path_timing", hot_path_timing);
+  ReadOptional(cin, "s1_energy_check_frequency", energy_check_freq);
 
   cout << setw(35) << "Input coordinate file       : " << crd_name      << endl;
   cout << setw(35) << "Input topology file         : " << top_name      << endl;
@@ -57,6 +82,19 @@ Simulation::Simulation() {
   cout << setw(35) << "Sampling frequency          : " << sample_freq   << endl;
   cout << setw(35) << "Statistics output frequency : " << stat_out_freq << endl;
   cout << setw(35) << "Trajectory output frequency : " << traj_out_freq << endl;
+  cout << setw(35) << "Trajectory format           : " << traj_format   << endl;
+  if (traj_format == "fixed") {
+    cout << setw(35) << "Trajectory precision (ul)   : " << traj_precision
+                                                         << endl;
+  }
+  if (traj_format != "xyz" && traj_format != "float" &&
+      traj_format != "fixed") {
+    cout << "  Error: Unknown trajectory format, use xyz, float or fixed!"
+         << endl;
+    exit(1);
+  }
+  cout << setw(35) << "Checkpoint frequency        : " << checkpoint_freq
+                                                       << endl;
   cout << setw(35) << "Number of dimension of PBC  : " << npbc          << endl;
   cout << setw(35) << "MC move size (ul)           : " << move_size     << endl;
   cout << setw(35) << "beta (1/kBT)                : " << beta          << endl;
@@ -69,6 +107,19 @@ Simulation::Simulation() {
   cout << setw(35) << "p(pol pivot move)           : " << move_prob[2]  << endl;
   cout << setw(35) << "p(pol crankshaft move)      : " << move_prob[3]  << endl;
   cout << setw(35) << "p(pol random reptation move): " << move_prob[4]  << endl;
+  cout << setw(35) << "Checkerboard moves / domain : " << checkerboard_moves
+                                                       << endl;
+  if (checkerboard_moves > 0) {
+    // Four bead move lengths by default, see Molecule::BeadTranslate.
+    if (checkerboard_width <= 0)  checkerboard_width = 4*3*move_size;
+    cout << setw(35) << "Checkerboard domain (ul)    : " << checkerboard_width
+                                                         << endl;
+  }
+  cout << setw(35) << "Random number seed (0: time): " << seed          << endl;
+  cout << setw(35) << "Hot path timing (0, 1, 2)   : " << hot_path_timing
+                                                       << endl;
+  cout << setw(35) << "Energy check frequency      : " << energy_check_freq
+                                                       << endl;
 
   // Set up variables for simulation statistics.
   step = 0;
@@ -100,13 +151,37 @@ Simulation::Simulation() {
   insertion_attempted = 0;
   deletion_attempted = 0;
 
-  // Read bead connectivity info and initialize bead/molecule numbers.
-  ReadTop();
-  // Read coordinates.
-  ReadCrd();
-  // Set up ForceField object.
+  bool restart = (restart_name != "");
+  if (restart) {
+    chk_in.open(restart_name.c_str(), ios::binary);
+    if (!chk_in) {
+      cout << "  Cannot open checkpoint " << restart_name << ". Exiting! "
+           << "Program complete." << endl;
+      exit(1);
+    }
+    ReadCheckpointSystem();
+  }
+  else {
+    // Read bead connectivity info and initialize bead/molecule numbers.
+    ReadTop();
+    // Read coordinates.
+    ReadCrd();
+  }
+  // Set up ForceField object. On restart, the energies are read from the
+  // checkpoint later on. The energy checks build their force field from the
+  // same input, so it is kept.
+  string ff_input;
+  if (energy_check_freq > 0) {
+    ostringstream rest;
+    rest << cin.rdbuf();
+    ff_input = rest.str();
+  }
+  streambuf * cin_buf = cin.rdbuf();
+  istringstream ff_in(ff_input);
+  if (energy_check_freq > 0)  cin.rdbuf(ff_in.rdbuf());
   force_field.Initialize(beta, npbc, box_l, mols, phantom, coion, grafted,
-                         grafted_counterion);
+                         grafted_counterion, !restart);
+  cin.rdbuf(cin_buf);
 
   // Densities.
   density_cumu = 0;
@@ -122,23 +197,69 @@ Simulation::Simulation() {
   string traj_c_out_name = run_name + "_traj_c.xyz";
   string traj_a_out_name = run_name + "_traj_a.xyz";
   string traj_n_out_name = run_name + "_traj_n.xyz";
-  info_out.open(info_out_name.c_str());
-  traj_p_out.open(traj_p_out_name.c_str());
-  traj_c_out.open(traj_c_out_name.c_str());
-  traj_a_out.open(traj_a_out_name.c_str());
-  traj_n_out.open(traj_n_out_name.c_str());
+  // A restarted run continues the output files of the original run, from
+  // where they were at its checkpoint. The files are opened at their end, so
+  // that tellp gives their size, see WriteCheckpoint.
+  ios_base::openmode mode = restart ? ios::app | ios::ate : ios::out;
+  if (restart) {
+    TruncateOutput(info_out_name, output_end[0]);
+    TruncateOutput(traj_p_out_name, output_end[1]);
+    TruncateOutput(traj_c_out_name, output_end[2]);
+    TruncateOutput(traj_a_out_name, output_end[3]);
+    TruncateOutput(traj_n_out_name, output_end[4]);
+  }
+  // Large buffers, so that the output thread writes in big chunks.
+  for (int i = 0; i < 10; i++) {
+    out_buf[i].resize(kOutputBufferSize);
+  }
+  info_out.rdbuf()->pubsetbuf(&out_buf[0][0], kOutputBufferSize);
+  traj_p_out.rdbuf()->pubsetbuf(&out_buf[1][0], kOutputBufferSize);
+  traj_c_out.rdbuf()->pubsetbuf(&out_buf[2][0], kOutputBufferSize);
+  traj_a_out.rdbuf()->pubsetbuf(&out_buf[3][0], kOutputBufferSize);
+  traj_n_out.rdbuf()->pubsetbuf(&out_buf[4][0], kOutputBufferSize);
+  info_out.open(info_out_name.c_str(), mode);
+  if (traj_format == "xyz") {
+    traj_p_out.open(traj_p_out_name.c_str(), mode);
+    traj_c_out.open(traj_c_out_name.c_str(), mode);
+    traj_a_out.open(traj_a_out_name.c_str(), mode);
+    traj_n_out.open(traj_n_out_name.c_str(), mode);
+  }
+  else {
+    // The type indices of the frames are the bead type IDs.
+    vector<string> symbols;
+    for (int i = 0; i < NumBeadTypes(); i++)
+      symbols.push_back(BeadTypeSymbol(i));
+    string species[4] = {"p", "c", "a", "n"};
+    int coding = traj_format == "fixed" ? kTrajFixed : kTrajFloat;
+    for (int i = 0; i < 4; i++) {
+      traj_bin[i].Open(run_name + "_traj_" + species[i] + ".trj", box_l,
+                       symbols, coding, traj_precision,
+                       restart ? output_end[5+i] : -1);
+    }
+  }
   // Print header for output statistics file.
-  PrintStatHeader();
+  if (!restart)  PrintStatHeader();
+  writer.Start(kOutputQueueSize);
 
-  // Initialize random number generator using time.
-  unsigned s = chrono::system_clock::now().time_since_epoch().count();
-  rand_gen.seed(s);
-  cout << "  The random number seed is: " << s << endl;
+  if (restart) {
+    ReadCheckpointState(rebuild);
+    cout << "  Restarted from " << restart_name << " at step " << step
+         << "." << endl;
+  }
+  else {
+    // Initialize random number generator using time, unless the input sets
+    // the seed.
+    if (seed == 0)
+      seed = chrono::system_clock::now().time_since_epoch().count();
+    rand_gen.seed(seed);
+    cout << "  The random number seed is: " << seed << endl;
+  }
 
   ///////////////////
   // A few checks. //
   ///////////////////
   UpdateMolCounts();
+  BuildMolLists();
   if (beta <= 0) {
     cout << "  " << beta << " is not an acceptable beta value. Exiting! "
          << "Program complete." << endl;
@@ -184,6 +305,14 @@ Simulation::Simulation() {
          << "the same time. Exiting! Program complete." << endl;
     exit(1);
   }
+  if (checkerboard_moves > 0) {
+    if (force_field.InitCheckerboard(checkerboard_width) == 0) {
+      cout << "  Checkerboard moves need a short-ranged force field without "
+           << "Ewald sum and GC, and a box at least two domains long along "
+           << "a periodic dimension. Exiting! Program complete." << endl;
+      exit(1);
+    }
+  }
   if (calc_chem_pot && force_field.UseGC()) {
     cout << "  ERROR: Chemical potential cannot be calculate when GCMC" << endl;
     cout << "         is used. Exiting. Program complete." << endl;
@@ -198,117 +327,119 @@ Simulation::Simulation() {
     cout << "        input coordiante file." << endl;
   }
 
+  if (energy_check_freq > 0) {
+    validator.Start(ff_input, beta, npbc, box_l, mols, phantom, coion, grafted,
+                    grafted_counterion, run_name + "_energy_check.dat",
+                    restart);
+  }
+
+  // The timed wall time starts here, after the setup.
+  force_field.HotPathTiming().Enable(hot_path_timing > 0);
+
 }
 
 Simulation::~Simulation() {
   PrintLastCrd();
   PrintLastTop();
+  writer.Stop();
+  cout << "  Output writes: " << writer.Posted() << ", waits for a full output "
+       << "queue: " << writer.Waits() << " (" << writer.WaitTime() << " s)."
+       << endl;
+  if (writer.Waits() > 0) {
+    cout << "  Note: The simulation had to wait for the output files. Consider"
+         << endl;
+    cout << "        writing trajectories and statistics less often." << endl;
+  }
+  if (hot_path_timing > 0)  force_field.HotPathTiming().PrintSummary(cout);
+  if (energy_check_freq > 0) {
+    validator.Stop();
+    validator.PrintSummary(cout);
+  }
   info_out.close();
   traj_p_out.close();
   traj_c_out.close();
   traj_a_out.close();
   traj_n_out.close();
+  for (int i = 0; i < 4; i++)
+    traj_bin[i].Close();
   delete [] density_z_cumu;
   cout << "\n  Simulation complete." << endl;
 
 }
 
 void Simulation::Run() {
+  Run(steps);
+
+}
+
+void Simulation::Run(long last) {
   int gc_freq = force_field.GCFrequency();
+  Timing& timing = force_field.HotPathTiming();
   UpdateMolCounts();
 
-  for (step = 1; step <= steps; step++) {
+  // step is the last step done, which is not 0 for a restarted run.
+  while (step < last) {
+    step++;
     int rand_num = rand_gen();
     // Randomly choose whether to do a GC move.
     if (force_field.UseGC() && (rand_num % gc_freq == 0)) {
       GCMove();
     }
     // If not doing a GC move, do a translational move.
+    else if (checkerboard_moves > 0) {
+      Timing::Clock::time_point start = timing.Start();
+      CheckerboardMove();
+      timing.Stop(kTimeCheckerboard, start);
+    }
     else {
       TranslationalMove();
     }
 
+    if (energy_check_freq > 0 && step % energy_check_freq == 0)
+      validator.Check(step, mols, force_field);
+    Timing::Clock::time_point start = timing.Start();
     Sample();
+    timing.Stop(kTimeSample, start);
+    start = timing.Start();
     PrintStat();
     PrintTraj();
     PrintLastCrd();
     PrintLastTop();
     PrintLastRhoZ();
+    WriteCheckpoint();
+    timing.Stop(kTimeOutput, start);
   }
 
 }
 
 void Simulation::TranslationalMove() {
+  Timing& timing = force_field.HotPathTiming();
+  Timing::Clock::time_point start = timing.Start();
   if (n_mol - phantom > 0) {
     // Pre-choose a chain and an ion.
     int chain_id = -1;
     int ion_id = -1;
     int mol_id = -1;
-    int which_chain = (int)floor((double)rand_gen()/rand_gen.max() *
-                                 (grafted + n_chain));
-    int which_ion   = (int)floor((double)rand_gen()/rand_gen.max() *
+    // Uniform() is below 1, so the indices are in range.
+    int which_chain = (int)floor(rand_gen.Uniform() * (grafted + n_chain));
+    int which_ion   = (int)floor(rand_gen.Uniform() *
                                  (n_cion + n_aion + n_nion));
-    if (which_chain == grafted + n_chain)       which_chain--;
-    if (which_ion == n_cion + n_aion + n_nion)  which_ion--;
-    int chain_choosing_counter = -1;
-    int ion_choosing_counter = -1;
-    for (int i = phantom; i < n_mol; i++) {
-      if (mols[i].Size() > 1)  chain_choosing_counter++;
-      else                     ion_choosing_counter++;
-      if (chain_choosing_counter == which_chain) {
-        chain_id = i;
-        which_chain = -2;
-      }
-      if (ion_choosing_counter == which_ion) {
-        ion_id = i;
-        which_ion = -2;
-      }
-    }
+    if (which_chain >= 0 && which_chain < (int)chain_list.size())
+      chain_id = chain_list[which_chain];
+    if (which_ion >= 0 && which_ion < (int)ion_list.size())
+      ion_id = ion_list[which_ion];
 
-    // Decide move type.
-    int move_type = 0;
-    double rand_num = (double)rand_gen() / rand_gen.max(); 
-    double current_move_type = move_prob[0];
-    while (current_move_type < rand_num) {
-      move_type++;
-      current_move_type += move_prob[move_type];
-    }
-    if (move_type >= kNoMoveType)  move_type = kNoMoveType - 1;
+    int move_type = PickMoveType(rand_gen);
   
     // If choose to move a single bead and there is one.
     if (move_type == 0 && n_cion + n_aion + n_nion > 0) {
       mol_id = ion_id;
-      mols[mol_id].BeadTranslate(move_size, box_l, rand_gen);
+      TrialMove(mol_id, move_type, rand_gen);
     }
     // If choose to move a chain and there is one.
     else if (grafted + n_chain > 0) {
       mol_id = chain_id;
-
-      // Decide bond length.
-      double bond_len = 0;
-      bool vary_bond = false;
-      if (force_field.UseBondRigid())
-        bond_len = force_field.RigidBondLen();
-      // Overwrite rigid bond if bond potential is used.
-      if (force_field.UseBondPot()) {
-        bond_len = force_field.EqBondLen();
-        vary_bond = true;
-      }
-
-      switch (move_type) {
-        case 1:
-          mols[mol_id].COMTranslate(move_size, rand_gen);
-          break;
-        case 2: 
-          mols[mol_id].Pivot(move_size, rand_gen, bond_len, vary_bond);
-          break;
-        case 3:
-          mols[mol_id].Crankshaft(move_size, rand_gen);
-          break;
-        case 4:
-          mols[mol_id].RandomReptation(rand_gen, bond_len, vary_bond);
-          break;
-      }
+      if (move_type > 0)  TrialMove(mol_id, move_type, rand_gen);
     }
 
     // If a move is actually attempted.
@@ -328,33 +459,87 @@ void Simulation::TranslationalMove() {
         accept = false;
       }
       else {
-        accept = ((double)rand_gen() / rand_gen.max() < exp(-beta*dE));
+        accept = (rand_gen.Uniform() < exp(-beta*dE));
       }
 
       force_field.FinalizeEnergies(mols, accept, mol_id);
+      EndMove(mol_id, accept);
+      if (accept)  accepted[move_type]++; 
+      timing.Stop(move_type, start);
+    }
+  }
 
-      // Make trial positions current positions.
-      if (accept) {
-        for (int i = 0; i < mols[mol_id].Size(); i++) {
-          mols[mol_id].bds[i].UpdateCurrentPos();   
-        }
-        accepted[move_type]++; 
-      }
-      // Set trial positions to the current positions.
-      else {
-        for (int i = 0; i < mols[mol_id].Size(); i++) {
-          mols[mol_id].bds[i].UpdateTrialPos();
-        }
-      }
-      for (int i = 0; i < mols[mol_id].Size(); i++) {
-        mols[mol_id].bds[i].UnsetMoved(); 
-      }
+}
+
+int Simulation::PickMoveType(RandomGenerator& gen) {
+  int move_type = 0;
+  double rand_num = gen.Uniform(); 
+  double current_move_type = move_prob[0];
+  while (current_move_type < rand_num) {
+    move_type++;
+    current_move_type += move_prob[move_type];
+  }
+  if (move_type >= kNoMoveType)  move_type = kNoMoveType - 1;
+  return move_type;
+
+}
+
+void Simulation::TrialMove(int mol_id, int move_type, RandomGenerator& gen) {
+  if (move_type == 0) {
+    mols[mol_id].BeadTranslate(move_size, box_l, gen);
+    return;
+  }
+
+  // Decide bond length.
+  double bond_len = 0;
+  bool vary_bond = false;
+  if (force_field.UseBondRigid())
+    bond_len = force_field.RigidBondLen();
+  // Overwrite rigid bond if bond potential is used.
+  if (force_field.UseBondPot()) {
+    bond_len = force_field.EqBondLen();
+    vary_bond = true;
+  }
+
+  switch (move_type) {
+    case 1:
+      mols[mol_id].COMTranslate(move_size, gen);
+      break;
+    case 2: 
+      mols[mol_id].Pivot(move_size, gen, bond_len, vary_bond);
+      break;
+    case 3:
+      mols[mol_id].Crankshaft(move_size, gen);
+      break;
+    case 4:
+      mols[mol_id].RandomReptation(gen, bond_len, vary_bond);
+      break;
+  }
+
+}
+
+void Simulation::EndMove(int mol_id, bool accept) {
+  // Make trial positions current positions.
+  if (accept) {
+    for (int i = 0; i < mols[mol_id].Size(); i++) {
+      mols[mol_id].bds[i].UpdateCurrentPos();   
     }
   }
+  // Set trial positions to the current positions.
+  else {
+    for (int i = 0; i < mols[mol_id].Size(); i++) {
+      mols[mol_id].bds[i].UpdateTrialPos();
+    }
+  }
+  for (int i = 0; i < mols[mol_id].Size(); i++) {
+    mols[mol_id].bds[i].UnsetMoved(); 
+  }
 
 }
 
 void Simulation::GCMove() {
+  Timing& timing = force_field.HotPathTiming();
+  Timing::Clock::time_point start = timing.Start();
   // Choose whether to attempt insertion or deletion.
   bool insert = rand_gen() % 2;
 
@@ -370,6 +555,7 @@ void Simulation::GCMove() {
           mols[i].bds[j].SetChainID(i);
         }
       }
+      AddToMolLists(n_mol);
       force_field.EnergyInitForAddedMolecule(mols);
     }
   }
@@ -391,15 +577,14 @@ void Simulation::GCMove() {
         for (int i = 0; i < mols[deleted_chain].Size(); i++)
           deleted_ions += (int)round(abs(mols[deleted_chain].bds[i].Charge()));
 
-        for (int i = deleted_chain + deleted_ions; i >= deleted_chain; i--) {
-          mols.erase(mols.begin()+i);
-        }
+        RemoveMolecules(deleted_chain, 1 + deleted_ions);
       }
     }
   }
 
   UpdateMolCounts();
   force_field.UpdateMolCounts(mols);
+  timing.Stop(insert ? kTimeInsert : kTimeDelete, start);
 
 }
 
@@ -682,6 +867,238 @@ void Simulation::CoordinateObeyRigidBond(double rigid_bond) {
 
 }
 
+void Simulation::WriteCheckpoint() {
+  if (checkpoint_freq > 0 && (step % checkpoint_freq == 0 || step == steps)) {
+    // Everything the checkpoint counts as done is on disk before it is.
+    writer.Flush();
+    info_out.flush();
+    traj_p_out.flush();
+    traj_c_out.flush();
+    traj_a_out.flush();
+    traj_n_out.flush();
+    for (int i = 0; i < 4; i++)
+      traj_bin[i].Flush();
+
+    string chk_name = run_name + "_checkpoint.bin";
+    string tmp_name = chk_name + ".tmp";
+    chk_out.open(tmp_name.c_str(), ios::binary | ios::trunc);
+
+    WriteBinary(chk_out, string("PLUMCHK"));
+    WriteBinary(chk_out, kCheckpointVersion);
+    // The system.
+    WriteBinary(chk_out, step);
+    WriteBinary(chk_out, box_l, 3);
+    WriteBinary(chk_out, phantom);
+    WriteBinary(chk_out, coion);
+    WriteBinary(chk_out, grafted);
+    WriteBinary(chk_out, grafted_counterion);
+    WriteBinary(chk_out, n_mol);
+    for (int i = 0; i < n_mol; i++) {
+      WriteBinary(chk_out, mols[i].Size());
+      for (int j = 0; j < mols[i].Size(); j++) {
+        Bead& bead = mols[i].bds[j];
+        WriteBinary(chk_out, bead.Symbol());
+        WriteBinary(chk_out, bead.ID());
+        WriteBinary(chk_out, bead.ChainID());
+        WriteBinary(chk_out, bead.Charge());
+        for (int k = 0; k < 3; k++)
+          WriteBinary(chk_out, bead.GetCrd(0, k));
+      }
+      WriteBinary(chk_out, mols[i].bonds);
+      WriteBinary(chk_out, mols[i].angles);
+      WriteBinary(chk_out, mols[i].diheds);
+    }
+    WriteBinary(chk_out, id_counter);
+    WriteBinary(chk_out, vector<int>(id_list.begin(), id_list.end()));
+    // The sizes of the output files.
+    ofstream * text_out[5] = {&info_out, &traj_p_out, &traj_c_out,
+                              &traj_a_out, &traj_n_out};
+    output_end.clear();
+    for (int i = 0; i < 5; i++) {
+      output_end.push_back(text_out[i]->is_open() ?
+                           (long)text_out[i]->tellp() : -1);
+    }
+    for (int i = 0; i < 4; i++) {
+      output_end.push_back(traj_bin[i].IsOpen() ? traj_bin[i].Position() : -1);
+    }
+    WriteBinary(chk_out, output_end);
+    // The random number generator.
+    ostringstream rand_state;
+    rand_state << rand_gen;
+    WriteBinary(chk_out, rand_state.str());
+    // Statistics.
+    WriteBinary(chk_out, chem_pot_cumu);
+    WriteBinary(chk_out, accepted, kNoMoveType);
+    WriteBinary(chk_out, attempted, kNoMoveType);
+    WriteBinary(chk_out, insertion_accepted);
+    WriteBinary(chk_out, deletion_accepted);
+    WriteBinary(chk_out, insertion_attempted);
+    WriteBinary(chk_out, deletion_attempted);
+    WriteBinary(chk_out, ff_avg_counter);
+    WriteBinary(chk_out, mol_avg_counter);
+    WriteBinary(chk_out, pair_e_cumu);
+    WriteBinary(chk_out, ewald_e_cumu);
+    WriteBinary(chk_out, ewald_e_real_cumu);
+    WriteBinary(chk_out, ewald_e_repl_cumu);
+    WriteBinary(chk_out, ewald_e_self_cumu);
+    WriteBinary(chk_out, bond_e_cumu);
+    WriteBinary(chk_out, ext_e_cumu);
+    WriteBinary(chk_out, density_cumu);
+    WriteBinary(chk_out, density_z_bin);
+    WriteBinary(chk_out, density_z_cumu, 3*density_z_bin);
+    WriteBinary(chk_out, rg_tot_cumu);
+    WriteBinary(chk_out, rg_x_cumu);
+    WriteBinary(chk_out, rg_y_cumu);
+    WriteBinary(chk_out, rg_z_cumu);
+    WriteBinary(chk_out, e_to_e_cumu);
+    WriteBinary(chk_out, adsorbed_chains);
+    WriteBinary(chk_out, adsorbed_beads);
+    WriteBinary(chk_out, adsorption_percent);
+    force_field.SaveAccumulators(chk_out);
+    // The stored energies.
+    force_field.SaveEnergies(chk_out);
+
+    chk_out.close();
+    if (!chk_out || rename(tmp_name.c_str(), chk_name.c_str()) != 0) {
+      cout << "  Warning: Failed to write the checkpoint at step " << step
+           << "!" << endl;
+    }
+    chk_out.clear();
+  }
+
+}
+
+void Simulation::ReadCheckpointSystem() {
+  string magic;
+  int version;
+  ReadBinary(chk_in, magic);
+  ReadBinary(chk_in, version);
+  if (magic != "PLUMCHK" || version != kCheckpointVersion) {
+    cout << "  The restart file is not a checkpoint of this version of "
+         << "Plum. Exiting! Program complete." << endl;
+    exit(1);
+  }
+
+  int phantom_in, coion_in, grafted_in, grafted_counterion_in;
+  ReadBinary(chk_in, step);
+  ReadBinary(chk_in, box_l, 3);
+  ReadBinary(chk_in, phantom_in);
+  ReadBinary(chk_in, coion_in);
+  ReadBinary(chk_in, grafted_in);
+  ReadBinary(chk_in, grafted_counterion_in);
+  if (phantom_in != phantom || coion_in != coion || grafted_in != grafted ||
+      grafted_counterion_in != grafted_counterion) {
+    cout << "  The numbers of phantom beads, coions, grafted chains or their "
+         << "counterions" << endl;
+    cout << "  differ from the checkpoint. Exiting! Program complete." << endl;
+    exit(1);
+  }
+
+  ReadBinary(chk_in, n_mol);
+  for (int i = 0; i < n_mol; i++) {
+    mols.push_back(Molecule());
+    int size;
+    ReadBinary(chk_in, size);
+    for (int j = 0; j < size; j++) {
+      string symbol;
+      int id, c_id;
+      double charge, crd[3];
+      ReadBinary(chk_in, symbol);
+      ReadBinary(chk_in, id);
+      ReadBinary(chk_in, c_id);
+      ReadBinary(chk_in, charge);
+      ReadBinary(chk_in, crd, 3);
+      mols[i].AddBead(Bead(symbol, id, c_id, charge, crd[0], crd[1], crd[2]));
+    }
+    vector<vector<int> > bonds, angles, diheds;
+    ReadBinary(chk_in, bonds);
+    ReadBinary(chk_in, angles);
+    ReadBinary(chk_in, diheds);
+    for (int j = 0; j < (int)bonds.size(); j++)
+      mols[i].AddBond(bonds[j][0], bonds[j][1]);
+    for (int j = 0; j < (int)angles.size(); j++)
+      mols[i].AddAngle(angles[j][0], angles[j][1], angles[j][2]);
+    for (int j = 0; j < (int)diheds.size(); j++)
+      mols[i].AddDihed(diheds[j][0], diheds[j][1], diheds[j][2], diheds[j][3]);
+  }
+  vector<int> ids;
+  ReadBinary(chk_in, id_counter);
+  ReadBinary(chk_in, ids);
+  id_list = set<int>(ids.begin(), ids.end());
+  ReadBinary(chk_in, output_end);
+
+  if (!chk_in || (int)output_end.size() != 9) {
+    cout << "  The checkpoint is incomplete. Exiting! Program complete."
+         << endl;
+    exit(1);
+  }
+
+}
+
+void Simulation::ReadCheckpointState(bool rebuild) {
+  string rand_state;
+  ReadBinary(chk_in, rand_state);
+  istringstream rand_in(rand_state);
+  rand_in >> rand_gen;
+
+  int density_z_bin_in;
+  ReadBinary(chk_in, chem_pot_cumu);
+  ReadBinary(chk_in, accepted, kNoMoveType);
+  ReadBinary(chk_in, attempted, kNoMoveType);
+  ReadBinary(chk_in, insertion_accepted);
+  ReadBinary(chk_in, deletion_accepted);
+  ReadBinary(chk_in, insertion_attempted);
+  ReadBinary(chk_in, deletion_attempted);
+  ReadBinary(chk_in, ff_avg_counter);
+  ReadBinary(chk_in, mol_avg_counter);
+  ReadBinary(chk_in, pair_e_cumu);
+  ReadBinary(chk_in, ewald_e_cumu);
+  ReadBinary(chk_in, ewald_e_real_cumu);
+  ReadBinary(chk_in, ewald_e_repl_cumu);
+  ReadBinary(chk_in, ewald_e_self_cumu);
+  ReadBinary(chk_in, bond_e_cumu);
+  ReadBinary(chk_in, ext_e_cumu);
+  ReadBinary(chk_in, density_cumu);
+  ReadBinary(chk_in, density_z_bin_in);
+  if (density_z_bin_in != density_z_bin) {
+    cout << "  The density profile of the checkpoint does not match the box. "
+         << "Exiting! Program complete." << endl;
+    exit(1);
+  }
+  ReadBinary(chk_in, density_z_cumu, 3*density_z_bin);
+  ReadBinary(chk_in, rg_tot_cumu);
+  ReadBinary(chk_in, rg_x_cumu);
+  ReadBinary(chk_in, rg_y_cumu);
+  ReadBinary(chk_in, rg_z_cumu);
+  ReadBinary(chk_in, e_to_e_cumu);
+  ReadBinary(chk_in, adsorbed_chains);
+  ReadBinary(chk_in, adsorbed_beads);
+  ReadBinary(chk_in, adsorption_percent);
+  force_field.LoadAccumulators(chk_in);
+  force_field.LoadEnergies(chk_in, mols, rebuild);
+
+  if (!chk_in || !rand_in) {
+    cout << "  The checkpoint is incomplete. Exiting! Program complete."
+         << endl;
+    exit(1);
+  }
+  chk_in.close();
+
+}
+
+// A file that is already shorter, or missing, is continued as it is.
+void Simulation::TruncateOutput(string name, long end) {
+  struct stat info;
+  if (end < 0 || stat(name.c_str(), &info) != 0 || info.st_size <= end)
+    return;
+  if (truncate(name.c_str(), end) != 0) {
+    cout << "  Cannot truncate " << name << ". Exiting! Program complete."
+         << endl;
+    exit(1);
+  }
+
+}
+
 void Simulation::PrintStatHeader() {
   info_out << "#Step";
   if (force_field.UsePairPot()) {
@@ -716,10 +1133,42 @@ void Simulation::PrintStatHeader() {
   if (force_field.UseGC()) {
     info_out << " " << "insert delete";
   }
+  if (hot_path_timing > 1) {
+    for (int i = 0; i < kNoTimeSection; i++) {
+      if (TimedSection(i))  info_out << " us_" << Timing::Name(i);
+    }
+  }
   info_out << endl;
 
 }
 
+// The checkerboard passes do not go through TranslationalMove and
+// ForceField::EnergyDifference, so they are only timed as a whole.
+bool Simulation::TimedSection(int section) {
+  bool serial = (checkerboard_moves == 0);
+  switch (section) {
+    case kTimeInsert:
+    case kTimeDelete:
+      return force_field.UseGC();
+    case kTimeCheckerboard:
+      return !serial;
+    case kTimePair:
+      return serial && force_field.UsePairPot();
+    case kTimeEwald:
+      return serial && force_field.UseEwaldPot();
+    case kTimeBond:
+      return serial && force_field.UseBondPot();
+    case kTimeExt:
+      return serial && force_field.UseExtPot();
+    case kTimeSample:
+    case kTimeOutput:
+      return true;
+  }
+  // The move types.
+  return serial;
+
+}
+
 void Simulation::Sample() {
   if (step > steps_eq && step % sample_freq == 0) {
     ff_avg_counter++;
@@ -799,42 +1248,45 @@ void Simulation::Sample() {
 
 void Simulation::PrintStat() {
   if (step % stat_out_freq == 0) {
-    info_out << step;
+    // The line keeps the formatting state of the previous lines, as the file
+    // stream did.
+    stat_line.str("");
+    stat_line << step;
 
     double tot_energy = 0;
     if (force_field.UsePairPot()) {
-      info_out << " " << setprecision(7) << pair_e_cumu / ff_avg_counter;
+      stat_line << " " << setprecision(7) << pair_e_cumu / ff_avg_counter;
       tot_energy += pair_e_cumu / ff_avg_counter;
     }
     if (force_field.UseEwaldPot()) {
-      info_out << " " << setprecision(7) << ewald_e_cumu / ff_avg_counter;
-      //info_out << " " << setprecision(12) << ewald_e_real_cumu / ff_avg_counter;
-      //info_out << " " << setprecision(12) << ewald_e_repl_cumu / ff_avg_counter;
-      //info_out << " " << setprecision(12) << ewald_e_self_cumu / ff_avg_counter;
+      stat_line << " " << setprecision(7) << ewald_e_cumu / ff_avg_counter;
+      //stat_line << " " << setprecision(12) << ewald_e_real_cumu / ff_avg_counter;
+      //stat_line << " " << setprecision(12) << ewald_e_repl_cumu / ff_avg_counter;
+      //stat_line << " " << setprecision(12) << ewald_e_self_cumu / ff_avg_counter;
       tot_energy += ewald_e_cumu / ff_avg_counter;
     }
     if (force_field.UseBondPot()) {
-      info_out << " " << setprecision(7) << bond_e_cumu / ff_avg_counter;
+      stat_line << " " << setprecision(7) << bond_e_cumu / ff_avg_counter;
       tot_energy += bond_e_cumu / ff_avg_counter;
     }
     if (force_field.UseExtPot()) {
-      info_out << " " << setprecision(7) << ext_e_cumu / ff_avg_counter;
+      stat_line << " " << setprecision(7) << ext_e_cumu / ff_avg_counter;
       tot_energy += ext_e_cumu / ff_avg_counter;
     }
-    info_out << " " << tot_energy;
+    stat_line << " " << tot_energy;
     if (force_field.UseGC()) {
-      info_out << " " << (int)mols.size()
+      stat_line << " " << (int)mols.size()
                << " " << setprecision(4) << density_cumu/ff_avg_counter;
     }
-    info_out << " " << force_field.GetPressure();
+    stat_line << " " << force_field.GetPressure();
     if (calc_chem_pot) {
       if (chem_pot_cumu/ff_avg_counter > 0)
-        info_out << " " << -(1.0/beta)*log(chem_pot_cumu/ff_avg_counter);
+        stat_line << " " << -(1.0/beta)*log(chem_pot_cumu/ff_avg_counter);
       else
-        info_out << " INF";
+        stat_line << " INF";
     }
 
-    info_out << " " << setprecision(4) << sqrt(rg_tot_cumu/mol_avg_counter)
+    stat_line << " " << setprecision(4) << sqrt(rg_tot_cumu/mol_avg_counter)
              << " " << setprecision(4) << sqrt(rg_x_cumu/mol_avg_counter)
              << " " << setprecision(4) << sqrt(rg_y_cumu/mol_avg_counter)
              << " " << setprecision(4) << sqrt(rg_z_cumu/mol_avg_counter)
@@ -845,184 +1297,276 @@ void Simulation::PrintStat() {
       // 2 represents two walls.
       double area_convert = (rg_tot_cumu/mol_avg_counter) * (rg_tot_cumu/mol_avg_counter)
                             / (2*box_l[0]*box_l[1]);
-      info_out << " " << setprecision(4)
+      stat_line << " " << setprecision(4)
                << area_convert*(1.0*adsorbed_chains)/mol_avg_counter
                << " " << setprecision(4)
                << area_convert*(1.0*adsorbed_beads)/mol_avg_counter
                << " " << setprecision(4) << adsorption_percent/mol_avg_counter;
     }
     */
-    info_out << " " << accepted[0] / (double)attempted[0];
-    info_out << " " << accepted[1] / (double)attempted[1];
-    info_out << " " << accepted[2] / (double)attempted[2];
-    info_out << " " << accepted[3] / (double)attempted[3];
-    info_out << " " << accepted[4] / (double)attempted[4];
+    stat_line << " " << accepted[0] / (double)attempted[0];
+    stat_line << " " << accepted[1] / (double)attempted[1];
+    stat_line << " " << accepted[2] / (double)attempted[2];
+    stat_line << " " << accepted[3] / (double)attempted[3];
+    stat_line << " " << accepted[4] / (double)attempted[4];
     if (force_field.UseGC()) {
-      info_out << " " << insertion_accepted / (double)insertion_attempted;
-      info_out << " " << deletion_accepted / (double)deletion_attempted;
+      stat_line << " " << insertion_accepted / (double)insertion_attempted;
+      stat_line << " " << deletion_accepted / (double)deletion_attempted;
     }
-    info_out << endl;
+    // The average time per call since the start of the run.
+    if (hot_path_timing > 1) {
+      Timing& timing = force_field.HotPathTiming();
+      for (int i = 0; i < kNoTimeSection; i++) {
+        if (TimedSection(i))
+          stat_line << " " << setprecision(4) << timing.MicrosecondsPerCall(i);
+      }
+    }
+    stat_line << '\n';
+    string line = stat_line.str();
+    writer.Post([this, line]() { info_out << line; });
   }
 
 }
 
 void Simulation::PrintTraj() {
   if (step > steps_eq && step % traj_out_freq == 0) {
-    if (grafted + n_chain > 0) {
-      traj_p_out << n_chain_b << endl;
-      traj_p_out << "STEP: " << step << endl;
+    shared_ptr<const Frame> snapshot = TakeFrame();
+    writer.Post([this, snapshot]() { WriteTraj(*snapshot); });
+  }
+
+}
+
+void Simulation::WriteTraj(const Frame& frame) {
+  if (traj_format != "xyz") {
+    WriteTrajBinary(frame);
+    return;
+  }
+  if (frame.n_chain > 0) {
+    traj_p_out << frame.n_chain_b << '\n';
+    traj_p_out << "STEP: " << frame.step << '\n';
+  }
+  if (frame.n_cion > 0) {
+    traj_c_out << frame.n_cion << '\n';
+    traj_c_out << "STEP: " << frame.step << '\n';
+  }
+  if (frame.n_aion > 0) {
+    traj_a_out << frame.n_aion << '\n';
+    traj_a_out << "STEP: " << frame.step << '\n';
+  }
+  if (frame.n_nion > 0) {
+    traj_n_out << frame.n_nion << '\n';
+    traj_n_out << "STEP: " << frame.step << '\n';
+  }
+
+  for (int i = phantom; i < frame.n_mol; i++) {
+    int begin = frame.mol_begin[i];
+    int end = frame.mol_begin[i+1];
+    double center[3] = {0, 0, 0};
+    for (int j = begin; j < end; j++) {
+      for (int k = 0; k < 3; k++)
+        center[k] += frame.crd[3*j + k];
     }
-    if (n_cion > 0) {
-      traj_c_out << n_cion << endl;
-      traj_c_out << "STEP: " << step << endl;
+    double disp[3];
+    for (int k = 0; k < 3; k++) {
+      center[k] /= (double)(end - begin);
+      disp[k] = floor(center[k]/box_l[k])*box_l[k];
     }
-    if (n_aion > 0) {
-      traj_a_out << n_aion << endl;
-      traj_a_out << "STEP: " << step << endl;
+
+    ofstream * out;
+    if (end - begin > 1)      out = &traj_p_out;
+    else if (frame.q[begin] > 0)  out = &traj_c_out;
+    else if (frame.q[begin] < 0)  out = &traj_a_out;
+    else                          out = &traj_n_out;
+    for (int j = begin; j < end; j++) {
+      *out << BeadTypeSymbol(frame.type[j]) << " ";
+      *out << frame.crd[3*j + 0] - disp[0] << " ";
+      *out << frame.crd[3*j + 1] - disp[1] << " ";
+      *out << frame.crd[3*j + 2] - disp[2] << '\n';
     }
-    if (n_nion > 0) {
-      traj_n_out << n_nion << endl;
-      traj_n_out << "STEP: " << step << endl;
+  }
+
+}
+
+void Simulation::WriteTrajBinary(const Frame& frame) {
+  // Types and shifted coordinates of the polymers, cations, anions and
+  // "neutral ions", in the order of the .xyz files.
+  vector<int> types[4];
+  vector<double> crds[4];
+  for (int i = phantom; i < frame.n_mol; i++) {
+    int begin = frame.mol_begin[i];
+    int end = frame.mol_begin[i+1];
+    double center[3] = {0, 0, 0};
+    for (int j = begin; j < end; j++) {
+      for (int k = 0; k < 3; k++)
+        center[k] += frame.crd[3*j + k];
+    }
+    double disp[3];
+    for (int k = 0; k < 3; k++) {
+      center[k] /= (double)(end - begin);
+      disp[k] = floor(center[k]/box_l[k])*box_l[k];
     }
 
-    for (int i = phantom; i < n_mol; i++) {
-      double centerx = 0;
-      double centery = 0;
-      double centerz = 0;
-      for (int j = 0; j < mols[i].Size(); j++) {
-        centerx += mols[i].bds[j].GetCrd(0, 0);
-        centery += mols[i].bds[j].GetCrd(0, 1);
-        centerz += mols[i].bds[j].GetCrd(0, 2);
-      }
-      centerx /= (double)mols[i].Size();
-      centery /= (double)mols[i].Size();
-      centerz /= (double)mols[i].Size();
-      double dispx = floor(centerx/box_l[0])*box_l[0];
-      double dispy = floor(centery/box_l[1])*box_l[1];
-      double dispz = floor(centerz/box_l[2])*box_l[2];
+    int s;
+    if (end - begin > 1)          s = 0;
+    else if (frame.q[begin] > 0)  s = 1;
+    else if (frame.q[begin] < 0)  s = 2;
+    else                          s = 3;
+    for (int j = begin; j < end; j++) {
+      types[s].push_back(frame.type[j]);
+      for (int k = 0; k < 3; k++)
+        crds[s].push_back(frame.crd[3*j + k] - disp[k]);
+    }
+  }
 
-      if (mols[i].Size() > 1) {
-        for (int j = 0; j < mols[i].Size(); j++) {
-          traj_p_out << mols[i].bds[j].Symbol() << " ";
-          traj_p_out << mols[i].bds[j].GetCrd(0, 0) - dispx << " ";
-          traj_p_out << mols[i].bds[j].GetCrd(0, 1) - dispy << " ";
-          traj_p_out << mols[i].bds[j].GetCrd(0, 2) - dispz << endl;
-        }
-      }
-      else if (mols[i].bds[0].Charge() > 0) {
-        traj_c_out << mols[i].bds[0].Symbol() << " ";
-        traj_c_out << mols[i].bds[0].GetCrd(0, 0) - dispx << " ";
-        traj_c_out << mols[i].bds[0].GetCrd(0, 1) - dispy << " ";
-        traj_c_out << mols[i].bds[0].GetCrd(0, 2) - dispz << endl;
-      }
-      else if (mols[i].bds[0].Charge() < 0) {
-        traj_a_out << mols[i].bds[0].Symbol() << " ";
-        traj_a_out << mols[i].bds[0].GetCrd(0, 0) - dispx << " ";
-        traj_a_out << mols[i].bds[0].GetCrd(0, 1) - dispy << " ";
-        traj_a_out << mols[i].bds[0].GetCrd(0, 2) - dispz << endl;
-      }
-      else {
-        traj_n_out << mols[i].bds[0].Symbol() << " ";
-        traj_n_out << mols[i].bds[0].GetCrd(0, 0) - dispx << " ";
-        traj_n_out << mols[i].bds[0].GetCrd(0, 1) - dispy << " ";
-        traj_n_out << mols[i].bds[0].GetCrd(0, 2) - dispz << endl;
-      }
+  for (int s = 0; s < 4; s++) {
+    if (!types[s].empty()) {
+      traj_bin[s].WriteFrame(frame.step, (int)types[s].size(), &types[s][0],
+                             &crds[s][0]);
     }
   }
 
 }
 
 void Simulation::PrintLastCrd() {
-  string bck[2] = {"", "2"};
   if (step > steps_eq && step % stat_out_freq == 0) {
-    for (int f = 0; f < 2; f++) {
-      crd_last_out[f].open(run_name + "_lastcrd.dat" + bck[f]);
-  
-      crd_last_out[f] << n_bead << endl;
-      crd_last_out[f] << " " << endl; 
-      for (int i = 0; i < n_mol; i++) {
-        double centerx = 0;
-        double centery = 0;
-        double centerz = 0;
-        for (int j = 0; j < mols[i].Size(); j++) {
-          centerx += mols[i].bds[j].GetCrd(0, 0);
-          centery += mols[i].bds[j].GetCrd(0, 1);
-          centerz += mols[i].bds[j].GetCrd(0, 2);
-        }
-        centerx /= (double)mols[i].Size();
-        centery /= (double)mols[i].Size();
-        centerz /= (double)mols[i].Size();
-        double dispx = floor(centerx/box_l[0])*box_l[0];
-        double dispy = floor(centery/box_l[1])*box_l[1];
-        double dispz = floor(centerz/box_l[2])*box_l[2];
-        if (i < phantom) {
-          dispx = dispy = dispz = 0;
-        }
-  
-        for (int j = 0; j < mols[i].Size(); j++) {
-          crd_last_out[f] << i << " ";
-          crd_last_out[f] << mols[i].bds[j].Symbol() << " ";
-          crd_last_out[f] << setprecision(18)
-                       << mols[i].bds[j].GetCrd(0, 0) - dispx << " ";
-          crd_last_out[f] << setprecision(18)
-                       << mols[i].bds[j].GetCrd(0, 1) - dispy << " ";
-          crd_last_out[f] << setprecision(18)
-                       << mols[i].bds[j].GetCrd(0, 2) - dispz << " ";
-          crd_last_out[f] << setprecision(4) << mols[i].bds[j].Charge() << endl;
-        }
+    shared_ptr<const Frame> snapshot = TakeFrame();
+    writer.Post([this, snapshot]() { WriteLastCrd(*snapshot); });
+  }
+
+}
+
+void Simulation::WriteLastCrd(const Frame& frame) {
+  string bck[2] = {"", "2"};
+  for (int f = 0; f < 2; f++) {
+    crd_last_out[f].rdbuf()->pubsetbuf(&out_buf[5+f][0], kOutputBufferSize);
+    crd_last_out[f].open(run_name + "_lastcrd.dat" + bck[f]);
+
+    crd_last_out[f] << frame.n_bead << '\n';
+    crd_last_out[f] << " " << '\n';
+    for (int i = 0; i < frame.n_mol; i++) {
+      int begin = frame.mol_begin[i];
+      int end = frame.mol_begin[i+1];
+      double center[3] = {0, 0, 0};
+      for (int j = begin; j < end; j++) {
+        for (int k = 0; k < 3; k++)
+          center[k] += frame.crd[3*j + k];
+      }
+      double disp[3];
+      for (int k = 0; k < 3; k++) {
+        center[k] /= (double)(end - begin);
+        disp[k] = floor(center[k]/box_l[k])*box_l[k];
+        if (i < phantom)  disp[k] = 0;
+      }
+
+      for (int j = begin; j < end; j++) {
+        crd_last_out[f] << i << " ";
+        crd_last_out[f] << BeadTypeSymbol(frame.type[j]) << " ";
+        crd_last_out[f] << setprecision(18)
+                        << frame.crd[3*j + 0] - disp[0] << " ";
+        crd_last_out[f] << setprecision(18)
+                        << frame.crd[3*j + 1] - disp[1] << " ";
+        crd_last_out[f] << setprecision(18)
+                        << frame.crd[3*j + 2] - disp[2] << " ";
+        crd_last_out[f] << setprecision(4) << frame.q[j] << '\n';
       }
-  
-      crd_last_out[f].close();
     }
+
+    crd_last_out[f].close();
   }
 
 }
 
-void Simulation::PrintLastTop() {
-  if (step > steps_eq && step % stat_out_freq == 0) {
-    top_last_out.open(run_name + "_lasttop.dat");
-
-    top_last_out << "TotNoOfBeads: " << n_bead      << endl; 
-    top_last_out << "TotNoOfMolec: " << n_mol       << endl; 
-    top_last_out << "Box_Length_X: " << setprecision(18) << box_l[0] <<endl; 
-    top_last_out << "Box_Length_Y: " << setprecision(18) << box_l[1] <<endl; 
-    top_last_out << "Box_Length_Z: " << setprecision(18) << box_l[2] <<endl; 
-    top_last_out << "bonds:" << endl; 
-    /*
+shared_ptr<const Frame> Simulation::TakeFrame() {
+  if (!frame || frame->step != step) {
+    shared_ptr<Frame> snapshot(new Frame);
+    snapshot->step = step;
+    snapshot->n_bead = n_bead;
+    snapshot->n_mol = n_mol;
+    snapshot->n_chain = grafted + n_chain;
+    snapshot->n_chain_b = n_chain_b;
+    snapshot->n_cion = n_cion;
+    snapshot->n_aion = n_aion;
+    snapshot->n_nion = n_nion;
+    snapshot->mol_begin.reserve(n_mol + 1);
+    int n = 0;
     for (int i = 0; i < n_mol; i++) {
-      for (int j = 0; j < (int)mols[i].bonds.size(); j++) {
-        top_last_out << i << " " << mols[i].bonds[j][0] << " "
-                                 << mols[i].bonds[j][1] << endl; 
-      }
+      snapshot->mol_begin.push_back(n);
+      n += mols[i].Size();
     }
-    */
-    top_last_out << "-1" << endl; 
-    top_last_out << "angles:" << endl; 
-    /*
-    for (int i = 0; i < n_mol; i++) {
-      for(int j = 0; j < (int)mols[i].angles.size(); j++) {
-        top_last_out << i << " " << mols[i].angles[j][0] << " "
-                                 << mols[i].angles[j][1] << " "
-                                 << mols[i].angles[j][2] << endl; 
-      }
-    } 
-    */ 
-    top_last_out << "-1" << endl; 
-    top_last_out << "diheds" << endl; 
-    /*
+    snapshot->mol_begin.push_back(n);
+    snapshot->type.resize(n);
+    snapshot->q.resize(n);
+    snapshot->crd.resize(3*n);
     for (int i = 0; i < n_mol; i++) {
-      for(int j = 0; j < (int)mols[i].diheds.size(); j++) {
-        top_last_out << i << " " << mols[i].diheds[j][0] << " "
-                                 << mols[i].diheds[j][1] << " "
-                                 << mols[i].diheds[j][2] << " "
-                                 << mols[i].diheds[j][3] << endl;
+      for (int j = 0; j < mols[i].Size(); j++) {
+        int index = snapshot->mol_begin[i] + j;
+        snapshot->type[index] = mols[i].bds[j].Type();
+        snapshot->q[index] = mols[i].bds[j].Charge();
+        for (int k = 0; k < 3; k++)
+          snapshot->crd[3*index + k] = mols[i].bds[j].GetCrd(0, k);
       }
     }
-    */
-    top_last_out << "-1" << endl; 
+    frame = snapshot;
+  }
+  return frame;
+
+}
+
+void Simulation::PrintLastTop() {
+  if (step > steps_eq && step % stat_out_freq == 0) {
+    int beads = n_bead;
+    int molecules = n_mol;
+    writer.Post([this, beads, molecules]() {
+      WriteLastTop(beads, molecules);
+    });
+  }
 
-    top_last_out.close();
+}
+
+void Simulation::WriteLastTop(int beads, int molecules) {
+  top_last_out.rdbuf()->pubsetbuf(&out_buf[7][0], kOutputBufferSize);
+  top_last_out.open(run_name + "_lasttop.dat");
+
+  top_last_out << "TotNoOfBeads: " << beads       << '\n'; 
+  top_last_out << "TotNoOfMolec: " << molecules   << '\n'; 
+  top_last_out << "Box_Length_X: " << setprecision(18) << box_l[0] << '\n'; 
+  top_last_out << "Box_Length_Y: " << setprecision(18) << box_l[1] << '\n'; 
+  top_last_out << "Box_Length_Z: " << setprecision(18) << box_l[2] << '\n'; 
+  top_last_out << "bonds:" << '\n'; 
+  /*
+  for (int i = 0; i < n_mol; i++) {
+    for (int j = 0; j < (int)mols[i].bonds.size(); j++) {
+      top_last_out << i << " " << mols[i].bonds[j][0] << " "
+                               << mols[i].bonds[j][1] << endl; 
+    }
+  }
+  */
+  top_last_out << "-1" << '\n'; 
+  top_last_out << "angles:" << '\n'; 
+  /*
+  for (int i = 0; i < n_mol; i++) {
+    for(int j = 0; j < (int)mols[i].angles.size(); j++) {
+      top_last_out << i << " " << mols[i].angles[j][0] << " "
+                               << mols[i].angles[j][1] << " "
+                               << mols[i].angles[j][2] << endl; 
+    }
+  } 
+  */ 
+  top_last_out << "-1" << '\n'; 
+  top_last_out << "diheds" << '\n'; 
+  /*
+  for (int i = 0; i < n_mol; i++) {
+    for(int j = 0; j < (int)mols[i].diheds.size(); j++) {
+      top_last_out << i << " " << mols[i].diheds[j][0] << " "
+                               << mols[i].diheds[j][1] << " "
+                               << mols[i].diheds[j][2] << " "
+                               << mols[i].diheds[j][3] << endl;
+    }
   }
+  */
+  top_last_out << "-1" << '\n'; 
+
+  top_last_out.close();
 
 }
 
@@ -1045,20 +1589,31 @@ void Simulation::CalcRhoZ() {
 }
 
 void Simulation::PrintLastRhoZ() {
-  string bck[2] = {"", "2"};
   if (step > steps_eq && step % stat_out_freq == 0) {
-    for (int i = 0; i < 2; i++) {
-      rho_last_out[i].open(run_name + "_lastrhoZ.dat" + bck[i]);
-
-      for (int bin = 0; bin < density_z_bin; bin++) {
-        double pos = (bin + 0.5) * density_z_res;
-        rho_last_out[i] << pos << '\t'
-                        << density_z_cumu[3*bin + 0]/(double)ff_avg_counter << '\t'
-                        << density_z_cumu[3*bin + 1]/(double)ff_avg_counter << '\t'
-                        << density_z_cumu[3*bin + 2]/(double)ff_avg_counter << endl;
-      }
-      rho_last_out[i].close();
+    shared_ptr<vector<double> > density(new vector<double>(
+        density_z_cumu, density_z_cumu + 3*density_z_bin));
+    int counter = ff_avg_counter;
+    writer.Post([this, density, counter]() {
+      WriteLastRhoZ(*density, counter);
+    });
+  }
+
+}
+
+void Simulation::WriteLastRhoZ(const vector<double>& density, int counter) {
+  string bck[2] = {"", "2"};
+  for (int i = 0; i < 2; i++) {
+    rho_last_out[i].rdbuf()->pubsetbuf(&out_buf[8+i][0], kOutputBufferSize);
+    rho_last_out[i].open(run_name + "_lastrhoZ.dat" + bck[i]);
+
+    for (int bin = 0; bin < density_z_bin; bin++) {
+      double pos = (bin + 0.5) * density_z_res;
+      rho_last_out[i] << pos << '\t'
+                      << density[3*bin + 0]/(double)counter << '\t'
+                      << density[3*bin + 1]/(double)counter << '\t'
+                      << density[3*bin + 2]/(double)counter << '\n';
     }
+    rho_last_out[i].close();
   }
 
 }
@@ -1093,4 +1648,113 @@ void Simulation::UpdateMolCounts() {
 
 }
 
+void Simulation::BuildMolLists() {
+  chain_list.clear();
+  ion_list.clear();
+  AddToMolLists(phantom);
+
+}
+
+void Simulation::AddToMolLists(int first) {
+  for (int i = first; i < (int)mols.size(); i++) {
+    if (mols[i].Size() > 1)  chain_list.push_back(i);
+    else                     ion_list.push_back(i);
+  }
+
+}
+
+void Simulation::RemoveMolecules(int first, int count) {
+  int last = n_mol - count;
+
+  // Moving the last molecules into the gap keeps the lists sorted as long as
+  // every moved molecule is of the same kind as the one it replaces. Then
+  // only the entries of the last molecules, at the ends of the lists, go.
+  bool same_kinds = (first == last || first + count <= last);
+  for (int i = 0; i < count && same_kinds; i++) {
+    same_kinds = (mols[first+i].Size() > 1) == (mols[last+i].Size() > 1);
+  }
+  if (same_kinds) {
+    for (int i = n_mol-1; i >= last; i--) {
+      if (mols[i].Size() > 1)  chain_list.pop_back();
+      else                     ion_list.pop_back();
+    }
+  }
+
+  // IDs are never reused, see GenBeadID, but they need not be kept.
+  for (int i = first; i < first + count; i++) {
+    for (int j = 0; j < mols[i].Size(); j++) {
+      id_list.erase(mols[i].bds[j].ID());
+    }
+  }
+
+  force_field.RemoveMolecules(mols, first, count);
+  if (!same_kinds)  BuildMolLists();
+
+}
+
+
+
+string Simulation::RunName() {
+  return run_name;
+
+}
+
+long Simulation::Step() {
+  return step;
+
+}
+
+long Simulation::Steps() {
+  return steps;
+
+}
+
+unsigned long Simulation::Seed() {
+  return seed;
+
+}
+
+void Simulation::Seed(unsigned long s, unsigned long stream) {
+  seed = s;
+  rand_gen.seed(s, stream);
+
+}
+
+double Simulation::ReducedEnergy(Simulation& config) {
+  ForceField& ff = config.force_field;
+  double energy = 0;
+  if (ff.UsePairPot())  energy += ff.TotPairEnergy();
+  if (ff.UseBondPot())  energy += ff.TotBondEnergy();
+  if (ff.UseExtPot())   energy += ff.TotExtEnergy();
+  if (ff.UseEwaldPot()) {
+    energy += ff.TotEwaldEnergy() * force_field.BjerrumLength() /
+              ff.BjerrumLength();
+  }
+  double reduced = beta * energy;
+  // The chains that GC moves insert and delete.
+  if (force_field.UseGC())
+    reduced -= beta * force_field.ChemPot() * config.n_chain;
+
+  return reduced;
 
+}
+
+void Simulation::SwapSystem(Simulation& other) {
+  swap(mols, other.mols);
+  swap(chain_list, other.chain_list);
+  swap(ion_list, other.ion_list);
+  swap(id_list, other.id_list);
+  swap(id_counter, other.id_counter);
+  UpdateMolCounts();
+  other.UpdateMolCounts();
+  force_field.SwapSystem(other.force_field, mols, other.mols);
+  // The frames taken in this step show the old configurations.
+  frame.reset();
+  other.frame.reset();
+
+}
+
+bool Simulation::SameEwaldSums(Simulation& other) {
+  return force_field.SameEwaldSums(other.force_field);
+
+}
@@ -7,16 +7,43 @@
 #define SRC_SIMULATION_SIMULATION_H_ 
 
 #include <fstream>
-#include <random> 
+#include <memory>
 #include <set>
+#include <sstream>
 #include <vector>
 
 #include "../force_field/force_field.h"
 #include "../molecules/molecule.h"
 #include "../utilities/constants.h"
+#include "../utilities/output_writer.h"
+#include "../utilities/random_generator.h"
+#include "../utilities/trajectory.h"
+#include "energy_validator.h"
 
 using namespace std; 
 
+/** A copy of the beads of one step, which the trajectory and last coordinate
+    files are written from on the output thread. */
+struct Frame {
+  long step;
+  /** The counts of Simulation at that step. n_chain includes the grafted
+      chains. */
+  int n_bead;
+  int n_mol;
+  int n_chain;
+  int n_chain_b;
+  int n_cion;
+  int n_aion;
+  int n_nion;
+  /** Index of the first bead of each molecule, followed by the total number
+      of beads. */
+  vector<int> mol_begin;
+  /** Type, charge and current x, y, z of every bead. */
+  vector<int> type;
+  vector<double> q;
+  vector<double> crd;
+};
+
 class Simulation {
  private:
   //////////////////////////////////////
@@ -41,6 +68,13 @@ class Simulation {
   long stat_out_freq;
   /** The frequency to print trajectory file. */
   long traj_out_freq;
+  /** The trajectory format: "xyz", or "float" or "fixed" for the binary
+      trajectories of TrajectoryWriter. */
+  string traj_format;
+  /** The resolution of "fixed" trajectories, in unit length. */
+  double traj_precision;
+  /** The frequency to write a checkpoint, 0 to write none. */
+  long checkpoint_freq;
   /** The number of dimensions to apply PBC, use 2 or 3. */
   int npbc;
   /** The length of displacement for random moves, in unit length. */
@@ -72,9 +106,29 @@ class Simulation {
   ofstream traj_a_out;
   /** For "neutral ion" trajectories. */
   ofstream traj_n_out;
+  /** The binary trajectories of polymers, cations, anions and "neutral
+      ions", used instead of the four above unless traj_format is "xyz". */
+  TrajectoryWriter traj_bin[4];
   ofstream crd_last_out[2];
   ofstream top_last_out;
   ofstream rho_last_out[2];
+  /** For the checkpoint the simulation restarts from. */
+  ifstream chk_in;
+  /** For writing checkpoints. */
+  ofstream chk_out;
+  /** The sizes of the statistics file, the four .xyz and the four binary
+      trajectories at the checkpoint the run restarts from, -1 for the files
+      that were not written. */
+  vector<long> output_end;
+  /** Formats the lines of the statistics file. */
+  ostringstream stat_line;
+  /** Writes the output files in the background. */
+  OutputWriter writer;
+  /** Buffers of the output streams: info, the four trajectories, the two last
+      coordinate files, the last topology and the two last density files. */
+  vector<char> out_buf[10];
+  /** The last frame taken, see TakeFrame. */
+  shared_ptr<const Frame> frame;
 
   /////////////////////////////////////////////
   // Parameters read from top and crd files. //
@@ -97,8 +151,31 @@ class Simulation {
   double box_l[3];
   /** The probabilities to choose one of the four MC translational moves. */
   double move_prob[kNoMoveType];
+  /** The number of moves per domain in each pass of checkerboard moves, 0 to
+      make the moves one at a time. See CheckerboardMove. */
+  int checkerboard_moves;
+  /** The smallest width of a checkerboard domain, in unit length, 0 for four
+      bead move lengths. Chains that do not fit into a domain are not moved,
+      so it should be larger than the chains. */
+  double checkerboard_width;
+  /** The seed of the random number generator, 0 to seed it from the clock. */
+  unsigned long seed;
+  /** Timing of the hot path, see ForceField::HotPathTiming: 0 off, 1 a
+      summary table at exit, 2 also the time per call of every section in the
+      statistics output. */
+  int hot_path_timing;
+  /** Every how many steps the running energies are checked against the
+      energies computed from scratch, 0 for never. See EnergyValidator. */
+  long energy_check_freq;
+  /** Does the energy checks on a thread of its own. */
+  EnergyValidator validator;
   /** Molecule vector. */
   vector<Molecule> mols;
+  /** Indices in mols of the chains (grafted ones included) and of the single
+      bead molecules after the phantom ones, in increasing order. Kept up to
+      date by GCMove, so that TranslationalMove picks a molecule in O(1). */
+  vector<int> chain_list;
+  vector<int> ion_list;
   /** Force field for the simulation. */
   ForceField force_field;
 
@@ -145,11 +222,43 @@ class Simulation {
   //////////////////////////////
   // Random number generator. //
   //////////////////////////////
-  mt19937 rand_gen;
+  RandomGenerator rand_gen;
+
+  /////////////////////////
+  // Checkerboard moves. //
+  /////////////////////////
+  /** The chains and the single beads of every active domain of the current
+      pass, see ForceField::SortIntoDomains. */
+  vector<vector<int> > domain_chains;
+  vector<vector<int> > domain_ions;
+  /** Every active domain draws from its own stream of this seed, drawn from
+      rand_gen for every pass, so that a pass does not depend on the number
+      of threads. */
+  unsigned long pass_seed;
+  /** Accepted and attempted moves of every active domain by move type,
+      kNoMoveType entries per domain. */
+  vector<int> domain_accepted;
+  vector<int> domain_attempted;
+
+  /** Pick a move type by the move probabilities. */
+  int PickMoveType(RandomGenerator&);
+  /** Make a trial move of the given type on a molecule. */
+  void TrialMove(int, int, RandomGenerator&);
+  /** Make the trial positions of a molecule current if the move was accepted
+      and the current ones trial if not, and clear the moved flags. */
+  void EndMove(int, bool);
+  /** The moves of one active domain in a checkerboard pass, on the given
+      thread. */
+  void DomainMoves(int, int);
 
  public:
-  /** Constructor. */
-  Simulation();
+  /** Constructor. The first argument is the checkpoint file to restart
+      from, or empty to start from the input coordinate and topology files.
+      The second one asks to recompute the energies instead of loading them
+      from the checkpoint. The third one is appended to the prefix of the
+      output file names, which tells the replicas of a replica exchange run
+      apart. */
+  Simulation(string, bool, string);
   /** Destructor. */
   ~Simulation();
 
@@ -158,9 +267,16 @@ class Simulation {
   ///////////////////////////
   /** Run this simulation. */
   void Run();
+  /** Run this simulation up to and including the given step. */
+  void Run(long);
   /** Attempts to perform one of the available translational moves on a random
       molecule; Accepts/rejects and adjusts all coordinate & energy arrays. */
   void TranslationalMove(); 
+  /** Attempts checkerboard_moves translational moves in each active domain
+      of a checkerboard pass, with the domains moved in parallel on the
+      threads of the force field. Only for short-ranged force fields, see
+      ForceField::InitCheckerboard. */
+  void CheckerboardMove();
   /** Attempts a grand-canonical Monte Carlo move. */
   void GCMove();
 
@@ -169,6 +285,9 @@ class Simulation {
   ////////////////
   /** Sample energy, pressure, molecular conformation etc. */
   void Sample();
+  /** Whether a section of the hot path timing can be called in this
+      simulation, and so gets a column in the statistics output. */
+  bool TimedSection(int);
   void CalcRhoZ();
   /** Calculates average value of sqrt(Rg^2) for all chains. */
   double RadiusOfGyration();
@@ -179,6 +298,38 @@ class Simulation {
       int out of bound error. */
   int GenBeadID();
   void UpdateMolCounts();
+  /** Rebuild chain_list and ion_list from mols. */
+  void BuildMolLists();
+  /** Add the molecules from the given index to the end of mols to the lists. */
+  void AddToMolLists(int);
+  /** Remove the given number of molecules from the given index, a deleted
+      chain and its counterions. The last as many molecules take their place
+      (see ForceField::RemoveMolecules), and the molecule lists and the ID set
+      are updated to match. */
+  void RemoveMolecules(int, int);
+
+  ///////////////////////
+  // Replica exchange. //
+  ///////////////////////
+  string RunName();
+  long Step();
+  long Steps();
+  /** The seed of the random number generator. */
+  unsigned long Seed();
+  /** Restart the random number generator at a stream of a seed. */
+  void Seed(unsigned long, unsigned long);
+  /** -log of the Boltzmann weight that the current configuration of the
+      given replica has under the parameters of this one, in which only
+      beta, the Bjerrum length and the chemical potential may differ. The
+      Ewald energy is proportional to the Bjerrum length, so no energy is
+      recomputed. */
+  double ReducedEnergy(Simulation&);
+  /** Exchange the configurations of two replicas. Each keeps its own
+      parameters, statistics and output files, and takes over the energies
+      of the configuration it receives, see ForceField::SwapSystem. */
+  void SwapSystem(Simulation&);
+  /** Whether SwapSystem with another replica keeps the Ewald energies. */
+  bool SameEwaldSums(Simulation&);
 
   ///////////////////////////////////
   // Read input crd and top files. //
@@ -187,16 +338,48 @@ class Simulation {
   void ReadTop();
   void CoordinateObeyRigidBond(double);
 
+  /////////////////////////////
+  // Checkpoint and restart. //
+  /////////////////////////////
+  /** Write everything needed to continue the run bit for bit: the step, the
+      molecules and their topology, the bead IDs, the state of the random
+      number generator, all running averages and the stored energies. The
+      checkpoint goes to a temporary file first, which then replaces the
+      previous checkpoint, so a run that dies while writing it still leaves
+      the last complete checkpoint behind. */
+  void WriteCheckpoint();
+  /** Read the step, box and molecules from the checkpoint, in place of
+      ReadTop and ReadCrd. */
+  void ReadCheckpointSystem();
+  /** Read the rest of the checkpoint, after the force field is set up. The
+      argument is passed on to ForceField::LoadEnergies. */
+  void ReadCheckpointState(bool);
+  /** Cut an output file of a restarted run back to the given size, dropping
+      what the original run wrote after its checkpoint. */
+  void TruncateOutput(string, long);
+
   //////////////////////
   // Print functions. //
   //////////////////////
+  /** The Print functions copy what the output needs and post the writing to
+      the output thread. The Write functions run on that thread; they may only
+      use their arguments, the output streams and parameters that do not
+      change during the run. */
   void PrintStatHeader();
   void PrintStat();
   void PrintTraj();
+  void WriteTraj(const Frame&);
+  void WriteTrajBinary(const Frame&);
   void PrintLastCrd();
+  void WriteLastCrd(const Frame&);
   void PrintLastTop();
+  void WriteLastTop(int, int);
   void PrintLastRhoZ();
+  void WriteLastRhoZ(const vector<double>&, int);
   void PrintEndToEndVector();
+  /** Copy the beads of the current step, or return the copy already taken
+      in this step. */
+  shared_ptr<const Frame> TakeFrame();
 
 };
  
@@ -0,0 +1,126 @@
+/** Raw binary reading and writing of plain values, arrays, strings, vectors
+    and maps, used by the checkpoint files. Values are stored in the native
+    byte order and size, so a checkpoint can only be read by a Plum binary
+    built for the same platform. */
+
+#ifndef SRC_UTILITIES_BINARY_IO_H_
+#define SRC_UTILITIES_BINARY_IO_H_
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/** A single value of a trivially copyable type. */
+template <class T>
+inline void WriteBinary(ostream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+
+}
+
+template <class T>
+inline void ReadBinary(istream& in, T& value) {
+  in.read(reinterpret_cast<char*>(&value), sizeof(T));
+
+}
+
+/** An array of n values. The length is not stored. */
+template <class T>
+inline void WriteBinary(ostream& out, const T* values, long n) {
+  out.write(reinterpret_cast<const char*>(values), n*sizeof(T));
+
+}
+
+template <class T>
+inline void ReadBinary(istream& in, T* values, long n) {
+  in.read(reinterpret_cast<char*>(values), n*sizeof(T));
+
+}
+
+/** A string, stored with its length. */
+inline void WriteBinary(ostream& out, const string& value) {
+  long n = (long)value.size();
+  WriteBinary(out, n);
+  out.write(value.data(), n);
+
+}
+
+inline void ReadBinary(istream& in, string& value) {
+  long n = 0;
+  ReadBinary(in, n);
+  value.assign(n, ' ');
+  if (n > 0)  in.read(&value[0], n);
+
+}
+
+/** A vector, stored with its length. */
+template <class T>
+inline void WriteBinary(ostream& out, const vector<T>& values) {
+  long n = (long)values.size();
+  WriteBinary(out, n);
+  if (n > 0)  WriteBinary(out, values.data(), n);
+
+}
+
+template <class T>
+inline void ReadBinary(istream& in, vector<T>& values) {
+  long n = 0;
+  ReadBinary(in, n);
+  values.resize(n);
+  if (n > 0)  ReadBinary(in, values.data(), n);
+
+}
+
+/** A vector of vectors, stored with all lengths. */
+template <class T>
+inline void WriteBinary(ostream& out, const vector<vector<T> >& values) {
+  long n = (long)values.size();
+  WriteBinary(out, n);
+  for (long i = 0; i < n; i++)
+    WriteBinary(out, values[i]);
+
+}
+
+template <class T>
+inline void ReadBinary(istream& in, vector<vector<T> >& values) {
+  long n = 0;
+  ReadBinary(in, n);
+  values.resize(n);
+  for (long i = 0; i < n; i++)
+    ReadBinary(in, values[i]);
+
+}
+
+/** A map of trivially copyable keys and values, stored in key order. */
+template <class K, class V>
+inline void WriteBinary(ostream& out, const map<K, V>& values) {
+  long n = (long)values.size();
+  WriteBinary(out, n);
+  for (typename map<K, V>::const_iterator it = values.begin();
+       it != values.end(); ++it) {
+    WriteBinary(out, it->first);
+    WriteBinary(out, it->second);
+  }
+
+}
+
+template <class K, class V>
+inline void ReadBinary(istream& in, map<K, V>& values) {
+  long n = 0;
+  ReadBinary(in, n);
+  values.clear();
+  for (long i = 0; i < n; i++) {
+    K key;
+    V value;
+    ReadBinary(in, key);
+    ReadBinary(in, value);
+    // Keys come in order, so each one goes at the end.
+    values.insert(values.end(), make_pair(key, value));
+  }
+
+}
+
+#endif
+
@@ -13,6 +13,10 @@ const double kEwaldCutoff = 1E-7;
 const double kVerySmallDistance = 1E-8;
 /** In kBT. */
 const double kVeryLargeEnergy = 1E+8;
+/** SIMD levels of the batched kernels, see SimdLevel(). */
+const int kSimdScalar = 0;
+const int kSimdAVX2   = 1;
+const int kSimdAVX512 = 2;
 /** For detecting adsorption, in unit length. */
 const double kAdsorbCutoff = 1.13;  // 1.5 is slightly larger than r_m.
 
@@ -51,10 +55,20 @@ const double kEps0 = 0.00552634963;
 
 /** The number of different Monte Carlo moves implemented in the code. */
 const int kNoMoveType = 5;
+/** Version of the checkpoint file format, changed whenever its layout
+    changes. */
+const int kCheckpointVersion = 5;
+/** Number of output tasks that can wait for the output thread. */
+const int kOutputQueueSize = 16;
+/** Size of the buffer of every output file, in bytes. */
+const int kOutputBufferSize = 1 << 20;
 
 const double kDz = 0.00001;
 /** Scale the box this number of times when using dipole correction. */
 const int kDiCorrection = 3;
+/** Number of incremental updates of the total dipole moment after which it
+    is summed from scratch again. */
+const int kDipoleRefreshFreq = 100000;
 
 /** Constant for wall LJ potential, 2^(1/3). */
 const double k213 = 1.25992104989;
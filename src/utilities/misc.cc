@@ -2,9 +2,9 @@
 
 #include <stdlib.h>
 #include <cmath>
-#include <random> 
 
 #include "../molecules/bead.h"
+#include "constants.h"
 #include <Eigen/Dense>
 
 using namespace std;
@@ -92,44 +92,13 @@ void GetDistVectorC(Bead& b1, Bead& b2, double box_l[], int npbc,
 
 }
 
-void randSphere(double vec[], mt19937& rand_gen) {
-  double rand_square = 2;
-  double r1, r2;
-  while (rand_square > 1) {
-    // Random numbers between -1 and 1.
-    r1 = 1 - 2 * ((double)rand_gen() / rand_gen.max()); 
-    r2 = 1 - 2 * ((double)rand_gen() / rand_gen.max());
-    rand_square = r1 * r1 + r2 * r2;
-  }
-  double ranh = 2 * sqrt(1 - rand_square);
-  vec[0] = r1 * ranh; 
-  vec[1] = r2 * ranh; 
-  vec[2] = (1 - 2*rand_square); 
+void randSphere(double vec[], RandomGenerator& rand_gen) {
+  rand_gen.UnitSphere(vec, 1);
 
 }
 
-double gasdev(double mean, double stdev, mt19937& ranGen) {
-  static int iset = 0;
-  static double gset;
-  double fac, rsq, v1, v2;
-  if (iset == 0) {
-    do {
-      v1=2.0*((double)ranGen() / ranGen.max()) - 1.0;
-      v2=2.0*((double)ranGen() / ranGen.max()) - 1.0;
-      rsq = v1*v1 + v2*v2;
-    } while (rsq >= 1.0 || rsq == 0.0 );
-      fac = sqrt(-2.0 * log(rsq)/rsq);
-
-      gset = v1*fac;
-      iset = 1;
-      return v2*fac * stdev + mean;
-  }
-  else {
-    iset = 0;
-    return gset * stdev + mean;
-  }
-
-  return 0; 
+double gasdev(double mean, double stdev, RandomGenerator& ranGen) {
+  return ranGen.Normal() * stdev + mean;
 
 }
 
@@ -143,6 +112,23 @@ string YesOrNo(bool input) {
 
 }
 
+int SimdLevel() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))  return kSimdAVX512;
+  if (__builtin_cpu_supports("avx2"))     return kSimdAVX2;
+#endif
+  return kSimdScalar;
+
+}
+
+string SimdName(int level) {
+  if (level == kSimdAVX512)     return "AVX-512";
+  else if (level == kSimdAVX2)  return "AVX2";
+  else                          return "scalar";
+
+}
+
 int factorial(int n) {
   if (n != 1) {
      return n*factorial(n-1);
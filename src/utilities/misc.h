@@ -3,10 +3,11 @@
 #ifndef SRC_UTILITIES_MISC_H_
 #define SRC_UTILITIES_MISC_H_ 
 
-#include <random> 
+#include <istream>
 #include <string>
 
 #include "../molecules/bead.h"
+#include "random_generator.h"
 
 /** Bead-bead dist func that takes bead ptrs. from MC12 & earlier. */
 double getDist(Bead&, Bead&, double[], int);
@@ -21,17 +22,41 @@ void GetDistVectorC(Bead&, Bead&, double[], int, double (&)[3]);
     image convention. */
 void GetDistVectorConsistent(Bead&, Bead&, double[], int, double (&)[3]);
 /** Fills in a vector with random point on unit sphere. */
-void randSphere(double[], std::mt19937&);
+void randSphere(double[], RandomGenerator&);
 /** Returns rand deviate from gaussian distribution with mean 0 and stdev 1.
     multiplied /shifted to give the requested distribution. */
-double gasdev(double, double, std::mt19937&);
+double gasdev(double, double, RandomGenerator&);
 /** Print bool as yes or no. */
 string YesOrNo(bool);
+/** The widest SIMD instruction set of the CPU that the batched kernels can
+    use: kSimdScalar, kSimdAVX2 or kSimdAVX512. */
+int SimdLevel();
+/** Name of a SIMD level, for printing. */
+string SimdName(int);
 int factorial(int);
 /** This is a simple least square fit procedure. */
 double Interpolate(double *, double *, int, double);
 double Interpolate2(double *, double *, int, double);
 
+/** Read the value of an optional input key. If the next flag of the input is
+    the key, its value is read. Otherwise the input is left where it was and
+    the value keeps its default, so that inputs written before the key was
+    added still read. The input has to be seekable, see main. Returns whether
+    the key was there. */
+template <typename T>
+bool ReadOptional(istream& in, const string& key, T& value) {
+  streampos start = in.tellg();
+  string flag;
+  if (in >> flag && flag == key) {
+    in >> value;
+    return true;
+  }
+  in.clear();
+  in.seekg(start);
+  return false;
+
+}
+
 #endif
 
 
@@ -0,0 +1,105 @@
+#include "output_writer.h"
+
+#include <chrono>
+
+using namespace std;
+
+OutputWriter::OutputWriter() {
+  head = 0;
+  pending = 0;
+  stop = false;
+  n_posted = 0;
+  n_waits = 0;
+  wait_time = 0;
+
+}
+
+OutputWriter::~OutputWriter() {
+  Stop();
+
+}
+
+void OutputWriter::Start(int size) {
+  ring.assign(size > 0 ? size : 1, function<void()>());
+  worker = thread(&OutputWriter::WorkerLoop, this);
+
+}
+
+void OutputWriter::Post(function<void()> task) {
+  if (!worker.joinable()) {
+    n_posted++;
+    task();
+    return;
+  }
+
+  unique_lock<mutex> guard(lock);
+  if (pending == (int)ring.size()) {
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    done.wait(guard, [this] { return pending < (int)ring.size(); });
+    n_waits++;
+    wait_time += chrono::duration<double>(chrono::steady_clock::now() -
+                                          t0).count();
+  }
+  ring[(head + pending) % ring.size()] = task;
+  pending++;
+  n_posted++;
+  guard.unlock();
+  posted.notify_one();
+
+}
+
+void OutputWriter::Flush() {
+  if (!worker.joinable())  return;
+  unique_lock<mutex> guard(lock);
+  done.wait(guard, [this] { return pending == 0; });
+
+}
+
+void OutputWriter::Stop() {
+  if (!worker.joinable())  return;
+  {
+    unique_lock<mutex> guard(lock);
+    stop = true;
+  }
+  posted.notify_one();
+  worker.join();
+
+}
+
+long OutputWriter::Posted() {
+  return n_posted;
+
+}
+
+long OutputWriter::Waits() {
+  return n_waits;
+
+}
+
+double OutputWriter::WaitTime() {
+  return wait_time;
+
+}
+
+// The running task stays counted in pending, and in its slot, until it is
+// done, so Flush also waits for it.
+void OutputWriter::WorkerLoop() {
+  while (true) {
+    function<void()> task;
+    {
+      unique_lock<mutex> guard(lock);
+      posted.wait(guard, [this] { return stop || pending > 0; });
+      if (pending == 0)  return;
+      task.swap(ring[head]);
+    }
+    task();
+    {
+      unique_lock<mutex> guard(lock);
+      head = (head + 1) % ring.size();
+      pending--;
+    }
+    done.notify_all();
+  }
+
+}
+
@@ -0,0 +1,63 @@
+#ifndef SRC_UTILITIES_OUTPUT_WRITER_H_
+#define SRC_UTILITIES_OUTPUT_WRITER_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/** Runs output tasks on a background thread, one at a time and in the order
+    they were posted, so that the simulation never waits on the file system.
+    The tasks wait in a ring buffer of fixed size. When the buffer is full,
+    Post blocks until the writer has caught up; these waits are counted so
+    that the back-pressure can be reported. A task must only use data it owns
+    or that no other thread changes while it is pending. */
+class OutputWriter {
+ private:
+  /** The background thread. */
+  thread worker;
+  mutex lock;
+  /** Signals the worker that a task is posted or that it should stop. */
+  condition_variable posted;
+  /** Signals waiting callers that a task is done. */
+  condition_variable done;
+  /** The ring buffer of pending tasks. */
+  vector<function<void()> > ring;
+  /** Index of the oldest pending task. */
+  int head;
+  /** Number of pending tasks, including the one that is running. */
+  int pending;
+  bool stop;
+  /** Number of tasks posted. */
+  long n_posted;
+  /** Number of times Post found the buffer full, and the total time it waited
+      for space, in seconds. */
+  long n_waits;
+  double wait_time;
+
+  void WorkerLoop();
+
+ public:
+  OutputWriter();
+  /** Run the remaining tasks and stop the thread. */
+  ~OutputWriter();
+  /** Start the thread with a ring buffer of the given size. Before Start,
+      tasks are run by Post itself. */
+  void Start(int);
+  /** Queue a task, waiting for space if the buffer is full. */
+  void Post(function<void()>);
+  /** Wait until all posted tasks are done. */
+  void Flush();
+  /** Run the remaining tasks and stop the thread. */
+  void Stop();
+  long Posted();
+  long Waits();
+  double WaitTime();
+
+};
+
+#endif
+
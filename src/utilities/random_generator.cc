@@ -0,0 +1,137 @@
+#include "random_generator.h"
+
+#include <cmath>
+
+#include "constants.h"
+
+using namespace std;
+
+// Philox4x32 round and key schedule constants.
+const uint32_t kPhiloxM0 = 0xD2511F53;
+const uint32_t kPhiloxM1 = 0xCD9E8D57;
+const uint32_t kPhiloxW0 = 0x9E3779B9;
+const uint32_t kPhiloxW1 = 0xBB67AE85;
+/** 2^-32. */
+const double kTwoToMinus32 = 1.0 / 4294967296.0;
+
+RandomGenerator::RandomGenerator(uint64_t s, uint64_t stream) {
+  seed(s, stream);
+
+}
+
+void RandomGenerator::seed(uint64_t s, uint64_t stream) {
+  key[0] = (uint32_t)s;
+  key[1] = (uint32_t)(s >> 32);
+  counter[0] = 0;
+  counter[1] = 0;
+  counter[2] = (uint32_t)stream;
+  counter[3] = (uint32_t)(stream >> 32);
+  for (int i = 0; i < 4; i++) {
+    block[i] = 0;
+  }
+  used = 4;
+
+}
+
+void RandomGenerator::NextBlock() {
+  uint32_t c[4] = {counter[0], counter[1], counter[2], counter[3]};
+  uint32_t k[2] = {key[0], key[1]};
+  for (int round = 0; round < 10; round++) {
+    uint64_t p0 = (uint64_t)kPhiloxM0 * c[0];
+    uint64_t p1 = (uint64_t)kPhiloxM1 * c[2];
+    uint32_t hi0 = (uint32_t)(p0 >> 32);
+    uint32_t hi1 = (uint32_t)(p1 >> 32);
+    c[0] = hi1 ^ c[1] ^ k[0];
+    c[1] = (uint32_t)p1;
+    c[2] = hi0 ^ c[3] ^ k[1];
+    c[3] = (uint32_t)p0;
+    k[0] += kPhiloxW0;
+    k[1] += kPhiloxW1;
+  }
+  for (int i = 0; i < 4; i++) {
+    block[i] = c[i];
+  }
+  used = 0;
+
+  // The block count carries into word 1; the stream words are never touched.
+  if (++counter[0] == 0)  counter[1]++;
+
+}
+
+RandomGenerator::result_type RandomGenerator::operator()() {
+  if (used == 4)  NextBlock();
+  return block[used++];
+
+}
+
+double RandomGenerator::Uniform() {
+  return ((double)(*this)() + 0.5) * kTwoToMinus32;
+
+}
+
+// Box-Muller. The second deviate of the pair is dropped, so the generator
+// keeps no state besides the counter.
+double RandomGenerator::Normal() {
+  double r = sqrt(-2.0 * log(Uniform()));
+  return r * cos(2 * kPi * Uniform());
+
+}
+
+void RandomGenerator::Uniform(double values[], int n) {
+  for (int i = 0; i < n; i++) {
+    values[i] = ((double)(*this)() + 0.5) * kTwoToMinus32;
+  }
+
+}
+
+// Box-Muller, both deviates of each pair are used.
+void RandomGenerator::Normal(double values[], int n) {
+  for (int i = 0; i < n; i += 2) {
+    double r = sqrt(-2.0 * log(Uniform()));
+    double angle = 2 * kPi * Uniform();
+    values[i] = r * cos(angle);
+    if (i+1 < n)  values[i+1] = r * sin(angle);
+  }
+
+}
+
+// z is uniform in (-1, 1) and the azimuth in (0, 2 pi), which covers the
+// sphere uniformly (Archimedes) without the rejections of Marsaglia's method.
+void RandomGenerator::UnitSphere(double vec[], int n) {
+  for (int i = 0; i < n; i++) {
+    double z = 2 * Uniform() - 1;
+    double angle = 2 * kPi * Uniform();
+    double r = sqrt(1 - z*z);
+    vec[3*i]   = r * cos(angle);
+    vec[3*i+1] = r * sin(angle);
+    vec[3*i+2] = z;
+  }
+
+}
+
+ostream& operator<<(ostream& out, const RandomGenerator& gen) {
+  out << gen.key[0] << " " << gen.key[1];
+  for (int i = 0; i < 4; i++) {
+    out << " " << gen.counter[i];
+  }
+  for (int i = 0; i < 4; i++) {
+    out << " " << gen.block[i];
+  }
+  out << " " << gen.used;
+  return out;
+
+}
+
+istream& operator>>(istream& in, RandomGenerator& gen) {
+  in >> gen.key[0] >> gen.key[1];
+  for (int i = 0; i < 4; i++) {
+    in >> gen.counter[i];
+  }
+  for (int i = 0; i < 4; i++) {
+    in >> gen.block[i];
+  }
+  in >> gen.used;
+  return in;
+
+}
+
@@ -0,0 +1,59 @@
+#ifndef SRC_UTILITIES_RANDOM_GENERATOR_H_
+#define SRC_UTILITIES_RANDOM_GENERATOR_H_
+
+#include <stdint.h>
+#include <iostream>
+
+using namespace std;
+
+/** Counter-based random number generator, Philox4x32-10 (Salmon et al., SC11).
+    Each block of four 32-bit numbers is a keyed hash of a 128-bit counter,
+    so generators with the same seed (the key) but different streams (the
+    upper half of the counter) give independent sequences without any
+    setup. A thread, domain or replica that needs its own sequence gets a
+    stream of a common seed, and the sequence does not depend on which
+    thread draws it. Meets the requirements of a uniform random bit
+    generator, so it works with the <random> distributions. */
+class RandomGenerator {
+ private:
+  uint32_t key[2];
+  /** Words 0 and 1 count the blocks, words 2 and 3 hold the stream. */
+  uint32_t counter[4];
+  /** The current block and the number of its words already handed out. */
+  uint32_t block[4];
+  int used;
+
+  /** Compute the block of the counter and advance the counter. */
+  void NextBlock();
+
+ public:
+  typedef uint32_t result_type;
+
+  /** Constructor. The arguments are the seed and the stream. */
+  RandomGenerator(uint64_t = 5489, uint64_t = 0);
+  /** Restart the generator at the beginning of a stream of a seed. */
+  void seed(uint64_t, uint64_t = 0);
+  static result_type min() { return 0; }
+  static result_type max() { return 0xFFFFFFFF; }
+  result_type operator()();
+
+  /** A uniform number in the open interval (0, 1), never 0 or 1. */
+  double Uniform();
+  /** A normal deviate with mean 0 and standard deviation 1. */
+  double Normal();
+  /** Fill an array with the given number of uniform numbers in (0, 1). */
+  void Uniform(double[], int);
+  /** Same for normal deviates. */
+  void Normal(double[], int);
+  /** Fill an array with the given number of random unit vectors, x y z one
+      after the other. */
+  void UnitSphere(double[], int);
+
+  /** Write and read the complete state, as text. */
+  friend ostream& operator<<(ostream&, const RandomGenerator&);
+  friend istream& operator>>(istream&, RandomGenerator&);
+
+};
+
+#endif
+
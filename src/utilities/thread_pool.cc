@@ -0,0 +1,94 @@
+#include "thread_pool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool() {
+  n_tasks = 0;
+  next_task = 0;
+  busy = 0;
+  generation = 0;
+  stop = false;
+
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    unique_lock<mutex> guard(lock);
+    stop = true;
+  }
+  start.notify_all();
+  for (int i = 0; i < (int)workers.size(); i++) {
+    workers[i].join();
+  }
+
+}
+
+void ThreadPool::Start(int n_threads) {
+  for (int i = 1; i < n_threads; i++) {
+    workers.push_back(thread(&ThreadPool::WorkerLoop, this, i));
+  }
+
+}
+
+int ThreadPool::Size() {
+  return (int)workers.size() + 1;
+
+}
+
+void ThreadPool::Run(int n, function<void(int, int)> body) {
+  if (workers.empty() || n <= 1) {
+    for (int i = 0; i < n; i++) {
+      body(i, 0);
+    }
+    return;
+  }
+
+  {
+    unique_lock<mutex> guard(lock);
+    task = body;
+    n_tasks = n;
+    next_task = 0;
+    busy = (int)workers.size();
+    generation++;
+  }
+  start.notify_all();
+  Drain(0);
+
+  unique_lock<mutex> guard(lock);
+  done.wait(guard, [this] { return busy == 0; });
+  task = nullptr;
+
+}
+
+void ThreadPool::WorkerLoop(int id) {
+  long seen = 0;
+  while (true) {
+    {
+      unique_lock<mutex> guard(lock);
+      start.wait(guard, [&] { return stop || generation != seen; });
+      if (stop)  return;
+      seen = generation;
+    }
+    Drain(id);
+    {
+      unique_lock<mutex> guard(lock);
+      busy--;
+    }
+    done.notify_one();
+  }
+
+}
+
+void ThreadPool::Drain(int id) {
+  while (true) {
+    int i;
+    {
+      unique_lock<mutex> guard(lock);
+      if (next_task >= n_tasks)  return;
+      i = next_task++;
+    }
+    task(i, id);
+  }
+
+}
+
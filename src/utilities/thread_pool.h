@@ -0,0 +1,56 @@
+#ifndef SRC_UTILITIES_THREAD_POOL_H_
+#define SRC_UTILITIES_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/** A fixed set of worker threads that run the iterations of a loop in
+    parallel. The calling thread takes part as thread 0, so a pool of size 1
+    starts no threads and runs everything inline. Iterations are handed out
+    one at a time, so each should write its results to its own slot; which
+    thread runs which iteration is not deterministic. */
+class ThreadPool {
+ private:
+  /** The worker threads, numbered 1 to Size()-1. */
+  vector<thread> workers;
+  mutex lock;
+  /** Signals the workers that a new loop is posted or that the pool is
+      shutting down. */
+  condition_variable start;
+  /** Signals the caller that all workers have left the current loop. */
+  condition_variable done;
+  /** The body of the current loop, called with the iteration and the thread
+      number. */
+  function<void(int, int)> task;
+  /** Number of iterations of the current loop. */
+  int n_tasks;
+  /** The next iteration to hand out. */
+  int next_task;
+  /** Number of workers still inside the current loop. */
+  int busy;
+  /** Incremented for every loop, so that workers see each loop once. */
+  long generation;
+  bool stop;
+
+  void WorkerLoop(int);
+  /** Run iterations of the current loop until none are left. */
+  void Drain(int);
+
+ public:
+  ThreadPool();
+  ~ThreadPool();
+  /** Start the pool with the given total number of threads. */
+  void Start(int);
+  int Size();
+  /** Call task(i, thread) for i = 0 ... n-1 and return when all are done. */
+  void Run(int, function<void(int, int)>);
+
+};
+
+#endif
+
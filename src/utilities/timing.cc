@@ -0,0 +1,63 @@
+#include "timing.h"
+
+#include <iomanip>
+
+using namespace std;
+
+const char * kTimeSectionNames[kNoTimeSection] = {
+  "bead", "com", "pivot", "crankshaft", "reptation", "insert", "delete",
+  "checkerboard", "pair", "ewald", "bond", "ext", "sample", "output"
+};
+
+Timing::Timing() {
+  Enable(false);
+
+}
+
+void Timing::Enable(bool on) {
+  enabled = on;
+  for (int i = 0; i < kNoTimeSection; i++) {
+    seconds[i] = 0;
+    calls[i] = 0;
+  }
+  begin = Clock::now();
+
+}
+
+long Timing::Calls(int section) const {
+  return calls[section];
+
+}
+
+double Timing::MicrosecondsPerCall(int section) const {
+  if (calls[section] == 0)  return 0;
+  return 1e6 * seconds[section] / calls[section];
+
+}
+
+string Timing::Name(int section) {
+  return kTimeSectionNames[section];
+
+}
+
+// The potentials are indented below the moves, which include them.
+void Timing::PrintSummary(ostream& out) const {
+  double total = chrono::duration<double>(Clock::now() - begin).count();
+  streamsize precision = out.precision();
+  out << "\n  Hot path timing (wall time " << total << " s):" << endl;
+  out << "    " << setw(16) << left << "Section" << right << setw(12)
+      << "Calls" << setw(14) << "Total (s)" << setw(16) << "Per call (us)"
+      << setw(11) << "Share (%)" << endl;
+  for (int i = 0; i < kNoTimeSection; i++) {
+    if (calls[i] == 0)  continue;
+    string name = Name(i);
+    if (i >= kTimePair && i <= kTimeExt)  name = "  " + name;
+    out << "    " << setw(16) << left << name << right << setw(12) << calls[i]
+        << setw(14) << setprecision(4) << seconds[i] << setw(16)
+        << setprecision(4) << MicrosecondsPerCall(i) << setw(11)
+        << setprecision(3) << 100*seconds[i]/total << endl;
+  }
+  out.precision(precision);
+
+}
+
@@ -0,0 +1,75 @@
+#ifndef SRC_UTILITIES_TIMING_H_
+#define SRC_UTILITIES_TIMING_H_
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// The timed sections of the hot path. The first kNoMoveType are the move
+// types of Simulation, in the same order. The potentials are timed inside
+// ForceField::EnergyDifference and so are part of the move that called it.
+const int kTimeBead = 0;
+const int kTimeCOM = 1;
+const int kTimePivot = 2;
+const int kTimeCrankshaft = 3;
+const int kTimeReptation = 4;
+const int kTimeInsert = 5;
+const int kTimeDelete = 6;
+const int kTimeCheckerboard = 7;
+const int kTimePair = 8;
+const int kTimeEwald = 9;
+const int kTimeBond = 10;
+const int kTimeExt = 11;
+const int kTimeSample = 12;
+const int kTimeOutput = 13;
+const int kNoTimeSection = 14;
+
+/** Accumulates the wall time and the number of calls of every section of the
+    hot path. A section is timed by taking Start() before it and passing the
+    result to Stop() after it. While the timing is off both only test a flag,
+    so the calls can stay in the hot path. One object must only be used by one
+    thread. */
+class Timing {
+ public:
+  typedef chrono::steady_clock Clock;
+
+ private:
+  bool enabled;
+  /** Wall time, in seconds, and number of calls of every section. */
+  double seconds[kNoTimeSection];
+  long calls[kNoTimeSection];
+  /** When the timing was switched on. */
+  Clock::time_point begin;
+
+ public:
+  Timing();
+  /** Switch the timing on or off. Switching it on resets the sums. */
+  void Enable(bool);
+  bool Enabled() const { return enabled; }
+
+  Clock::time_point Start() const {
+    return enabled ? Clock::now() : Clock::time_point();
+  }
+  void Stop(int section, Clock::time_point start) {
+    if (!enabled)  return;
+    seconds[section] += chrono::duration<double>(Clock::now() - start).count();
+    calls[section]++;
+  }
+
+  /** Number of calls of a section and their average time in microseconds, 0
+      before the first call. */
+  long Calls(int) const;
+  double MicrosecondsPerCall(int) const;
+  /** Short name of a section, used in the summary and in the column header of
+      the statistics output. */
+  static string Name(int);
+  /** Print the table of all sections that were called, with their share of
+      the wall time since the timing was switched on. */
+  void PrintSummary(ostream&) const;
+
+};
+
+#endif
+
@@ -0,0 +1,425 @@
+#include "trajectory.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "constants.h"
+
+using namespace std;
+
+namespace {
+
+const char kTrajMagic[8] = {'P', 'L', 'U', 'M', 'T', 'R', 'J', '\0'};
+const char kIndexMagic[8] = {'P', 'L', 'U', 'M', 'I', 'D', 'X', '\0'};
+const int kTrajVersion = 1;
+/** Size of the fixed part of a frame: its size, step, bead and coordinate
+    byte counts. */
+const long kFrameHead = 24;
+
+/** Round up to a multiple of 8. */
+inline long Align8(long n) {
+  return (n + 7) & ~7L;
+
+}
+
+template <class T>
+inline void Append(vector<char>& buf, const T& value) {
+  const char* p = reinterpret_cast<const char*>(&value);
+  buf.insert(buf.end(), p, p + sizeof(T));
+
+}
+
+template <class T>
+inline T Load(const char* p) {
+  T value;
+  memcpy(&value, p, sizeof(T));
+  return value;
+
+}
+
+/** Zigzag and base 128 varint coding of a signed difference. */
+inline void AppendVarint(vector<char>& buf, int64_t value) {
+  uint64_t u = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+  while (u >= 0x80) {
+    buf.push_back((char)(u | 0x80));
+    u >>= 7;
+  }
+  buf.push_back((char)u);
+
+}
+
+inline int64_t ReadVarint(const unsigned char*& p) {
+  uint64_t u = 0;
+  int shift = 0;
+  while (*p & 0x80) {
+    u |= (uint64_t)(*p & 0x7f) << shift;
+    shift += 7;
+    p++;
+  }
+  u |= (uint64_t)*p << shift;
+  p++;
+  return (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+
+}
+
+}
+
+////// TrajectoryWriter //////
+
+TrajectoryWriter::TrajectoryWriter() {
+  mode = kTrajFloat;
+  precision = 0;
+  position = 0;
+
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+  Close();
+
+}
+
+void TrajectoryWriter::Open(string name, double box[3],
+                            const vector<string>& symbols, int mode,
+                            double precision, long end) {
+  if (mode == kTrajFixed && !(precision > 0)) {
+    cout << "  Error: The precision of a fixed point trajectory must be"
+         << endl
+         << "         positive!" << endl;
+    exit(1);
+  }
+  this->mode = mode;
+  this->precision = precision;
+  offsets.clear();
+  steps.clear();
+  out_buf.resize(kOutputBufferSize);
+
+  if (end >= 0) {
+    TrajectoryReader old;
+    if (old.Open(name)) {
+      if (old.Symbols() != symbols) {
+        cout << "  Error: The bead types of " << name << endl
+             << "         do not match the current ones!" << endl;
+        exit(1);
+      }
+      // Continue with the encoding of the file.
+      this->mode = old.Mode();
+      this->precision = old.Precision();
+      offsets = old.Offsets();
+      steps = old.Steps();
+      position = old.DataEnd();
+      old.Close();
+      while (!offsets.empty() && position > end) {
+        position = offsets.back();
+        offsets.pop_back();
+        steps.pop_back();
+      }
+      // Drop the index, the frames after the end, and a partly written frame
+      // if there is one.
+      if (truncate(name.c_str(), position) != 0) {
+        cout << "  Error: Cannot truncate " << name << "!" << endl;
+        exit(1);
+      }
+      out.rdbuf()->pubsetbuf(&out_buf[0], out_buf.size());
+      out.open(name.c_str(), ios::binary | ios::app);
+      if (!out) {
+        cout << "  Error: Cannot open " << name << "!" << endl;
+        exit(1);
+      }
+      return;
+    }
+  }
+
+  out.rdbuf()->pubsetbuf(&out_buf[0], out_buf.size());
+  out.open(name.c_str(), ios::binary | ios::trunc);
+  if (!out) {
+    cout << "  Error: Cannot open " << name << "!" << endl;
+    exit(1);
+  }
+  vector<char> head(kTrajMagic, kTrajMagic + 8);
+  Append(head, (int32_t)kTrajVersion);
+  Append(head, (int32_t)this->mode);
+  Append(head, this->precision);
+  for (int i = 0; i < 3; i++)
+    Append(head, box[i]);
+  Append(head, (int32_t)symbols.size());
+  for (size_t i = 0; i < symbols.size(); i++) {
+    Append(head, (int32_t)symbols[i].size());
+    head.insert(head.end(), symbols[i].begin(), symbols[i].end());
+  }
+  head.resize(Align8(head.size()), 0);
+  out.write(&head[0], head.size());
+  position = head.size();
+
+}
+
+bool TrajectoryWriter::IsOpen() {
+  return out.is_open();
+
+}
+
+long TrajectoryWriter::Position() {
+  return position;
+
+}
+
+void TrajectoryWriter::WriteFrame(long step, int n, const int* types,
+                                  const double* crd) {
+  frame.clear();
+  frame.resize(kFrameHead, 0);
+  if (mode == kTrajFloat) {
+    for (int i = 0; i < 3*n; i++)
+      Append(frame, (float)crd[i]);
+  }
+  else {
+    int64_t last[3] = {0, 0, 0};
+    for (int i = 0; i < n; i++) {
+      for (int j = 0; j < 3; j++) {
+        int64_t q = llround(crd[3*i+j] / precision);
+        AppendVarint(frame, q - last[j]);
+        last[j] = q;
+      }
+    }
+  }
+  int32_t coord_bytes = (int32_t)(frame.size() - kFrameHead);
+  frame.resize(Align8(frame.size()), 0);
+  for (int i = 0; i < n; i++)
+    Append(frame, (uint16_t)types[i]);
+  frame.resize(Align8(frame.size()), 0);
+
+  int64_t rest = frame.size() - 8;
+  int64_t step64 = step;
+  int32_t n32 = n;
+  memcpy(&frame[0], &rest, 8);
+  memcpy(&frame[8], &step64, 8);
+  memcpy(&frame[16], &n32, 4);
+  memcpy(&frame[20], &coord_bytes, 4);
+  out.write(&frame[0], frame.size());
+  offsets.push_back(position);
+  steps.push_back(step);
+  position += frame.size();
+
+}
+
+void TrajectoryWriter::Flush() {
+  out.flush();
+
+}
+
+void TrajectoryWriter::Close() {
+  if (!out.is_open())  return;
+  vector<char> index;
+  for (size_t i = 0; i < offsets.size(); i++)
+    Append(index, (int64_t)offsets[i]);
+  for (size_t i = 0; i < steps.size(); i++)
+    Append(index, (int64_t)steps[i]);
+  Append(index, (int64_t)offsets.size());
+  index.insert(index.end(), kIndexMagic, kIndexMagic + 8);
+  out.write(&index[0], index.size());
+  out.close();
+
+}
+
+////// TrajectoryReader //////
+
+TrajectoryReader::TrajectoryReader() {
+  data = NULL;
+  size = 0;
+  mode = kTrajFloat;
+  precision = 0;
+  box[0] = box[1] = box[2] = 0;
+  data_end = 0;
+
+}
+
+TrajectoryReader::~TrajectoryReader() {
+  Close();
+
+}
+
+bool TrajectoryReader::Open(string name) {
+  Close();
+  int fd = open(name.c_str(), O_RDONLY);
+  if (fd < 0)  return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < 52) {
+    close(fd);
+    return false;
+  }
+  size = st.st_size;
+  void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping stays valid after the descriptor is closed.
+  close(fd);
+  if (map == MAP_FAILED) {
+    size = 0;
+    return false;
+  }
+  data = (const char*)map;
+  if (memcmp(data, kTrajMagic, 8) != 0 ||
+      Load<int32_t>(data + 8) != kTrajVersion) {
+    Close();
+    return false;
+  }
+
+  mode = Load<int32_t>(data + 12);
+  precision = Load<double>(data + 16);
+  for (int i = 0; i < 3; i++)
+    box[i] = Load<double>(data + 24 + 8*i);
+  long p = 48;
+  int n_types = Load<int32_t>(data + p);
+  p += 4;
+  symbols.clear();
+  for (int i = 0; i < n_types; i++) {
+    if (p + 4 > size)  break;
+    int len = Load<int32_t>(data + p);
+    p += 4;
+    if (len < 0 || p + len > size)  break;
+    symbols.push_back(string(data + p, len));
+    p += len;
+  }
+  if ((int)symbols.size() != n_types) {
+    Close();
+    return false;
+  }
+  ReadIndex(Align8(p));
+  return true;
+
+}
+
+void TrajectoryReader::ReadIndex(long header_end) {
+  offsets.clear();
+  steps.clear();
+
+  // The index written by TrajectoryWriter::Close.
+  if (size >= header_end + 16 &&
+      memcmp(data + size - 8, kIndexMagic, 8) == 0) {
+    long n = Load<int64_t>(data + size - 16);
+    long begin = size - 16 - 16*n;
+    if (n >= 0 && begin >= header_end) {
+      offsets.resize(n);
+      steps.resize(n);
+      for (long i = 0; i < n; i++) {
+        offsets[i] = Load<int64_t>(data + begin + 8*i);
+        steps[i] = Load<int64_t>(data + begin + 8*(n + i));
+      }
+      data_end = begin;
+      return;
+    }
+  }
+
+  // No index, scan the complete frames.
+  long p = header_end;
+  while (p + kFrameHead <= size) {
+    long rest = Load<int64_t>(data + p);
+    if (rest < kFrameHead - 8 || p + 8 + rest > size)  break;
+    offsets.push_back(p);
+    steps.push_back(Load<int64_t>(data + p + 8));
+    p += 8 + rest;
+  }
+  data_end = p;
+
+}
+
+void TrajectoryReader::Close() {
+  if (data != NULL)  munmap((void*)data, size);
+  data = NULL;
+  size = 0;
+  symbols.clear();
+  offsets.clear();
+  steps.clear();
+  data_end = 0;
+
+}
+
+int TrajectoryReader::Mode() {
+  return mode;
+
+}
+
+double TrajectoryReader::Precision() {
+  return precision;
+
+}
+
+const double* TrajectoryReader::Box() {
+  return box;
+
+}
+
+const vector<string>& TrajectoryReader::Symbols() {
+  return symbols;
+
+}
+
+int TrajectoryReader::NumFrames() {
+  return (int)offsets.size();
+
+}
+
+long TrajectoryReader::Step(int frame) {
+  return steps[frame];
+
+}
+
+int TrajectoryReader::NumBeads(int frame) {
+  return Load<int32_t>(data + offsets[frame] + 16);
+
+}
+
+const unsigned short* TrajectoryReader::Types(int frame) {
+  const char* p = data + offsets[frame];
+  long coord_bytes = Load<int32_t>(p + 20);
+  return (const unsigned short*)(p + Align8(kFrameHead + coord_bytes));
+
+}
+
+const float* TrajectoryReader::Coordinates(int frame) {
+  if (mode != kTrajFloat)  return NULL;
+  return (const float*)(data + offsets[frame] + kFrameHead);
+
+}
+
+void TrajectoryReader::ReadCoordinates(int frame, vector<double>& crd) {
+  int n = NumBeads(frame);
+  crd.resize(3*n);
+  if (mode == kTrajFloat) {
+    const float* xyz = Coordinates(frame);
+    for (int i = 0; i < 3*n; i++)
+      crd[i] = xyz[i];
+  }
+  else {
+    const unsigned char* p =
+      (const unsigned char*)(data + offsets[frame] + kFrameHead);
+    int64_t last[3] = {0, 0, 0};
+    for (int i = 0; i < n; i++) {
+      for (int j = 0; j < 3; j++) {
+        last[j] += ReadVarint(p);
+        crd[3*i+j] = last[j] * precision;
+      }
+    }
+  }
+
+}
+
+const vector<long>& TrajectoryReader::Offsets() {
+  return offsets;
+
+}
+
+const vector<long>& TrajectoryReader::Steps() {
+  return steps;
+
+}
+
+long TrajectoryReader::DataEnd() {
+  return data_end;
+
+}
+
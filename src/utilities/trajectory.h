@@ -0,0 +1,122 @@
+/** Binary trajectory files, a compact alternative to the .xyz trajectories.
+
+    A file starts with a header holding the box, the coordinate encoding and
+    the table of bead type symbols. Every frame holds its step, its number of
+    beads, their coordinates and their indices into the type table, so the
+    number and the kind of beads may change from frame to frame. Coordinates
+    are either stored as float32, or quantized to a fixed precision and
+    written as variable length differences between consecutive beads, which
+    is small for the beads of a chain (similar in spirit to XTC).
+
+    On Close, an index of the frame offsets and steps is appended to the file
+    for random access. The frames are all 8 byte aligned and carry their size,
+    so a file that was never closed, e.g. of a killed run, is indexed by
+    scanning it instead. Values are stored in the native byte order. */
+
+#ifndef SRC_UTILITIES_TRAJECTORY_H_
+#define SRC_UTILITIES_TRAJECTORY_H_
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/** Coordinate encodings. */
+const int kTrajFloat = 0;
+const int kTrajFixed = 1;
+
+/** Appends frames to a binary trajectory file. */
+class TrajectoryWriter {
+ private:
+  ofstream out;
+  vector<char> out_buf;
+  /** The coordinate encoding and, for kTrajFixed, the precision. */
+  int mode;
+  double precision;
+  /** Offset and step of every frame, for the index. */
+  vector<long> offsets;
+  vector<long> steps;
+  /** The current size of the file. */
+  long position;
+  /** The frame being encoded. */
+  vector<char> frame;
+
+ public:
+  TrajectoryWriter();
+  /** Closes the file if it is open. */
+  ~TrajectoryWriter();
+  /** Open a file with the box dimensions, the bead type symbols, the encoding
+      and its precision. If the last argument is not negative and the file
+      exists, the frames that do not end by that offset are dropped and new
+      frames are added after the others; the existing header is kept and must
+      have the same symbols. Otherwise a new file is started. */
+  void Open(string, double[3], const vector<string>&, int, double, long);
+  bool IsOpen();
+  /** The end of the last frame written, i.e. the size of the file without
+      the index. */
+  long Position();
+  /** Add a frame: the step, the number of beads, their type indices and their
+      x, y, z coordinates. */
+  void WriteFrame(long, int, const int*, const double*);
+  void Flush();
+  /** Write the index and close the file. */
+  void Close();
+
+};
+
+/** Reads a binary trajectory file through a read-only memory mapping, so
+    frames can be visited in any order without reading the whole file. */
+class TrajectoryReader {
+ private:
+  /** The mapped file. */
+  const char* data;
+  long size;
+  int mode;
+  double precision;
+  double box[3];
+  vector<string> symbols;
+  /** Offset and step of every frame. */
+  vector<long> offsets;
+  vector<long> steps;
+  /** The end of the last complete frame. */
+  long data_end;
+
+  /** Fill in the index from the end of the file, or else by scanning the
+      frames. */
+  void ReadIndex(long);
+
+ public:
+  TrajectoryReader();
+  ~TrajectoryReader();
+  /** Map a file and read its header and index. Returns false if the file
+      cannot be opened or is not a trajectory. */
+  bool Open(string);
+  void Close();
+
+  int Mode();
+  double Precision();
+  /** The x, y, z box dimensions. */
+  const double* Box();
+  /** The bead type symbols that the type indices refer to. */
+  const vector<string>& Symbols();
+  int NumFrames();
+  long Step(int);
+  int NumBeads(int);
+  /** The type indices of the beads of a frame, pointing into the mapping. */
+  const unsigned short* Types(int);
+  /** The x, y, z coordinates of a frame, pointing into the mapping. Only for
+      kTrajFloat files, returns NULL otherwise. */
+  const float* Coordinates(int);
+  /** Decode the x, y, z coordinates of a frame of either encoding. */
+  void ReadCoordinates(int, vector<double>&);
+  /** The offset of every frame and the end of the last complete one, for
+      TrajectoryWriter to continue the file. */
+  const vector<long>& Offsets();
+  const vector<long>& Steps();
+  long DataEnd();
+
+};
+
+#endif
+